@@ -0,0 +1,90 @@
+"""
+Test of match_batch of FastMapMatch with NumPy arrays, run in this folder
+after the python extension is built and installed.
+"""
+import threading
+import numpy as np
+from fmm import Network, NetworkGraph, FastMapMatch, FastMapMatchConfig, UBODT
+
+network = Network("../data/edges.shp")
+graph = NetworkGraph(network)
+ubodt = UBODT.read_ubodt_csv("../data/ubodt.txt")
+model = FastMapMatch(network, graph, ubodt)
+config = FastMapMatchConfig(4, 0.4, 0.5)
+
+# Read the trajectories into flat arrays
+wkts = []
+with open("../data/trips.csv") as f:
+    next(f)
+    for line in f:
+        wkts.append(line.strip().split(";")[1])
+xs, ys, offsets = [], [], [0]
+for wkt in wkts:
+    for point in wkt[len("LINESTRING("):-1].split(","):
+        x, y = point.split()
+        xs.append(float(x))
+        ys.append(float(y))
+    offsets.append(len(xs))
+xs = np.array(xs)
+ys = np.array(ys)
+offsets = np.array(offsets, dtype=np.int64)
+
+
+def check_batch(result):
+    """Check a batch against the results of match_wkt"""
+    arrays = result.to_numpy()
+    assert len(arrays["cpath_offsets"]) == len(wkts) + 1
+    for i, wkt in enumerate(wkts):
+        expected = model.match_wkt(wkt, config)
+        begin, end = arrays["cpath_offsets"][i], arrays["cpath_offsets"][i + 1]
+        assert list(arrays["cpath"][begin:end]) == list(expected.cpath)
+        begin, end = offsets[i], offsets[i + 1]
+        assert list(arrays["opath"][begin:end]) == list(expected.opath)
+
+
+# Float64 arrays are copied at once
+result = model.match_batch(xs, ys, np.empty(0), offsets, config, 2)
+check_batch(result)
+# Lists, int32 offsets and strided arrays are converted item by item
+check_batch(model.match_batch(list(xs), list(ys), [], list(offsets),
+                              config, 2))
+check_batch(model.match_batch(xs, ys, np.empty(0), offsets.astype(np.int32),
+                              config, 2))
+points = np.stack([xs, ys], axis=1)
+check_batch(model.match_batch(points[:, 0], points[:, 1], np.empty(0),
+                              offsets, config, 2))
+
+# Arrays of different sizes raise an error
+try:
+    model.match_batch(xs, ys[:-1], np.empty(0), offsets, config, 2)
+    assert False
+except RuntimeError:
+    pass
+
+# Other threads run while a batch is matched
+repeat = 2000
+big_offsets = np.concatenate(
+    [[0]] + [offsets[1:] + i * offsets[-1] for i in range(repeat)])
+ticks = [0]
+stop = threading.Event()
+
+
+def tick():
+    while not stop.is_set():
+        ticks[0] += 1
+
+
+thread = threading.Thread(target=tick)
+thread.start()
+ticks_before = ticks[0]
+big_result = model.match_batch(np.tile(xs, repeat), np.tile(ys, repeat),
+                               np.empty(0), big_offsets, config, 2)
+ticks_after = ticks[0]
+stop.set()
+thread.join()
+assert ticks_after > ticks_before
+arrays = result.to_numpy()
+big_arrays = big_result.to_numpy()
+for name in ["opath", "cpath"]:
+    assert np.array_equal(big_arrays[name], np.tile(arrays[name], repeat))
+print("match_batch test passed")
@@ -44,18 +44,169 @@
 #include "mm/h3mm/h3_util.hpp"
 #include "mm/h3mm/h3mm.hpp"
 #include "mm/fmm/ubodt.hpp"
+#include <cstring>
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 using namespace FMM::MM;
 using namespace FMM::CONFIG;
+
+/* Check the format of a buffer item, which can start with a byte order
+   character if the order is the native one */
+static bool fmm_buffer_native_format(const char *format, const char *codes) {
+  if (format == NULL) return false;
+  const int one = 1;
+  bool little = *reinterpret_cast<const char *>(&one) == 1;
+  if (*format == '@' || *format == '=' ||
+      (*format == '<' && little) || (*format == '>' && !little)) {
+    ++format;
+  }
+  return format[0] != '\0' && format[1] == '\0' &&
+    std::strchr(codes, format[0]) != NULL;
+}
+
+static bool fmm_sequence_item(PyObject *item, double *value) {
+  *value = PyFloat_AsDouble(item);
+  return !PyErr_Occurred();
+}
+
+static bool fmm_sequence_item(PyObject *item, long long *value) {
+  *value = PyLong_AsLongLong(item);
+  return !PyErr_Occurred();
+}
+
+/* Copy an object into a vector. A contiguous buffer such as a NumPy
+   array with items of the type of the vector is copied at once, other
+   buffers and sequences are converted item by item. */
+template <typename T>
+static bool fmm_object_to_vector(PyObject *obj, const char *codes,
+                                 std::vector<T> *vec) {
+  if (PyObject_CheckBuffer(obj)) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(obj, &view,
+                           PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) == 0) {
+      bool valid = view.itemsize == sizeof(T) &&
+        fmm_buffer_native_format(view.format, codes);
+      if (valid) {
+        vec->resize(view.len / sizeof(T));
+        if (view.len > 0) std::memcpy(vec->data(), view.buf, view.len);
+      }
+      PyBuffer_Release(&view);
+      if (valid) return true;
+    } else {
+      PyErr_Clear();
+    }
+  }
+  PyObject *seq = PySequence_Fast(obj, "expected a buffer or a sequence");
+  if (seq == NULL) return false;
+  Py_ssize_t size = PySequence_Fast_GET_SIZE(seq);
+  PyObject **items = PySequence_Fast_ITEMS(seq);
+  vec->resize(size);
+  for (Py_ssize_t i = 0; i < size; ++i) {
+    if (!fmm_sequence_item(items[i], &(*vec)[i])) {
+      Py_DECREF(seq);
+      return false;
+    }
+  }
+  Py_DECREF(seq);
+  return true;
+}
+
+/* Copy a vector into bytes, which can be read by numpy.frombuffer */
+template <typename T>
+static PyObject *fmm_vector_to_bytes(const std::vector<T> &vec) {
+  return PyBytes_FromStringAndSize(
+    reinterpret_cast<const char *>(vec.data()), vec.size() * sizeof(T));
+}
 %}
 
+// Arrays of the bulk matching API, accepting NumPy arrays and any object
+// supporting the buffer protocol as well as lists
+%typemap(in) const std::vector<double> &BUFFER (std::vector<double> temp) {
+  if (!fmm_object_to_vector($input, "d", &temp)) SWIG_fail;
+  $1 = &temp;
+}
+%typemap(in) const std::vector<long long> &BUFFER
+    (std::vector<long long> temp) {
+  if (!fmm_object_to_vector($input, "qlQL", &temp)) SWIG_fail;
+  $1 = &temp;
+}
+%typemap(typecheck, precedence=SWIG_TYPECHECK_DOUBLE_ARRAY)
+    const std::vector<double> &BUFFER,
+    const std::vector<long long> &BUFFER {
+  $1 = PyObject_CheckBuffer($input) || PySequence_Check($input);
+}
+%apply const std::vector<double> &BUFFER {
+  const std::vector<double> &xs,
+  const std::vector<double> &ys,
+  const std::vector<double> &timestamps };
+%apply const std::vector<long long> &BUFFER {
+  const std::vector<long long> &offsets };
+
+// The GIL is released while a batch is matched, so that other Python
+// threads run in the meantime
+%define FMM_RELEASE_GIL(function)
+%exception function {
+    PyThreadState *_save = PyEval_SaveThread();
+    try {
+        $action
+    } catch (std::exception& e) {
+        PyEval_RestoreThread(_save);
+        SWIG_exception(SWIG_RuntimeError, const_cast<char*>(e.what()));
+    } catch (...) {
+        PyEval_RestoreThread(_save);
+        SWIG_exception(SWIG_RuntimeError, "Unknown error");
+    }
+    PyEval_RestoreThread(_save);
+}
+%enddef
+FMM_RELEASE_GIL(FMM::MM::FastMapMatch::match_batch)
+FMM_RELEASE_GIL(FMM::MM::STMATCH::match_batch)
+
+%extend FMM::PYTHON::PyBatchResult {
+  // Get a member as bytes, see to_numpy
+  PyObject *get_bytes(const std::string &name) {
+    if (name == "opath") return fmm_vector_to_bytes($self->opath);
+    if (name == "indices") return fmm_vector_to_bytes($self->indices);
+    if (name == "error") return fmm_vector_to_bytes($self->error);
+    if (name == "offset") return fmm_vector_to_bytes($self->offset);
+    if (name == "ep") return fmm_vector_to_bytes($self->ep);
+    if (name == "tp") return fmm_vector_to_bytes($self->tp);
+    if (name == "spdist") return fmm_vector_to_bytes($self->spdist);
+    if (name == "px") return fmm_vector_to_bytes($self->px);
+    if (name == "py") return fmm_vector_to_bytes($self->py);
+    if (name == "cpath_offsets")
+      return fmm_vector_to_bytes($self->cpath_offsets);
+    if (name == "cpath") return fmm_vector_to_bytes($self->cpath);
+    if (name == "mgeom_offsets")
+      return fmm_vector_to_bytes($self->mgeom_offsets);
+    if (name == "mgeom_x") return fmm_vector_to_bytes($self->mgeom_x);
+    if (name == "mgeom_y") return fmm_vector_to_bytes($self->mgeom_y);
+    PyErr_SetString(PyExc_KeyError, name.c_str());
+    return NULL;
+  }
+  %pythoncode %{
+    def to_numpy(self):
+        """Get the members as a dict of NumPy arrays"""
+        import numpy as np
+        dtypes = {"opath": np.int64, "indices": np.intc,
+                  "cpath_offsets": np.int64, "cpath": np.int64,
+                  "mgeom_offsets": np.int64}
+        names = ["opath", "indices", "error", "offset", "ep", "tp",
+                 "spdist", "px", "py", "cpath_offsets", "cpath",
+                 "mgeom_offsets", "mgeom_x", "mgeom_y"]
+        return {name: np.frombuffer(self.get_bytes(name),
+                                    dtype=dtypes.get(name, np.float64))
+                for name in names}
+  %}
+}
+
 %template(IntVector) std::vector<int>;
 %template(IDVector) std::vector<long long>;
 %template(HexVector) std::vector<unsigned long long>;
 %template(UnsignedIntVector) std::vector<unsigned int>;
 %template(DoubleVector) std::vector<double>;
+%template(StringVector) std::vector<std::string>;
 %template(PyCandidateVector) std::vector<FMM::PYTHON::PyCandidate>;
 // %template(DoubleVVector) vector<vector<double> >;
 // %template(DoubleVVVector) vector<vector<vector<double> > >;
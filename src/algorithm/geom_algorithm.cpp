@@ -22,6 +22,46 @@ std::vector<double> FMM::ALGORITHM::cal_eu_dist(
   return lengths;
 }
 
+std::vector<double> FMM::ALGORITHM::calc_headings(
+    const FMM::CORE::LineString &trajectory, double min_distance) {
+  int N = trajectory.get_num_points();
+  std::vector<double> headings(N, NAN);
+  if (N < 2) return headings;
+  for (int i = 0; i < N; ++i) {
+    int prev = (i > 0) ? i - 1 : i;
+    int next = (i < N - 1) ? i + 1 : i;
+    double dx = trajectory.get_x(next) - trajectory.get_x(prev);
+    double dy = trajectory.get_y(next) - trajectory.get_y(prev);
+    if (dx == 0 && dy == 0) continue;
+    if (sqrt(dx * dx + dy * dy) < min_distance) continue;
+    headings[i] = atan2(dy, dx);
+  }
+  return headings;
+}
+
+double FMM::ALGORITHM::calc_heading_at_offset(
+    const FMM::CORE::LineString &linestring, double offset) {
+  int Npoints = linestring.get_num_points();
+  double L_processed = 0;
+  double heading = NAN;
+  for (int i = 0; i < Npoints - 1; ++i) {
+    double dx = linestring.get_x(i + 1) - linestring.get_x(i);
+    double dy = linestring.get_y(i + 1) - linestring.get_y(i);
+    double deltaL = sqrt(dx * dx + dy * dy);
+    if (deltaL == 0) continue;
+    // The last segment is returned if offset exceeds the length
+    heading = atan2(dy, dx);
+    L_processed += deltaL;
+    if (offset <= L_processed) break;
+  }
+  return heading;
+}
+
+double FMM::ALGORITHM::heading_difference(double a, double b) {
+  double diff = fmod(fabs(a - b), 2 * M_PI);
+  return diff > M_PI ? 2 * M_PI - diff : diff;
+}
+
 void FMM::ALGORITHM::append_segs_to_line(
     FMM::CORE::LineString *line, const FMM::CORE::LineString &segs,
     int offset) {
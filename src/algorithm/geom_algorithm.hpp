@@ -27,6 +27,37 @@ namespace ALGORITHM {
  */
 std::vector<double> cal_eu_dist(const FMM::CORE::LineString &trajectory);
 
+/**
+ * Estimate the travel heading at each point of a trajectory from the
+ * displacement between its previous and next point (the point itself is
+ * used at the two ends).
+ * @param trajectory a trajectory as input
+ * @param min_distance minimum displacement for a heading to be estimated,
+ * the heading of a point whose displacement is shorter is NaN
+ * @return A vector of headings in radians (counterclockwise from the
+ * x axis) with size of N.
+ */
+std::vector<double> calc_headings(const FMM::CORE::LineString &trajectory,
+                                  double min_distance);
+
+/**
+ * Calculate the heading of a linestring at an offset
+ * @param linestring input line
+ * @param offset the distance from the start point of linestring
+ * @return heading in radians of the segment containing offset,
+ * NaN if the linestring is degenerate
+ */
+double calc_heading_at_offset(const FMM::CORE::LineString &linestring,
+                              double offset);
+
+/**
+ * Calculate the absolute difference of two headings
+ * @param a heading in radians
+ * @param b heading in radians
+ * @return difference in radians in the range of [0,pi]
+ */
+double heading_difference(double a, double b);
+
 /**
  * Concatenate a linestring segs to a linestring line, used in the
  * function network.complete_path_to_geometry
@@ -0,0 +1,46 @@
+/**
+ * Fast map matching.
+ *
+ * fmm_server command line program main function
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/server/match_server.hpp"
+
+#include <csignal>
+
+using namespace FMM;
+using namespace FMM::MM;
+
+static MatchServer *server = nullptr;
+
+static void handle_signal(int signal) {
+  if (server == nullptr) return;
+  if (signal == SIGHUP) {
+    server->reload();
+  } else {
+    server->stop();
+  }
+}
+
+int main(int argc, char **argv){
+  MatchServerConfig config(argc,argv);
+  if (config.help_specified) {
+    MatchServerConfig::print_help();
+    return 0;
+  }
+  if (!config.validate()){
+    return 0;
+  }
+  MatchServer match_server(config);
+  server = &match_server;
+  std::signal(SIGINT, handle_signal);
+  std::signal(SIGTERM, handle_signal);
+  // SIGHUP reloads the network and UBODT files without a restart
+  std::signal(SIGHUP, handle_signal);
+  match_server.run();
+  server = nullptr;
+  return 0;
+};
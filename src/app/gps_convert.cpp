@@ -0,0 +1,27 @@
+/**
+ * Fast map matching.
+ *
+ * gps_convert command line program main function
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/gps_convert_app.hpp"
+
+using namespace FMM;
+using namespace FMM::IO;
+
+int main(int argc, char **argv){
+  GPSConvertAppConfig config(argc,argv);
+  if (config.help_specified) {
+    GPSConvertAppConfig::print_help();
+    return 0;
+  }
+  if (!config.validate()){
+    return 0;
+  }
+  GPSConvertApp app(config);
+  app.run();
+  return 0;
+};
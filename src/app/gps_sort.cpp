@@ -0,0 +1,27 @@
+/**
+ * Fast map matching.
+ *
+ * gps_sort command line program main function
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/gps_sort_app.hpp"
+
+using namespace FMM;
+using namespace FMM::IO;
+
+int main(int argc, char **argv){
+  GPSSortAppConfig config(argc,argv);
+  if (config.help_specified) {
+    GPSSortAppConfig::print_help();
+    return 0;
+  }
+  if (!config.validate()){
+    return 0;
+  }
+  GPSSortApp app(config);
+  app.run();
+  return 0;
+};
@@ -15,6 +15,9 @@ void FMM::CONFIG::GPSConfig::print() const{
     SPDLOG_INFO("ID name: {} ",id);
     SPDLOG_INFO("Geom name: {} ",geom);
     SPDLOG_INFO("Timestamp name: {} ",timestamp);
+  } else if (format==3) {
+    SPDLOG_INFO("GPS format: binary trajectory");
+    SPDLOG_INFO("File name: {} ",file);
   } else {
     SPDLOG_INFO("GPS format: CSV point");
     SPDLOG_INFO("File name: {} ",file);
@@ -23,6 +26,10 @@ void FMM::CONFIG::GPSConfig::print() const{
     SPDLOG_INFO("y name: {} ",y);
     SPDLOG_INFO("Timestamp name: {} ",timestamp);
   }
+  std::size_t num_files = get_files().size();
+  if (num_files > 1) {
+    SPDLOG_INFO("Number of files: {} ",num_files);
+  }
 };
 
 std::string FMM::CONFIG::GPSConfig::to_string() const{
@@ -84,7 +91,10 @@ void FMM::CONFIG::GPSConfig::register_arg(cxxopts::Options &options){
 };
 
 void FMM::CONFIG::GPSConfig::register_help(std::ostringstream &oss){
-  oss<<"--gps (required) <string>: GPS file name\n";
+  oss<<"--gps (required) <string>: GPS file name, a .fmmtraj file "
+    "is read as binary trajectories. Several files can be given as a "
+    "list separated by , of files, patterns like data/*.csv "
+    "or folders\n";
   oss<<"--gps_id (optional) <string>: GPS id name (id)\n";
   oss<<"--gps_x (optional) <string>: GPS x name (x)\n";
   oss<<"--gps_y (optional) <string>: GPS y name (y)\n";
@@ -95,9 +105,10 @@ void FMM::CONFIG::GPSConfig::register_help(std::ostringstream &oss){
     "otherwise (default) read input data as trajectory\n";
 };
 
-int FMM::CONFIG::GPSConfig::get_gps_format() const {
-  std::string fn_extension = file.substr(
-      file.find_last_of(".") + 1);
+int FMM::CONFIG::GPSConfig::get_file_format(const std::string &filename,
+                                             bool gps_point) {
+  std::string fn_extension = filename.substr(
+      filename.find_last_of(".") + 1);
   if (fn_extension == "csv" || fn_extension == "txt") {
     if (gps_point) {
       return 2;
@@ -106,21 +117,61 @@ int FMM::CONFIG::GPSConfig::get_gps_format() const {
     }
   } else if (fn_extension == "gpkg" || fn_extension == "shp") {
     return 0;
-  } else {
+  } else if (fn_extension == "fmmtraj") {
+    return 3;
+  }
+  return -1;
+};
+
+int FMM::CONFIG::GPSConfig::get_gps_format() const {
+  // The format of several files is the format of the first one
+  std::vector<std::string> files = get_files();
+  std::string first_file = files.empty() ? file : files[0];
+  int format = get_file_format(first_file, gps_point);
+  if (format < 0) {
+    std::string fn_extension = first_file.substr(
+        first_file.find_last_of(".") + 1);
     SPDLOG_CRITICAL("GPS file extension {} unknown",fn_extension);
-    return -1;
   }
+  return format;
+};
+
+std::vector<std::string> FMM::CONFIG::GPSConfig::get_files() const {
+  std::vector<std::string> files;
+  for (const std::string &item : UTIL::split_string(file)) {
+    if (item.empty()) continue;
+    if (UTIL::folder_exist(item)) {
+      for (const std::string &folder_file : UTIL::list_folder_files(item)) {
+        if (get_file_format(folder_file, gps_point) >= 0) {
+          files.push_back(folder_file);
+        }
+      }
+    } else if (item.find_first_of("*?[") != std::string::npos) {
+      std::vector<std::string> matched = UTIL::glob_files(item);
+      files.insert(files.end(), matched.begin(), matched.end());
+    } else {
+      files.push_back(item);
+    }
+  }
+  return files;
 };
 
 bool FMM::CONFIG::GPSConfig::validate() const {
-  if (!UTIL::file_exists(file))
-  {
+  std::vector<std::string> files = get_files();
+  if (files.empty()) {
     SPDLOG_CRITICAL("GPS file {} not found",file);
     return false;
-  };
-  if (get_gps_format()<0) {
-    SPDLOG_CRITICAL("Unknown GPS format");
-    return false;
+  }
+  for (const std::string &gps_file : files) {
+    if (!UTIL::file_exists(gps_file))
+    {
+      SPDLOG_CRITICAL("GPS file {} not found",gps_file);
+      return false;
+    };
+    if (get_file_format(gps_file, gps_point)<0) {
+      SPDLOG_CRITICAL("Unknown GPS format of {}",gps_file);
+      return false;
+    }
   }
   return true;
 };
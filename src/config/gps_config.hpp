@@ -10,6 +10,7 @@
 #define FMM_SRC_CONFIG_GPS_CONFIG_HPP_
 
 #include <string>
+#include <vector>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
@@ -35,7 +36,9 @@ struct GPSConfig {
     x(x_arg),y(y_arg),timestamp(timestamp_arg),
     gps_point(gps_point_arg)
   {};
-  std::string file; /**< filename */
+  std::string file; /**< filename, or several GPS files given as a list
+                         separated by ",", where each item can be a file,
+                         a pattern with wildcards or a folder */
   std::string id; /**< id field/column name */
   std::string geom; /**< geometry field/column name */
   std::string x; /**< x field/column name */
@@ -54,11 +57,27 @@ struct GPSConfig {
   /**
    * Find the GPS format.
    *
-   * @return 0 for GDAL trajectory file, 1 for CSV trajectory file
-   * and 2 for CSV point file, otherwise -1 is returned for unknown
-   * format.
+   * @return 0 for GDAL trajectory file, 1 for CSV trajectory file,
+   * 2 for CSV point file and 3 for binary trajectory file, otherwise -1
+   * is returned for unknown format.
    */
   int get_gps_format() const;
+  /**
+   * Find the format of a GPS file from its extension.
+   *
+   * @param filename the GPS file
+   * @param gps_point if true, a CSV file stores GPS points
+   * @return the format as in get_gps_format, -1 for unknown format
+   */
+  static int get_file_format(const std::string &filename, bool gps_point);
+  /**
+   * Get the GPS files, where a pattern is expanded into the files
+   * matching it and a folder into the files in it with a GPS format.
+   *
+   * @return the files in the order of the list, the files expanded
+   * from an item are sorted by name
+   */
+  std::vector<std::string> get_files() const;
 
   std::string to_string() const;
   /**
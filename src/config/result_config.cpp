@@ -1,6 +1,7 @@
 #include "config/result_config.hpp"
 #include "util/util.hpp"
 #include "util/debug.hpp"
+#include <map>
 #include <set>
 
 void FMM::CONFIG::ResultConfig::print() const {
@@ -34,6 +35,10 @@ void FMM::CONFIG::ResultConfig::print() const {
   SPDLOG_INFO("ResultConfig");
   SPDLOG_INFO("File: {}",file);
   SPDLOG_INFO("Fields: {}",ss.str());
+  SPDLOG_INFO("Coordinate precision: {}",
+              output_config.coordinate_precision);
+  SPDLOG_INFO("Value precision: {}",output_config.value_precision);
+  SPDLOG_INFO("Reorder window: {}",reorder_window);
 };
 
 std::string FMM::CONFIG::ResultConfig::to_string() const{
@@ -66,6 +71,11 @@ std::string FMM::CONFIG::ResultConfig::to_string() const{
     oss << "duration ";
   if (output_config.write_speed)
     oss << "speed ";
+  oss << "\n";
+  oss << "Coordinate precision : " << output_config.coordinate_precision
+      << "\n";
+  oss << "Value precision : " << output_config.value_precision << "\n";
+  oss << "Reorder window : " << reorder_window << "\n";
   return oss.str();
 };
 
@@ -73,6 +83,11 @@ FMM::CONFIG::ResultConfig FMM::CONFIG::ResultConfig::load_from_xml(
   const boost::property_tree::ptree &xml_data) {
   ResultConfig config;
   config.file = xml_data.get<std::string>("config.output.file");
+  config.reorder_window = xml_data.get("config.output.reorder_window", 0);
+  config.output_config.coordinate_precision =
+    xml_data.get("config.output.coordinate_precision", 12);
+  config.output_config.value_precision =
+    xml_data.get("config.output.value_precision", 6);
   if (xml_data.get_child_optional("config.output.fields")) {
     // Fields specified
     // close the default output fields (cpath,mgeom are true by default)
@@ -140,6 +155,11 @@ FMM::CONFIG::ResultConfig FMM::CONFIG::ResultConfig::load_from_arg(
   const cxxopts::ParseResult &arg_data) {
   FMM::CONFIG::ResultConfig config;
   config.file = arg_data["output"].as<std::string>();
+  config.reorder_window = arg_data["reorder_window"].as<int>();
+  config.output_config.coordinate_precision =
+    arg_data["coordinate_precision"].as<int>();
+  config.output_config.value_precision =
+    arg_data["value_precision"].as<int>();
   if (arg_data.count("output_fields") > 0) {
     config.output_config.write_cpath = false;
     config.output_config.write_mgeom = false;
@@ -215,14 +235,82 @@ std::set<std::string> FMM::CONFIG::ResultConfig::string2set(
   return result;
 };
 
+bool FMM::CONFIG::ResultConfig::is_sharded() const {
+  return !file.empty() && UTIL::folder_exist(file);
+};
+
+std::string FMM::CONFIG::ResultConfig::get_shard_file(
+  const std::string &gps_file) const {
+  std::string folder = file;
+  if (folder.back() == '/') folder.pop_back();
+  return folder + "/" + UTIL::get_file_stem(gps_file) + ".txt";
+};
+
+bool FMM::CONFIG::ResultConfig::validate_shards(
+  const std::vector<std::string> &gps_files) const {
+  if (!is_sharded()) return true;
+  // The paths are resolved so that the same file given by two paths,
+  // e.g., data/trips.txt and ./data/trips.txt, is detected
+  std::string folder = UTIL::get_real_path(file);
+  std::map<std::string, std::string> input_files;
+  for (const std::string &gps_file : gps_files) {
+    input_files.insert({UTIL::get_real_path(gps_file), gps_file});
+  }
+  std::map<std::string, std::string> shard_files;
+  for (const std::string &gps_file : gps_files) {
+    std::string shard_file = get_shard_file(gps_file);
+    std::string shard_path =
+      folder + "/" + UTIL::get_file_stem(gps_file) + ".txt";
+    auto input = input_files.find(shard_path);
+    if (input != input_files.end()) {
+      SPDLOG_CRITICAL("Result of GPS file {} would overwrite GPS file {}",
+                      gps_file, input->second);
+      return false;
+    }
+    // The shards of a run would be read as GPS files by the next one
+    if (UTIL::get_file_directory(UTIL::get_real_path(gps_file)) == folder) {
+      SPDLOG_CRITICAL("GPS file {} is in the output folder {}",
+                      gps_file, file);
+      return false;
+    }
+    auto result = shard_files.insert({shard_file, gps_file});
+    if (!result.second) {
+      SPDLOG_CRITICAL("GPS files {} and {} are both written into {}",
+                      result.first->second, gps_file, shard_file);
+      return false;
+    }
+  }
+  return true;
+};
+
 bool FMM::CONFIG::ResultConfig::validate() const {
-  if (UTIL::file_exists(file))
-  {
-    SPDLOG_WARN("Overwrite existing result file {}",file);
-  };
-  std::string output_folder = UTIL::get_file_directory(file);
-  if (!UTIL::folder_exist(output_folder)) {
-    SPDLOG_CRITICAL("Output folder {} not exists",output_folder);
+  if (is_sharded()) {
+    SPDLOG_INFO("Write result of each GPS file into folder {}",file);
+  } else {
+    if (UTIL::file_exists(file))
+    {
+      SPDLOG_WARN("Overwrite existing result file {}",file);
+    };
+    std::string output_folder = UTIL::get_file_directory(file);
+    if (!UTIL::folder_exist(output_folder)) {
+      SPDLOG_CRITICAL("Output folder {} not exists",output_folder);
+      return false;
+    }
+  }
+  if (reorder_window < 0) {
+    SPDLOG_CRITICAL("Invalid reorder window {}",reorder_window);
+    return false;
+  }
+  if (output_config.coordinate_precision <= 0 ||
+      output_config.coordinate_precision > 17) {
+    SPDLOG_CRITICAL("Invalid coordinate precision {}",
+                    output_config.coordinate_precision);
+    return false;
+  }
+  if (output_config.value_precision <= 0 ||
+      output_config.value_precision > 17) {
+    SPDLOG_CRITICAL("Invalid value precision {}",
+                    output_config.value_precision);
     return false;
   }
   return true;
@@ -233,12 +321,29 @@ void FMM::CONFIG::ResultConfig::register_arg(cxxopts::Options &options){
     ("o,output","Output file name",
     cxxopts::value<std::string>()->default_value(""))
     ("output_fields","Output fields",
-    cxxopts::value<std::string>()->default_value(""));
+    cxxopts::value<std::string>()->default_value(""))
+    ("reorder_window","Write results in the input order",
+    cxxopts::value<int>()->default_value("0"))
+    ("coordinate_precision","Significant digits of coordinates",
+    cxxopts::value<int>()->default_value("12"))
+    ("value_precision","Significant digits of the other numbers",
+    cxxopts::value<int>()->default_value("6"));
 };
 
 void FMM::CONFIG::ResultConfig::register_help(std::ostringstream &oss){
-  oss<<"--output (required) <string>: Output file name\n";
+  oss<<"--output (required) <string>: Output file name, or a folder "
+      "where the result of each GPS file is written into a file named "
+      "after it\n";
   oss<<"--output_fields (optional) <string>: Output fields\n";
   oss<<"  opath,cpath,tpath,mgeom,pgeom,\n";
   oss<<"  offset,error,spdist,tp,ep,length,duration,speed,all\n";
+  oss<<"--reorder_window (optional) <int>: if positive, results are "
+      "written in the order of the input, holding at most this number "
+      "of results, or of chunks of a point file, waiting for an earlier "
+      "one (0)\n";
+  oss<<"--coordinate_precision (optional) <int>: significant digits of "
+      "the coordinates written in mgeom and pgeom (12)\n";
+  oss<<"--value_precision (optional) <int>: significant digits of "
+      "the numbers written in error, offset, spdist, ep, tp, length, "
+      "duration and speed (6)\n";
 };
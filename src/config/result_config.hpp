@@ -11,6 +11,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include "cxxopts/cxxopts.hpp"
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -51,14 +52,26 @@ struct OutputConfig {
                                   two points) will be exported */
   bool write_speed = false; /**< if true, speed (sp_dist/duration)
                                   will be exported */
+  int coordinate_precision = 12; /**< number of significant digits of the
+                                       coordinates in mgeom and pgeom */
+  int value_precision = 6; /**< number of significant digits of the
+                                numbers in error, offset, spdist, ep, tp,
+                                length, duration and speed */
 };
 
 /**
  * Result Configuration class, defining output file and output fields
  */
 struct ResultConfig {
-  std::string file; /**< Output file to write the result */
+  std::string file; /**< Output file to write the result, or a folder
+                         where the result of each GPS file is written
+                         into a file named after it */
   OutputConfig output_config; /**< Output fields to export */
+  int reorder_window = 0; /**< if positive, results are written in the
+                              order of the input, with at most this number
+                              of trajectories, or of chunks when the file
+                              is read in chunks, waiting for an earlier
+                              one */
   /**
    * Check the validation of the configuration
    * @return true if valid otherwise false
@@ -69,6 +82,30 @@ struct ResultConfig {
    */
   void print() const;
   std::string to_string() const;
+  /**
+   * Check if the result is sharded, i.e., the result of each GPS file
+   * is written into a separate file, which is the case when the output
+   * is a folder.
+   * @return true if the output is a folder
+   */
+  bool is_sharded() const;
+  /**
+   * Get the file of the result of a GPS file when the result is sharded
+   * @param gps_file a GPS file
+   * @return the file named after the GPS file with extension txt in the
+   * output folder, e.g., result/trips.txt for data/trips.csv
+   */
+  std::string get_shard_file(const std::string &gps_file) const;
+  /**
+   * Check that the results of the GPS files are written into different
+   * files when the result is sharded
+   * @param gps_files the GPS files, see GPSConfig::get_files
+   * @return false if two GPS files have the same shard file, e.g.,
+   * a/day.csv and b/day.csv, which would overwrite each other, if a
+   * shard file is a GPS file or if a GPS file is in the output folder,
+   * where the shards would be taken as GPS files by the next run
+   */
+  bool validate_shards(const std::vector<std::string> &gps_files) const;
   /**
    * Parse a string separated by , into a set of strings.
    *
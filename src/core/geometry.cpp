@@ -3,6 +3,7 @@
  */
 
 #include "core/geometry.hpp"
+#include "util/formatter.hpp"
 
 #include <ogrsf_frmts.h> // C++ API for GDAL
 #include <boost/geometry.hpp>
@@ -11,9 +12,23 @@
 #include <vector>
 #include <sstream>
 
+std::string FMM::CORE::LineString::export_wkt(int precision) const{
+  UTIL::FormatBuffer buf;
+  UTIL::append_wkt(buf, *this, precision);
+  return fmt::to_string(buf);
+};
+
+std::string FMM::CORE::LineString::export_json(int precision) const{
+  UTIL::FormatBuffer buf;
+  UTIL::append_json(buf, *this, precision);
+  return fmt::to_string(buf);
+};
+
 std::ostream& FMM::CORE::operator<<(std::ostream& os,
     const FMM::CORE::LineString& rhs){
-  os<< std::setprecision(12) << boost::geometry::wkt(rhs.line);
+  UTIL::FormatBuffer buf;
+  UTIL::append_wkt(buf, rhs, 12);
+  os.write(buf.data(), buf.size());
   return os;
 };
 
@@ -138,32 +138,18 @@ public:
   };
   /**
    * Export a string containing WKT representation of the line.
+   * @param precision number of significant digits of a coordinate
    * @return The WKT of the line
    *
-   * Example: LINESTRING (30 10, 10 30, 40 40)
+   * Example: LINESTRING(30 10,10 30,40 40)
    */
-  inline std::string export_wkt(int precision=8) const{
-    std::ostringstream ss;
-    ss << std::setprecision(precision) << boost::geometry::wkt(line);
-    return ss.str();
-  };
+  std::string export_wkt(int precision=8) const;
   /**
    * Export a string containing GeoJSON representation of the line.
+   * @param precision number of significant digits of a coordinate
    * @return The GeoJSON of the line
    */
-  inline std::string export_json() const{
-    std::ostringstream ss;
-    int N = get_num_points();
-    if (N>0){
-      ss << "{\"type\":\"LineString\",\"coordinates\": [";
-      for (int i=0;i<N;++i){
-        ss << "[" << get_x(i) << "," << get_y(i) <<"]"
-           << (i==N-1 ? "": ",");
-      }
-      ss << "]}";
-    }
-    return ss.str();
-  };
+  std::string export_json(int precision=6) const;
   /**
    * Get a const reference to the inner boost geometry linestring
    * @return const reference to the inner boost geometry linestring
@@ -0,0 +1,151 @@
+/**
+ * Content
+ * Definition of AsyncFileWriter Class, which writes text records to a file
+ * from multiple threads without a global lock on the file stream.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/async_file_writer.hpp"
+#include "util/debug.hpp"
+
+#include <unordered_map>
+
+namespace FMM {
+
+namespace IO {
+
+const std::size_t AsyncFileWriter::MAX_QUEUED_CHUNKS;
+
+std::atomic<std::size_t> AsyncFileWriter::writer_counter_{0};
+
+AsyncFileWriter::AsyncFileWriter(const std::string &filename,
+                                 int reorder_window,
+                                 std::size_t buffer_size) :
+  m_fstream(filename), reorder_window_(reorder_window),
+  buffer_size_(buffer_size), writer_id_(writer_counter_++) {
+  io_thread_ = std::thread(&AsyncFileWriter::run_io, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  close();
+}
+
+void AsyncFileWriter::write_header(const std::string &header) {
+  submit(std::string(header));
+}
+
+void AsyncFileWriter::write(const std::string &record) {
+  if (reorder_window_ > 0) {
+    write(call_index_++, std::string(record));
+    return;
+  }
+  ThreadBuffer *buffer = get_thread_buffer();
+  std::string chunk;
+  {
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->data += record;
+    if (buffer->data.size() >= buffer_size_) chunk.swap(buffer->data);
+  }
+  if (!chunk.empty()) submit(std::move(chunk));
+}
+
+void AsyncFileWriter::write(std::size_t index, std::string &&record) {
+  if (reorder_window_ <= 0) {
+    write(record);
+    return;
+  }
+  std::unique_lock<std::mutex> lock(order_mutex_);
+  order_cv_.wait(lock, [&] {
+    return index < next_index_ + reorder_window_;
+  });
+  pending_.emplace(index, std::move(record));
+  bool advanced = false;
+  auto iter = pending_.begin();
+  while (iter != pending_.end() && iter->first == next_index_) {
+    ordered_data_ += iter->second;
+    iter = pending_.erase(iter);
+    ++next_index_;
+    advanced = true;
+  }
+  if (advanced) order_cv_.notify_all();
+  // Submitted with the lock held so that chunks keep their order
+  if (ordered_data_.size() >= buffer_size_) {
+    std::string chunk;
+    chunk.swap(ordered_data_);
+    submit(std::move(chunk));
+  }
+}
+
+void AsyncFileWriter::close() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (closed_) return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    for (ThreadBuffer &buffer : buffers_) {
+      std::lock_guard<std::mutex> buffer_lock(buffer.mutex);
+      if (!buffer.data.empty()) submit(std::move(buffer.data));
+      buffer.data.clear();
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(order_mutex_);
+    if (!pending_.empty()) {
+      SPDLOG_WARN("Records missing before index {}, {} records written "
+                  "out of order", pending_.begin()->first, pending_.size());
+      for (auto &item : pending_) ordered_data_ += item.second;
+      pending_.clear();
+    }
+    if (!ordered_data_.empty()) submit(std::move(ordered_data_));
+    ordered_data_.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    closed_ = true;
+  }
+  queue_not_empty_.notify_all();
+  io_thread_.join();
+  m_fstream.close();
+}
+
+AsyncFileWriter::ThreadBuffer *AsyncFileWriter::get_thread_buffer() {
+  // The buffer of a thread is looked up once per writer without locking
+  static thread_local std::unordered_map<std::size_t, ThreadBuffer *> cache;
+  auto iter = cache.find(writer_id_);
+  if (iter != cache.end()) return iter->second;
+  std::lock_guard<std::mutex> lock(buffers_mutex_);
+  buffers_.emplace_back();
+  ThreadBuffer *buffer = &buffers_.back();
+  cache[writer_id_] = buffer;
+  return buffer;
+}
+
+void AsyncFileWriter::submit(std::string &&chunk) {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  queue_not_full_.wait(lock, [&] {
+    return queue_.size() < MAX_QUEUED_CHUNKS;
+  });
+  queue_.push_back(std::move(chunk));
+  queue_not_empty_.notify_one();
+}
+
+void AsyncFileWriter::run_io() {
+  std::string chunk;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      queue_not_empty_.wait(lock, [&] { return !queue_.empty() || closed_; });
+      if (queue_.empty()) return;
+      chunk = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    queue_not_full_.notify_all();
+    m_fstream.write(chunk.data(), chunk.size());
+  }
+}
+
+} //IO
+} //FMM
@@ -0,0 +1,116 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of AsyncFileWriter Class, which writes text records to a file
+ * from multiple threads without a global lock on the file stream.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_ASYNC_FILE_WRITER_HPP
+#define FMM_ASYNC_FILE_WRITER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace FMM {
+
+namespace IO {
+
+/**
+ * A writer of text records, where records are appended to a buffer owned
+ * by the calling thread and a full buffer is handed to a dedicated I/O
+ * thread, so the threads producing records do not wait for each other
+ * or for the disk.
+ *
+ * In ordered mode (reorder_window > 0), each record carries its index
+ * in the input and the records are written in the order of the index.
+ * A record whose index is reorder_window or more ahead of the next
+ * record to write blocks until the gap is closed, which bounds the
+ * records held in memory. A record can hold the lines of several
+ * trajectories, such as the results of a chunk of the input, so that a
+ * thread producing them waits at most once.
+ */
+class AsyncFileWriter {
+public:
+  /**
+   * Constructor
+   * @param filename the file to write
+   * @param reorder_window if positive, records are written in the
+   * order of their index, otherwise in the order they are buffered
+   * @param buffer_size the size in bytes of a buffer handed to the
+   * I/O thread
+   */
+  AsyncFileWriter(const std::string &filename, int reorder_window = 0,
+                  std::size_t buffer_size = 1 << 20);
+  /**
+   * Destructor, the records left are written and the file is closed.
+   */
+  ~AsyncFileWriter();
+  /**
+   * Write a header before any record
+   * @param header the text written
+   */
+  void write_header(const std::string &header);
+  /**
+   * Write a record. In ordered mode, its index is the number of
+   * records written before it.
+   * @param record the text written
+   */
+  void write(const std::string &record);
+  /**
+   * Write a record with its index in the input. The index is ignored
+   * if the writer is not ordered.
+   * @param index index of the record, starting from 0 without gaps
+   * @param record the text written
+   */
+  void write(std::size_t index, std::string &&record);
+  /**
+   * Write all the records buffered, stop the I/O thread and close the
+   * file. It should be called after all the threads stop writing.
+   */
+  void close();
+private:
+  static const std::size_t MAX_QUEUED_CHUNKS = 16; /**< Maximum number of
+    chunks waiting for the I/O thread */
+  static std::atomic<std::size_t> writer_counter_;
+  struct ThreadBuffer {
+    std::mutex mutex;
+    std::string data;
+  };
+  ThreadBuffer *get_thread_buffer();
+  void submit(std::string &&chunk);
+  void run_io();
+  std::ofstream m_fstream;
+  int reorder_window_;
+  std::size_t buffer_size_;
+  std::size_t writer_id_;
+  std::mutex buffers_mutex_;
+  std::list<ThreadBuffer> buffers_;
+  // Ordered mode
+  std::atomic<std::size_t> call_index_{0};
+  std::mutex order_mutex_;
+  std::condition_variable order_cv_;
+  std::size_t next_index_ = 0;
+  std::map<std::size_t, std::string> pending_;
+  std::string ordered_data_;
+  // Chunks waiting for the I/O thread
+  std::mutex queue_mutex_;
+  std::condition_variable queue_not_empty_;
+  std::condition_variable queue_not_full_;
+  std::deque<std::string> queue_;
+  bool closed_ = false;
+  std::thread io_thread_;
+}; // AsyncFileWriter
+
+} //IO
+} //FMM
+#endif // FMM_ASYNC_FILE_WRITER_HPP
@@ -0,0 +1,127 @@
+/**
+ * Content
+ * Definition of BinaryTrajectoryWriter Class, which writes trajectories
+ * into a binary columnar file.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/binary_trajectory.hpp"
+#include "util/debug.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace FMM {
+
+namespace IO {
+
+BinaryTrajectoryWriter::BinaryTrajectoryWriter(const std::string &filename,
+                                               bool has_timestamp) :
+  filename_(filename), has_timestamp_(has_timestamp) {
+  ids_.open(column_file("ids"), std::ios::binary);
+  offsets_.open(column_file("offsets"), std::ios::binary);
+  x_.open(column_file("x"), std::ios::binary);
+  y_.open(column_file("y"), std::ios::binary);
+  if (has_timestamp_) {
+    timestamps_.open(column_file("timestamps"), std::ios::binary);
+  }
+  if (!ids_.is_open() || !offsets_.is_open() || !x_.is_open() ||
+      !y_.is_open() || (has_timestamp_ && !timestamps_.is_open())) {
+    std::string message = "Open temporary file fail " + filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  uint64_t offset = 0;
+  offsets_.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+}
+
+BinaryTrajectoryWriter::~BinaryTrajectoryWriter() {
+  if (!closed_) {
+    try {
+      close();
+    } catch (const std::exception &) {
+      // The error is already logged
+    }
+  }
+}
+
+void BinaryTrajectoryWriter::write(const FMM::CORE::Trajectory &trajectory) {
+  int num_points = trajectory.geom.get_num_points();
+  if (has_timestamp_ && trajectory.timestamps.size() != num_points) {
+    std::string message = "Trajectory " + std::to_string(trajectory.id) +
+      " has " + std::to_string(trajectory.timestamps.size()) +
+      " timestamps for " + std::to_string(num_points) + " points";
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  int64_t id = trajectory.id;
+  ids_.write(reinterpret_cast<const char *>(&id), sizeof(id));
+  std::vector<double> xs(num_points);
+  std::vector<double> ys(num_points);
+  for (int i = 0; i < num_points; ++i) {
+    xs[i] = trajectory.geom.get_x(i);
+    ys[i] = trajectory.geom.get_y(i);
+  }
+  x_.write(reinterpret_cast<const char *>(xs.data()),
+           num_points * sizeof(double));
+  y_.write(reinterpret_cast<const char *>(ys.data()),
+           num_points * sizeof(double));
+  if (has_timestamp_ && num_points > 0) {
+    timestamps_.write(
+      reinterpret_cast<const char *>(trajectory.timestamps.data()),
+      num_points * sizeof(double));
+  }
+  num_points_ += num_points;
+  ++num_trajectories_;
+  offsets_.write(reinterpret_cast<const char *>(&num_points_),
+                 sizeof(num_points_));
+}
+
+void BinaryTrajectoryWriter::close() {
+  closed_ = true;
+  std::vector<std::string> columns = {"ids", "offsets", "x", "y"};
+  if (has_timestamp_) columns.push_back("timestamps");
+  ids_.close();
+  offsets_.close();
+  x_.close();
+  y_.close();
+  timestamps_.close();
+  BinaryTrajectoryHeader header;
+  std::memcpy(header.magic, BINARY_TRAJECTORY_MAGIC, sizeof(header.magic));
+  header.version = BINARY_TRAJECTORY_VERSION;
+  header.flags = has_timestamp_ ? BINARY_TRAJECTORY_TIMESTAMP : 0;
+  header.num_trajectories = num_trajectories_;
+  header.num_points = num_points_;
+  std::ofstream ofs(filename_, std::ios::binary);
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const std::string &column : columns) {
+    std::string file = column_file(column);
+    {
+      std::ifstream ifs(file, std::ios::binary);
+      // An empty column makes operator<< set the failbit
+      if (ifs.peek() != std::ifstream::traits_type::eof()) {
+        ofs << ifs.rdbuf();
+      }
+    }
+    std::remove(file.c_str());
+  }
+  ofs.close();
+  if (!ofs) {
+    std::string message = "Write file fail " + filename_;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  SPDLOG_INFO("Write binary trajectories {} points {} to {}",
+              num_trajectories_, num_points_, filename_);
+}
+
+std::string BinaryTrajectoryWriter::column_file(
+  const std::string &column) const {
+  return filename_ + "." + column + ".tmp";
+}
+
+} //IO
+} //FMM
@@ -0,0 +1,129 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the binary trajectory format and the
+ * BinaryTrajectoryWriter Class.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_BINARY_TRAJECTORY_HPP
+#define FMM_BINARY_TRAJECTORY_HPP
+
+#include "core/gps.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace FMM {
+
+namespace IO {
+
+/**
+ * Header of a binary trajectory file.
+ *
+ * The file stores trajectories in columns, which are read in place from
+ * a file mapped into memory by BinaryTrajectoryReader. After the header,
+ * the file contains the following arrays in native byte order:
+ *
+ * - ids: int64_t[num_trajectories], the id of each trajectory
+ * - offsets: uint64_t[num_trajectories + 1], the points of trajectory i
+ *   are in the range [offsets[i], offsets[i + 1]) of the point columns
+ * - x: double[num_points]
+ * - y: double[num_points]
+ * - timestamps: double[num_points], only if BINARY_TRAJECTORY_TIMESTAMP
+ *   is set in the flags
+ *
+ * The header is 32 bytes, so all the arrays are aligned to 8 bytes.
+ */
+struct BinaryTrajectoryHeader {
+  char magic[8]; /**< BINARY_TRAJECTORY_MAGIC */
+  uint32_t version; /**< BINARY_TRAJECTORY_VERSION */
+  uint32_t flags; /**< Combination of BinaryTrajectoryFlag */
+  uint64_t num_trajectories; /**< Number of trajectories */
+  uint64_t num_points; /**< Number of points of all the trajectories */
+};
+
+/**
+ * Flags of a binary trajectory file
+ */
+enum BinaryTrajectoryFlag {
+  BINARY_TRAJECTORY_TIMESTAMP = 1 /**< timestamps are stored */
+};
+
+/**
+ * Magic number at the start of a binary trajectory file
+ */
+const char BINARY_TRAJECTORY_MAGIC[8] = {'F', 'M', 'M', 'T', 'R', 'A', 'J', 0};
+
+/**
+ * Version of the binary trajectory format
+ */
+const uint32_t BINARY_TRAJECTORY_VERSION = 1;
+
+/**
+ * Writer of a binary trajectory file.
+ *
+ * The trajectories are appended to a temporary file per column, which
+ * are concatenated after the header when the writer is closed, so the
+ * number of trajectories written is not limited by memory.
+ */
+class BinaryTrajectoryWriter {
+public:
+  /**
+   * Constructor
+   * @param filename the file to write
+   * @param has_timestamp if true, the timestamps of the trajectories
+   * are written and each trajectory should have a timestamp per point
+   */
+  BinaryTrajectoryWriter(const std::string &filename, bool has_timestamp);
+  /**
+   * Destructor, the file is closed if it is not closed yet
+   */
+  ~BinaryTrajectoryWriter();
+  /**
+   * Write a trajectory
+   * @param trajectory the trajectory written
+   * @throw std::runtime_error if the trajectory has no timestamp while
+   * the file stores timestamps
+   */
+  void write(const FMM::CORE::Trajectory &trajectory);
+  /**
+   * Write the header and the columns into the file and remove the
+   * temporary files.
+   */
+  void close();
+  /**
+   * Get the number of trajectories written
+   */
+  inline uint64_t get_num_trajectories() const {
+    return num_trajectories_;
+  };
+  /**
+   * Get the number of points written
+   */
+  inline uint64_t get_num_points() const {
+    return num_points_;
+  };
+private:
+  /**
+   * Name of the temporary file of a column
+   */
+  std::string column_file(const std::string &column) const;
+  std::string filename_;
+  bool has_timestamp_;
+  bool closed_ = false;
+  uint64_t num_trajectories_ = 0;
+  uint64_t num_points_ = 0;
+  std::ofstream ids_;
+  std::ofstream offsets_;
+  std::ofstream x_;
+  std::ofstream y_;
+  std::ofstream timestamps_;
+}; // BinaryTrajectoryWriter
+
+} //IO
+} //FMM
+#endif // FMM_BINARY_TRAJECTORY_HPP
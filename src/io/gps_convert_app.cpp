@@ -0,0 +1,32 @@
+#include "io/gps_convert_app.hpp"
+#include "io/binary_trajectory.hpp"
+#include "io/gps_reader.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::IO;
+
+void GPSConvertApp::run() const {
+  std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+  SPDLOG_INFO("Write binary trajectories to file {}", config_.result_file);
+  GPSReader reader(config_.gps_config);
+  BinaryTrajectoryWriter writer(config_.result_file,
+                                reader.has_timestamp());
+  while (reader.has_next_trajectory()) {
+    std::vector<Trajectory> trajectories =
+        reader.read_next_N_trajectories(1000);
+    for (const Trajectory &trajectory : trajectories) {
+      writer.write(trajectory);
+    }
+  }
+  writer.close();
+  std::chrono::steady_clock::time_point end =
+      std::chrono::steady_clock::now();
+  double time_spent =
+      std::chrono::duration_cast<std::chrono::milliseconds>
+          (end - begin).count() / 1000.;
+  SPDLOG_INFO("Time takes {}", time_spent);
+};
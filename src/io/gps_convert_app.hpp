@@ -0,0 +1,39 @@
+/**
+ * Fast map matching.
+ *
+ * gps_convert command line program
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_IO_GPS_CONVERT_APP_HPP_
+#define FMM_SRC_IO_GPS_CONVERT_APP_HPP_
+
+#include "io/gps_convert_app_config.hpp"
+
+namespace FMM {
+namespace IO {
+/**
+ * gps_convert command line program, which converts a GPS file in any
+ * format read by GPSReader into a binary trajectory file
+ */
+class GPSConvertApp {
+public:
+  /**
+   * Constructor
+   * @param config Configuration data
+   */
+  GPSConvertApp(const GPSConvertAppConfig &config) : config_(config) {
+  };
+  /**
+   * Run the conversion
+   */
+  void run() const;
+private:
+  const GPSConvertAppConfig &config_;
+};
+}
+}
+
+#endif //FMM_SRC_IO_GPS_CONVERT_APP_HPP_
@@ -0,0 +1,94 @@
+#include "io/gps_convert_app_config.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+
+using namespace FMM;
+using namespace FMM::IO;
+using namespace FMM::CONFIG;
+
+GPSConvertAppConfig::GPSConvertAppConfig(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  load_arg(argc, argv);
+  spdlog::set_level((spdlog::level::level_enum) log_level);
+  if (!help_specified)
+    print();
+}
+
+void GPSConvertAppConfig::load_arg(int argc, char **argv) {
+  SPDLOG_INFO("Start reading gps_convert configuration from arguments");
+  cxxopts::Options options("config",
+                           "Configuration parser of gps_convert");
+  // Register options
+  GPSConfig::register_arg(options);
+  options.add_options()
+    ("o,output", "Output file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("l,log_level", "Log level", cxxopts::value<int>()->default_value("2"))
+    ("h,help",   "Help information");
+  if (argc==1) {
+    help_specified = true;
+    return;
+  }
+  // Parse options
+  auto result = options.parse(argc, argv);
+  // Read options
+  gps_config = GPSConfig::load_from_arg(result);
+  result_file = result["output"].as<std::string>();
+  log_level = result["log_level"].as<int>();
+  if (result.count("help")>0) {
+    help_specified = true;
+  }
+  SPDLOG_INFO("Finish with reading gps_convert arg configuration");
+}
+
+void GPSConvertAppConfig::print() const {
+  SPDLOG_INFO("----    Print configuration   ----");
+  gps_config.print();
+  SPDLOG_INFO("Output file {}",result_file);
+  SPDLOG_INFO("Log level {}",UTIL::LOG_LEVESLS[log_level]);
+  SPDLOG_INFO("---- Print configuration done ----");
+}
+
+void GPSConvertAppConfig::print_help() {
+  std::ostringstream oss;
+  oss << "gps_convert argument lists:\n";
+  GPSConfig::register_help(oss);
+  oss << "-o/--output (required) <string>: Output file name, "
+    "with extension .fmmtraj\n";
+  oss << "-l/--log_level (optional) <int>: log level (2)\n";
+  oss << "-h/--help: help information\n";
+  oss << "The output can be passed as --gps to fmm and stmatch, "
+    "which skips parsing the GPS file in every run\n";
+  std::cout<<oss.str();
+}
+
+bool GPSConvertAppConfig::validate() const {
+  SPDLOG_INFO("Validating configuration for GPS conversion");
+  if (!gps_config.validate()) {
+    return false;
+  }
+  if (!UTIL::check_file_extension(result_file, "fmmtraj")) {
+    SPDLOG_CRITICAL("Output file {} should have extension .fmmtraj",
+                    result_file);
+    return false;
+  }
+  if (result_file == gps_config.file) {
+    SPDLOG_CRITICAL("Output file should differ from the GPS file");
+    return false;
+  }
+  if (UTIL::file_exists(result_file)) {
+    SPDLOG_WARN("Overwrite result file {}", result_file);
+  }
+  std::string output_folder = UTIL::get_file_directory(result_file);
+  if (!UTIL::folder_exist(output_folder)) {
+    SPDLOG_CRITICAL("Output folder {} not exists", output_folder);
+    return false;
+  }
+  if (log_level < 0 || log_level > UTIL::LOG_LEVESLS.size()) {
+    SPDLOG_CRITICAL("Invalid log_level {}, which should be 0 - 6", log_level);
+    SPDLOG_INFO("0-trace,1-debug,2-info,3-warn,4-err,5-critical,6-off");
+    return false;
+  }
+  SPDLOG_INFO("Validating done.");
+  return true;
+}
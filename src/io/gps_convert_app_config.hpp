@@ -0,0 +1,56 @@
+/**
+ * Fast map matching.
+ *
+ * gps_convert command line program configuration
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_IO_GPS_CONVERT_APP_CONFIG_HPP_
+#define FMM_SRC_IO_GPS_CONVERT_APP_CONFIG_HPP_
+
+#include "config/gps_config.hpp"
+
+namespace FMM {
+namespace IO {
+/**
+ * Configuration of gps_convert command line program
+ */
+class GPSConvertAppConfig {
+public:
+  /**
+   * Constructor of Configuration of gps_convert command line program
+   * @param argc number of argument
+   * @param argv argument data
+   */
+  GPSConvertAppConfig(int argc, char **argv);
+  /**
+   * Load configuration from arguments
+   * @param argc number of argument
+   * @param argv argument data
+   */
+  void load_arg(int argc, char **argv);
+  /**
+   * Print information
+   */
+  void print() const;
+  /**
+   * Check the validity of the configuration
+   * @return true if valid otherwise false
+   */
+  bool validate() const;
+  /**
+   * Print help information
+   */
+  static void print_help();
+  CONFIG::GPSConfig gps_config; /**< GPS file to convert */
+  std::string result_file; /**< Binary trajectory file */
+  int log_level = 2; /**< Level level. 0-trace,1-debug,2-info,3-warn,4-err,
+                         5-critical,6-off */
+  bool help_specified = false; /**< Help is specified or not */
+}; // GPSConvertAppConfig
+}
+}
+
+#endif //FMM_SRC_IO_GPS_CONVERT_APP_CONFIG_HPP_
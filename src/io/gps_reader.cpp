@@ -8,7 +8,11 @@
 #include "util/debug.hpp"
 #include "util/util.hpp"
 #include "config/gps_config.hpp"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <numeric>
 #include <stdexcept>
 #include <string>
 
@@ -31,10 +35,11 @@ std::vector<Trajectory> ITrajectoryReader::read_next_N_trajectories(int N) {
 
 std::vector<Trajectory> ITrajectoryReader::read_all_trajectories() {
   std::vector<Trajectory> trajectories;
-  int i = 0;
   while (has_next_trajectory()) {
-    trajectories.push_back(read_next_trajectory());
-    ++i;
+    std::vector<Trajectory> batch = read_next_N_trajectories();
+    trajectories.insert(trajectories.end(),
+                        std::make_move_iterator(batch.begin()),
+                        std::make_move_iterator(batch.end()));
   }
   return trajectories;
 }
@@ -113,14 +118,16 @@ CSVTrajectoryReader::CSVTrajectoryReader(const std::string &e_filename,
                                          const std::string &id_name,
                                          const std::string &geom_name,
                                          const std::string &timestamp_name) :
-  ifs(e_filename) {
-  std::string line;
-  std::getline(ifs, line);
-  std::stringstream check1(line);
-  std::string intermediate;
-  // Tokenizing w.r.t. space ' '
-  int i = 0;
-  while (safe_get_line(check1, intermediate, delim)) {
+  file(new MMapFile(e_filename)) {
+  cursor = file->data();
+  data_end = file->end();
+  TextSpan line{cursor, cursor};
+  next_line(&cursor, data_end, &line);
+  data_begin = cursor;
+  std::vector<TextSpan> fields;
+  split_line(line, delim, &fields);
+  for (int i = 0; i < fields.size(); ++i) {
+    std::string intermediate = fields[i].str();
     if (intermediate == id_name) {
       id_idx = i;
     }
@@ -130,7 +137,6 @@ CSVTrajectoryReader::CSVTrajectoryReader(const std::string &e_filename,
     if (intermediate == timestamp_name) {
       timestamp_idx = i;
     }
-    ++i;
   }
   if (id_idx < 0 || geom_idx < 0) {
     std::string message = (boost::format("Id %1% or Geometry column %2% not found") % id_name % geom_name).str();
@@ -147,13 +153,8 @@ CSVTrajectoryReader::CSVTrajectoryReader(const std::string &e_filename,
 std::vector<double> CSVTrajectoryReader::string2time(
   const std::string &str) {
   std::vector<double> values;
-  std::stringstream ss(str);
-  double v;
-  while (ss >> v) {
-    values.push_back(v);
-    if (ss.peek() == ',')
-      ss.ignore();
-  }
+  parse_double_list(TextSpan{str.data(), str.data() + str.size()}, ',',
+                    &values);
   return values;
 }
 
@@ -161,45 +162,99 @@ bool CSVTrajectoryReader::has_timestamp() {
   return timestamp_idx > 0;
 }
 
-Trajectory CSVTrajectoryReader::read_next_trajectory() {
-  // Read the geom idx column into a trajectory
-  std::string line;
-  std::getline(ifs, line);
-  std::stringstream ss(line);
-  int trid = 0;
+bool CSVTrajectoryReader::parse_trajectory(const TextSpan &line,
+                                           Trajectory *trajectory) const {
+  trajectory->id = 0;
   int index = 0;
-  std::string intermediate;
-  FMM::CORE::LineString geom;
-  std::vector<double> timestamps;
-  while (std::getline(ss, intermediate, delim)) {
+  const char *p = line.begin;
+  while (true) {
+    const char *field_end = static_cast<const char *>(
+      std::memchr(p, delim, line.end - p));
+    if (field_end == nullptr) field_end = line.end;
+    TextSpan field{p, field_end};
     if (index == id_idx) {
-      trid = std::stoi(intermediate);
+      long long id;
+      if (!parse_int(field, &id)) return false;
+      trajectory->id = id;
     }
     if (index == geom_idx) {
-      // intermediate
-      boost::geometry::read_wkt(intermediate, geom.get_geometry());
+      if (!parse_linestring(field, &trajectory->geom)) {
+        // Other forms of WKT are left to boost
+        trajectory->geom = FMM::CORE::LineString();
+        try {
+          boost::geometry::read_wkt(field.str(),
+                                    trajectory->geom.get_geometry());
+        } catch (std::exception &e) {
+          return false;
+        }
+      }
     }
     if (index == timestamp_idx) {
-      // intermediate
-      timestamps = string2time(intermediate);
+      if (!parse_double_list(field, ',', &trajectory->timestamps)) {
+        return false;
+      }
     }
+    if (field_end == line.end) break;
+    p = field_end + 1;
     ++index;
   }
-  return Trajectory{trid, geom, timestamps};
+  return true;
+}
+
+Trajectory CSVTrajectoryReader::read_next_trajectory() {
+  TextSpan line{cursor, cursor};
+  next_line(&cursor, data_end, &line);
+  Trajectory trajectory;
+  if (!parse_trajectory(line, &trajectory)) {
+    std::string message = "Invalid trajectory line " + line.str();
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  return trajectory;
+}
+
+std::vector<Trajectory> CSVTrajectoryReader::read_next_N_trajectories(
+  int N) {
+  // Lines are located sequentially and parsed in parallel
+  std::vector<TextSpan> lines;
+  TextSpan line{cursor, cursor};
+  while (lines.size() < N && next_line(&cursor, data_end, &line)) {
+    if (!line.empty()) lines.push_back(line);
+  }
+  int num_lines = lines.size();
+  std::vector<Trajectory> trajectories(num_lines);
+  int invalid_line = num_lines;
+  #pragma omp parallel for if (num_lines >= 64)
+  for (int i = 0; i < num_lines; ++i) {
+    if (!parse_trajectory(lines[i], &trajectories[i])) {
+      #pragma omp critical
+      invalid_line = std::min(invalid_line, i);
+    }
+  }
+  if (invalid_line < num_lines) {
+    std::string message = "Invalid trajectory line " +
+      lines[invalid_line].str();
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  return trajectories;
 }
 
 bool CSVTrajectoryReader::has_next_trajectory() {
-  return ifs.peek() != EOF;
+  // Empty lines at the end of the file are skipped
+  while (cursor < data_end && (*cursor == '\n' || *cursor == '\r')) {
+    ++cursor;
+  }
+  return cursor < data_end;
 }
 
 void CSVTrajectoryReader::reset_cursor() {
-  ifs.clear();
-  ifs.seekg(0, std::ios::beg);
-  std::string line;
-  std::getline(ifs, line);
+  cursor = data_begin;
 }
+
 void CSVTrajectoryReader::close() {
-  ifs.close();
+  file.reset();
+  data_begin = cursor = data_end = nullptr;
 }
 
 CSVPointReader::CSVPointReader(const std::string &e_filename,
@@ -207,14 +262,16 @@ CSVPointReader::CSVPointReader(const std::string &e_filename,
                                const std::string &x_name,
                                const std::string &y_name,
                                const std::string &time_name) :
-  ifs(e_filename) {
-  std::string line;
-  std::getline(ifs, line);
-  std::stringstream check1(line);
-  std::string intermediate;
-  // Tokenizing w.r.t. space ' '
-  int i = 0;
-  while (safe_get_line(check1, intermediate, delim)) {
+  file(new MMapFile(e_filename)) {
+  cursor = file->data();
+  data_end = file->end();
+  TextSpan line{cursor, cursor};
+  next_line(&cursor, data_end, &line);
+  data_begin = cursor;
+  std::vector<TextSpan> fields;
+  split_line(line, delim, &fields);
+  for (int i = 0; i < fields.size(); ++i) {
+    std::string intermediate = fields[i].str();
     if (intermediate == id_name) {
       id_idx = i;
     }
@@ -227,7 +284,6 @@ CSVPointReader::CSVPointReader(const std::string &e_filename,
     if (intermediate == time_name) {
       timestamp_idx = i;
     }
-    ++i;
   }
   if (id_idx < 0 || x_idx < 0 || y_idx < 0) {
     if (id_idx < 0) {
@@ -253,98 +309,460 @@ CSVPointReader::CSVPointReader(const std::string &e_filename,
               id_idx, x_idx, y_idx, timestamp_idx);
 }
 
-Trajectory CSVPointReader::read_next_trajectory() {
-  // Read the geom idx column into a trajectory
-  std::string intermediate;
-  FMM::CORE::LineString geom;
-  std::vector<double> timestamps;
-  bool on_same_trajectory = true;
+bool CSVPointReader::parse_point(const TextSpan &line, int *id,
+                                 double *x, double *y,
+                                 double *timestamp) const {
+  int index = 0;
+  const char *p = line.begin;
+  while (true) {
+    const char *field_end = static_cast<const char *>(
+      std::memchr(p, delim, line.end - p));
+    if (field_end == nullptr) field_end = line.end;
+    TextSpan field{p, field_end};
+    const char *value_cursor = field.begin;
+    if (index == id_idx) {
+      long long value;
+      if (!parse_int(field, &value)) return false;
+      *id = value;
+    }
+    if (index == x_idx && !parse_double(&value_cursor, field.end, x)) {
+      return false;
+    }
+    if (index == y_idx && !parse_double(&value_cursor, field.end, y)) {
+      return false;
+    }
+    if (index == timestamp_idx &&
+        !parse_double(&value_cursor, field.end, timestamp)) {
+      return false;
+    }
+    if (field_end == line.end) break;
+    p = field_end + 1;
+    ++index;
+  }
+  return true;
+}
+
+Trajectory CSVPointReader::read_trajectory(const char **position,
+                                           const char *end) const {
+  // Consecutive lines with the same id are read into a trajectory
+  Trajectory trajectory;
+  trajectory.id = -1;
   bool first_observation = true;
-  int trid = -1;
-  int prev_id = -1;
-  double prev_timestamp = -1.0;
-  std::string line;
-  while (on_same_trajectory && has_next_trajectory()) {
-    if (prev_line.empty()) {
-      std::getline(ifs, line);
-    } else {
-      line = prev_line;
-      prev_line.clear();
+  const char *p = *position;
+  while (p < end) {
+    const char *next = p;
+    TextSpan line{p, p};
+    next_line(&next, end, &line);
+    if (line.empty()) {
+      p = next;
+      continue;
     }
-    std::stringstream ss(line);
     int id = 0;
     double x = 0, y = 0;
     double timestamp = 0;
-    int index = 0;
-    while (std::getline(ss, intermediate, delim)) {
-      if (index == id_idx) {
-        id = std::stoi(intermediate);
-      }
-      if (index == x_idx) {
-        x = std::stof(intermediate);
-      }
-      if (index == y_idx) {
-        y = std::stof(intermediate);
-      }
-      if (index == timestamp_idx) {
-        timestamp = std::stof(intermediate);
-      }
-      ++index;
-    }
-    if (prev_id == id || first_observation) {
-      geom.add_point(x, y);
-      if (has_timestamp())
-        timestamps.push_back(timestamp);
-    }
-    if (prev_id != id && !first_observation) {
-      on_same_trajectory = false;
-      trid = prev_id;
+    if (!parse_point(line, &id, &x, &y, &timestamp)) {
+      std::string message = "Invalid point line " + line.str();
+      SPDLOG_CRITICAL(message);
+      throw std::runtime_error(message);
     }
+    // The line of the next trajectory is left for the next call
+    if (!first_observation && id != trajectory.id) break;
+    p = next;
     first_observation = false;
-    prev_id = id;
-    if (!on_same_trajectory) {
-      prev_line = line;
+    trajectory.id = id;
+    trajectory.geom.add_point(x, y);
+    if (timestamp_idx > 0)
+      trajectory.timestamps.push_back(timestamp);
+  }
+  *position = p;
+  return trajectory;
+}
+
+Trajectory CSVPointReader::read_next_trajectory() {
+  return read_trajectory(&cursor, data_end);
+}
+
+const char *CSVPointReader::align_to_trajectory(const char *position) const {
+  if (position <= data_begin) return data_begin;
+  if (position >= data_end) return data_end;
+  // Start of the first line at or after the position
+  const char *line_start = position;
+  if (*(position - 1) != '\n') {
+    line_start = static_cast<const char *>(
+      std::memchr(position, '\n', data_end - position));
+    if (line_start == nullptr) return data_end;
+    ++line_start;
+  }
+  // Id of the last point before that line, empty lines are skipped
+  const char *prev_end = line_start;
+  TextSpan prev_line{prev_end, prev_end};
+  while (prev_line.empty()) {
+    if (prev_end <= data_begin) return data_begin;
+    const char *prev_start = prev_end - 1;
+    while (prev_start > data_begin && *(prev_start - 1) != '\n') {
+      --prev_start;
+    }
+    const char *cursor_end = prev_start;
+    next_line(&cursor_end, data_end, &prev_line);
+    prev_end = prev_start;
+  }
+  int prev_id = 0;
+  double x, y, timestamp;
+  if (!parse_point(prev_line, &prev_id, &x, &y, &timestamp)) {
+    std::string message = "Invalid point line " + prev_line.str();
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  // Skip the rest of the trajectory of that point
+  const char *p = line_start;
+  while (p < data_end) {
+    const char *next = p;
+    TextSpan line{p, p};
+    next_line(&next, data_end, &line);
+    if (!line.empty()) {
+      int id = 0;
+      if (!parse_point(line, &id, &x, &y, &timestamp)) {
+        std::string message = "Invalid point line " + line.str();
+        SPDLOG_CRITICAL(message);
+        throw std::runtime_error(message);
+      }
+      if (id != prev_id) return p;
     }
+    p = next;
   }
-  if (!has_next_trajectory()) {
-    trid = prev_id;
+  return data_end;
+}
+
+std::size_t CSVPointReader::get_num_chunks(std::size_t chunk_size) const {
+  if (data_begin == data_end || chunk_size == 0) return 0;
+  return (data_end - data_begin + chunk_size - 1) / chunk_size;
+}
+
+std::vector<Trajectory> CSVPointReader::read_chunk(
+  std::size_t chunk_index, std::size_t chunk_size) const {
+  const char *begin = align_to_trajectory(
+    data_begin + std::min<std::size_t>(chunk_index * chunk_size,
+                                       data_end - data_begin));
+  const char *end = align_to_trajectory(
+    data_begin + std::min<std::size_t>((chunk_index + 1) * chunk_size,
+                                       data_end - data_begin));
+  std::vector<Trajectory> trajectories;
+  const char *p = begin;
+  while (p < end) {
+    Trajectory trajectory = read_trajectory(&p, end);
+    if (trajectory.geom.get_num_points() > 0) {
+      trajectories.push_back(std::move(trajectory));
+    }
   }
-  return Trajectory{trid, geom, timestamps};
+  SPDLOG_DEBUG("Chunk {} trajectories {}", chunk_index, trajectories.size());
+  return trajectories;
 }
 
 bool CSVPointReader::has_next_trajectory() {
-  return ifs.peek() != EOF;
+  // Empty lines are skipped
+  while (cursor < data_end && (*cursor == '\n' || *cursor == '\r')) {
+    ++cursor;
+  }
+  return cursor < data_end;
 }
 
 void CSVPointReader::reset_cursor() {
-  ifs.clear();
-  ifs.seekg(0, std::ios::beg);
-  std::string line;
-  std::getline(ifs, line);
+  cursor = data_begin;
 }
 
 void CSVPointReader::close() {
-  ifs.close();
+  file.reset();
+  data_begin = cursor = data_end = nullptr;
 }
 
 bool CSVPointReader::has_timestamp() {
   return timestamp_idx > 0;
 }
 
+BinaryTrajectoryReader::BinaryTrajectoryReader(const std::string &filename) :
+  file(new MMapFile(filename)) {
+  BinaryTrajectoryHeader header;
+  if (file->size() < sizeof(header)) {
+    std::string message = "Invalid binary trajectory file " + filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, BINARY_TRAJECTORY_MAGIC,
+                  sizeof(header.magic)) != 0 ||
+      header.version != BINARY_TRAJECTORY_VERSION) {
+    std::string message = "Invalid binary trajectory file " + filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  // The counts are checked against the file size before computing the
+  // expected size, which could overflow with a corrupt header
+  uint64_t max_count = file->size() / sizeof(double);
+  if ((header.flags & ~uint32_t(BINARY_TRAJECTORY_TIMESTAMP)) != 0 ||
+      header.num_trajectories > max_count ||
+      header.num_points > max_count) {
+    std::string message = "Invalid binary trajectory file header " +
+                          filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  num_trajectories = header.num_trajectories;
+  num_points = header.num_points;
+  bool timestamp_stored = (header.flags & BINARY_TRAJECTORY_TIMESTAMP) != 0;
+  uint64_t expected_size = sizeof(header) +
+    sizeof(int64_t) * num_trajectories +
+    sizeof(uint64_t) * (num_trajectories + 1) +
+    sizeof(double) * num_points * (timestamp_stored ? 3 : 2);
+  if (file->size() != expected_size) {
+    std::string message = (boost::format(
+      "Binary trajectory file %1% size %2% differs from %3%")
+      % filename % file->size() % expected_size).str();
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  const char *p = file->data() + sizeof(header);
+  ids = reinterpret_cast<const int64_t *>(p);
+  p += sizeof(int64_t) * num_trajectories;
+  offsets = reinterpret_cast<const uint64_t *>(p);
+  p += sizeof(uint64_t) * (num_trajectories + 1);
+  xs = reinterpret_cast<const double *>(p);
+  ys = xs + num_points;
+  if (timestamp_stored) {
+    timestamps = ys + num_points;
+  }
+  // The points of a trajectory are read without bound checks
+  bool offsets_valid = offsets[0] == 0 &&
+    offsets[num_trajectories] == num_points;
+  for (std::size_t i = 0; offsets_valid && i < num_trajectories; ++i) {
+    offsets_valid = offsets[i] <= offsets[i + 1];
+  }
+  if (!offsets_valid) {
+    std::string message = "Invalid binary trajectory offsets " + filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  SPDLOG_INFO("Binary trajectories {} points {}",
+              num_trajectories, num_points);
+}
+
+Trajectory BinaryTrajectoryReader::get_trajectory(std::size_t index) const {
+  Trajectory trajectory;
+  trajectory.id = ids[index];
+  std::size_t begin = offsets[index];
+  std::size_t end = offsets[index + 1];
+  trajectory.geom.get_geometry().reserve(end - begin);
+  for (std::size_t i = begin; i < end; ++i) {
+    trajectory.geom.add_point(xs[i], ys[i]);
+  }
+  if (timestamps != nullptr) {
+    trajectory.timestamps.assign(timestamps + begin, timestamps + end);
+  }
+  return trajectory;
+}
+
+Trajectory BinaryTrajectoryReader::read_next_trajectory() {
+  return get_trajectory(cursor++);
+}
+
+bool BinaryTrajectoryReader::has_next_trajectory() {
+  return cursor < num_trajectories;
+}
+
+bool BinaryTrajectoryReader::has_timestamp() {
+  return timestamps != nullptr;
+}
+
+void BinaryTrajectoryReader::reset_cursor() {
+  cursor = 0;
+}
+
+void BinaryTrajectoryReader::close() {
+  file.reset();
+  ids = nullptr;
+  offsets = nullptr;
+  xs = ys = timestamps = nullptr;
+  num_trajectories = num_points = cursor = 0;
+}
+
+std::size_t BinaryTrajectoryReader::get_chunk_points(
+  std::size_t chunk_size) const {
+  std::size_t point_size = sizeof(double) * (timestamps ? 3 : 2);
+  return std::max<std::size_t>(chunk_size / point_size, 1);
+}
+
+std::size_t BinaryTrajectoryReader::get_num_chunks(
+  std::size_t chunk_size) const {
+  if (num_trajectories == 0) return 0;
+  std::size_t chunk_points = get_chunk_points(chunk_size);
+  return std::max<std::size_t>(
+    (num_points + chunk_points - 1) / chunk_points, 1);
+}
+
+std::vector<Trajectory> BinaryTrajectoryReader::read_chunk(
+  std::size_t chunk_index, std::size_t chunk_size) const {
+  // A chunk contains the trajectories whose first point is in it
+  std::size_t chunk_points = get_chunk_points(chunk_size);
+  std::size_t first = std::lower_bound(
+    offsets, offsets + num_trajectories,
+    static_cast<uint64_t>(chunk_index * chunk_points)) - offsets;
+  std::size_t last = num_trajectories;
+  if (chunk_index + 1 < get_num_chunks(chunk_size)) {
+    last = std::lower_bound(
+      offsets, offsets + num_trajectories,
+      static_cast<uint64_t>((chunk_index + 1) * chunk_points)) - offsets;
+  }
+  std::vector<Trajectory> trajectories;
+  trajectories.reserve(last > first ? last - first : 0);
+  for (std::size_t i = first; i < last; ++i) {
+    trajectories.push_back(get_trajectory(i));
+  }
+  return trajectories;
+}
+
+MultiFileTrajectoryReader::MultiFileTrajectoryReader(
+  const FMM::CONFIG::GPSConfig &config) {
+  for (const std::string &file : config.get_files()) {
+    FMM::CONFIG::GPSConfig file_config = config;
+    file_config.file = file;
+    int mode = FMM::CONFIG::GPSConfig::get_file_format(
+      file, config.gps_point);
+    configs.push_back(file_config);
+    modes.push_back(mode);
+    if (mode != 2 && mode != 3) chunked = false;
+  }
+  readers.resize(configs.size());
+  SPDLOG_INFO("GPS files {}", configs.size());
+}
+
+std::shared_ptr<ITrajectoryReader> MultiFileTrajectoryReader::get_reader(
+  std::size_t index) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (readers[index] == nullptr) {
+    SPDLOG_DEBUG("Open GPS file {}", configs[index].file);
+    readers[index] = GPSReader::create_reader(configs[index], modes[index]);
+  }
+  return readers[index];
+}
+
+Trajectory MultiFileTrajectoryReader::read_next_trajectory() {
+  has_next_trajectory();
+  return get_reader(current)->read_next_trajectory();
+}
+
+bool MultiFileTrajectoryReader::has_next_trajectory() {
+  while (current < configs.size() &&
+         !get_reader(current)->has_next_trajectory()) {
+    // The file is closed once it is read
+    std::lock_guard<std::mutex> lock(mutex);
+    readers[current]->close();
+    readers[current].reset();
+    ++current;
+  }
+  return current < configs.size();
+}
+
+bool MultiFileTrajectoryReader::has_timestamp() {
+  if (configs.empty()) return false;
+  return get_reader(std::min(current, configs.size() - 1))->has_timestamp();
+}
+
+void MultiFileTrajectoryReader::close() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (std::shared_ptr<ITrajectoryReader> &reader : readers) {
+    if (reader != nullptr) reader->close();
+    reader.reset();
+  }
+  current = configs.size();
+}
+
+std::vector<Trajectory> MultiFileTrajectoryReader::read_next_N_trajectories(
+  int N) {
+  // Batches are read from each file to keep its parallel parsing
+  std::vector<Trajectory> trajectories;
+  while (trajectories.size() < N && has_next_trajectory()) {
+    std::vector<Trajectory> batch = get_reader(current)->
+      read_next_N_trajectories(N - trajectories.size());
+    trajectories.insert(trajectories.end(),
+                        std::make_move_iterator(batch.begin()),
+                        std::make_move_iterator(batch.end()));
+  }
+  return trajectories;
+}
+
+const std::vector<std::size_t> &MultiFileTrajectoryReader::get_file_chunks(
+  std::size_t chunk_size) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (file_chunk_size != chunk_size || file_chunks.empty()) {
+    file_chunks.assign(configs.size(), 0);
+    chunks_read.assign(configs.size(), 0);
+    for (std::size_t i = 0; i < configs.size(); ++i) {
+      // The files not open yet are only opened to count their chunks
+      std::shared_ptr<ITrajectoryReader> reader = readers[i] != nullptr ?
+        readers[i] : GPSReader::create_reader(configs[i], modes[i]);
+      file_chunks[i] = reader->get_num_chunks(chunk_size);
+    }
+    file_chunk_size = chunk_size;
+  }
+  return file_chunks;
+}
+
+std::size_t MultiFileTrajectoryReader::get_num_chunks(
+  std::size_t chunk_size) const {
+  if (!chunked) return 0;
+  const std::vector<std::size_t> &counts = get_file_chunks(chunk_size);
+  return std::accumulate(counts.begin(), counts.end(), std::size_t(0));
+}
+
+std::vector<Trajectory> MultiFileTrajectoryReader::read_chunk(
+  std::size_t chunk_index, std::size_t chunk_size) const {
+  const std::vector<std::size_t> &counts = get_file_chunks(chunk_size);
+  for (std::size_t i = 0; i < counts.size(); ++i) {
+    if (chunk_index >= counts[i]) {
+      chunk_index -= counts[i];
+      continue;
+    }
+    std::vector<Trajectory> trajectories =
+      get_reader(i)->read_chunk(chunk_index, chunk_size);
+    // The file is closed once all its chunks are read, the workers still
+    // reading it keep their reference
+    std::lock_guard<std::mutex> lock(mutex);
+    if (++chunks_read[i] == counts[i]) readers[i].reset();
+    return trajectories;
+  }
+  return {};
+}
+
 GPSReader::GPSReader(const FMM::CONFIG::GPSConfig &config) {
   mode = config.get_gps_format();
+  std::vector<std::string> files = config.get_files();
+  if (files.size() > 1) {
+    SPDLOG_INFO("GPS data in {} files", files.size());
+    reader = std::make_shared<MultiFileTrajectoryReader>(config);
+  } else {
+    // The file can be given by a pattern or a folder
+    FMM::CONFIG::GPSConfig file_config = config;
+    if (!files.empty()) file_config.file = files[0];
+    reader = create_reader(file_config, mode);
+  }
+};
+
+std::shared_ptr<ITrajectoryReader> GPSReader::create_reader(
+  const FMM::CONFIG::GPSConfig &config, int mode) {
   if (mode == 0) {
     SPDLOG_INFO("GPS data in trajectory shapefile format");
-    reader = std::make_shared<GDALTrajectoryReader>
-               (config.file, config.id,config.timestamp);
+    return std::make_shared<GDALTrajectoryReader>
+             (config.file, config.id,config.timestamp);
   } else if (mode == 1) {
     SPDLOG_INFO("GPS data in trajectory CSV format");
-    reader = std::make_shared<CSVTrajectoryReader>
-               (config.file, config.id, config.geom, config.timestamp);
+    return std::make_shared<CSVTrajectoryReader>
+             (config.file, config.id, config.geom, config.timestamp);
   } else if (mode == 2) {
     SPDLOG_INFO("GPS data in point CSV format");
-    reader = std::make_shared<CSVPointReader>
-               (config.file, config.id, config.x, config.y, config.timestamp);
+    return std::make_shared<CSVPointReader>
+             (config.file, config.id, config.x, config.y, config.timestamp);
+  } else if (mode == 3) {
+    SPDLOG_INFO("GPS data in binary trajectory format");
+    return std::make_shared<BinaryTrajectoryReader>(config.file);
   } else {
     std::string message = "Unrecognized GPS format";
     SPDLOG_CRITICAL(message);
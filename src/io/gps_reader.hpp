@@ -12,9 +12,14 @@
 
 #include "core/gps.hpp"
 #include "config/gps_config.hpp"
+#include "io/binary_trajectory.hpp"
+#include "io/mmap_file.hpp"
+#include "io/text_parser.hpp"
 
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
 
 namespace FMM {
@@ -54,12 +59,36 @@ public:
    * @param N the number of trajectories to read
    * @return a vector of trajectories.
    */
-  std::vector<FMM::CORE::Trajectory> read_next_N_trajectories(int N = 1000);
+  virtual std::vector<FMM::CORE::Trajectory> read_next_N_trajectories(
+    int N = 1000);
   /**
    * Read all the remaining trajectories in a file
    * @return a vector of trajectories
    */
   std::vector<FMM::CORE::Trajectory> read_all_trajectories();
+  /**
+   * Get the number of chunks the file is split into for reading in
+   * parallel with read_chunk.
+   * @param chunk_size the size of a chunk in bytes
+   * @return the number of chunks, 0 if the reader does not support
+   * reading chunks
+   */
+  virtual std::size_t get_num_chunks(std::size_t chunk_size) const {
+    return 0;
+  };
+  /**
+   * Read the trajectories of a chunk of the file. It can be called
+   * concurrently and does not move the cursor of read_next_trajectory.
+   * The chunks of a file contain each trajectory exactly once, in the
+   * order of the chunk index.
+   * @param chunk_index index of the chunk, smaller than get_num_chunks
+   * @param chunk_size the size of a chunk in bytes
+   * @return the trajectories starting in the chunk, which can be empty
+   */
+  virtual std::vector<FMM::CORE::Trajectory> read_chunk(
+    std::size_t chunk_index, std::size_t chunk_size) const {
+    return {};
+  };
 };
 
 /**
@@ -111,6 +140,9 @@ private:
  * Example:
  *    id;geom;timestamp
  *    1;LineString(1 0,1 1);1,1
+ *
+ * The file is mapped into memory and the lines are parsed in place, a
+ * batch of lines read by read_next_N_trajectories is parsed in parallel.
  */
 class CSVTrajectoryReader : public ITrajectoryReader {
 public:
@@ -156,8 +188,27 @@ public:
    * @return a vector of timestamps
    */
   static std::vector<double> string2time(const std::string &str);
+  /**
+   * Read the next N trajectories in the file, the lines are parsed
+   * in parallel with OpenMP.
+   * @param N the number of trajectories to read
+   * @return a vector of trajectories.
+   */
+  std::vector<FMM::CORE::Trajectory> read_next_N_trajectories(
+    int N = 1000) override;
 private:
-  std::fstream ifs;
+  /**
+   * Parse a line of the file into a trajectory
+   * @param line a line of the file
+   * @param trajectory the trajectory parsed, which will be updated
+   * @return false if the line is invalid
+   */
+  bool parse_trajectory(const TextSpan &line,
+                        FMM::CORE::Trajectory *trajectory) const;
+  std::unique_ptr<MMapFile> file;
+  const char *data_begin = nullptr; // Start of the first line after header
+  const char *cursor = nullptr;
+  const char *data_end = nullptr;
   int id_idx = -1;
   int geom_idx = -1;
   int timestamp_idx = -1; // Index of the id column in shapefile
@@ -177,6 +228,11 @@ private:
  *    id;x;y;timestamp
  *    1;1;1;1
  *    1;1;2;2
+ *
+ * The file is mapped into memory and the lines are parsed in place.
+ * The file can also be read in chunks in parallel, where the boundary of
+ * a chunk is moved forward to the next line whose id differs from the
+ * line before it, so that a trajectory is never split between chunks.
  */
 class CSVPointReader : public ITrajectoryReader {
 public:
@@ -218,9 +274,43 @@ public:
    * Close the reader object
    */
   void close() override;
+  std::size_t get_num_chunks(std::size_t chunk_size) const override;
+  std::vector<FMM::CORE::Trajectory> read_chunk(
+    std::size_t chunk_index, std::size_t chunk_size) const override;
 private:
-  std::string prev_line = "";
-  std::fstream ifs;
+  /**
+   * Read the points of a trajectory
+   * @param position the start of the trajectory, which is moved to the
+   * start of the next trajectory
+   * @param end the end of the text to read
+   * @return the trajectory, which is empty if position reaches end
+   */
+  FMM::CORE::Trajectory read_trajectory(const char **position,
+                                        const char *end) const;
+  /**
+   * Move a position of the file to the start of the first trajectory
+   * at or after it
+   * @param position a position between the header and the end of file
+   * @return the start of a line whose id differs from the line before
+   * it, or the end of the file
+   */
+  const char *align_to_trajectory(const char *position) const;
+  /**
+   * Parse a line of the file into a point
+   * @param line a line of the file
+   * @param id the trajectory id, which will be updated
+   * @param x the x coordinate, which will be updated
+   * @param y the y coordinate, which will be updated
+   * @param timestamp the timestamp, which will be updated if the file
+   * contains timestamp
+   * @return false if the line is invalid
+   */
+  bool parse_point(const TextSpan &line, int *id, double *x, double *y,
+                   double *timestamp) const;
+  std::unique_ptr<MMapFile> file;
+  const char *data_begin = nullptr; // Start of the first line after header
+  const char *cursor = nullptr;
+  const char *data_end = nullptr;
   int id_idx = -1;
   int x_idx = -1;
   int y_idx = -1;
@@ -228,6 +318,117 @@ private:
   char delim = ';';
 }; // CSVTemporalTrajectoryReader
 
+/**
+ * Trajectory Reader class for binary trajectory file, which is written
+ * by BinaryTrajectoryWriter, see BinaryTrajectoryHeader for the format.
+ *
+ * The file is mapped into memory and the columns are read in place, so
+ * a trajectory is copied from the file without any parsing. Trajectories
+ * can also be read by index, and chunks of the file contain the
+ * trajectories starting in a range of points.
+ */
+class BinaryTrajectoryReader : public ITrajectoryReader {
+public:
+  /**
+   * Constructor of BinaryTrajectoryReader
+   * @param filename input file name
+   * @throw std::runtime_error if the file is not a valid binary
+   * trajectory file
+   */
+  explicit BinaryTrajectoryReader(const std::string &filename);
+  /**
+   * Reset cursor of the reader
+   */
+  void reset_cursor();
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  void close() override;
+  std::size_t get_num_chunks(std::size_t chunk_size) const override;
+  std::vector<FMM::CORE::Trajectory> read_chunk(
+    std::size_t chunk_index, std::size_t chunk_size) const override;
+  /**
+   * Get the number of trajectories in the file
+   */
+  inline std::size_t get_num_trajectories() const {
+    return num_trajectories;
+  };
+  /**
+   * Read a trajectory by index, which can be called concurrently
+   * @param index index of the trajectory, smaller than
+   * get_num_trajectories
+   * @return the trajectory
+   */
+  FMM::CORE::Trajectory get_trajectory(std::size_t index) const;
+private:
+  /**
+   * Get the number of points of a chunk
+   * @param chunk_size the size of a chunk in bytes
+   */
+  std::size_t get_chunk_points(std::size_t chunk_size) const;
+  std::unique_ptr<MMapFile> file;
+  const int64_t *ids = nullptr;
+  const uint64_t *offsets = nullptr;
+  const double *xs = nullptr;
+  const double *ys = nullptr;
+  const double *timestamps = nullptr; // nullptr if not stored
+  std::size_t num_trajectories = 0;
+  std::size_t num_points = 0;
+  std::size_t cursor = 0;
+}; // BinaryTrajectoryReader
+
+/**
+ * Trajectory Reader class for several GPS files, which are read one
+ * after another as a single file.
+ *
+ * If all the files are in a format read in chunks, the chunks of the
+ * files are numbered in the order of the files so that chunks of
+ * different files are read in parallel.
+ *
+ * A file is opened when it is first read and closed once all its
+ * trajectories or chunks are read, so that only a few files are open at
+ * the same time.
+ */
+class MultiFileTrajectoryReader : public ITrajectoryReader {
+public:
+  /**
+   * Constructor of MultiFileTrajectoryReader, no file is opened.
+   * @param config configuration of the GPS data, whose files are given
+   * by GPSConfig::get_files
+   */
+  explicit MultiFileTrajectoryReader(const FMM::CONFIG::GPSConfig &config);
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  void close() override;
+  std::vector<FMM::CORE::Trajectory> read_next_N_trajectories(
+    int N = 1000) override;
+  std::size_t get_num_chunks(std::size_t chunk_size) const override;
+  std::vector<FMM::CORE::Trajectory> read_chunk(
+    std::size_t chunk_index, std::size_t chunk_size) const override;
+private:
+  /**
+   * Get the reader of a file, which is opened if needed
+   * @param index index of the file
+   */
+  std::shared_ptr<ITrajectoryReader> get_reader(std::size_t index) const;
+  /**
+   * Get the number of chunks of each file
+   * @param chunk_size size of a chunk in bytes
+   */
+  const std::vector<std::size_t> &get_file_chunks(
+    std::size_t chunk_size) const;
+  std::vector<FMM::CONFIG::GPSConfig> configs; // Configuration of each file
+  std::vector<int> modes; // Format of each file
+  mutable std::vector<std::shared_ptr<ITrajectoryReader>> readers;
+  mutable std::mutex mutex; // Protects the readers and the chunk counts
+  mutable std::vector<std::size_t> file_chunks; // Chunks of each file
+  mutable std::vector<std::size_t> chunks_read; // Chunks read of each file
+  mutable std::size_t file_chunk_size = 0; // Chunk size of file_chunks
+  std::size_t current = 0; // Index of the file read
+  bool chunked = true; // All the files are read in chunks
+}; // MultiFileTrajectoryReader
+
 /**
  * %GPSReader class, a wrapper makes it easier to read data from
  * a file by specifying GPSConfig as input.
@@ -240,6 +441,14 @@ public:
    * determined from it automatically.
    */
   GPSReader(const FMM::CONFIG::GPSConfig &config);
+  /**
+   * Create the reader of a GPS file
+   * @param config configuration of GPS data, whose file is a single file
+   * @param mode the format of the file, see GPSConfig::get_gps_format
+   * @return the reader
+   */
+  static std::shared_ptr<ITrajectoryReader> create_reader(
+    const FMM::CONFIG::GPSConfig &config, int mode);
   /**
    * Read the next trajectory in the file.
    * @return A trajectory object
@@ -254,6 +463,12 @@ public:
   inline bool has_next_trajectory() {
     return reader->has_next_trajectory();
   };
+  /**
+   * Check if the file contains timestamp information
+   */
+  inline bool has_timestamp() {
+    return reader->has_timestamp();
+  };
   /**
    * Read next N trajectories from the file. If there are k trajectories left
    * k<N, then only k trajectories will be returned.
@@ -271,6 +486,24 @@ public:
   inline std::vector<FMM::CORE::Trajectory> read_all_trajectories() {
     return reader->read_all_trajectories();
   };
+  /**
+   * Get the number of chunks the file is split into for reading in
+   * parallel, 0 if the format does not support it
+   * @param chunk_size the size of a chunk in bytes
+   */
+  inline std::size_t get_num_chunks(std::size_t chunk_size) const {
+    return reader->get_num_chunks(chunk_size);
+  };
+  /**
+   * Read the trajectories of a chunk, which can be called concurrently
+   * @param chunk_index index of the chunk
+   * @param chunk_size the size of a chunk in bytes
+   * @return the trajectories starting in the chunk
+   */
+  inline std::vector<FMM::CORE::Trajectory> read_chunk(
+    std::size_t chunk_index, std::size_t chunk_size) const {
+    return reader->read_chunk(chunk_index, chunk_size);
+  };
 private:
   std::shared_ptr<ITrajectoryReader> reader;
   int mode; /**< Mode marking the type of GPS data stored in the file */
@@ -0,0 +1,30 @@
+#include "io/gps_sort_app.hpp"
+#include "io/gps_sorter.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+#include <omp.h>
+
+using namespace FMM;
+using namespace FMM::IO;
+
+void GPSSortApp::run() const {
+  std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+  SPDLOG_INFO("Write sorted points to file {}", config_.result_file);
+  std::string tmp_dir = config_.tmp_dir.empty() ?
+      UTIL::get_file_directory(config_.result_file) : config_.tmp_dir;
+  int num_threads = config_.use_omp ? omp_get_max_threads() : 1;
+  CSVPointSorter sorter(config_.gps_config.id, config_.gps_config.timestamp,
+                        std::size_t(config_.memory_limit) << 20, tmp_dir,
+                        num_threads);
+  // The file can be given by a pattern or a folder
+  std::size_t num_points = sorter.sort(config_.gps_config.get_files()[0],
+                                       config_.result_file);
+  std::chrono::steady_clock::time_point end =
+      std::chrono::steady_clock::now();
+  double time_spent =
+      std::chrono::duration_cast<std::chrono::milliseconds>
+          (end - begin).count() / 1000.;
+  SPDLOG_INFO("Points sorted {}", num_points);
+  SPDLOG_INFO("Time takes {}", time_spent);
+};
@@ -0,0 +1,39 @@
+/**
+ * Fast map matching.
+ *
+ * gps_sort command line program
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_IO_GPS_SORT_APP_HPP_
+#define FMM_SRC_IO_GPS_SORT_APP_HPP_
+
+#include "io/gps_sort_app_config.hpp"
+
+namespace FMM {
+namespace IO {
+/**
+ * gps_sort command line program, which sorts a CSV point file by id and
+ * timestamp with CSVPointSorter
+ */
+class GPSSortApp {
+public:
+  /**
+   * Constructor
+   * @param config Configuration data
+   */
+  GPSSortApp(const GPSSortAppConfig &config) : config_(config) {
+  };
+  /**
+   * Run the sorting
+   */
+  void run() const;
+private:
+  const GPSSortAppConfig &config_;
+};
+}
+}
+
+#endif //FMM_SRC_IO_GPS_SORT_APP_HPP_
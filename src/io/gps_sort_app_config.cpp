@@ -0,0 +1,126 @@
+#include "io/gps_sort_app_config.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+
+using namespace FMM;
+using namespace FMM::IO;
+using namespace FMM::CONFIG;
+
+GPSSortAppConfig::GPSSortAppConfig(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  load_arg(argc, argv);
+  spdlog::set_level((spdlog::level::level_enum) log_level);
+  if (!help_specified)
+    print();
+}
+
+void GPSSortAppConfig::load_arg(int argc, char **argv) {
+  SPDLOG_INFO("Start reading gps_sort configuration from arguments");
+  cxxopts::Options options("config",
+                           "Configuration parser of gps_sort");
+  // Register options
+  GPSConfig::register_arg(options);
+  options.add_options()
+    ("o,output", "Output file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("tmp_dir", "Folder of temporary files",
+    cxxopts::value<std::string>()->default_value(""))
+    ("memory_limit", "Memory used for sorting in MB",
+    cxxopts::value<int>()->default_value("1024"))
+    ("l,log_level", "Log level", cxxopts::value<int>()->default_value("2"))
+    ("h,help",   "Help information")
+    ("use_omp","Use parallel computing if specified");
+  if (argc==1) {
+    help_specified = true;
+    return;
+  }
+  // Parse options
+  auto result = options.parse(argc, argv);
+  // Read options
+  gps_config = GPSConfig::load_from_arg(result);
+  gps_config.gps_point = true;
+  result_file = result["output"].as<std::string>();
+  tmp_dir = result["tmp_dir"].as<std::string>();
+  memory_limit = result["memory_limit"].as<int>();
+  log_level = result["log_level"].as<int>();
+  use_omp = result.count("use_omp")>0;
+  if (result.count("help")>0) {
+    help_specified = true;
+  }
+  SPDLOG_INFO("Finish with reading gps_sort arg configuration");
+}
+
+void GPSSortAppConfig::print() const {
+  SPDLOG_INFO("----    Print configuration   ----");
+  gps_config.print();
+  SPDLOG_INFO("Output file {}",result_file);
+  SPDLOG_INFO("Temporary folder {}",
+              tmp_dir.empty() ? UTIL::get_file_directory(result_file)
+                              : tmp_dir);
+  SPDLOG_INFO("Memory limit {} MB",memory_limit);
+  SPDLOG_INFO("Log level {}",UTIL::LOG_LEVESLS[log_level]);
+  SPDLOG_INFO("Use omp {}",(use_omp ? "true" : "false"));
+  SPDLOG_INFO("---- Print configuration done ----");
+}
+
+void GPSSortAppConfig::print_help() {
+  std::ostringstream oss;
+  oss << "gps_sort argument lists:\n";
+  oss << "--gps (required) <string>: GPS point file name\n";
+  oss << "--gps_id (optional) <string>: GPS id name (id)\n";
+  oss << "--gps_timestamp (optional) <string>: "
+    "GPS timestamp name (timestamp)\n";
+  oss << "-o/--output (required) <string>: Output file name\n";
+  oss << "--tmp_dir (optional) <string>: folder of temporary files "
+    "(folder of the output file)\n";
+  oss << "--memory_limit (optional) <int>: memory used for sorting "
+    "in MB (1024)\n";
+  oss << "-l/--log_level (optional) <int>: log level (2)\n";
+  oss << "--use_omp: sort and merge runs with multiple threads\n";
+  oss << "-h/--help: help information\n";
+  oss << "The points are sorted by id and timestamp, so that the output "
+    "can be read with --gps_point\n";
+  std::cout<<oss.str();
+}
+
+bool GPSSortAppConfig::validate() const {
+  SPDLOG_INFO("Validating configuration for GPS sorting");
+  if (!gps_config.validate()) {
+    return false;
+  }
+  if (gps_config.get_files().size()!=1) {
+    SPDLOG_CRITICAL("Only a single GPS file can be sorted");
+    return false;
+  }
+  if (gps_config.get_gps_format()!=2) {
+    SPDLOG_CRITICAL("Only CSV point file can be sorted");
+    return false;
+  }
+  if (result_file == gps_config.file) {
+    SPDLOG_CRITICAL("Output file should differ from the GPS file");
+    return false;
+  }
+  if (UTIL::file_exists(result_file)) {
+    SPDLOG_WARN("Overwrite result file {}", result_file);
+  }
+  std::string output_folder = UTIL::get_file_directory(result_file);
+  if (!UTIL::folder_exist(output_folder)) {
+    SPDLOG_CRITICAL("Output folder {} not exists", output_folder);
+    return false;
+  }
+  if (!tmp_dir.empty() && !UTIL::folder_exist(tmp_dir)) {
+    SPDLOG_CRITICAL("Temporary folder {} not exists", tmp_dir);
+    return false;
+  }
+  if (memory_limit <= 0) {
+    SPDLOG_CRITICAL("Memory limit {} should be positive", memory_limit);
+    return false;
+  }
+  if (log_level < 0 || log_level > UTIL::LOG_LEVESLS.size()) {
+    SPDLOG_CRITICAL("Invalid log_level {}, which should be 0 - 6", log_level);
+    SPDLOG_INFO("0-trace,1-debug,2-info,3-warn,4-err,5-critical,6-off");
+    return false;
+  }
+  SPDLOG_INFO("Validating done.");
+  return true;
+}
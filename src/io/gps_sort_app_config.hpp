@@ -0,0 +1,60 @@
+/**
+ * Fast map matching.
+ *
+ * gps_sort command line program configuration
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_IO_GPS_SORT_APP_CONFIG_HPP_
+#define FMM_SRC_IO_GPS_SORT_APP_CONFIG_HPP_
+
+#include "config/gps_config.hpp"
+
+namespace FMM {
+namespace IO {
+/**
+ * Configuration of gps_sort command line program
+ */
+class GPSSortAppConfig {
+public:
+  /**
+   * Constructor of Configuration of gps_sort command line program
+   * @param argc number of argument
+   * @param argv argument data
+   */
+  GPSSortAppConfig(int argc, char **argv);
+  /**
+   * Load configuration from arguments
+   * @param argc number of argument
+   * @param argv argument data
+   */
+  void load_arg(int argc, char **argv);
+  /**
+   * Print information
+   */
+  void print() const;
+  /**
+   * Check the validity of the configuration
+   * @return true if valid otherwise false
+   */
+  bool validate() const;
+  /**
+   * Print help information
+   */
+  static void print_help();
+  CONFIG::GPSConfig gps_config; /**< GPS point file to sort */
+  std::string result_file; /**< Sorted file */
+  std::string tmp_dir; /**< Folder of temporary files, the folder of the
+                            result file if empty */
+  int memory_limit = 1024; /**< Memory used for sorting in MB */
+  int log_level = 2; /**< Level level. 0-trace,1-debug,2-info,3-warn,4-err,
+                         5-critical,6-off */
+  bool use_omp = false; /**< If true, parallel sorting performed */
+  bool help_specified = false; /**< Help is specified or not */
+}; // GPSSortAppConfig
+}
+}
+
+#endif //FMM_SRC_IO_GPS_SORT_APP_CONFIG_HPP_
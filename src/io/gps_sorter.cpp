@@ -0,0 +1,369 @@
+/**
+ * Content
+ * Definition of CSVPointSorter Class, which sorts a CSV point file by id
+ * and timestamp with an external merge sort.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/gps_sorter.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <omp.h>
+#include <unistd.h>
+
+namespace FMM {
+
+namespace IO {
+
+/**
+ * Reader of the records of a run, each record is stored as the id,
+ * the timestamp, the length of the line and the line.
+ */
+struct CSVPointSorter::RunReader {
+  RunReader(const std::string &filename, std::size_t buffer_size) :
+    buffer(buffer_size) {
+    stream.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    stream.open(filename, std::ios::binary);
+    if (!stream.is_open()) {
+      std::string message = "Open temporary file fail " + filename;
+      SPDLOG_CRITICAL(message);
+      throw std::runtime_error(message);
+    }
+  };
+  /**
+   * Read the next record
+   * @return false if the run is exhausted
+   */
+  bool next() {
+    uint32_t length = 0;
+    if (!stream.read(reinterpret_cast<char *>(&id), sizeof(id))) {
+      return false;
+    }
+    stream.read(reinterpret_cast<char *>(&timestamp), sizeof(timestamp));
+    stream.read(reinterpret_cast<char *>(&length), sizeof(length));
+    line.resize(length);
+    stream.read(&line[0], length);
+    if (!stream) {
+      std::string message = "Temporary file truncated";
+      SPDLOG_CRITICAL(message);
+      throw std::runtime_error(message);
+    }
+    return true;
+  };
+  std::vector<char> buffer;
+  std::ifstream stream;
+  long long id = 0;
+  double timestamp = 0;
+  std::string line;
+};
+
+CSVPointSorter::CSVPointSorter(const std::string &id_name,
+                               const std::string &time_name,
+                               std::size_t memory_limit,
+                               const std::string &tmp_dir,
+                               int num_threads) :
+  id_name_(id_name), time_name_(time_name), memory_limit_(memory_limit),
+  tmp_dir_(tmp_dir.empty() ? "." : tmp_dir),
+  num_threads_(num_threads > 0 ? num_threads : 1) {
+}
+
+CSVPointSorter::~CSVPointSorter() {
+  for (const std::string &file : spill_files_) {
+    std::remove(file.c_str());
+  }
+}
+
+std::size_t CSVPointSorter::sort(const std::string &input_file,
+                                 const std::string &output_file) {
+  std::ifstream ifs(input_file, std::ios::binary);
+  if (!ifs.is_open()) {
+    std::string message = "Open file fail " + input_file;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  std::string header;
+  std::getline(ifs, header);
+  if (!header.empty() && header.back() == '\r') header.pop_back();
+  read_header(header);
+  std::size_t num_points = 0;
+  std::vector<std::string> runs = create_runs(ifs, &num_points);
+  SPDLOG_INFO("Points {} runs {}", num_points, runs.size());
+  while (runs.size() > MAX_MERGE_FILES) {
+    runs = merge_pass(runs);
+    SPDLOG_INFO("Runs left after merge {}", runs.size());
+  }
+  std::size_t buffer_size = std::max<std::size_t>(
+    std::min<std::size_t>(memory_limit_ / (runs.size() + 1), 1 << 24),
+    1 << 16);
+  merge_runs(runs, output_file, header, true, buffer_size);
+  return num_points;
+}
+
+void CSVPointSorter::read_header(const std::string &header) {
+  TextSpan line{header.data(), header.data() + header.size()};
+  std::vector<TextSpan> fields;
+  split_line(line, delim_, &fields);
+  for (int i = 0; i < fields.size(); ++i) {
+    std::string name = fields[i].str();
+    if (name == id_name_) {
+      id_idx_ = i;
+    }
+    if (name == time_name_) {
+      timestamp_idx_ = i;
+    }
+  }
+  if (id_idx_ < 0) {
+    std::string message = "Id column " + id_name_ + " not found";
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  if (timestamp_idx_ < 0) {
+    SPDLOG_WARN("Time stamp {} not found, points are sorted by id only",
+                time_name_);
+  }
+  SPDLOG_INFO("Id index {} time index {}", id_idx_, timestamp_idx_);
+}
+
+bool CSVPointSorter::parse_key(const TextSpan &line, long long *id,
+                               double *timestamp) const {
+  bool id_found = false;
+  *timestamp = 0;
+  int index = 0;
+  const char *p = line.begin;
+  while (true) {
+    const char *field_end = static_cast<const char *>(
+      std::memchr(p, delim_, line.end - p));
+    if (field_end == nullptr) field_end = line.end;
+    TextSpan field{p, field_end};
+    if (index == id_idx_) {
+      if (!parse_int(field, id)) return false;
+      id_found = true;
+    }
+    const char *value_cursor = field.begin;
+    if (index == timestamp_idx_ &&
+        !parse_double(&value_cursor, field.end, timestamp)) {
+      return false;
+    }
+    if (field_end == line.end) break;
+    p = field_end + 1;
+    ++index;
+  }
+  return id_found;
+}
+
+std::vector<std::string> CSVPointSorter::create_runs(
+  std::ifstream &ifs, std::size_t *num_points) {
+  // The text and the keys of a run take about the same memory
+  std::size_t run_size = std::max<std::size_t>(
+    std::min(memory_limit_ / (2 * num_threads_), MAX_RUN_SIZE), 1 << 16);
+  std::vector<std::string> runs;
+  std::vector<std::string> texts(num_threads_);
+  std::string carry; // Incomplete line at the end of the previous read
+  bool at_end = false;
+  while (!at_end) {
+    // Read a run for each thread
+    int num_texts = 0;
+    for (; num_texts < num_threads_ && !at_end; ++num_texts) {
+      std::string &text = texts[num_texts];
+      text.swap(carry);
+      carry.clear();
+      while (true) {
+        std::size_t old_size = text.size();
+        std::size_t to_read = old_size < run_size ? run_size - old_size
+                                                  : run_size;
+        text.resize(old_size + to_read);
+        ifs.read(&text[old_size], to_read);
+        text.resize(old_size + ifs.gcount());
+        if (static_cast<std::size_t>(ifs.gcount()) < to_read) {
+          at_end = true;
+          break;
+        }
+        std::size_t last_break = text.rfind('\n');
+        // A line longer than a run is read entirely
+        if (last_break != std::string::npos) {
+          carry.assign(text, last_break + 1, std::string::npos);
+          text.resize(last_break + 1);
+          break;
+        }
+      }
+    }
+    std::vector<std::string> files;
+    for (int i = 0; i < num_texts; ++i) {
+      files.push_back(new_spill_file());
+    }
+    std::string error;
+    #pragma omp parallel for num_threads(num_threads_) schedule(dynamic)
+    for (int i = 0; i < num_texts; ++i) {
+      try {
+        std::size_t run_points = sort_run(texts[i], files[i]);
+        #pragma omp atomic
+        *num_points += run_points;
+      } catch (const std::exception &e) {
+        #pragma omp critical
+        error = e.what();
+      }
+    }
+    if (!error.empty()) throw std::runtime_error(error);
+    runs.insert(runs.end(), files.begin(), files.end());
+    SPDLOG_DEBUG("Runs created {}", runs.size());
+  }
+  return runs;
+}
+
+std::size_t CSVPointSorter::sort_run(const std::string &text,
+                                     const std::string &filename) const {
+  std::vector<Record> records;
+  const char *cursor = text.data();
+  const char *end = text.data() + text.size();
+  TextSpan line{cursor, cursor};
+  while (next_line(&cursor, end, &line)) {
+    if (line.empty()) continue;
+    Record record;
+    if (!parse_key(line, &record.id, &record.timestamp)) {
+      std::string message = "Invalid point line " + line.str();
+      SPDLOG_CRITICAL(message);
+      throw std::runtime_error(message);
+    }
+    record.offset = line.begin - text.data();
+    record.length = line.end - line.begin;
+    records.push_back(record);
+  }
+  // The offset keeps the order of the input for equal keys
+  std::sort(records.begin(), records.end(),
+            [](const Record &a, const Record &b) {
+              if (a.id != b.id) return a.id < b.id;
+              if (a.timestamp != b.timestamp) {
+                return a.timestamp < b.timestamp;
+              }
+              return a.offset < b.offset;
+            });
+  std::vector<char> buffer(1 << 20);
+  std::ofstream ofs;
+  ofs.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  ofs.open(filename, std::ios::binary);
+  for (const Record &record : records) {
+    ofs.write(reinterpret_cast<const char *>(&record.id),
+              sizeof(record.id));
+    ofs.write(reinterpret_cast<const char *>(&record.timestamp),
+              sizeof(record.timestamp));
+    ofs.write(reinterpret_cast<const char *>(&record.length),
+              sizeof(record.length));
+    ofs.write(text.data() + record.offset, record.length);
+  }
+  ofs.close();
+  if (!ofs) {
+    std::string message = "Write temporary file fail " + filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  return records.size();
+}
+
+std::vector<std::string> CSVPointSorter::merge_pass(
+  const std::vector<std::string> &runs) {
+  int num_groups = (runs.size() + MAX_MERGE_FILES - 1) / MAX_MERGE_FILES;
+  std::vector<std::string> merged;
+  for (int i = 0; i < num_groups; ++i) {
+    merged.push_back(new_spill_file());
+  }
+  std::size_t buffer_size = std::max<std::size_t>(
+    std::min<std::size_t>(
+      memory_limit_ / (num_threads_ * (MAX_MERGE_FILES + 1)), 1 << 24),
+    1 << 16);
+  std::string error;
+  #pragma omp parallel for num_threads(num_threads_) schedule(dynamic)
+  for (int i = 0; i < num_groups; ++i) {
+    std::size_t first = i * MAX_MERGE_FILES;
+    std::size_t last = std::min(first + MAX_MERGE_FILES, runs.size());
+    std::vector<std::string> group(runs.begin() + first,
+                                   runs.begin() + last);
+    try {
+      merge_runs(group, merged[i], "", false, buffer_size);
+    } catch (const std::exception &e) {
+      #pragma omp critical
+      error = e.what();
+    }
+  }
+  if (!error.empty()) throw std::runtime_error(error);
+  return merged;
+}
+
+void CSVPointSorter::merge_runs(const std::vector<std::string> &runs,
+                                const std::string &output_file,
+                                const std::string &header, bool text,
+                                std::size_t buffer_size) const {
+  std::vector<std::unique_ptr<RunReader>> readers;
+  for (const std::string &run : runs) {
+    readers.emplace_back(new RunReader(run, buffer_size));
+  }
+  // Runs are in the order of the input, so the run index keeps the
+  // order of the input for equal keys
+  auto greater = [&readers](std::size_t a, std::size_t b) {
+    const RunReader &ra = *readers[a];
+    const RunReader &rb = *readers[b];
+    if (ra.id != rb.id) return ra.id > rb.id;
+    if (ra.timestamp != rb.timestamp) return ra.timestamp > rb.timestamp;
+    return a > b;
+  };
+  std::priority_queue<std::size_t, std::vector<std::size_t>,
+                      decltype(greater)> heap(greater);
+  for (std::size_t i = 0; i < readers.size(); ++i) {
+    if (readers[i]->next()) heap.push(i);
+  }
+  std::vector<char> buffer(buffer_size);
+  std::ofstream ofs;
+  ofs.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  ofs.open(output_file, std::ios::binary);
+  if (!ofs.is_open()) {
+    std::string message = "Open file fail " + output_file;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  if (text) ofs << header << '\n';
+  while (!heap.empty()) {
+    std::size_t i = heap.top();
+    heap.pop();
+    const RunReader &reader = *readers[i];
+    uint32_t length = reader.line.size();
+    if (text) {
+      ofs.write(reader.line.data(), length);
+      ofs.put('\n');
+    } else {
+      ofs.write(reinterpret_cast<const char *>(&reader.id),
+                sizeof(reader.id));
+      ofs.write(reinterpret_cast<const char *>(&reader.timestamp),
+                sizeof(reader.timestamp));
+      ofs.write(reinterpret_cast<const char *>(&length), sizeof(length));
+      ofs.write(reader.line.data(), length);
+    }
+    if (readers[i]->next()) heap.push(i);
+  }
+  ofs.close();
+  if (!ofs) {
+    std::string message = "Write file fail " + output_file;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  readers.clear();
+  for (const std::string &run : runs) {
+    std::remove(run.c_str());
+  }
+}
+
+std::string CSVPointSorter::new_spill_file() {
+  std::string file = tmp_dir_ + "/fmm_sort_" + std::to_string(getpid())
+    + "_" + std::to_string(spill_files_.size()) + ".tmp";
+  spill_files_.push_back(file);
+  return file;
+}
+
+} //IO
+} //FMM
@@ -0,0 +1,156 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of CSVPointSorter Class, which sorts a CSV point file by id
+ * and timestamp with an external merge sort.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_GPS_SORTER_HPP
+#define FMM_GPS_SORTER_HPP
+
+#include "io/text_parser.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace FMM {
+
+namespace IO {
+
+/**
+ * Sort the points of a CSV point file by id and timestamp, so that the
+ * points of a trajectory are stored in consecutive lines in temporal
+ * order, which is the format read by CSVPointReader.
+ *
+ * The file is sorted with an external merge sort under a memory limit:
+ *
+ * 1. The input is read in runs, which are sorted in parallel and
+ *    spilled into temporary files.
+ * 2. While there are more than MAX_MERGE_FILES runs, groups of runs are
+ *    merged in parallel into larger runs.
+ * 3. The runs left are merged into the output file.
+ *
+ * Each line is copied unchanged, including the columns which are not
+ * used as a key, and the header of the input is written to the output.
+ * Points with the same id and timestamp keep their order in the input.
+ * If the file has no timestamp column, the points of a trajectory keep
+ * their order in the input. Empty lines are removed.
+ */
+class CSVPointSorter {
+public:
+  /**
+   * Constructor
+   * @param id_name the id column name
+   * @param time_name the timestamp column name, which can be missing
+   * in the file
+   * @param memory_limit the memory in bytes used for sorting, about
+   * half of it holds the text of the runs and the other half the keys
+   * @param tmp_dir the folder where the temporary files are written
+   * @param num_threads the number of threads sorting and merging runs
+   */
+  CSVPointSorter(const std::string &id_name, const std::string &time_name,
+                 std::size_t memory_limit, const std::string &tmp_dir,
+                 int num_threads = 1);
+  /**
+   * Destructor, the temporary files left are removed
+   */
+  ~CSVPointSorter();
+  CSVPointSorter(const CSVPointSorter &) = delete;
+  CSVPointSorter &operator=(const CSVPointSorter &) = delete;
+  /**
+   * Sort a CSV point file
+   * @param input_file the file to sort
+   * @param output_file the sorted file
+   * @return the number of points sorted
+   * @throw std::runtime_error if a file cannot be read or written, the
+   * id column is not found or a line has an invalid id or timestamp
+   */
+  std::size_t sort(const std::string &input_file,
+                   const std::string &output_file);
+private:
+  static const std::size_t MAX_MERGE_FILES = 64; /**< Maximum number of
+    runs merged at once */
+  static const std::size_t MAX_RUN_SIZE = std::size_t(1) << 30; /**<
+    Maximum size in bytes of the text of a run */
+  /**
+   * Key of a line in the text of a run
+   */
+  struct Record {
+    long long id; /**< id of the point */
+    double timestamp; /**< timestamp of the point */
+    uint32_t offset; /**< offset of the line in the run */
+    uint32_t length; /**< length of the line */
+  };
+  struct RunReader;
+  /**
+   * Find the id and timestamp columns in the header
+   * @param header the first line of the input
+   */
+  void read_header(const std::string &header);
+  /**
+   * Parse the key of a line
+   * @param line a line of the input
+   * @param id the id parsed
+   * @param timestamp the timestamp parsed, 0 without a timestamp column
+   * @return false if the id or timestamp is invalid
+   */
+  bool parse_key(const TextSpan &line, long long *id,
+                 double *timestamp) const;
+  /**
+   * Read the input into sorted runs stored in temporary files
+   * @param ifs the input stream, positioned after the header
+   * @param num_points the number of points read, which will be updated
+   * @return the temporary files in the order of the input
+   */
+  std::vector<std::string> create_runs(std::ifstream &ifs,
+                                       std::size_t *num_points);
+  /**
+   * Sort the lines of a run and write them into a temporary file
+   * @param text the text of the run, made of complete lines
+   * @param filename the temporary file written
+   * @return the number of points in the run
+   */
+  std::size_t sort_run(const std::string &text,
+                       const std::string &filename) const;
+  /**
+   * Merge groups of runs in parallel into larger runs
+   * @param runs the runs in the order of the input, which are removed
+   * @return the merged runs in the order of the input
+   */
+  std::vector<std::string> merge_pass(const std::vector<std::string> &runs);
+  /**
+   * Merge runs into a file, the runs are removed
+   * @param runs the runs in the order of the input
+   * @param output_file the file written
+   * @param header the header of the output, only used for a text file
+   * @param text if true, the lines are written as text otherwise the
+   * output is a run
+   * @param buffer_size the size of the buffer of each file
+   */
+  void merge_runs(const std::vector<std::string> &runs,
+                  const std::string &output_file,
+                  const std::string &header, bool text,
+                  std::size_t buffer_size) const;
+  /**
+   * Create the name of a new temporary file
+   */
+  std::string new_spill_file();
+  std::string id_name_;
+  std::string time_name_;
+  std::size_t memory_limit_;
+  std::string tmp_dir_;
+  int num_threads_;
+  char delim_ = ';';
+  int id_idx_ = -1;
+  int timestamp_idx_ = -1;
+  std::vector<std::string> spill_files_; /**< temporary files created */
+}; // CSVPointSorter
+
+} //IO
+} //FMM
+#endif // FMM_GPS_SORTER_HPP
@@ -10,6 +10,7 @@
 #include "io/mm_writer.hpp"
 #include "util/util.hpp"
 #include "util/debug.hpp"
+#include "util/formatter.hpp"
 #include "config/result_config.hpp"
 #include <omp.h>
 
@@ -20,8 +21,10 @@ namespace FMM {
 namespace IO {
 
 CSVMatchResultWriter::CSVMatchResultWriter(
-    const std::string &result_file, const CONFIG::OutputConfig &config_arg) :
-    m_fstream(result_file), config_(config_arg) {
+    const std::string &result_file, const CONFIG::OutputConfig &config_arg,
+    const NETWORK::Network &network, int reorder_window) :
+    config_(config_arg), network_(network),
+    writer_(result_file, reorder_window) {
   write_header();
 }
 
@@ -40,65 +43,85 @@ void CSVMatchResultWriter::write_header() {
   if (config_.write_length) header += ";length";
   if (config_.write_duration) header += ";duration";
   if (config_.write_speed) header += ";speed";
-  m_fstream << header << '\n';
+  writer_.write_header(header + '\n');
 }
 
 void CSVMatchResultWriter::write_result(
     const FMM::CORE::Trajectory &traj,
     const FMM::MM::MatchResult &result) {
-  std::stringstream buf;
-  buf << result.id;
+  writer_.write(format_result(traj, result));
+}
+
+void CSVMatchResultWriter::write_results(
+    std::size_t index,
+    const std::vector<FMM::CORE::Trajectory> &trajectories,
+    const std::vector<FMM::MM::MatchResult> &results) {
+  std::string records;
+  for (std::size_t i = 0; i < trajectories.size(); ++i) {
+    records += format_result(trajectories[i], results[i]);
+  }
+  writer_.write(index, std::move(records));
+}
+
+std::string CSVMatchResultWriter::format_result(
+    const FMM::CORE::Trajectory &traj,
+    const FMM::MM::MatchResult &result) const {
+  UTIL::FormatBuffer buf;
+  const FMM::MM::MatchedCandidatePath &mcpath = result.opt_candidate_path;
+  int N = mcpath.size();
+  // Paths are stored with edge index, which is mapped to edge ID here
+  const std::vector<NETWORK::Edge> &edges = network_.get_edges();
+  int precision = config_.coordinate_precision;
+  int value_precision = config_.value_precision;
+  UTIL::append_int(buf, result.id);
   if (config_.write_opath) {
-    buf << ";" << result.opath;
+    buf.push_back(';');
+    for (int i = 0; i < result.opath.size(); ++i) {
+      if (i > 0) buf.push_back(',');
+      UTIL::append_int(buf, edges[result.opath[i]].id);
+    }
   }
   if (config_.write_error) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].c.dist << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].c.dist;
+    buf.push_back(';');
+    for (int i = 0; i < N; ++i) {
+      if (i > 0) buf.push_back(',');
+      UTIL::append_double(buf, mcpath[i].c.dist, value_precision);
     }
   }
   if (config_.write_offset) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].c.offset << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].c.offset;
+    buf.push_back(';');
+    for (int i = 0; i < N; ++i) {
+      if (i > 0) buf.push_back(',');
+      UTIL::append_double(buf, mcpath[i].c.offset, value_precision);
     }
   }
   if (config_.write_spdist) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 1; i < N; ++i) {
-        buf << result.opt_candidate_path[i].sp_dist
-            << (i==N-1?"":",");
-      }
+    buf.push_back(';');
+    for (int i = 1; i < N; ++i) {
+      if (i > 1) buf.push_back(',');
+      UTIL::append_double(buf, mcpath[i].sp_dist, value_precision);
     }
   }
   if (config_.write_pgeom) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
+    buf.push_back(';');
+    if (N > 0) {
       FMM::CORE::LineString pline;
       for (int i = 0; i < N; ++i) {
-        const FMM::CORE::Point &point = result.opt_candidate_path[i].c.point;
-        pline.add_point(point);
+        pline.add_point(mcpath[i].c.point);
       }
-      buf << pline;
+      UTIL::append_wkt(buf, pline, precision);
     }
   }
   // Write fields related with cpath
   if (config_.write_cpath) {
-    buf << ";" << result.cpath;
+    buf.push_back(';');
+    for (int i = 0; i < result.cpath.size(); ++i) {
+      if (i > 0) buf.push_back(',');
+      UTIL::append_int(buf, edges[result.cpath[i]].id);
+    }
   }
   if (config_.write_tpath) {
-    buf << ";";
+    buf.push_back(';');
     if (!result.cpath.empty()) {
       // Iterate through consecutive indexes and write the traversed path
       int J = result.indices.size();
@@ -106,80 +129,81 @@ void CSVMatchResultWriter::write_result(
         int a = result.indices[j];
         int b = result.indices[j + 1];
         for (int i = a; i < b; ++i) {
-          buf << result.cpath[i];
-          buf << ",";
+          UTIL::append_int(buf, edges[result.cpath[i]].id);
+          buf.push_back(',');
         }
-        buf << result.cpath[b];
+        UTIL::append_int(buf, edges[result.cpath[b]].id);
         if (j < J - 2) {
           // Last element should not have a bar
-          buf << "|";
+          buf.push_back('|');
         }
       }
     }
   }
   if (config_.write_mgeom) {
-    buf << ";" << result.mgeom;
+    buf.push_back(';');
+    UTIL::append_wkt(buf, result.mgeom, precision);
   }
   if (config_.write_ep) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].ep << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].ep;
+    buf.push_back(';');
+    for (int i = 0; i < N; ++i) {
+      if (i > 0) buf.push_back(',');
+      UTIL::append_double(buf, mcpath[i].ep, value_precision);
     }
   }
   if (config_.write_tp) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].tp << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].tp;
+    buf.push_back(';');
+    for (int i = 0; i < N; ++i) {
+      if (i > 0) buf.push_back(',');
+      UTIL::append_double(buf, mcpath[i].tp, value_precision);
     }
   }
   if (config_.write_length) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      SPDLOG_TRACE("Write length for {} edges",N);
-      for (int i = 0; i < N - 1; ++i) {
-        // SPDLOG_TRACE("Write length {}",i);
-        buf << result.opt_candidate_path[i].c.edge->length << ",";
-      }
-      // SPDLOG_TRACE("Write length {}",N-1);
-      buf << result.opt_candidate_path[N - 1].c.edge->length;
+    buf.push_back(';');
+    SPDLOG_TRACE("Write length for {} edges",N);
+    for (int i = 0; i < N; ++i) {
+      if (i > 0) buf.push_back(',');
+      UTIL::append_double(buf, mcpath[i].c.edge->length, value_precision);
     }
   }
   if (config_.write_duration) {
-    buf << ";";
-    if (!traj.timestamps.empty()) {
-      int N = traj.timestamps.size();
-      SPDLOG_TRACE("Write duration for {} points",N);
-      for (int i = 1; i < N; ++i) {
-        // SPDLOG_TRACE("Write length {}",i);
-        buf << traj.timestamps[i] - traj.timestamps[i-1]
-            << (i==N-1?"":",");
-      }
+    buf.push_back(';');
+    int T = traj.timestamps.size();
+    SPDLOG_TRACE("Write duration for {} points",T);
+    for (int i = 1; i < T; ++i) {
+      if (i > 1) buf.push_back(',');
+      UTIL::append_double(buf, traj.timestamps[i] - traj.timestamps[i-1],
+                          value_precision);
     }
   }
   if (config_.write_speed) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty() && !traj.timestamps.empty()) {
-      int N = traj.timestamps.size();
-      for (int i = 1; i < N; ++i) {
+    buf.push_back(';');
+    if (N > 0) {
+      int T = traj.timestamps.size();
+      for (int i = 1; i < T; ++i) {
         double duration = traj.timestamps[i] - traj.timestamps[i-1];
-        buf << (duration>0?(result.opt_candidate_path[i].sp_dist/duration):0)
-            << (i==N-1?"":",");
+        if (i > 1) buf.push_back(',');
+        UTIL::append_double(
+          buf, duration > 0 ? mcpath[i].sp_dist / duration : 0,
+          value_precision);
       }
     }
   }
-  buf << '\n';
-  // Ensure that fstream is called corrected in OpenMP
-  #pragma omp critical
-  m_fstream << buf.rdbuf();
+  buf.push_back('\n');
+  return fmt::to_string(buf);
+}
+
+int CSVMatchResultWriter::get_match_fields(
+    const CONFIG::OutputConfig &config) {
+  int fields = 0;
+  if (config.write_opath) fields |= FMM::MM::MATCH_OPATH;
+  if (config.write_error || config.write_offset || config.write_spdist ||
+      config.write_pgeom || config.write_ep || config.write_tp ||
+      config.write_length || config.write_speed) {
+    fields |= FMM::MM::MATCH_CANDIDATES;
+  }
+  if (config.write_mgeom) fields |= FMM::MM::MATCH_MGEOM;
+  return fields;
 }
 
 } //IO
@@ -17,6 +17,7 @@
 #include "util/debug.hpp"
 #include "network/network.hpp"
 #include "config/result_config.hpp"
+#include "io/async_file_writer.hpp"
 
 #include <iostream>
 #include <fstream>
@@ -53,10 +54,16 @@ public:
    *
    * @param result_file the filename to write result
    * @param config_arg the fields that will be exported
+   * @param network the network whose edge ID are written for the edge
+   * indices of a match result
+   * @param reorder_window if positive, the results are written in the
+   * order of their index, see AsyncFileWriter
    *
    */
   CSVMatchResultWriter(const std::string &result_file,
-                       const CONFIG::OutputConfig &config_arg);
+                       const CONFIG::OutputConfig &config_arg,
+                       const NETWORK::Network &network,
+                       int reorder_window = 0);
   /**
    * Write a header line for the fields exported
    */
@@ -68,9 +75,36 @@ public:
    */
   void write_result(const FMM::CORE::Trajectory &traj,
                     const FMM::MM::MatchResult &result);
+  /**
+   * Write the match results of a batch of trajectories as a single
+   * record, whose index decides its position in ordered mode
+   * @param index index of the batch, starting from 0 without gaps,
+   * see run_match_pipeline
+   * @param trajectories Input trajectories, which can be empty
+   * @param results Map match result of each trajectory
+   */
+  void write_results(std::size_t index,
+                     const std::vector<FMM::CORE::Trajectory> &trajectories,
+                     const std::vector<FMM::MM::MatchResult> &results);
+  /**
+   * Format match result as a line of the CSV file
+   * @param traj Input trajectory
+   * @param result Map match result
+   * @return the line including the line break
+   */
+  std::string format_result(const FMM::CORE::Trajectory &traj,
+                            const FMM::MM::MatchResult &result) const;
+  /**
+   * Get the members of the match result required to export the fields
+   * of an output configuration, so that the others are not computed
+   * @param config the fields exported
+   * @return bit mask of MM::MatchResultField
+   */
+  static int get_match_fields(const CONFIG::OutputConfig &config);
 private:
-  std::ofstream m_fstream;
   const CONFIG::OutputConfig &config_;
+  const NETWORK::Network &network_;
+  AsyncFileWriter writer_;
 }; // CSVMatchResultWriter
 
 };     //IO
@@ -0,0 +1,61 @@
+/**
+ * Content
+ * Definition of MMapFile Class, a read only file mapped into memory.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/mmap_file.hpp"
+#include "util/debug.hpp"
+
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace FMM {
+
+namespace IO {
+
+MMapFile::MMapFile(const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::string message = "Open file fail " + filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    ::close(fd);
+    std::string message = "Read file size fail " + filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  size_ = file_stat.st_size;
+  if (size_ > 0) {
+    void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      std::string message = "Map file fail " + filename;
+      SPDLOG_CRITICAL(message);
+      throw std::runtime_error(message);
+    }
+    // The file is mostly read from the start to the end
+    madvise(addr, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(addr);
+  }
+  // The mapping stays valid after the file is closed
+  ::close(fd);
+  SPDLOG_DEBUG("Map file {} size {}", filename, size_);
+}
+
+MMapFile::~MMapFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+} //IO
+} //FMM
@@ -0,0 +1,62 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of MMapFile Class, a read only file mapped into memory.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_MMAP_FILE_HPP
+#define FMM_MMAP_FILE_HPP
+
+#include <string>
+
+namespace FMM {
+
+namespace IO {
+
+/**
+ * A read only file mapped into memory, whose content can be parsed in
+ * place without copying it into strings.
+ */
+class MMapFile {
+public:
+  /**
+   * Constructor, the whole file is mapped
+   * @param filename the file to map
+   * @throw std::runtime_error if the file cannot be opened or mapped
+   */
+  explicit MMapFile(const std::string &filename);
+  /**
+   * Destructor, the file is unmapped
+   */
+  ~MMapFile();
+  MMapFile(const MMapFile &) = delete;
+  MMapFile &operator=(const MMapFile &) = delete;
+  /**
+   * Get the first character of the file, nullptr for an empty file
+   */
+  inline const char *data() const {
+    return data_;
+  };
+  /**
+   * Get the size of the file in bytes
+   */
+  inline std::size_t size() const {
+    return size_;
+  };
+  /**
+   * Get the end of the file, which is one past the last character
+   */
+  inline const char *end() const {
+    return data_ + size_;
+  };
+private:
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+}; // MMapFile
+
+} //IO
+} //FMM
+#endif // FMM_MMAP_FILE_HPP
@@ -0,0 +1,203 @@
+/**
+ * Content
+ * Functions parsing lines, fields, numbers and WKT linestrings in place
+ * from a character buffer.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/text_parser.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace FMM {
+
+namespace IO {
+
+bool next_line(const char **cursor, const char *end, TextSpan *line) {
+  const char *p = *cursor;
+  if (p >= end) return false;
+  const char *line_end = static_cast<const char *>(
+    std::memchr(p, '\n', end - p));
+  if (line_end == nullptr) {
+    line_end = end;
+    *cursor = end;
+  } else {
+    *cursor = line_end + 1;
+  }
+  if (line_end > p && *(line_end - 1) == '\r') --line_end;
+  line->begin = p;
+  line->end = line_end;
+  return true;
+}
+
+void split_line(const TextSpan &line, char delim,
+                std::vector<TextSpan> *fields) {
+  fields->clear();
+  const char *p = line.begin;
+  while (true) {
+    const char *field_end = static_cast<const char *>(
+      std::memchr(p, delim, line.end - p));
+    if (field_end == nullptr) {
+      fields->push_back(TextSpan{p, line.end});
+      return;
+    }
+    fields->push_back(TextSpan{p, field_end});
+    p = field_end + 1;
+  }
+}
+
+bool parse_double(const char **cursor, const char *end, double *value) {
+  static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *p = skip_spaces(*cursor, end);
+  const char *start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+  // At most 19 significant digits are stored in the mantissa
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool truncated = false;
+  bool has_digit = false;
+  while (p < end && *p >= '0' && *p <= '9') {
+    has_digit = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa > 0) ++digits;
+    } else {
+      ++exponent;
+      if (*p != '0') truncated = true;
+    }
+    ++p;
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    while (p < end && *p >= '0' && *p <= '9') {
+      has_digit = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa > 0) ++digits;
+        --exponent;
+      } else if (*p != '0') {
+        truncated = true;
+      }
+      ++p;
+    }
+  }
+  if (!has_digit) return false;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool exponent_negative = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      exponent_negative = (*q == '-');
+      ++q;
+    }
+    if (q < end && *q >= '0' && *q <= '9') {
+      int e = 0;
+      while (q < end && *q >= '0' && *q <= '9') {
+        if (e < 100000) e = e * 10 + (*q - '0');
+        ++q;
+      }
+      exponent += exponent_negative ? -e : e;
+      p = q;
+    }
+  }
+  if (!truncated && mantissa <= (uint64_t(1) << 53) &&
+      exponent >= -22 && exponent <= 22) {
+    // Both the mantissa and the power of 10 are exact in a double,
+    // so a single operation gives the correctly rounded result.
+    double v = static_cast<double>(mantissa);
+    v = exponent < 0 ? v / POW10[-exponent] : v * POW10[exponent];
+    *value = negative ? -v : v;
+  } else {
+    std::size_t length = p - start;
+    char buf[64];
+    if (length < sizeof(buf)) {
+      std::memcpy(buf, start, length);
+      buf[length] = '\0';
+      *value = std::strtod(buf, nullptr);
+    } else {
+      *value = std::strtod(std::string(start, p).c_str(), nullptr);
+    }
+  }
+  *cursor = p;
+  return true;
+}
+
+bool parse_int(const TextSpan &span, long long *value) {
+  const char *p = skip_spaces(span.begin, span.end);
+  bool negative = false;
+  if (p < span.end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+  const char *digits_begin = p;
+  long long v = 0;
+  while (p < span.end && *p >= '0' && *p <= '9') {
+    v = v * 10 + (*p - '0');
+    ++p;
+  }
+  if (p == digits_begin) return false;
+  if (skip_spaces(p, span.end) != span.end) return false;
+  *value = negative ? -v : v;
+  return true;
+}
+
+bool parse_double_list(const TextSpan &span, char delim,
+                       std::vector<double> *values) {
+  const char *p = span.begin;
+  while (true) {
+    p = skip_spaces(p, span.end);
+    if (p == span.end) return true;
+    double v;
+    if (!parse_double(&p, span.end, &v)) return false;
+    values->push_back(v);
+    p = skip_spaces(p, span.end);
+    if (p == span.end) return true;
+    if (*p != delim) return false;
+    ++p;
+  }
+}
+
+bool parse_linestring(const TextSpan &span, FMM::CORE::LineString *line) {
+  static const char KEYWORD[] = "LINESTRING";
+  static const std::size_t KEYWORD_LENGTH = sizeof(KEYWORD) - 1;
+  const char *p = skip_spaces(span.begin, span.end);
+  if (static_cast<std::size_t>(span.end - p) < KEYWORD_LENGTH) return false;
+  for (std::size_t i = 0; i < KEYWORD_LENGTH; ++i, ++p) {
+    if ((*p & ~0x20) != KEYWORD[i]) return false;
+  }
+  p = skip_spaces(p, span.end);
+  if (p == span.end || *p != '(') return false;
+  p = skip_spaces(p + 1, span.end);
+  if (p < span.end && *p == ')') {
+    return skip_spaces(p + 1, span.end) == span.end;
+  }
+  while (true) {
+    double x, y;
+    if (!parse_double(&p, span.end, &x) || !parse_double(&p, span.end, &y)) {
+      return false;
+    }
+    line->add_point(x, y);
+    p = skip_spaces(p, span.end);
+    if (p == span.end) return false;
+    if (*p == ',') {
+      ++p;
+    } else if (*p == ')') {
+      return skip_spaces(p + 1, span.end) == span.end;
+    } else {
+      return false;
+    }
+  }
+}
+
+} //IO
+} //FMM
@@ -0,0 +1,123 @@
+/**
+ * Fast map matching.
+ *
+ * Functions parsing lines, fields, numbers and WKT linestrings in place
+ * from a character buffer, such as a file mapped by MMapFile, without
+ * copying them into strings or streams.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_TEXT_PARSER_HPP
+#define FMM_TEXT_PARSER_HPP
+
+#include "core/geometry.hpp"
+
+#include <string>
+#include <vector>
+
+namespace FMM {
+
+namespace IO {
+
+/**
+ * A range of characters in a buffer, which is not null terminated
+ */
+struct TextSpan {
+  const char *begin; /**< the first character */
+  const char *end; /**< one past the last character */
+  /**
+   * Check if the span has no character
+   */
+  inline bool empty() const {
+    return begin == end;
+  };
+  /**
+   * Copy the characters into a string
+   */
+  inline std::string str() const {
+    return std::string(begin, end);
+  };
+};
+
+/**
+ * Skip spaces and tabs
+ * @param p the position to read
+ * @param end the end of the buffer
+ * @return the first position which is not a space or a tab
+ */
+inline const char *skip_spaces(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) ++p;
+  return p;
+}
+
+/**
+ * Get the next line from a buffer. The line break, either \\n or \\r\\n,
+ * is not included in the line.
+ * @param cursor the position to read, which is moved to the start of
+ * the next line
+ * @param end the end of the buffer
+ * @param line the line read, which will be updated
+ * @return false if the cursor is already at the end of the buffer
+ */
+bool next_line(const char **cursor, const char *end, TextSpan *line);
+
+/**
+ * Split a line into fields, the fields are not copied
+ * @param line the line to split
+ * @param delim the delimiter of the fields
+ * @param fields the fields, which will be updated
+ */
+void split_line(const TextSpan &line, char delim,
+                std::vector<TextSpan> *fields);
+
+/**
+ * Parse a floating point number at the cursor, leading spaces are
+ * skipped.
+ *
+ * Numbers whose digits fit in the 53 bits of a double and whose decimal
+ * exponent is at most 22, which is the case of most coordinates and
+ * timestamps, are converted exactly with a single multiplication or
+ * division by a power of 10. Other numbers are passed to strtod, so the
+ * result is always the correctly rounded value.
+ *
+ * @param cursor the position to read, which is moved after the number
+ * @param end the end of the buffer
+ * @param value the value parsed, which will be updated
+ * @return false if no number is found at the cursor
+ */
+bool parse_double(const char **cursor, const char *end, double *value);
+
+/**
+ * Parse an integer number occupying a whole span, leading and trailing
+ * spaces are allowed
+ * @param span the text to parse
+ * @param value the value parsed, which will be updated
+ * @return false if the span is not an integer
+ */
+bool parse_int(const TextSpan &span, long long *value);
+
+/**
+ * Parse a list of floating point numbers separated by a delimiter
+ * @param span the text to parse
+ * @param delim the delimiter of the numbers
+ * @param values the values parsed are appended to it
+ * @return false if the span contains text which is not a number
+ */
+bool parse_double_list(const TextSpan &span, char delim,
+                       std::vector<double> *values);
+
+/**
+ * Parse a linestring in WKT, e.g. LINESTRING(30 10,10 30,40 40).
+ * The keyword is case insensitive and spaces are allowed between tokens.
+ * @param span the text to parse
+ * @param line the linestring, points parsed are appended to it
+ * @return false if the span is not a 2D linestring in WKT, in which case
+ * the line may contain the points parsed before the error
+ */
+bool parse_linestring(const TextSpan &span, FMM::CORE::LineString *line);
+
+} //IO
+} //FMM
+#endif // FMM_TEXT_PARSER_HPP
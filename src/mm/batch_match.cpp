@@ -0,0 +1,108 @@
+#include "mm/batch_match.hpp"
+#include "util/debug.hpp"
+
+#include <limits>
+#include <stdexcept>
+#include <omp.h>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+using namespace FMM::PYTHON;
+
+PyBatchResult FMM::MM::match_batch(
+  const Network &network,
+  const std::vector<double> &xs, const std::vector<double> &ys,
+  const std::vector<double> &timestamps,
+  const std::vector<long long> &offsets, int num_threads,
+  const std::function<MatchResult(const Trajectory &)> &match) {
+  std::size_t num_points = xs.size();
+  bool valid = ys.size() == num_points &&
+    (timestamps.empty() || timestamps.size() == num_points) &&
+    !offsets.empty() && offsets.front() == 0 &&
+    offsets.back() == static_cast<long long>(num_points);
+  for (std::size_t i = 1; valid && i < offsets.size(); ++i) {
+    valid = offsets[i - 1] <= offsets[i];
+  }
+  if (!valid) {
+    std::string message = fmt::format(
+      "Invalid batch with {} x {} y {} timestamps {} offsets",
+      xs.size(), ys.size(), timestamps.size(), offsets.size());
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  int num_trajectories = offsets.size() - 1;
+  if (num_threads <= 0) num_threads = omp_get_max_threads();
+  std::vector<MatchResult> results(num_trajectories);
+  #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+  for (int i = 0; i < num_trajectories; ++i) {
+    Trajectory traj;
+    traj.id = i;
+    for (long long j = offsets[i]; j < offsets[i + 1]; ++j) {
+      traj.geom.add_point(xs[j], ys[j]);
+    }
+    if (!timestamps.empty()) {
+      traj.timestamps.assign(timestamps.begin() + offsets[i],
+                             timestamps.begin() + offsets[i + 1]);
+    }
+    // An exception cannot leave the parallel loop, the trajectory is
+    // reported as not matched
+    try {
+      results[i] = match(traj);
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("Match trajectory {} fail {}", i, e.what());
+    }
+  }
+  const double NaN = std::numeric_limits<double>::quiet_NaN();
+  PyBatchResult batch;
+  batch.opath.assign(num_points, 0);
+  batch.indices.assign(num_points, 0);
+  batch.error.assign(num_points, NaN);
+  batch.offset.assign(num_points, NaN);
+  batch.ep.assign(num_points, NaN);
+  batch.tp.assign(num_points, NaN);
+  batch.spdist.assign(num_points, NaN);
+  batch.px.assign(num_points, NaN);
+  batch.py.assign(num_points, NaN);
+  batch.cpath_offsets.reserve(num_trajectories + 1);
+  batch.mgeom_offsets.reserve(num_trajectories + 1);
+  batch.cpath_offsets.push_back(0);
+  batch.mgeom_offsets.push_back(0);
+  for (int i = 0; i < num_trajectories; ++i) {
+    const MatchResult &result = results[i];
+    long long begin = offsets[i];
+    std::size_t size = offsets[i + 1] - begin;
+    if (!result.cpath.empty()) {
+      for (EdgeIndex e : result.cpath) {
+        batch.cpath.push_back(network.get_edge_id(e));
+      }
+      int mgeom_size = result.mgeom.get_num_points();
+      for (int j = 0; j < mgeom_size; ++j) {
+        batch.mgeom_x.push_back(result.mgeom.get_x(j));
+        batch.mgeom_y.push_back(result.mgeom.get_y(j));
+      }
+      if (result.opath.size() == size && result.indices.size() == size) {
+        for (std::size_t j = 0; j < size; ++j) {
+          batch.opath[begin + j] = network.get_edge_id(result.opath[j]);
+          batch.indices[begin + j] = result.indices[j];
+        }
+      }
+      if (result.opt_candidate_path.size() == size) {
+        for (std::size_t j = 0; j < size; ++j) {
+          const MatchedCandidate &mc = result.opt_candidate_path[j];
+          batch.error[begin + j] = mc.c.dist;
+          batch.offset[begin + j] = mc.c.offset;
+          batch.ep[begin + j] = mc.ep;
+          batch.tp[begin + j] = mc.tp;
+          batch.spdist[begin + j] = mc.sp_dist;
+          batch.px[begin + j] = boost::geometry::get<0>(mc.c.point);
+          batch.py[begin + j] = boost::geometry::get<1>(mc.c.point);
+        }
+      }
+    }
+    batch.cpath_offsets.push_back(batch.cpath.size());
+    batch.mgeom_offsets.push_back(batch.mgeom_x.size());
+  }
+  return batch;
+}
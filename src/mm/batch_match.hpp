@@ -0,0 +1,54 @@
+/**
+ * Fast map matching.
+ *
+ * Matching of a batch of trajectories stored in flat coordinate arrays,
+ * used by the bulk Python API.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_BATCH_MATCH_HPP
+#define FMM_BATCH_MATCH_HPP
+
+#include "core/gps.hpp"
+#include "mm/mm_type.hpp"
+#include "network/network.hpp"
+#include "python/pyfmm.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Match a batch of trajectories stored in flat arrays with several
+ * threads, the results are returned in the order of the trajectories.
+ *
+ * The points of trajectory i are in the range [offsets[i],offsets[i+1])
+ * of xs, ys and timestamps, so offsets has one more value than the number
+ * of trajectories, starting with 0 and ending with the number of points.
+ * The id of trajectory i is i.
+ *
+ * @param network road network
+ * @param xs x of all the points
+ * @param ys y of all the points
+ * @param timestamps timestamp of all the points, can be empty
+ * @param offsets offsets of the trajectories in the points
+ * @param num_threads number of threads, 0 means the number of cores
+ * @param match function matching a trajectory, called in parallel
+ * @return the results in flat arrays
+ * @throw std::runtime_error if the sizes of the arrays do not match
+ */
+PYTHON::PyBatchResult match_batch(
+  const NETWORK::Network &network,
+  const std::vector<double> &xs, const std::vector<double> &ys,
+  const std::vector<double> &timestamps,
+  const std::vector<long long> &offsets, int num_threads,
+  const std::function<MatchResult(const CORE::Trajectory &)> &match);
+
+} // MM
+} // FMM
+
+#endif // FMM_BATCH_MATCH_HPP
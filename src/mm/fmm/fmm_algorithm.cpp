@@ -8,6 +8,13 @@
 #include "util/debug.hpp"
 #include "io/gps_reader.hpp"
 #include "io/mm_writer.hpp"
+#include "mm/traj_filter.hpp"
+#include "mm/match_pipeline.hpp"
+#include "mm/batch_match.hpp"
+
+#include <atomic>
+
+#include <omp.h>
 
 
 using namespace FMM;
@@ -20,13 +27,26 @@ FastMapMatchConfig::FastMapMatchConfig(int k_arg, double r_arg,
                                        double gps_error,
                                        double reverse_tolerance) :
   k(k_arg), radius(r_arg), gps_error(gps_error),
-  reverse_tolerance(reverse_tolerance) {
+  reverse_tolerance(reverse_tolerance), window_size(0),
+  min_point_distance(0), min_point_interval(0),
+  beam_width(0), beam_margin(0), beam_check(false),
+  adaptive_search(false), heading_tolerance(0),
+  candidate_cache_size(0), path_cache_size(0) {
 };
 
 void FastMapMatchConfig::print() const {
   SPDLOG_INFO("FMMAlgorithmConfig");
   SPDLOG_INFO("k {} radius {} gps_error {} reverse_tolerance {}",
     k, radius, gps_error, reverse_tolerance);
+  SPDLOG_INFO("window_size {}", window_size);
+  SPDLOG_INFO("min_point_distance {} min_point_interval {}",
+    min_point_distance, min_point_interval);
+  SPDLOG_INFO("beam_width {} beam_margin {} beam_check {}",
+    beam_width, beam_margin, beam_check);
+  SPDLOG_INFO("adaptive_search {} heading_tolerance {}",
+    adaptive_search, heading_tolerance);
+  SPDLOG_INFO("candidate_cache_size {} path_cache_size {}",
+    candidate_cache_size, path_cache_size);
 };
 
 FastMapMatchConfig FastMapMatchConfig::load_from_xml(
@@ -36,7 +56,24 @@ FastMapMatchConfig FastMapMatchConfig::load_from_xml(
   double gps_error = xml_data.get("config.parameters.gps_error", 50.0);
   double reverse_tolerance =
     xml_data.get("config.parameters.reverse_tolerance", 0.0);
-  return FastMapMatchConfig{k, radius, gps_error, reverse_tolerance};
+  FastMapMatchConfig config{k, radius, gps_error, reverse_tolerance};
+  config.window_size = xml_data.get("config.parameters.window_size", 0);
+  config.min_point_distance =
+    xml_data.get("config.parameters.min_point_distance", 0.0);
+  config.min_point_interval =
+    xml_data.get("config.parameters.min_point_interval", 0.0);
+  config.beam_width = xml_data.get("config.parameters.beam_width", 0);
+  config.beam_margin = xml_data.get("config.parameters.beam_margin", 0.0);
+  config.beam_check = xml_data.get("config.parameters.beam_check", false);
+  config.adaptive_search =
+    xml_data.get("config.parameters.adaptive_search", false);
+  config.heading_tolerance =
+    xml_data.get("config.parameters.heading_tolerance", 0.0);
+  config.candidate_cache_size =
+    xml_data.get("config.parameters.candidate_cache_size", 0);
+  config.path_cache_size =
+    xml_data.get("config.parameters.path_cache_size", 0);
+  return config;
 };
 
 FastMapMatchConfig FastMapMatchConfig::load_from_arg(
@@ -45,7 +82,18 @@ FastMapMatchConfig FastMapMatchConfig::load_from_arg(
   double radius = arg_data["radius"].as<double>();
   double gps_error = arg_data["error"].as<double>();
   double reverse_tolerance = arg_data["reverse_tolerance"].as<double>();
-  return FastMapMatchConfig{k, radius, gps_error, reverse_tolerance};
+  FastMapMatchConfig config{k, radius, gps_error, reverse_tolerance};
+  config.window_size = arg_data["window_size"].as<int>();
+  config.min_point_distance = arg_data["min_point_distance"].as<double>();
+  config.min_point_interval = arg_data["min_point_interval"].as<double>();
+  config.beam_width = arg_data["beam_width"].as<int>();
+  config.beam_margin = arg_data["beam_margin"].as<double>();
+  config.beam_check = arg_data.count("beam_check") > 0;
+  config.adaptive_search = arg_data.count("adaptive_search") > 0;
+  config.heading_tolerance = arg_data["heading_tolerance"].as<double>();
+  config.candidate_cache_size = arg_data["candidate_cache_size"].as<int>();
+  config.path_cache_size = arg_data["path_cache_size"].as<int>();
+  return config;
 };
 
 void FastMapMatchConfig::register_arg(cxxopts::Options &options){
@@ -57,7 +105,25 @@ void FastMapMatchConfig::register_arg(cxxopts::Options &options){
     ("reverse_tolerance","Ratio of reverse movement allowed",
       cxxopts::value<double>()->default_value("0.0"))
     ("e,error","GPS error",
-    cxxopts::value<double>()->default_value("50.0"));
+    cxxopts::value<double>()->default_value("50.0"))
+    ("window_size","Points in a window of a long trajectory",
+      cxxopts::value<int>()->default_value("0"))
+    ("min_point_distance","Minimum distance between matched points",
+      cxxopts::value<double>()->default_value("0.0"))
+    ("min_point_interval","Minimum time interval between matched points",
+      cxxopts::value<double>()->default_value("0.0"))
+    ("beam_width","Candidates kept in each layer",
+      cxxopts::value<int>()->default_value("0"))
+    ("beam_margin","Log probability margin of candidates kept",
+      cxxopts::value<double>()->default_value("0.0"))
+    ("beam_check","Count paths changed by pruning")
+    ("adaptive_search","Search candidates by nearest neighbour query")
+    ("heading_tolerance","Heading difference in degrees allowed",
+      cxxopts::value<double>()->default_value("0.0"))
+    ("candidate_cache_size","Grid cells in the candidate search cache",
+      cxxopts::value<int>()->default_value("0"))
+    ("path_cache_size","Shortest paths in the complete path cache",
+      cxxopts::value<int>()->default_value("0"));
 }
 
 void FastMapMatchConfig::register_help(std::ostringstream &oss){
@@ -68,6 +134,36 @@ void FastMapMatchConfig::register_help(std::ostringstream &oss){
     "(network data unit) (50)\n";
   oss<<"--reverse_tolerance (optional) <double>: proportion "
       "of reverse movement allowed on an edge\n";
+  oss<<"--window_size (optional) <int>: trajectories with more points "
+      "are split into windows of this size matched in parallel, "
+      "0 to disable (0)\n";
+  oss<<"--min_point_distance (optional) <double>: points closer than "
+      "this distance to the previous kept point are collapsed "
+      "before matching (0)\n";
+  oss<<"--min_point_interval (optional) <double>: points within this "
+      "time interval of the previous kept point are collapsed "
+      "before matching (0)\n";
+  oss<<"--beam_width (optional) <int>: candidates with the highest "
+      "probability kept in each layer, the shortest paths of "
+      "trajectories split into windows are not pruned, 0 to disable (0)\n";
+  oss<<"--beam_margin (optional) <double>: candidates whose log "
+      "probability is lower than the best by more than the margin are "
+      "pruned, 0 to disable (0)\n";
+  oss<<"--beam_check: if specified, trajectories are matched again "
+      "without pruning to count the paths changed by pruning\n";
+  oss<<"--adaptive_search: if specified, candidates are searched by "
+      "an incremental nearest neighbour query stopped after k "
+      "candidates are found within radius\n";
+  oss<<"--heading_tolerance (optional) <double>: candidates whose edge "
+      "direction differs from the heading estimated from the neighbouring "
+      "points by more than this angle in degrees are ranked after the "
+      "others, 0 to disable (0)\n";
+  oss<<"--candidate_cache_size (optional) <int>: number of grid cells "
+      "whose nearby edges are cached for the candidate search, "
+      "0 to disable (0)\n";
+  oss<<"--path_cache_size (optional) <int>: number of shortest paths "
+      "unpacked from the UBODT which are cached for the construction of "
+      "the complete paths, 0 to disable (0)\n";
 };
 
 bool FastMapMatchConfig::validate() const {
@@ -78,51 +174,157 @@ bool FastMapMatchConfig::validate() const {
                     k, radius, gps_error,reverse_tolerance);
     return false;
   }
+  if (window_size < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter window_size {}", window_size);
+    return false;
+  }
+  if (min_point_distance < 0 || min_point_interval < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter min_point_distance {} "
+      "min_point_interval {}", min_point_distance, min_point_interval);
+    return false;
+  }
+  if (beam_width < 0 || beam_margin < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter beam_width {} beam_margin {}",
+                    beam_width, beam_margin);
+    return false;
+  }
+  if (window_size > 0 && (beam_width > 0 || beam_margin > 0)) {
+    SPDLOG_WARN("Beam pruning does not skip the shortest path search "
+                "of trajectories split into windows");
+  }
+  if (heading_tolerance < 0 || heading_tolerance > 180) {
+    SPDLOG_CRITICAL("Invalid mm parameter heading_tolerance {}",
+                    heading_tolerance);
+    return false;
+  }
+  if (candidate_cache_size < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter candidate_cache_size {}",
+                    candidate_cache_size);
+    return false;
+  }
+  if (path_cache_size < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter path_cache_size {}",
+                    path_cache_size);
+    return false;
+  }
   return true;
 }
 
-MatchResult FastMapMatch::match_traj(const Trajectory &traj,
-                                     const FastMapMatchConfig &config) {
-  SPDLOG_DEBUG("Count of points in trajectory {}", traj.geom.get_num_points());
+Traj_Candidates FastMapMatch::search_candidates(
+  const Trajectory &traj, const FastMapMatchConfig &config) {
   SPDLOG_DEBUG("Search candidates");
-  Traj_Candidates tc = network_.search_tr_cs_knn(
-    traj.geom, config.k, config.radius);
+  CandidateCache *cache = get_candidate_cache(config);
+  // Long trajectories are split into windows processed in parallel
+  return get_window_size(traj, config) > 0 ?
+    network_.search_tr_cs_knn_omp(traj.geom, config.k, config.radius,
+                                  config.adaptive_search,
+                                  config.heading_tolerance,
+                                  config.gps_error, cache) :
+    network_.search_tr_cs_knn(traj.geom, config.k, config.radius,
+                              config.adaptive_search,
+                              config.heading_tolerance,
+                              config.gps_error, cache);
+}
+
+TGOpath FastMapMatch::infer_opath(TransitionGraph *tg,
+                                  const Traj_Candidates &tc,
+                                  const Trajectory &traj,
+                                  const FastMapMatchConfig &config) {
   SPDLOG_DEBUG("Trajectory candidate {}", tc);
-  if (tc.empty()) return MatchResult{};
-  SPDLOG_DEBUG("Generate transition graph");
-  TransitionGraph tg(tc, config.gps_error);
+  int window = get_window_size(traj, config);
   SPDLOG_DEBUG("Update cost in transition graph");
   // The network will be used internally to update transition graph
-  update_tg(&tg, traj, config.reverse_tolerance);
+  update_tg(tg, traj, config, window);
   SPDLOG_DEBUG("Optimal path inference");
-  TGOpath tg_opath = tg.backtrack();
+  TGOpath tg_opath = tg->backtrack();
   SPDLOG_DEBUG("Optimal path size {}", tg_opath.size());
-  MatchedCandidatePath matched_candidate_path(tg_opath.size());
-  std::transform(tg_opath.begin(), tg_opath.end(),
-                 matched_candidate_path.begin(),
-                 [](const TGNode *a) {
-    return MatchedCandidate{
-      *(a->c), a->ep, a->tp, a->sp_dist
-    };
-  });
-  O_Path opath(tg_opath.size());
-  std::transform(tg_opath.begin(), tg_opath.end(),
-                 opath.begin(),
-                 [](const TGNode *a) {
-    return a->c->edge->id;
-  });
+  if (config.beam_check && (config.beam_width > 0 || config.beam_margin > 0)) {
+    FastMapMatchConfig full_config = config;
+    full_config.beam_width = 0;
+    full_config.beam_margin = 0;
+    TransitionGraph full_tg(tc, config.gps_error);
+    update_tg(&full_tg, traj, full_config, window);
+    TGOpath full_opath = full_tg.backtrack();
+    ++beam_stats_.checked_trajectories;
+    if (tg_opath.size() != full_opath.size() ||
+        !std::equal(tg_opath.begin(), tg_opath.end(), full_opath.begin(),
+                    [](const TGNode *a, const TGNode *b) {
+      return a->c->index == b->c->index;
+    })) {
+      SPDLOG_DEBUG("Traj {} optimal path changed by pruning", traj.id);
+      ++beam_stats_.changed_paths;
+    }
+  }
+  return tg_opath;
+}
+
+int FastMapMatch::get_window_size(const Trajectory &traj,
+                              const FastMapMatchConfig &config) {
+  return (config.window_size > 0 &&
+    traj.geom.get_num_points() > config.window_size) ? config.window_size : 0;
+}
+
+MatchResult FastMapMatch::match_traj(const Trajectory &traj,
+                                     const FastMapMatchConfig &config,
+                                     int fields) {
+  SPDLOG_DEBUG("Count of points in trajectory {}", traj.geom.get_num_points());
+  if (config.min_point_distance > 0 || config.min_point_interval > 0) {
+    std::vector<int> kept_indices;
+    Trajectory filtered = filter_trajectory(
+      traj, config.min_point_distance, config.min_point_interval,
+      &kept_indices);
+    if (kept_indices.size() < traj.geom.get_num_points()) {
+      FastMapMatchConfig filtered_config = config;
+      filtered_config.min_point_distance = 0;
+      filtered_config.min_point_interval = 0;
+      // Candidates of the filtered points are required by the expansion
+      MatchResult result = match_traj(filtered, filtered_config,
+                                      fields | MATCH_CANDIDATES);
+      return expand_match_result(network_, traj, result, kept_indices,
+                                 config.gps_error, fields);
+    }
+  }
+  Traj_Candidates tc = search_candidates(traj, config);
+  if (tc.empty()) return MatchResult{};
+  SPDLOG_DEBUG("Generate transition graph");
+  TransitionGraph tg(tc, config.gps_error);
+  TGOpath tg_opath = infer_opath(&tg, tc, traj, config);
+  // Only the members requested by fields are computed
+  MatchedCandidatePath matched_candidate_path;
+  if (fields & MATCH_CANDIDATES) {
+    matched_candidate_path.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   matched_candidate_path.begin(),
+                   [](const TGNode *a) {
+      return MatchedCandidate{
+        *(a->c), a->ep, a->tp, a->sp_dist
+      };
+    });
+  }
+  O_Path opath;
+  if (fields & MATCH_OPATH) {
+    opath.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   opath.begin(),
+                   [](const TGNode *a) {
+      return a->c->edge->index;
+    });
+  }
   std::vector<int> indices;
-  const std::vector<Edge> &edges = network_.get_edges();
-  C_Path cpath = ubodt_->construct_complete_path(traj.id, tg_opath, edges,
+  C_Path cpath = ubodt_->construct_complete_path(traj.id, tg_opath,
                                                  &indices,
-                                                 config.reverse_tolerance);
+                                                 config.reverse_tolerance,
+                                                 get_path_cache(config));
   SPDLOG_DEBUG("Opath is {}", opath);
   SPDLOG_DEBUG("Indices is {}", indices);
   SPDLOG_DEBUG("Complete path is {}", cpath);
-  LineString mgeom = network_.complete_path_to_geometry(
-    traj.geom, cpath);
+  LineString mgeom;
+  if (fields & MATCH_MGEOM) {
+    mgeom = network_.complete_path_to_geometry(traj.geom, cpath);
+  }
   return MatchResult{
-    traj.id, matched_candidate_path, opath, cpath, indices, mgeom};
+    traj.id, std::move(matched_candidate_path), std::move(opath),
+    std::move(cpath), std::move(indices), std::move(mgeom)};
 }
 
 PyMatchResult FastMapMatch::match_wkt(
@@ -133,8 +335,8 @@ PyMatchResult FastMapMatch::match_wkt(
   MatchResult result = match_traj(traj, config);
   PyMatchResult output;
   output.id = result.id;
-  output.opath = result.opath;
-  output.cpath = result.cpath;
+  output.opath = network_.get_edge_ids(result.opath);
+  output.cpath = network_.get_edge_ids(result.cpath);
   output.mgeom = result.mgeom;
   output.indices = result.indices;
   for (int i = 0; i < result.opt_candidate_path.size(); ++i) {
@@ -156,6 +358,45 @@ PyMatchResult FastMapMatch::match_wkt(
   return output;
 };
 
+void FastMapMatch::match_points(const double *xs, const double *ys,
+                                const double *ts, std::size_t n,
+                                const FastMapMatchConfig &config,
+                                ResultSink &sink) {
+  Trajectory traj;
+  for (std::size_t i = 0; i < n; ++i) traj.geom.add_point(xs[i], ys[i]);
+  if (ts != nullptr) traj.timestamps.assign(ts, ts + n);
+  if (config.min_point_distance > 0 || config.min_point_interval > 0) {
+    // The result of a filtered trajectory is expanded by match_traj
+    MatchResult result = match_traj(
+      traj, config, sink.need_geometry() ? MATCH_ALL : MATCH_CANDIDATES);
+    write_to_sink(network_, result, n, &sink);
+    return;
+  }
+  Traj_Candidates tc = search_candidates(traj, config);
+  if (tc.empty()) {
+    write_to_sink(network_, traj, TGOpath{}, C_Path{}, {}, &sink);
+    return;
+  }
+  TransitionGraph tg(tc, config.gps_error);
+  TGOpath tg_opath = infer_opath(&tg, tc, traj, config);
+  std::vector<int> indices;
+  C_Path cpath = ubodt_->construct_complete_path(traj.id, tg_opath,
+                                                 &indices,
+                                                 config.reverse_tolerance,
+                                                 get_path_cache(config));
+  write_to_sink(network_, traj, tg_opath, cpath, indices, &sink);
+}
+
+PyBatchResult FastMapMatch::match_batch(
+  const std::vector<double> &xs, const std::vector<double> &ys,
+  const std::vector<double> &timestamps,
+  const std::vector<long long> &offsets,
+  const FastMapMatchConfig &config, int num_threads) {
+  return MM::match_batch(
+    network_, xs, ys, timestamps, offsets, num_threads,
+    [&](const Trajectory &traj) { return match_traj(traj, config); });
+}
+
 std::string FastMapMatch::match_gps_file(
   const FMM::CONFIG::GPSConfig &gps_config,
   const FMM::CONFIG::ResultConfig &result_config,
@@ -169,7 +410,8 @@ std::string FastMapMatch::match_gps_file(
     oss<<"gps_config invalid\n";
     validate = false;
   }
-  if (!result_config.validate()) {
+  if (!result_config.validate() ||
+      !result_config.validate_shards(gps_config.get_files())) {
     oss<<"result_config invalid\n";
     validate = false;
   }
@@ -182,30 +424,72 @@ std::string FastMapMatch::match_gps_file(
     return oss.str();
   }
   // Start map matching
-  int progress = 0;
-  int points_matched = 0;
-  int total_points = 0;
-  int traj_matched = 0;
-  int total_trajs = 0;
+  std::atomic<int> progress{0};
+  std::atomic<int> points_matched{0};
+  std::atomic<int> total_points{0};
+  std::atomic<int> traj_matched{0};
+  std::atomic<int> total_trajs{0};
   int step_size = 1000;
   auto begin_time = UTIL::get_current_time();
-  FMM::IO::GPSReader reader(gps_config);
-  FMM::IO::CSVMatchResultWriter writer(result_config.file,
-                                       result_config.output_config);
-  if (use_omp){
-    int buffer_trajectories_size = 100000;
-    while (reader.has_next_trajectory()) {
-      std::vector<Trajectory> trajectories =
-        reader.read_next_N_trajectories(buffer_trajectories_size);
-      int trajectories_fetched = trajectories.size();
-      #pragma omp parallel for
-      for (int i = 0; i < trajectories_fetched; ++i) {
-        Trajectory &trajectory = trajectories[i];
+  // Only the members of the result exported are computed
+  int match_fields = FMM::IO::CSVMatchResultWriter::get_match_fields(
+    result_config.output_config);
+  // For a sharded result, the files are matched one after another into
+  // their own result file, otherwise they are read as a single file.
+  std::vector<std::string> gps_files = {gps_config.file};
+  if (result_config.is_sharded()) gps_files = gps_config.get_files();
+  for (const std::string &gps_file : gps_files) {
+    FMM::CONFIG::GPSConfig file_gps_config = gps_config;
+    file_gps_config.file = gps_file;
+    std::string result_file = result_config.is_sharded() ?
+      result_config.get_shard_file(gps_file) : result_config.file;
+    FMM::IO::GPSReader reader(file_gps_config);
+    FMM::IO::CSVMatchResultWriter writer(result_file,
+                                         result_config.output_config,
+                                         network_,
+                                         result_config.reorder_window);
+    if (use_omp){
+      // Windows of a long trajectory are already matched in parallel,
+      // so long trajectories are matched one at a time.
+      std::mutex long_trajectory_mutex;
+      run_match_pipeline(
+        reader,
+        [&](const Trajectory &trajectory) -> MM::MatchResult {
+          if (fmm_config.window_size > 0 &&
+              trajectory.geom.get_num_points() > fmm_config.window_size) {
+            std::lock_guard<std::mutex> lock(long_trajectory_mutex);
+            return match_traj(trajectory, fmm_config, match_fields);
+          }
+          return match_traj(trajectory, fmm_config, match_fields);
+        },
+        [&](std::size_t index, const std::vector<Trajectory> &trajectories,
+            const std::vector<MM::MatchResult> &results) {
+          writer.write_results(index,trajectories,results);
+          for (std::size_t i = 0; i < trajectories.size(); ++i) {
+            const Trajectory &trajectory = trajectories[i];
+            int points_in_tr = trajectory.geom.get_num_points();
+            if (!results[i].cpath.empty()) {
+              points_matched += points_in_tr;
+              traj_matched+=1;
+            }
+            total_points += points_in_tr;
+            total_trajs += 1;
+            int done = ++progress;
+            if (done % step_size == 0) {
+              SPDLOG_INFO("Progress {}", done);
+            }
+          }
+        });
+    } else {
+      while (reader.has_next_trajectory()) {
+        if (progress % step_size == 0) {
+          SPDLOG_INFO("Progress {}", progress.load());
+        }
+        Trajectory trajectory = reader.read_next_trajectory();
         int points_in_tr = trajectory.geom.get_num_points();
         MM::MatchResult result = match_traj(
-            trajectory, fmm_config);
+          trajectory, fmm_config, match_fields);
         writer.write_result(trajectory,result);
-        #pragma omp critical
         if (!result.cpath.empty()) {
           points_matched += points_in_tr;
           traj_matched+=1;
@@ -213,31 +497,8 @@ std::string FastMapMatch::match_gps_file(
         total_points += points_in_tr;
         total_trajs += 1;
         ++progress;
-        if (progress % step_size == 0) {
-          std::stringstream buf;
-          buf << "Progress " << progress << '\n';
-          std::cout << buf.rdbuf();
-        }
       }
     }
-  } else {
-    while (reader.has_next_trajectory()) {
-      if (progress % step_size == 0) {
-        SPDLOG_INFO("Progress {}", progress);
-      }
-      Trajectory trajectory = reader.read_next_trajectory();
-      int points_in_tr = trajectory.geom.get_num_points();
-      MM::MatchResult result = match_traj(
-        trajectory, fmm_config);
-      writer.write_result(trajectory,result);
-      if (!result.cpath.empty()) {
-        points_matched += points_in_tr;
-        traj_matched+=1;
-      }
-      total_points += points_in_tr;
-      total_trajs += 1;
-      ++progress;
-    }
   }
   auto end_time = UTIL::get_current_time();
   double duration = UTIL::get_duration(begin_time,end_time);
@@ -248,67 +509,212 @@ std::string FastMapMatch::match_gps_file(
      << traj_matched <<"\n";
   oss<<"Map match percentage " << points_matched / (double) total_points <<"\n";
   oss<<"Map match speed " << points_matched / duration << " points/s \n";
+  if (fmm_config.beam_width > 0 || fmm_config.beam_margin > 0) {
+    oss<<"Beam pruned nodes " << beam_stats_.pruned_nodes << " of "
+       << beam_stats_.total_nodes << "\n";
+    oss<<"Beam changed paths " << beam_stats_.changed_paths << " of "
+       << beam_stats_.checked_trajectories << " checked\n";
+  }
   return oss.str();
 };
 
+CandidateCache *FastMapMatch::get_candidate_cache(
+  const FastMapMatchConfig &config) {
+  if (config.candidate_cache_size <= 0) return nullptr;
+  std::call_once(candidate_cache_flag_, [&]() {
+    SPDLOG_INFO("Create candidate cache of {} cells of size {}",
+                config.candidate_cache_size, config.radius);
+    candidate_cache_.reset(
+      new CandidateCache(config.candidate_cache_size, config.radius));
+  });
+  return candidate_cache_.get();
+}
+
+const CandidateCache *FastMapMatch::get_candidate_cache() const {
+  return candidate_cache_.get();
+}
+
+SPPathCache *FastMapMatch::get_path_cache(const FastMapMatchConfig &config) {
+  if (config.path_cache_size <= 0) return nullptr;
+  std::call_once(path_cache_flag_, [&]() {
+    SPDLOG_INFO("Create shortest path cache of {} paths",
+                config.path_cache_size);
+    path_cache_.reset(new SPPathCache(config.path_cache_size));
+  });
+  return path_cache_.get();
+}
+
+const SPPathCache *FastMapMatch::get_path_cache() const {
+  return path_cache_.get();
+}
+
+const BeamStats &FastMapMatch::get_beam_stats() const {
+  return beam_stats_;
+}
+
 double FastMapMatch::get_sp_dist(
   const Candidate *ca, const Candidate *cb, double reverse_tolerance) {
   double sp_dist = 0;
+  if (direct_sp_dist(ca, cb, reverse_tolerance, &sp_dist)) return sp_dist;
+  Record *r = ubodt_->look_up(ca->edge->target, cb->edge->source);
+  // No sp path exist from O to D.
+  if (r == nullptr) return std::numeric_limits<double>::infinity();
+  // calculate original SP distance
+  return r->cost + ca->edge->length - ca->offset + cb->offset;
+}
+
+bool FastMapMatch::direct_sp_dist(const Candidate *ca, const Candidate *cb,
+                                  double reverse_tolerance, double *dist) {
   if (ca->edge->id == cb->edge->id && ca->offset <= cb->offset) {
-    sp_dist = cb->offset - ca->offset;
+    *dist = cb->offset - ca->offset;
   } else if (ca->edge->id == cb->edge->id &&
     ca->offset - cb->offset < ca->edge->length * reverse_tolerance) {
-    sp_dist = 0;
-  }
-  else if (ca->edge->target == cb->edge->source) {
+    *dist = 0;
+  } else if (ca->edge->target == cb->edge->source) {
     // Transition on the same OD nodes
-    sp_dist = ca->edge->length - ca->offset + cb->offset;
+    *dist = ca->edge->length - ca->offset + cb->offset;
   } else {
-    Record *r = ubodt_->look_up(ca->edge->target, cb->edge->source);
-    // No sp path exist from O to D.
-    if (r == nullptr) return std::numeric_limits<double>::infinity();
-    // calculate original SP distance
-    sp_dist = r->cost + ca->edge->length - ca->offset + cb->offset;
+    return false;
   }
-  return sp_dist;
+  return true;
 }
 
 void FastMapMatch::update_tg(
   TransitionGraph *tg,
-  const Trajectory &traj, double reverse_tolerance) {
+  const Trajectory &traj, const FastMapMatchConfig &config,
+  int window_size) {
   SPDLOG_DEBUG("Update transition graph");
   std::vector<TGLayer> &layers = tg->get_layers();
   std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(traj.geom);
   int N = layers.size();
-  for (int i = 0; i < N - 1; ++i) {
-    SPDLOG_DEBUG("Update layer {} ", i);
-    bool connected = false;
-    update_layer(i, &(layers[i]), &(layers[i + 1]),
-                 eu_dists[i], reverse_tolerance, &connected);
-    if (!connected){
-      SPDLOG_WARN("Traj {} unmatched as point {} and {} not connected",
-        traj.id, i, i+1);
-      tg->print_optimal_info();
-      break;
+  double reverse_tolerance = config.reverse_tolerance;
+  bool prune = config.beam_width > 0 || config.beam_margin > 0;
+  long long total_nodes = 0;
+  long long pruned_nodes = 0;
+  // The shortest path distances do not depend on the accumulated
+  // probabilities, therefore in a window they are calculated for a block
+  // of windows in parallel and the Viterbi update runs sequentially on
+  // the block, which gives the same result as a single thread.
+  int block_size = window_size > 0 ?
+    window_size * omp_get_max_threads() : N;
+  std::vector<std::vector<double>> sp_dists;
+  if (window_size > 0) sp_dists.resize(block_size);
+  // Distances of the layers updated one by one, batched by layer
+  std::vector<double> layer_sp_dists;
+  bool connected = true;
+  for (int start = 0; start < N - 1 && connected; start += block_size) {
+    int end = std::min(start + block_size, N - 1);
+    if (window_size > 0) {
+      int windows = (end - start + window_size - 1) / window_size;
+      #pragma omp parallel for schedule(dynamic)
+      for (int w = 0; w < windows; ++w) {
+        int wend = std::min(start + (w + 1) * window_size, end);
+        for (int i = start + w * window_size; i < wend; ++i) {
+          calc_layer_sp_dist(layers[i], layers[i + 1], reverse_tolerance,
+                             &sp_dists[i - start]);
+        }
+      }
+    }
+    for (int i = start; i < end && connected; ++i) {
+      SPDLOG_DEBUG("Update layer {} ", i);
+      double beam_threshold = -std::numeric_limits<double>::infinity();
+      if (prune) {
+        beam_threshold = TransitionGraph::calc_beam_threshold(
+          layers[i], config.beam_width, config.beam_margin);
+        total_nodes += layers[i].size();
+        pruned_nodes += std::count_if(
+          layers[i].begin(), layers[i].end(), [&](const TGNode &a) {
+          return a.cumu_prob < beam_threshold;
+        });
+      }
+      if (window_size <= 0) {
+        calc_layer_sp_dist(layers[i], layers[i + 1], reverse_tolerance,
+                           &layer_sp_dists, beam_threshold);
+      }
+      update_layer(i, &(layers[i]), &(layers[i + 1]),
+                   eu_dists[i], reverse_tolerance, &connected,
+                   beam_threshold,
+                   window_size > 0 ? &sp_dists[i - start] : &layer_sp_dists);
+      if (!connected){
+        SPDLOG_WARN("Traj {} unmatched as point {} and {} not connected",
+          traj.id, i, i+1);
+        tg->print_optimal_info();
+      }
     }
   }
+  if (prune) {
+    beam_stats_.total_nodes += total_nodes;
+    beam_stats_.pruned_nodes += pruned_nodes;
+  }
   SPDLOG_DEBUG("Update transition graph done");
 }
 
+void FastMapMatch::calc_layer_sp_dist(const TGLayer &la, const TGLayer &lb,
+                                      double reverse_tolerance,
+                                      std::vector<double> *sp_dists,
+                                      double beam_threshold) {
+  sp_dists->assign(la.size() * lb.size(),
+                   std::numeric_limits<double>::infinity());
+  // The pairs needing the UBODT are looked up in groups
+  const int group_size = UBODT::LOOK_UP_GROUP;
+  NodeIndex sources[group_size], targets[group_size];
+  double costs[group_size];
+  const Candidate *cas[group_size], *cbs[group_size];
+  std::size_t positions[group_size];
+  int n = 0;
+  auto resolve = [&]() {
+    ubodt_->look_up_many(sources, targets, n, costs);
+    for (int i = 0; i < n; ++i) {
+      (*sp_dists)[positions[i]] =
+        costs[i] + cas[i]->edge->length - cas[i]->offset + cbs[i]->offset;
+    }
+    n = 0;
+  };
+  std::size_t position = 0;
+  for (auto iter_a = la.begin(); iter_a != la.end(); ++iter_a) {
+    // Pruned by beam search
+    if (iter_a->cumu_prob < beam_threshold) {
+      position += lb.size();
+      continue;
+    }
+    for (auto iter_b = lb.begin(); iter_b != lb.end(); ++iter_b) {
+      const Candidate *ca = iter_a->c, *cb = iter_b->c;
+      if (!direct_sp_dist(ca, cb, reverse_tolerance,
+                          &(*sp_dists)[position])) {
+        sources[n] = ca->edge->target;
+        targets[n] = cb->edge->source;
+        cas[n] = ca;
+        cbs[n] = cb;
+        positions[n] = position;
+        if (++n == group_size) resolve();
+      }
+      ++position;
+    }
+  }
+  if (n > 0) resolve();
+}
+
 void FastMapMatch::update_layer(int level,
                                 TGLayer *la_ptr,
                                 TGLayer *lb_ptr,
                                 double eu_dist,
                                 double reverse_tolerance,
-                                bool *connected) {
+                                bool *connected,
+                                double beam_threshold,
+                                const std::vector<double> *sp_dists) {
   // SPDLOG_TRACE("Update layer");
   TGLayer &lb = *lb_ptr;
   bool layer_connected = false;
+  int nb = lb.size();
   for (auto iter_a = la_ptr->begin(); iter_a != la_ptr->end(); ++iter_a) {
+    // Pruned by beam search
+    if (iter_a->cumu_prob < beam_threshold) continue;
     NodeIndex source = iter_a->c->index;
+    int pair_index = std::distance(la_ptr->begin(), iter_a) * nb;
     for (auto iter_b = lb_ptr->begin(); iter_b != lb_ptr->end(); ++iter_b) {
-      double sp_dist = get_sp_dist(iter_a->c, iter_b->c,
-        reverse_tolerance);
+      double sp_dist = sp_dists != nullptr ? (*sp_dists)[pair_index] :
+        get_sp_dist(iter_a->c, iter_b->c, reverse_tolerance);
+      ++pair_index;
       double tp = TransitionGraph::calc_tp(sp_dist, eu_dist);
       double temp = iter_a->cumu_prob + log(tp) + log(iter_b->ep);
       SPDLOG_TRACE("L {} f {} t {} sp {} dist {} tp {} ep {} fcp {} tcp {}",
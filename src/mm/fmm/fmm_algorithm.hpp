@@ -14,11 +14,15 @@
 #include "network/network_graph.hpp"
 #include "mm/transition_graph.hpp"
 #include "mm/fmm/ubodt.hpp"
+#include "mm/result_sink.hpp"
 #include "python/pyfmm.hpp"
 #include "config/gps_config.hpp"
 #include "config/result_config.hpp"
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <limits>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
@@ -44,6 +48,49 @@ struct FastMapMatchConfig{
   double radius; /**< Search radius*/
   double gps_error; /**< GPS error */
   double reverse_tolerance;
+  int window_size; /**< Trajectories with more points than window_size
+                        are split into windows whose candidate search and
+                        transition probabilities are computed in parallel,
+                        0 means no split */
+  double min_point_distance; /**< points closer than this distance to
+                                  the last kept point are dropped before
+                                  matching, 0 means no filter */
+  double min_point_interval; /**< points with a time interval to the last
+                                  kept point smaller than this value are
+                                  dropped before matching,
+                                  0 means no filter */
+  int beam_width; /**< number of candidates with the highest
+                       accumulative probability kept in each layer,
+                       0 means no pruning. The shortest paths of
+                       trajectories split into windows are searched
+                       before the probabilities are known, so there
+                       pruning only saves the Viterbi update. */
+  double beam_margin; /**< candidates whose accumulative log probability
+                           is lower than the best by more than this margin
+                           are pruned, 0 means no pruning */
+  bool beam_check; /**< if true and pruning is enabled, trajectories are
+                        matched again without pruning to count
+                        the paths changed by pruning */
+  bool adaptive_search; /**< if true, the candidates of a point are
+                             searched by an incremental nearest neighbour
+                             query which stops after k candidates are
+                             found, otherwise all edges within radius
+                             are examined */
+  double heading_tolerance; /**< maximum difference in degrees between
+                                 the heading of a point and the direction
+                                 of a candidate edge, candidates exceeding
+                                 it only fill the remaining of the k slots,
+                                 0 means no check */
+  int candidate_cache_size; /**< number of grid cells whose nearby edges
+                                 are cached by the model and reused by
+                                 the candidate search of the following
+                                 points, 0 means no cache. The cells have
+                                 the size of the search radius. The
+                                 adaptive search does not use it. */
+  int path_cache_size; /**< number of shortest paths unpacked from the
+                            UBODT which are cached by the model and
+                            reused by the complete paths of the following
+                            trajectories, 0 means no cache */
   /**
    * Check if the configuration is valid or not
    * @return true if valid
@@ -99,10 +146,13 @@ class FastMapMatch {
    * Match a trajectory to the road network
    * @param  traj   input trajector data
    * @param  config configuration of map matching algorithm
+   * @param  fields bit mask of %MatchResultField specifying the optional
+   * members of the result computed, the others are left empty
    * @return map matching result
    */
   MatchResult match_traj(const CORE::Trajectory &traj,
-                         const FastMapMatchConfig &config);
+                         const FastMapMatchConfig &config,
+                         int fields = MATCH_ALL);
   /**
    * Match a wkt linestring to the road network.
    * @param wkt WKT representation of a trajectory
@@ -111,6 +161,37 @@ class FastMapMatch {
    */
   PYTHON::PyMatchResult match_wkt(
       const std::string &wkt,const FastMapMatchConfig &config);
+  /**
+   * Match a trajectory given as coordinate arrays and write the result
+   * into a sink, without building a WKT or a MatchResult.
+   * @param xs x of the points
+   * @param ys y of the points
+   * @param ts timestamp of the points, can be nullptr
+   * @param n number of points
+   * @param config Map matching configuration
+   * @param sink receiver of the result
+   */
+  void match_points(const double *xs, const double *ys, const double *ts,
+                    std::size_t n, const FastMapMatchConfig &config,
+                    ResultSink &sink);
+  /**
+   * Match a batch of trajectories stored in flat arrays with several
+   * threads, see MM::match_batch for the layout of the arrays. In Python,
+   * the arrays can be NumPy arrays or any object supporting the buffer
+   * protocol, and the GIL is released while matching.
+   * @param xs x of all the points
+   * @param ys y of all the points
+   * @param timestamps timestamp of all the points, can be empty
+   * @param offsets offsets of the trajectories in the points
+   * @param config Map matching configuration
+   * @param num_threads number of threads, 0 means the number of cores
+   * @return Map matching results in flat arrays
+   */
+  PYTHON::PyBatchResult match_batch(
+      const std::vector<double> &xs, const std::vector<double> &ys,
+      const std::vector<double> &timestamps,
+      const std::vector<long long> &offsets,
+      const FastMapMatchConfig &config, int num_threads = 0);
   /**
    * Match GPS data stored in a file
    * @param  gps_config    [description]
@@ -125,6 +206,22 @@ class FastMapMatch {
     const FastMapMatchConfig &config,
     bool use_omp = true
   );
+  /**
+   * Get the counters of beam pruning accumulated by the model
+   */
+  const BeamStats &get_beam_stats() const;
+  /**
+   * Get the candidate cache of the model
+   * @return the cache, nullptr if no trajectory is matched with a
+   * positive candidate_cache_size yet
+   */
+  const NETWORK::CandidateCache *get_candidate_cache() const;
+  /**
+   * Get the shortest path cache of the model
+   * @return the cache, nullptr if no trajectory is matched with a
+   * positive path_cache_size yet
+   */
+  const SPPathCache *get_path_cache() const;
  protected:
   /**
    * Get shortest path distance between two candidates
@@ -135,15 +232,47 @@ class FastMapMatch {
   double get_sp_dist(const Candidate *ca,
                      const Candidate *cb,
                      double reverse_tolerance);
+  /**
+   * Get the shortest path distance between two candidates when it does
+   * not need the UBODT, i.e., they are on the same edge or on adjacent
+   * edges
+   * @param ca from candidate
+   * @param cb to candidate
+   * @param reverse_tolerance reverse movement allowed on an edge
+   * @param dist the distance
+   * @return false if the distance must be looked up in the UBODT
+   */
+  static bool direct_sp_dist(const Candidate *ca, const Candidate *cb,
+                             double reverse_tolerance, double *dist);
   /**
    * Update probabilities in a transition graph
    * @param tg transition graph
    * @param traj raw trajectory
    * @param config map match configuration
+   * @param window_size if positive, the shortest path distances of the
+   * layers are calculated in parallel for windows of window_size layers
+   * before the probabilities are propagated sequentially
    */
   void update_tg(TransitionGraph *tg,
                  const CORE::Trajectory &traj,
-                 double reverse_tolerance = 0);
+                 const FastMapMatchConfig &config,
+                 int window_size = 0);
+  /**
+   * Calculate the shortest path distances from all nodes in layer a
+   * to all nodes in layer b
+   * @param la layer a
+   * @param lb layer b next to a
+   * @param reverse_tolerance reverse movement allowed on an edge
+   * @param sp_dists the distances stored in row major order with
+   * la.size() rows and lb.size() columns
+   * @param beam_threshold the rows of the nodes in layer a with
+   * accumulative probability lower than the threshold are not calculated
+   */
+  void calc_layer_sp_dist(const TGLayer &la, const TGLayer &lb,
+                          double reverse_tolerance,
+                          std::vector<double> *sp_dists,
+                          double beam_threshold =
+                            -std::numeric_limits<double>::infinity());
   /**
    * Update probabilities between two layers a and b in the transition graph
    * @param level   the index of layer a
@@ -152,14 +281,67 @@ class FastMapMatch {
    * @param eu_dist Euclidean distance between two observed point
    * @param connected the variable is set to false if the layer is not connected
    * with the next layer
+   * @param beam_threshold nodes in layer a with accumulative probability
+   * lower than the threshold are skipped
+   * @param sp_dists shortest path distances precomputed by
+   * calc_layer_sp_dist, if nullptr they are calculated in the update
    */
   void update_layer(int level, TGLayer *la_ptr, TGLayer *lb_ptr,
                     double eu_dist, double reverse_tolerance,
-                    bool *connected);
+                    bool *connected,
+                    double beam_threshold =
+                      -std::numeric_limits<double>::infinity(),
+                    const std::vector<double> *sp_dists = nullptr);
  private:
+  /**
+   * Search the candidates of the points of a trajectory
+   * @param traj trajectory
+   * @param config map match configuration
+   * @return the candidates of each point
+   */
+  Traj_Candidates search_candidates(const CORE::Trajectory &traj,
+                                    const FastMapMatchConfig &config);
+  /**
+   * Get the candidate cache, which is created with the cache size and
+   * search radius of the configuration on the first call
+   * @return the cache, nullptr if config.candidate_cache_size is 0
+   */
+  NETWORK::CandidateCache *get_candidate_cache(
+    const FastMapMatchConfig &config);
+  /**
+   * Get the shortest path cache, which is created with the cache size of
+   * the configuration on the first call
+   * @return the cache, nullptr if config.path_cache_size is 0
+   */
+  SPPathCache *get_path_cache(const FastMapMatchConfig &config);
+  /**
+   * Update a transition graph and find its optimal path
+   * @param tg transition graph created from tc
+   * @param tc candidates of the trajectory
+   * @param traj trajectory
+   * @param config map match configuration
+   * @return the optimal candidate of each point
+   */
+  TGOpath infer_opath(TransitionGraph *tg, const Traj_Candidates &tc,
+                      const CORE::Trajectory &traj,
+                      const FastMapMatchConfig &config);
+  /**
+   * Get the size of the windows of a trajectory matched in parallel,
+   * 0 if it is matched as a whole
+   */
+  static int get_window_size(const CORE::Trajectory &traj,
+                             const FastMapMatchConfig &config);
   const NETWORK::Network &network_;
   const NETWORK::NetworkGraph &graph_;
   std::shared_ptr<UBODT> ubodt_;
+  BeamStats beam_stats_;
+  std::once_flag candidate_cache_flag_;
+  std::unique_ptr<NETWORK::CandidateCache> candidate_cache_; /**< edges
+    near the cells of the points shared by the trajectories */
+  std::once_flag path_cache_flag_;
+  std::unique_ptr<SPPathCache> path_cache_; /**< paths unpacked from the
+                                                 UBODT shared by the
+                                                 trajectories */
 };
 }
 }
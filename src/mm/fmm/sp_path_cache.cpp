@@ -0,0 +1,40 @@
+#include "mm/fmm/sp_path_cache.hpp"
+
+#include <utility>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+SPPathCache::SPPathCache(std::size_t capacity, int num_shards)
+    : cache_(capacity, num_shards) {
+}
+
+SPPathCache::Path SPPathCache::find(NodeIndex source, NodeIndex target) {
+  Path path;
+  cache_.find(make_key(source, target), &path);
+  return path;
+}
+
+void SPPathCache::insert(NodeIndex source, NodeIndex target,
+                         std::vector<EdgeIndex> edges) {
+  cache_.insert(make_key(source, target),
+                std::make_shared<const std::vector<EdgeIndex>>(
+                  std::move(edges)));
+}
+
+std::size_t SPPathCache::size() const {
+  return cache_.size();
+}
+
+std::size_t SPPathCache::get_capacity() const {
+  return cache_.get_capacity();
+}
+
+const SPPathCacheStats &SPPathCache::get_stats() const {
+  return cache_.get_stats();
+}
+
+uint64_t SPPathCache::make_key(NodeIndex source, NodeIndex target) {
+  return (static_cast<uint64_t>(source) << 32) | target;
+}
@@ -0,0 +1,92 @@
+/**
+ * Fast map matching.
+ *
+ * Cache of the shortest paths unpacked from a UBODT, shared by the
+ * trajectories matched by fmm.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SP_PATH_CACHE_HPP
+#define FMM_SP_PATH_CACHE_HPP
+
+#include "network/type.hpp"
+#include "util/sharded_clock_cache.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Counters of a shortest path cache, a miss is a path unpacked from the
+ * UBODT
+ */
+typedef UTIL::ClockCacheStats SPPathCacheStats;
+
+/**
+ * A bounded cache of the edges of the shortest paths between pairs of
+ * nodes, safe to use from multiple threads.
+ *
+ * A path of n edges is unpacked from a UBODT with n look ups at random
+ * positions of the table. Consecutive trajectories often follow the same
+ * corridors, so the paths are kept and copied from a single contiguous
+ * array when they are needed again.
+ *
+ * The paths are kept in a ShardedClockCache indexed by the pair.
+ */
+class SPPathCache {
+ public:
+  /**
+   * Edges of a path, which stay valid while they are used even if the
+   * path is evicted
+   */
+  typedef std::shared_ptr<const std::vector<NETWORK::EdgeIndex>> Path;
+  /**
+   * Create a cache
+   * @param capacity maximum number of paths, rounded up to a multiple of
+   * the number of shards
+   * @param num_shards number of shards, rounded up to a power of 2 and
+   * reduced for a small capacity
+   */
+  explicit SPPathCache(std::size_t capacity, int num_shards = 64);
+  /**
+   * Find the path between a pair of nodes
+   * @param source source node
+   * @param target target node
+   * @return the edges of the path, nullptr if it is not cached
+   */
+  Path find(NETWORK::NodeIndex source, NETWORK::NodeIndex target);
+  /**
+   * Store the path between a pair of nodes
+   * @param source source node
+   * @param target target node
+   * @param edges edges of the path
+   */
+  void insert(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+              std::vector<NETWORK::EdgeIndex> edges);
+  /**
+   * Get the number of paths cached
+   */
+  std::size_t size() const;
+  /**
+   * Get the maximum number of paths
+   */
+  std::size_t get_capacity() const;
+  /**
+   * Get the counters of the cache
+   */
+  const SPPathCacheStats &get_stats() const;
+ private:
+  static uint64_t make_key(NETWORK::NodeIndex source,
+                           NETWORK::NodeIndex target);
+  UTIL::ShardedClockCache<uint64_t, Path> cache_;
+}; // SPPathCache
+
+} // MM
+} // FMM
+
+#endif // FMM_SP_PATH_CACHE_HPP
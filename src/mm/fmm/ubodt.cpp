@@ -5,8 +5,19 @@
 #include "mm/fmm/ubodt.hpp"
 #include "util/util.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <limits>
 #include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifdef BOOST_OS_WINDOWS
 #include <boost/throw_exception.hpp>
@@ -29,7 +40,37 @@ UBODT::UBODT(int buckets_arg, int multiplier_arg) :
   SPDLOG_TRACE("Intialization UBODT finished");
 }
 
+UBODT::UBODT(const std::string &name, int fd, const char *data,
+             std::size_t size) :
+    buckets(reinterpret_cast<const SharedHeader *>(data)->buckets),
+    multiplier(reinterpret_cast<const SharedHeader *>(data)->multiplier),
+    shared_name(name), shared_fd(fd), shared_data(data), shared_size(size) {
+  const SharedHeader *header = reinterpret_cast<const SharedHeader *>(data);
+  num_rows = header->num_rows;
+  delta = header->delta;
+  shared_offsets = reinterpret_cast<const uint64_t *>(
+    data + sizeof(SharedHeader));
+  shared_records = reinterpret_cast<const Record *>(
+    shared_offsets + buckets + 1);
+  filter_blocks = header->filter_blocks;
+  filter = reinterpret_cast<const uint64_t *>(
+    data + get_shared_filter_offset(buckets, num_rows));
+}
+
 UBODT::~UBODT() {
+  if (shared_data != nullptr) {
+    SPDLOG_TRACE("Release shared UBODT {}", shared_name);
+    munmap(const_cast<char *>(shared_data), shared_size);
+    // No process attaches the segment while the companion lock is held,
+    // and the lock is exclusive only if no other process uses it
+    int lock_fd = lock_shared(shared_name);
+    if (lock_fd >= 0 && flock(shared_fd, LOCK_EX | LOCK_NB) == 0) {
+      unlink_shared(shared_name, shared_fd);
+    }
+    close(shared_fd);
+    if (lock_fd >= 0) close(lock_fd);
+    return;
+  }
   /* Clean hashtable */
   SPDLOG_TRACE("Clean UBODT");
   int i;
@@ -43,46 +84,98 @@ UBODT::~UBODT() {
   }
   // Destory hash table pointer
   free(hashtable);
+  free(filter_data);
   SPDLOG_TRACE("Clean UBODT finished");
 }
 
 Record *UBODT::look_up(NodeIndex source, NodeIndex target) const {
-  unsigned int h = cal_bucket_index(source, target);
-  Record *r = hashtable[h];
-  while (r != nullptr) {
-    if (r->source == source && r->target == target) {
-      return r;
-    } else {
-      r = r->next;
+  // Most of the pairs missing are rejected without walking a chain
+  if (filter != nullptr && !filter_contains(filter_hash(source, target))) {
+    return nullptr;
+  }
+  // The records are never written through the pointer returned, even
+  // when they are mapped read only
+  return const_cast<Record *>(
+    find_in_bucket(cal_bucket_index(source, target), source, target));
+}
+
+void UBODT::look_up_many(const NodeIndex *sources, const NodeIndex *targets,
+                         std::size_t n, double *costs) const {
+  const double inf = std::numeric_limits<double>::infinity();
+  uint64_t hashes[LOOK_UP_GROUP];
+  unsigned int bucket_indices[LOOK_UP_GROUP];
+  bool passed[LOOK_UP_GROUP];
+  for (std::size_t start = 0; start < n; start += LOOK_UP_GROUP) {
+    int m = std::min<std::size_t>(LOOK_UP_GROUP, n - start);
+    const NodeIndex *s = sources + start;
+    const NodeIndex *t = targets + start;
+    double *c = costs + start;
+    // Each pass prefetches what the next pass reads
+    if (filter != nullptr) {
+      for (int i = 0; i < m; ++i) {
+        hashes[i] = filter_hash(s[i], t[i]);
+        __builtin_prefetch(filter + get_filter_block(hashes[i]));
+      }
+    }
+    for (int i = 0; i < m; ++i) {
+      passed[i] = filter == nullptr || filter_contains(hashes[i]);
+      if (!passed[i]) continue;
+      bucket_indices[i] = cal_bucket_index(s[i], t[i]);
+      if (shared_records != nullptr) {
+        __builtin_prefetch(shared_offsets + bucket_indices[i]);
+      } else {
+        __builtin_prefetch(hashtable + bucket_indices[i]);
+      }
+    }
+    for (int i = 0; i < m; ++i) {
+      if (!passed[i]) continue;
+      if (shared_records != nullptr) {
+        __builtin_prefetch(shared_records + shared_offsets[bucket_indices[i]]);
+      } else if (hashtable[bucket_indices[i]] != nullptr) {
+        __builtin_prefetch(hashtable[bucket_indices[i]]);
+      }
+    }
+    for (int i = 0; i < m; ++i) {
+      c[i] = inf;
+      if (!passed[i]) continue;
+      const Record *r = find_in_bucket(bucket_indices[i], s[i], t[i]);
+      if (r != nullptr) c[i] = r->cost;
     }
   }
-  return r;
 }
 
 std::vector<EdgeIndex> UBODT::look_sp_path(NodeIndex source,
-                                           NodeIndex target) const {
+                                           NodeIndex target,
+                                           SPPathCache *cache) const {
   std::vector<EdgeIndex> edges;
   if (source == target) { return edges; }
   Record *r = look_up(source, target);
   // No transition exist from source to target
   if (r == nullptr) { return edges; }
+  // A path of a single edge is complete after the first look up
+  bool cached = cache != nullptr && r->first_n != target;
+  if (cached) {
+    SPPathCache::Path path = cache->find(source, target);
+    if (path != nullptr) return *path;
+  }
   while (r->first_n != target) {
     edges.push_back(r->next_e);
     r = look_up(r->first_n, target);
   }
   edges.push_back(r->next_e);
+  if (cached) cache->insert(source, target, edges);
   return edges;
 }
 
 C_Path UBODT::construct_complete_path(int traj_id, const TGOpath &path,
-                                      const std::vector<Edge> &edges,
                                       std::vector<int> *indices,
-                                      double reverse_tolerance) const {
+                                      double reverse_tolerance,
+                                      SPPathCache *cache) const {
   C_Path cpath;
   if (!indices->empty()) indices->clear();
   if (path.empty()) return cpath;
   int N = path.size();
-  cpath.push_back(path[0]->c->edge->id);
+  cpath.push_back(path[0]->c->edge->index);
   int current_idx = 0;
   indices->push_back(current_idx);
   SPDLOG_TRACE("Insert index {}", current_idx);
@@ -93,7 +186,7 @@ C_Path UBODT::construct_complete_path(int traj_id, const TGOpath &path,
     if ((a->edge->id != b->edge->id) || (a->offset - b->offset >
         a->edge->length * reverse_tolerance)) {
       // segs stores edge index
-      auto segs = look_sp_path(a->edge->target, b->edge->source);
+      auto segs = look_sp_path(a->edge->target, b->edge->source, cache);
       // No transition exist in UBODT
       if (segs.empty() && a->edge->target != b->edge->source) {
         SPDLOG_DEBUG("Edges not found connecting a b");
@@ -112,11 +205,9 @@ C_Path UBODT::construct_complete_path(int traj_id, const TGOpath &path,
       } else {
         SPDLOG_DEBUG("Edges connecting ab are {}", segs);
       }
-      for (int e:segs) {
-        cpath.push_back(edges[e].id);
-        ++current_idx;
-      }
-      cpath.push_back(b->edge->id);
+      cpath.insert(cpath.end(), segs.begin(), segs.end());
+      current_idx += segs.size();
+      cpath.push_back(b->edge->index);
       ++current_idx;
       indices->push_back(current_idx);
       SPDLOG_TRACE("Insert index {}", current_idx);
@@ -144,6 +235,104 @@ void UBODT::insert(Record *r) {
   hashtable[h] = r;
   if (r->cost > delta) delta = r->cost;
   ++num_rows;
+  if (filter_data != nullptr) add_to_filter(r->source, r->target);
+}
+
+std::size_t UBODT::get_filter_size() const {
+  return filter_blocks * FILTER_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+double UBODT::get_filter_false_positive_rate() const {
+  if (filter == nullptr) return 1.0;
+  // A pair passes the filter if its bit is set in each word of its block
+  double rate = 0;
+  for (uint64_t b = 0; b < filter_blocks; ++b) {
+    const uint64_t *block = filter + b * FILTER_BLOCK_WORDS;
+    double block_rate = 1;
+    for (int w = 0; w < FILTER_BLOCK_WORDS; ++w) {
+      block_rate *= __builtin_popcountll(block[w]) / 64.0;
+    }
+    rate += block_rate;
+  }
+  return rate / filter_blocks;
+}
+
+uint64_t UBODT::filter_hash(NodeIndex source, NodeIndex target) {
+  // Finalizer of splitmix64
+  uint64_t h = (static_cast<uint64_t>(source) << 32) | target;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+void UBODT::build_filter() {
+  free(filter_data);
+  filter_blocks = std::max<uint64_t>(
+    1, (num_rows * FILTER_BITS_PER_ROW + 511) / 512);
+  std::size_t size = get_filter_size();
+  void *data = nullptr;
+  if (posix_memalign(&data, 64, size) != 0) {
+    std::string message = "Allocate UBODT filter fail";
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  std::memset(data, 0, size);
+  filter_data = static_cast<uint64_t *>(data);
+  filter = filter_data;
+  for (int i = 0; i < buckets; ++i) {
+    for (const Record *r = hashtable[i]; r != nullptr; r = r->next) {
+      add_to_filter(r->source, r->target);
+    }
+  }
+  SPDLOG_INFO("UBODT filter size {} bytes false positive rate {:.4f}",
+              size, get_filter_false_positive_rate());
+}
+
+// The block of a pair is selected by the high half of its hash, and its
+// bit in each word by the low half multiplied by the salt of the word, as
+// in the split block Bloom filter of Parquet
+static const uint32_t FILTER_SALTS[8] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+uint64_t UBODT::get_filter_block(uint64_t h) const {
+  return ((h >> 32) * filter_blocks >> 32) * FILTER_BLOCK_WORDS;
+}
+
+void UBODT::add_to_filter(NodeIndex source, NodeIndex target) {
+  uint64_t h = filter_hash(source, target);
+  uint64_t *block = filter_data + get_filter_block(h);
+  for (int w = 0; w < FILTER_BLOCK_WORDS; ++w) {
+    block[w] |= uint64_t(1) << (uint32_t(h) * FILTER_SALTS[w] >> 26);
+  }
+}
+
+bool UBODT::filter_contains(uint64_t h) const {
+  const uint64_t *block = filter + get_filter_block(h);
+  for (int w = 0; w < FILTER_BLOCK_WORDS; ++w) {
+    if ((block[w] >> (uint32_t(h) * FILTER_SALTS[w] >> 26) & 1) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const Record *UBODT::find_in_bucket(unsigned int h, NodeIndex source,
+                                    NodeIndex target) const {
+  if (shared_records != nullptr) {
+    // The records of a bucket are stored contiguously
+    const Record *end = shared_records + shared_offsets[h + 1];
+    for (const Record *r = shared_records + shared_offsets[h]; r < end; ++r) {
+      if (r->source == source && r->target == target) return r;
+    }
+    return nullptr;
+  }
+  const Record *r = hashtable[h];
+  while (r != nullptr) {
+    if (r->source == source && r->target == target) return r;
+    r = r->next;
+  }
+  return nullptr;
 }
 
 long UBODT::estimate_ubodt_rows(const std::string &filename) {
@@ -241,6 +430,7 @@ std::shared_ptr<UBODT> UBODT::read_ubodt_csv(const std::string &filename,
   SPDLOG_TRACE("Estimated load factor #elements/#tablebuckets {}", lf);
   if (lf > 10) { SPDLOG_WARN("Load factor is too large."); }
   SPDLOG_INFO("Finish reading UBODT with rows {}", NUM_ROWS);
+  table->build_filter();
   return table;
 }
 
@@ -281,5 +471,185 @@ std::shared_ptr<UBODT> UBODT::read_ubodt_binary(const std::string &filename,
     SPDLOG_WARN("Load factor is too large.");
   }
   SPDLOG_INFO("Finish reading UBODT with rows {}", NUM_ROWS);
+  table->build_filter();
   return table;
 }
+
+std::shared_ptr<UBODT> UBODT::read_ubodt_shared(const std::string &filename,
+                                                const std::string &name,
+                                                int multiplier) {
+  struct stat file_stat;
+  if (stat(filename.c_str(), &file_stat) != 0) {
+    std::string message = "UBODT file not exists " + filename;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  int64_t file_size = file_stat.st_size;
+  int64_t file_mtime = file_stat.st_mtime;
+  int lock_fd = lock_shared(name);
+  if (lock_fd < 0) {
+    std::string message = "Lock shared memory fail " + name + " " +
+                          std::strerror(errno);
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  // The segment is replaced at most once, when it was created from
+  // another version of the file or left incomplete
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd >= 0) {
+      flock(fd, LOCK_EX);
+      try {
+        create_shared(filename, name, multiplier, fd, file_size, file_mtime);
+      } catch (...) {
+        unlink_shared(name, fd);
+        close(fd);
+        close(lock_fd);
+        throw;
+      }
+      flock(fd, LOCK_SH);
+    } else if (errno == EEXIST) {
+      fd = shm_open(name.c_str(), O_RDONLY, 0);
+      if (fd < 0) continue;
+      flock(fd, LOCK_SH);
+    } else {
+      close(lock_fd);
+      std::string message = "Create shared memory fail " + name + " " +
+                            std::strerror(errno);
+      SPDLOG_CRITICAL(message);
+      throw std::runtime_error(message);
+    }
+    struct stat shm_stat;
+    std::size_t size = 0;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &shm_stat) == 0 &&
+        shm_stat.st_size >= (off_t) sizeof(SharedHeader)) {
+      size = shm_stat.st_size;
+      addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    const SharedHeader *header = static_cast<const SharedHeader *>(addr);
+    bool complete = addr != MAP_FAILED &&
+      std::memcmp(header->magic, "FMMUBODT", 8) == 0 &&
+      header->version == SHARED_VERSION && header->complete == 1 &&
+      size == get_shared_filter_offset(header->buckets, header->num_rows) +
+        sizeof(uint64_t) * FILTER_BLOCK_WORDS * header->filter_blocks;
+    if (complete && header->file_size == file_size &&
+        header->file_mtime == file_mtime) {
+      close(lock_fd);
+      SPDLOG_INFO("Attach shared UBODT {} with rows {}", name,
+                  header->num_rows);
+      std::shared_ptr<UBODT> table(
+        new UBODT(name, fd, static_cast<const char *>(addr), size));
+      SPDLOG_INFO("UBODT filter size {} bytes false positive rate {:.4f}",
+                  table->get_filter_size(),
+                  table->get_filter_false_positive_rate());
+      return table;
+    }
+    if (addr != MAP_FAILED) munmap(addr, size);
+    if (complete) {
+      // Created from another version of the file, the processes using
+      // it keep it after the name is removed
+      SPDLOG_INFO("Replace shared UBODT {} of another file version", name);
+    } else {
+      // A segment is filled while the companion lock is held, so it was
+      // left incomplete by a process which failed or was killed
+      SPDLOG_WARN("Remove incomplete shared UBODT {}", name);
+    }
+    unlink_shared(name, fd);
+    close(fd);
+  }
+  close(lock_fd);
+  std::string message = "Attach shared memory fail " + name;
+  SPDLOG_CRITICAL(message);
+  throw std::runtime_error(message);
+}
+
+void UBODT::remove_shared(const std::string &name) {
+  if (shm_unlink(name.c_str()) == 0) {
+    SPDLOG_INFO("Remove shared UBODT {}", name);
+  }
+}
+
+void UBODT::create_shared(const std::string &filename,
+                          const std::string &name, int multiplier, int fd,
+                          int64_t file_size, int64_t file_mtime) {
+  std::shared_ptr<UBODT> table = read_ubodt_file(filename, multiplier);
+  SPDLOG_INFO("Create shared UBODT {}", name);
+  long long buckets = table->buckets;
+  std::size_t filter_offset =
+    get_shared_filter_offset(buckets, table->num_rows);
+  std::size_t size = filter_offset + table->get_filter_size();
+  void *addr = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (addr == MAP_FAILED) {
+    std::string message = "Allocate shared memory fail " + name + " " +
+                          std::strerror(errno);
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(addr, size, MADV_HUGEPAGE);
+#endif
+  char *data = static_cast<char *>(addr);
+  SharedHeader *header = reinterpret_cast<SharedHeader *>(data);
+  uint64_t *offsets = reinterpret_cast<uint64_t *>(data + sizeof(SharedHeader));
+  Record *records = reinterpret_cast<Record *>(offsets + buckets + 1);
+  // The records of each bucket are copied in the order of the chain, so
+  // that look_up finds the same record as in the hashtable
+  uint64_t offset = 0;
+  for (long long b = 0; b < buckets; ++b) {
+    offsets[b] = offset;
+    for (const Record *r = table->hashtable[b]; r != nullptr; r = r->next) {
+      records[offset] = *r;
+      records[offset].next = nullptr;
+      ++offset;
+    }
+  }
+  offsets[buckets] = offset;
+  std::memcpy(data + filter_offset, table->filter, table->get_filter_size());
+  std::memcpy(header->magic, "FMMUBODT", 8);
+  header->version = SHARED_VERSION;
+  header->multiplier = table->multiplier;
+  header->buckets = buckets;
+  header->num_rows = table->num_rows;
+  header->delta = table->delta;
+  header->file_size = file_size;
+  header->file_mtime = file_mtime;
+  header->filter_blocks = table->filter_blocks;
+  std::atomic_thread_fence(std::memory_order_release);
+  header->complete = 1;
+  munmap(addr, size);
+}
+
+std::size_t UBODT::get_shared_filter_offset(int64_t buckets,
+                                            int64_t num_rows) {
+  std::size_t end = sizeof(SharedHeader) + sizeof(uint64_t) * (buckets + 1)
+                    + sizeof(Record) * num_rows;
+  // The blocks are aligned to the cache lines
+  return (end + 63) / 64 * 64;
+}
+
+void UBODT::unlink_shared(const std::string &name, int fd) {
+  // The name may already refer to a segment created by another process
+  struct stat fd_stat, name_stat;
+  int name_fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (name_fd < 0) return;
+  bool same = fstat(fd, &fd_stat) == 0 && fstat(name_fd, &name_stat) == 0 &&
+    fd_stat.st_dev == name_stat.st_dev && fd_stat.st_ino == name_stat.st_ino;
+  close(name_fd);
+  if (same) {
+    shm_unlink(name.c_str());
+    SPDLOG_DEBUG("Remove shared UBODT {}", name);
+  }
+}
+
+int UBODT::lock_shared(const std::string &name) {
+  std::string lock_name = name + ".lock";
+  // The companion segment is empty and never removed, so that all the
+  // processes lock the same one
+  int fd = shm_open(lock_name.c_str(), O_RDONLY | O_CREAT, 0666);
+  if (fd >= 0) flock(fd, LOCK_EX);
+  return fd;
+}
@@ -12,8 +12,12 @@
 
 #include "network/type.hpp"
 #include "mm/transition_graph.hpp"
+#include "mm/fmm/sp_path_cache.hpp"
 #include "util/debug.hpp"
 
+#include <cstdint>
+#include <string>
+
 namespace FMM {
 namespace MM {
 
@@ -53,33 +57,54 @@ class UBODT {
    * is returned.
    */
   Record *look_up(NETWORK::NodeIndex source, NETWORK::NodeIndex target) const;
+  /**
+   * Look up the costs of a batch of OD pairs.
+   *
+   * The pairs are processed in groups whose filter blocks, buckets and
+   * first records are prefetched in successive passes, so that the
+   * memory accesses of the pairs of a group overlap instead of waiting
+   * for each other as in a loop of look_up.
+   *
+   * @param sources source nodes
+   * @param targets target nodes
+   * @param n number of pairs
+   * @param costs the cost of each pair, infinity if the pair is not
+   * found
+   */
+  void look_up_many(const NETWORK::NodeIndex *sources,
+                    const NETWORK::NodeIndex *targets, std::size_t n,
+                    double *costs) const;
 
   /**
    * Look up a shortest path (SP) containing edges from source to target.
    * In case that SP is not found, empty is returned.
    * @param  source source node
    * @param  target target node
+   * @param  cache if not nullptr, the paths of more than one edge are
+   * taken from the cache instead of being unpacked with a look up per
+   * edge, and stored in it once unpacked
    * @return  a shortest path connecting source to target
    */
   std::vector<NETWORK::EdgeIndex> look_sp_path(NETWORK::NodeIndex source,
-      NETWORK::NodeIndex target) const;
+      NETWORK::NodeIndex target, SPPathCache *cache = nullptr) const;
 
   /**
-   * Construct the complete path (a vector of edge ID) from an optimal path
-   * (a vector of optimal nodes in the transition graph)
+   * Construct the complete path (a vector of edge index) from an optimal
+   * path (a vector of optimal nodes in the transition graph)
    *
    * @param path an optimal path
-   * @param edges a vector of edges
    * @param indices the index of each optimal edge in the complete path
+   * @param reverse_tolerance reverse movement allowed on an edge
+   * @param cache cache of the shortest paths, can be nullptr
    * @return a complete path (topologically connected).
    * If there is a large gap in the optimal
    * path implying complete path cannot be found in UBDOT,
    * an empty path is returned
    */
   C_Path construct_complete_path(int traj_id, const TGOpath &path,
-                                 const std::vector<NETWORK::Edge> &edges,
                                  std::vector<int> *indices,
-                                 double reverse_tolerance) const;
+                                 double reverse_tolerance,
+                                 SPPathCache *cache = nullptr) const;
   /**
    * Get the upperbound of the UBODT
    * @return upperbound value
@@ -103,6 +128,18 @@ class UBODT {
   inline long long get_num_rows(){
     return num_rows;
   };
+  /**
+   * Get the size of the membership filter checked by look_up
+   * @return size in bytes, 0 if the filter is not built
+   */
+  std::size_t get_filter_size() const;
+  /**
+   * Estimate the false positive rate of the membership filter, which is
+   * the probability that a pair not in the table passes the filter and
+   * is searched in the hashtable
+   * @return false positive rate, 1 if the filter is not built
+   */
+  double get_filter_false_positive_rate() const;
 
   /**
    * Read UBODT from a file.
@@ -130,6 +167,44 @@ class UBODT {
    */
   static std::shared_ptr<UBODT> read_ubodt_binary(const std::string &filename,
                                                   int multiplier = 50000);
+  /**
+   * Read UBODT from a file through a named POSIX shared memory segment,
+   * so that the processes matching with the same file share a single
+   * copy of the table.
+   *
+   * If the segment exists and was created from the same file, identified
+   * by its size and modification time, it is attached read only without
+   * reading the file. Otherwise the file is read and the table is copied
+   * into a new segment, replacing a segment created from a previous
+   * version of the file. The processes already attached to the previous
+   * segment keep using it until they release it.
+   *
+   * The segment is removed when the last process using it releases its
+   * UBODT or exits. The creation, the attachment and the removal of the
+   * segment are serialized by a companion segment named name.lock, so
+   * that a process never sees a segment which is still being filled.
+   *
+   * @param  filename   input file name
+   * @param  name       name of the segment, e.g. /fmm_ubodt
+   * @param  multiplier A value used for inserting rows to the UBODT
+   * @return  A shared pointer to the UBODT data.
+   * @throw std::runtime_error if the segment cannot be created or attached
+   */
+  static std::shared_ptr<UBODT> read_ubodt_shared(const std::string &filename,
+                                                  const std::string &name,
+                                                  int multiplier = 50000);
+  /**
+   * Remove a shared memory segment created by read_ubodt_shared. The
+   * processes attached to it keep using it until they release it.
+   * @param name name of the segment
+   */
+  static void remove_shared(const std::string &name);
+  /**
+   * Check if the table is stored in a shared memory segment
+   */
+  inline bool is_shared() const {
+    return shared_data != nullptr;
+  };
   /**
    * Estimate the number of rows in a file
    * @param  filename input file name
@@ -147,12 +222,122 @@ class UBODT {
                                               a bucket. */
   static const int BUFFER_LINE = 1024; /**< Number of characters to store in
                                             a line */
+  static const int LOOK_UP_GROUP = 32; /**< pairs prefetched together by
+                                            look_up_many */
+  static const int FILTER_BITS_PER_ROW = 16; /**< bits of the membership
+                                                  filter for each row */
  private:
+  /**
+   * Header of a shared memory segment, followed by the offsets of the
+   * buckets in the records, the records sorted by bucket, whose next
+   * member is not used, and the blocks of the membership filter aligned
+   * to 64 bytes
+   */
+  struct SharedHeader {
+    char magic[8]; /**< FMMUBODT */
+    uint32_t version; /**< version of the layout */
+    uint32_t complete; /**< 1 once the segment is filled */
+    int64_t multiplier; /**< multiplier of the table */
+    int64_t buckets; /**< number of buckets */
+    int64_t num_rows; /**< number of records */
+    double delta; /**< upper bound of the table */
+    int64_t file_size; /**< size of the file read */
+    int64_t file_mtime; /**< modification time of the file read */
+    int64_t filter_blocks; /**< number of blocks of the filter */
+  };
+  static const uint32_t SHARED_VERSION = 2; /**< version of the layout */
+  static const int FILTER_BLOCK_WORDS = 8; /**< words of a filter block,
+                                                which fill a cache line */
+  /**
+   * Get the offset of the filter in a shared memory segment
+   * @param buckets number of buckets
+   * @param num_rows number of records
+   */
+  static std::size_t get_shared_filter_offset(int64_t buckets,
+                                              int64_t num_rows);
+  /**
+   * Hash an OD pair for the membership filter
+   */
+  static uint64_t filter_hash(NETWORK::NodeIndex source,
+                              NETWORK::NodeIndex target);
+  /**
+   * Build the membership filter from the rows of the hashtable
+   */
+  void build_filter();
+  /**
+   * Set the bits of an OD pair in the membership filter
+   */
+  void add_to_filter(NETWORK::NodeIndex source, NETWORK::NodeIndex target);
+  /**
+   * Get the offset in the filter of the block of a hash
+   */
+  uint64_t get_filter_block(uint64_t h) const;
+  /**
+   * Check the hash of an OD pair against the membership filter, which
+   * must be built
+   * @return false if the pair is not in the table, true if it may be
+   */
+  bool filter_contains(uint64_t h) const;
+  /**
+   * Find the record of an OD pair in its bucket
+   * @return the record, nullptr if it is not found
+   */
+  const Record *find_in_bucket(unsigned int h, NETWORK::NodeIndex source,
+                               NETWORK::NodeIndex target) const;
+  /**
+   * Constructor of UBODT attached to a shared memory segment, which is
+   * released by the destructor
+   * @param name name of the segment
+   * @param fd file descriptor of the segment, locked in shared mode
+   * @param data segment mapped in memory
+   * @param size size of the segment
+   */
+  UBODT(const std::string &name, int fd, const char *data, std::size_t size);
+  /**
+   * Create a shared memory segment from a file
+   * @param filename input file name
+   * @param name name of the segment
+   * @param multiplier A value used for inserting rows to the UBODT
+   * @param fd file descriptor of the segment created with O_EXCL, which
+   * is locked in exclusive mode
+   * @param file_size size of the file
+   * @param file_mtime modification time of the file
+   */
+  static void create_shared(const std::string &filename,
+                            const std::string &name, int multiplier, int fd,
+                            int64_t file_size, int64_t file_mtime);
+  /**
+   * Remove the name of a shared memory segment if it still refers to
+   * the segment opened
+   * @param name name of the segment
+   * @param fd file descriptor of the segment
+   */
+  static void unlink_shared(const std::string &name, int fd);
+  /**
+   * Lock the companion segment of a shared memory segment in exclusive
+   * mode, the lock is released by closing the descriptor returned
+   * @param name name of the segment
+   * @return file descriptor of the companion segment, -1 if it cannot be
+   * opened
+   */
+  static int lock_shared(const std::string &name);
   const long long multiplier;   // multiplier to get a unique ID
   const int buckets;   // number of buckets
   long long num_rows=0;   // multiplier to get a unique ID
   double delta = 0.0;
-  Record **hashtable;
+  Record **hashtable = nullptr;
+  // Blocked Bloom filter of the OD pairs, where each pair sets one bit
+  // in each word of a block of 64 bytes
+  uint64_t *filter_data = nullptr; // blocks owned by the table
+  const uint64_t *filter = nullptr;
+  uint64_t filter_blocks = 0;
+  // Members of a table stored in a shared memory segment
+  std::string shared_name;
+  int shared_fd = -1;
+  const char *shared_data = nullptr;
+  std::size_t shared_size = 0;
+  const uint64_t *shared_offsets = nullptr; // offsets of the buckets
+  const Record *shared_records = nullptr;
 };
 }
 }
@@ -3,6 +3,7 @@
 
 #include "h3_header.hpp"
 #include "util/debug.hpp"
+#include "util/formatter.hpp"
 #include <inttypes.h>
 #include <stdio.h>
 #include <sstream>
@@ -14,22 +15,26 @@ namespace FMM{
 namespace MM{
 
 std::string hexs2wkt(const std::vector<HexIndex> &hexs, int precision=12){
-  std::ostringstream oss;
-  oss << "MULTIPOLYGON(";
+  FMM::UTIL::FormatBuffer buf;
+  FMM::UTIL::append_string(buf, "MULTIPOLYGON(");
   for (int i = 0 ; i<hexs.size();++i){
     GeoBoundary boundary;
-    oss << "((";
+    FMM::UTIL::append_string(buf, "((");
     h3ToGeoBoundary(hexs[i], &boundary);
-    for (int v = 0; v < boundary.numVerts; v++) {
-      oss << std::setprecision(precision) << radsToDegs(boundary.verts[v].lon)
-          << " " << radsToDegs(boundary.verts[v].lat) << ",";
+    // The first vertex is repeated to close the ring
+    int n = boundary.numVerts;
+    for (int v = 0; n > 0 && v <= n; v++) {
+      const GeoCoord &vert = boundary.verts[v % n];
+      if (v > 0) buf.push_back(',');
+      FMM::UTIL::append_double(buf, radsToDegs(vert.lon), precision);
+      buf.push_back(' ');
+      FMM::UTIL::append_double(buf, radsToDegs(vert.lat), precision);
     }
-    oss << std::setprecision(precision) << radsToDegs(boundary.verts[0].lon)
-          << " " << radsToDegs(boundary.verts[0].lat);
-    oss << "))" << (i<hexs.size()-1?",":"");
+    FMM::UTIL::append_string(buf, "))");
+    if (i<hexs.size()-1) buf.push_back(',');
   }
-  oss << ")";
-  return oss.str();
+  buf.push_back(')');
+  return fmt::to_string(buf);
 };
 
 HexIndex latlng2hex(double lat, double lng, int level){
@@ -6,6 +6,9 @@
 #include "h3_util.hpp"
 #include "h3mm_writer.hpp"
 #include "io/gps_reader.hpp"
+#include "mm/match_pipeline.hpp"
+
+#include <atomic>
 
 namespace FMM {
 namespace MM {
@@ -165,40 +168,35 @@ public:
       return oss.str();
     }
     // Start map matching
-    int progress = 0;
+    std::atomic<int> progress{0};
     int points_matched = 0;
-    int total_points = 0;
+    std::atomic<int> total_points{0};
     int step_size = 1000;
     UTIL::TimePoint begin_time = UTIL::get_current_time();
     FMM::IO::GPSReader reader(gps_config);
     H3MatchResultWriter writer(output_config);
     if (use_omp) {
-      int buffer_trajectories_size = 100000;
-      while (reader.has_next_trajectory()) {
-        std::vector<FMM::CORE::Trajectory> trajectories =
-          reader.read_next_N_trajectories(buffer_trajectories_size);
-        int trajectories_fetched = trajectories.size();
-        #pragma omp parallel for
-        for (int i = 0; i < trajectories_fetched; ++i) {
-          FMM::CORE::Trajectory &trajectory = trajectories[i];
-          int points_in_tr = trajectory.geom.get_num_points();
-          auto result = match_traj(
-            trajectory, config);
-          writer.write_result(trajectory,result);
-          #pragma omp critical
-          total_points += points_in_tr;
-          ++progress;
-          if (progress % step_size == 0) {
-            std::stringstream buf;
-            buf << "Progress " << progress << '\n';
-            std::cout << buf.rdbuf();
+      run_match_pipeline(
+        reader,
+        [&](const FMM::CORE::Trajectory &trajectory) {
+          return match_traj(trajectory, config);
+        },
+        [&](std::size_t index,
+            const std::vector<FMM::CORE::Trajectory> &trajectories,
+            const std::vector<H3MatchResult> &results) {
+          writer.write_results(index,trajectories,results);
+          for (const FMM::CORE::Trajectory &trajectory : trajectories) {
+            total_points += trajectory.geom.get_num_points();
+            int done = ++progress;
+            if (done % step_size == 0) {
+              SPDLOG_INFO("Progress {}", done);
+            }
           }
-        }
-      }
+        });
     } else {
       while (reader.has_next_trajectory()) {
         if (progress % step_size == 0) {
-          SPDLOG_INFO("Progress {}", progress);
+          SPDLOG_INFO("Progress {}", progress.load());
         }
         FMM::CORE::Trajectory trajectory = reader.read_next_trajectory();
         int points_in_tr = trajectory.geom.get_num_points();
@@ -3,6 +3,7 @@
 #include "h3_type.hpp"
 #include "h3_util.hpp"
 #include "util/util.hpp"
+#include "io/async_file_writer.hpp"
 
 namespace FMM {
 namespace MM {
@@ -11,12 +12,15 @@ struct H3MatchResultConfig {
   H3MatchResultConfig(){
     file = "";
     write_geom = false;
+    reorder_window = 0;
   };
   H3MatchResultConfig(const std::string &filename, bool write_geom_arg) :
-    file(filename),write_geom(write_geom_arg){
+    file(filename),write_geom(write_geom_arg),reorder_window(0){
   };
   std::string file;   /**< Output file to write the result */
   bool write_geom;
+  int reorder_window; /**< if positive, results are written in the
+                           order of the input */
   /**
    * Check the validation of the configuration
    * @return true if valid otherwise false
@@ -35,6 +39,10 @@ struct H3MatchResultConfig {
       SPDLOG_CRITICAL("Output folder {} not exists",output_folder);
       return false;
     }
+    if (reorder_window < 0) {
+      SPDLOG_CRITICAL("Invalid reorder window {}",reorder_window);
+      return false;
+    }
     return true;
   };
   /**
@@ -44,12 +52,14 @@ struct H3MatchResultConfig {
     SPDLOG_INFO("H3MatchResultConfig");
     SPDLOG_INFO("File: {}",file);
     SPDLOG_INFO("Write geom: {}",write_geom);
+    SPDLOG_INFO("Reorder window: {}",reorder_window);
   };
   std::string to_string() const{
     std::ostringstream oss;
     oss << "H3MatchResultConfig\n";
     oss << "result file : " << file << "\n";
     oss << "write geom : " << (write_geom?"true":"false") << "\n";
+    oss << "reorder window : " << reorder_window << "\n";
     return oss.str();
   };
   /**
@@ -64,6 +74,7 @@ struct H3MatchResultConfig {
     if (arg_data.count("write_geom") > 0) {
       config.write_geom = true;
     }
+    config.reorder_window = arg_data["reorder_window"].as<int>();
     return config;
   };
   /**
@@ -73,7 +84,9 @@ struct H3MatchResultConfig {
     options.add_options()
       ("o,output","Output file name",
       cxxopts::value<std::string>()->default_value(""))
-      ("write_geom","Write geometry");
+      ("write_geom","Write geometry")
+      ("reorder_window","Write results in the input order",
+      cxxopts::value<int>()->default_value("0"));
   };
   /**
    * Register help information to a string stream
@@ -81,6 +94,8 @@ struct H3MatchResultConfig {
   static void register_help(std::ostringstream &oss){
     oss<<"-o,--output (required) <string>: Output file name\n";
     oss<<"--write_geom: if specified, write geometry output\n";
+    oss<<"--reorder_window (optional) <int>: if positive, results are "
+        "written in the order of the input (0)\n";
   };
 };
 
@@ -102,7 +117,7 @@ public:
 
   H3MatchResultWriter(
     const H3MatchResultConfig &config_arg) :
-    config_(config_arg), m_fstream(config_.file){
+    config_(config_arg), writer_(config_.file, config_.reorder_window){
     write_header();
   };
 
@@ -113,25 +128,48 @@ public:
    */
   void write_result(const FMM::CORE::Trajectory &traj,
                     const FMM::MM::H3MatchResult &result){
-    std::ostringstream buf;
-    buf << traj.id;
-    buf << ";" << result.hexs;
-    if (config_.write_geom)
-      buf << ";" << hexs2wkt(result.hexs, 12);
-    buf << "\n";
-    #pragma omp critical
-    m_fstream << buf.str();
+    writer_.write(format_result(traj, result));
+  };
+  /**
+   * Write the match results of a batch of trajectories as a single
+   * record, whose index decides its position in ordered mode
+   * @param index index of the batch, starting from 0 without gaps,
+   * see run_match_pipeline
+   * @param trajectories Input trajectories, which can be empty
+   * @param results Map match result of each trajectory
+   */
+  void write_results(std::size_t index,
+                     const std::vector<FMM::CORE::Trajectory> &trajectories,
+                     const std::vector<FMM::MM::H3MatchResult> &results){
+    std::string records;
+    for (std::size_t i = 0; i < trajectories.size(); ++i) {
+      records += format_result(trajectories[i], results[i]);
+    }
+    writer_.write(index, std::move(records));
   };
 private:
+  std::string format_result(const FMM::CORE::Trajectory &traj,
+                            const FMM::MM::H3MatchResult &result) const {
+    FMM::UTIL::FormatBuffer buf;
+    FMM::UTIL::append_int(buf, traj.id);
+    buf.push_back(';');
+    FMM::UTIL::append_int_vector(buf, result.hexs);
+    if (config_.write_geom) {
+      buf.push_back(';');
+      FMM::UTIL::append_string(buf, hexs2wkt(result.hexs, 12));
+    }
+    buf.push_back('\n');
+    return fmt::to_string(buf);
+  };
   void write_header(){
-    m_fstream<<"id;hex";
+    std::string header = "id;hex";
     if (config_.write_geom) {
-      m_fstream<<";geom";
+      header += ";geom";
     }
-    m_fstream<<"\n";
+    writer_.write_header(header + "\n");
   };
   H3MatchResultConfig config_;
-  std::ofstream m_fstream;
+  FMM::IO::AsyncFileWriter writer_;
 };     // CSVMatchResultWriter
 }
 }
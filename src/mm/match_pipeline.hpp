@@ -0,0 +1,238 @@
+/**
+ * Fast map matching.
+ *
+ * A reader -> matcher -> writer pipeline used to match a GPS file with
+ * multiple threads, where reading, matching and writing overlap and the
+ * trajectories buffered are bounded by their number of points, or the
+ * file is read in chunks by the matching threads.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_MATCH_PIPELINE_HPP
+#define FMM_MATCH_PIPELINE_HPP
+
+#include "core/gps.hpp"
+#include "io/gps_reader.hpp"
+#include "util/debug.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * A blocking FIFO queue whose capacity is measured by the weight of the
+ * items, such as the number of points of a trajectory, rather than by
+ * the number of items.
+ *
+ * An item heavier than the capacity is still accepted when the queue is
+ * empty, so that a single very long trajectory does not block forever.
+ * Once closed, the queue accepts no item, so that a producer does not
+ * block forever after the consumers stop.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+  /**
+   * Constructor
+   * @param capacity the maximum total weight of the items queued
+   */
+  explicit BoundedQueue(std::size_t capacity) : capacity_(capacity) {};
+  /**
+   * Push an item, blocking while the queue is full and not closed
+   * @param item the item pushed
+   * @param weight the weight of the item
+   * @return false if the queue is closed and the item is not pushed
+   */
+  bool push(T &&item, std::size_t weight) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [&] {
+      return closed_ || items_.empty() || weight_ + weight <= capacity_;
+    });
+    if (closed_) return false;
+    weight_ += weight;
+    items_.emplace_back(std::move(item), weight);
+    not_empty_.notify_one();
+    return true;
+  };
+  /**
+   * Pop an item, blocking while the queue is empty and not closed
+   * @param item the item popped, which will be updated
+   * @return false if the queue is closed and no item is left
+   */
+  bool pop(T *item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [&] { return !items_.empty() || closed_; });
+    if (items_.empty()) return false;
+    *item = std::move(items_.front().first);
+    weight_ -= items_.front().second;
+    items_.pop_front();
+    not_full_.notify_all();
+    return true;
+  };
+  /**
+   * Close the queue, the consumers return after the items left are popped
+   * and the producers return without pushing
+   */
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  };
+private:
+  std::size_t capacity_;
+  std::size_t weight_ = 0;
+  bool closed_ = false;
+  std::deque<std::pair<T, std::size_t>> items_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+};
+
+/**
+ * Match all the trajectories of a reader with a pipeline of three stages.
+ *
+ * The calling thread reads trajectories into an input queue holding at
+ * most buffer_points points, so the memory used does not depend on the
+ * size of the file. A pool of worker threads match them and pass the
+ * results to the write function, which is expected to format the result
+ * in the worker and hand it to the I/O thread of the writer, such as
+ * CSVMatchResultWriter.
+ *
+ * If the reader supports reading chunks in parallel, such as
+ * CSVPointReader, there is no reader thread. Each worker reads the next
+ * chunk of the file itself, matches all its trajectories and writes
+ * their results at once.
+ *
+ * The results are written by batches numbered from 0 in the order of
+ * the input, a batch being a chunk of the file or else a single
+ * trajectory. A writer in ordered mode thus keeps the output of a chunk
+ * as a single record, and a worker never waits for the worker of an
+ * earlier chunk in the middle of its own chunk.
+ *
+ * If reading, matching or writing throws, the other threads stop at
+ * their next trajectory and the first exception is rethrown by the
+ * calling thread after all the threads are joined.
+ *
+ * @param reader GPS reader
+ * @param match function returning the result of a trajectory, called
+ * concurrently by the workers
+ * @param write function called with the index of a batch, its
+ * trajectories and their results, called concurrently by the workers
+ * @param num_workers number of worker threads, if not positive the
+ * number of OpenMP threads is used
+ * @param buffer_points maximum number of points buffered in the queue
+ * @param chunk_size size in bytes of a chunk read by a worker
+ */
+template<typename MatchFunc, typename WriteFunc>
+void run_match_pipeline(FMM::IO::GPSReader &reader,
+                        MatchFunc match, WriteFunc write,
+                        int num_workers = 0,
+                        std::size_t buffer_points = 1000000,
+                        std::size_t chunk_size = 1 << 22) {
+  typedef std::pair<std::size_t, FMM::CORE::Trajectory> Input;
+  typedef decltype(match(std::declval<const FMM::CORE::Trajectory &>()))
+    Result;
+  if (num_workers <= 0) num_workers = omp_get_max_threads();
+  // The first exception thrown by a thread, rethrown after the join
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  std::atomic<bool> failed{false};
+  auto fail = [&]() {
+    std::lock_guard<std::mutex> lock(error_mutex);
+    if (!error) error = std::current_exception();
+    failed = true;
+  };
+  std::size_t num_chunks = reader.get_num_chunks(chunk_size);
+  if (num_chunks > 0) {
+    SPDLOG_DEBUG("Match pipeline workers {} chunks {}",
+                 num_workers, num_chunks);
+    std::atomic<std::size_t> next_chunk{0};
+    std::vector<std::thread> workers;
+    for (int i = 0; i < num_workers; ++i) {
+      workers.emplace_back([&] {
+        try {
+          while (!failed) {
+            std::size_t chunk = next_chunk++;
+            if (chunk >= num_chunks) return;
+            std::vector<FMM::CORE::Trajectory> trajectories =
+              reader.read_chunk(chunk, chunk_size);
+            std::vector<Result> results;
+            results.reserve(trajectories.size());
+            for (const FMM::CORE::Trajectory &trajectory : trajectories) {
+              if (failed) return;
+              results.push_back(match(trajectory));
+            }
+            // An empty chunk is written as well, so that the batches have
+            // no gap
+            write(chunk, trajectories, results);
+          }
+        } catch (...) {
+          fail();
+        }
+      });
+    }
+    for (std::thread &worker : workers) worker.join();
+    if (error) std::rethrow_exception(error);
+    return;
+  }
+  SPDLOG_DEBUG("Match pipeline workers {} buffer points {}",
+               num_workers, buffer_points);
+  BoundedQueue<Input> input_queue(buffer_points);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < num_workers; ++i) {
+    workers.emplace_back([&] {
+      try {
+        Input input;
+        while (!failed && input_queue.pop(&input)) {
+          std::vector<Result> results{match(input.second)};
+          std::vector<FMM::CORE::Trajectory> trajectories;
+          trajectories.push_back(std::move(input.second));
+          write(input.first, trajectories, results);
+        }
+      } catch (...) {
+        fail();
+        // Stop the reader waiting for space in the queue
+        input_queue.close();
+      }
+    });
+  }
+  // Trajectories are read in batches, which a reader such as
+  // CSVTrajectoryReader parses in parallel
+  const int read_batch_size = 256;
+  std::size_t index = 0;
+  try {
+    bool open = true;
+    while (open && reader.has_next_trajectory()) {
+      std::vector<FMM::CORE::Trajectory> batch =
+        reader.read_next_N_trajectories(read_batch_size);
+      for (FMM::CORE::Trajectory &trajectory : batch) {
+        std::size_t points = trajectory.geom.get_num_points();
+        open = input_queue.push(Input(index++, std::move(trajectory)),
+                                points);
+        if (!open) break;
+      }
+    }
+  } catch (...) {
+    fail();
+  }
+  input_queue.close();
+  for (std::thread &worker : workers) worker.join();
+  if (error) std::rethrow_exception(error);
+};
+
+} // MM
+} // FMM
+
+#endif // FMM_MATCH_PIPELINE_HPP
@@ -41,11 +41,12 @@ typedef std::vector<Point_Candidates> Traj_Candidates;
 typedef std::vector<const Candidate*> OptCandidatePath;
 /**< Optimal candidates*/
 
-typedef std::vector<FMM::NETWORK::EdgeID> O_Path; /**< Optimal path, edge id matched to
-each point in the trajectory */
+typedef std::vector<FMM::NETWORK::EdgeIndex> O_Path; /**< Optimal path, edge
+index matched to each point in the trajectory */
 
-typedef std::vector<FMM::NETWORK::EdgeID> C_Path; /**< Complete path, ids of
-a sequence of topologically connected edges.*/
+typedef std::vector<FMM::NETWORK::EdgeIndex> C_Path; /**< Complete path,
+indices of a sequence of topologically connected edges. The indices are
+mapped to edge ID by Network::get_edge_ids when a result is exported. */
 
 /**
  * A candidate matched to a point
@@ -72,15 +73,29 @@ struct MatchResult {
   to each point of a trajectory. It is stored in order to export more
   detailed map matching information. */
   O_Path opath; /**< the optimal path,
-                              containing id of edges matched to each
+                              containing index of edges matched to each
                               point in a trajectory */
-  C_Path cpath; /**< the complete path, containing ids of a sequence of
+  C_Path cpath; /**< the complete path, containing indices of a sequence of
                      topologically connected edges traversed by the
                      trajectory.  */
   std::vector<int> indices; /**< index of opath edge in cpath */
   CORE::LineString mgeom; /**< the geometry of the matched path */
 };
 
+/**
+ * Optional products of a map matching result, combined as a bit mask to
+ * specify the members of %MatchResult computed by an algorithm. The
+ * cpath and indices are always computed as an empty cpath indicates
+ * that a trajectory is not matched.
+ */
+enum MatchResultField {
+  MATCH_CANDIDATES = 1, /**< opt_candidate_path */
+  MATCH_OPATH = 2, /**< opath */
+  MATCH_MGEOM = 4, /**< mgeom */
+  MATCH_ALL = MATCH_CANDIDATES | MATCH_OPATH | MATCH_MGEOM /**< all the
+                                                             members */
+};
+
 };
 
 };
@@ -0,0 +1,47 @@
+#include "mm/result_sink.hpp"
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+void FMM::MM::write_to_sink(const Network &network, const Trajectory &traj,
+                            const TGOpath &tg_opath, const C_Path &cpath,
+                            const std::vector<int> &indices,
+                            ResultSink *sink) {
+  int num_points = traj.geom.get_num_points();
+  sink->begin(num_points, cpath.size());
+  if (!cpath.empty()) {
+    for (int i = 0; i < tg_opath.size(); ++i) {
+      const TGNode *node = tg_opath[i];
+      sink->point(i, MatchedCandidate{*(node->c), node->ep, node->tp,
+                                      node->sp_dist}, indices[i]);
+    }
+    const std::vector<Edge> &edges = network.get_edges();
+    for (int i = 0; i < cpath.size(); ++i) {
+      sink->path_edge(i, edges[cpath[i]]);
+    }
+    if (sink->need_geometry()) {
+      sink->geometry(network.complete_path_to_geometry(traj.geom, cpath));
+    }
+  }
+  sink->end();
+}
+
+void FMM::MM::write_to_sink(const Network &network, const MatchResult &result,
+                            int num_points, ResultSink *sink) {
+  sink->begin(num_points, result.cpath.size());
+  if (!result.cpath.empty()) {
+    for (int i = 0; i < result.opt_candidate_path.size(); ++i) {
+      sink->point(i, result.opt_candidate_path[i], result.indices[i]);
+    }
+    const std::vector<Edge> &edges = network.get_edges();
+    for (int i = 0; i < result.cpath.size(); ++i) {
+      sink->path_edge(i, edges[result.cpath[i]]);
+    }
+    if (sink->need_geometry()) {
+      sink->geometry(result.mgeom);
+    }
+  }
+  sink->end();
+}
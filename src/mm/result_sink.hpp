@@ -0,0 +1,103 @@
+/**
+ * Fast map matching.
+ *
+ * Receiver of map matching results written without building a
+ * MatchResult, used by the match_points functions of the algorithms.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_RESULT_SINK_HPP
+#define FMM_RESULT_SINK_HPP
+
+#include "core/gps.hpp"
+#include "mm/mm_type.hpp"
+#include "mm/transition_graph.hpp"
+#include "network/network.hpp"
+
+#include <vector>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Receiver of the result of a trajectory.
+ *
+ * The result is written by calling begin once, point for each point
+ * in order, path_edge for each edge of the complete path in order,
+ * geometry if need_geometry returns true, and end once. A trajectory
+ * not matched has an empty complete path and no point is written.
+ *
+ * The default implementation of each function ignores its arguments, so
+ * a sink only overrides the parts of the result it stores, for example
+ * into buffers provided by the caller.
+ */
+class ResultSink {
+ public:
+  virtual ~ResultSink() = default;
+  /**
+   * Start the result of a trajectory
+   * @param num_points number of points of the trajectory
+   * @param cpath_size number of edges of the complete path, 0 if the
+   * trajectory is not matched
+   */
+  virtual void begin(int num_points, int cpath_size) {}
+  /**
+   * Write the candidate matched to a point
+   * @param index index of the point in the trajectory
+   * @param mc candidate matched to the point, with its probabilities
+   * @param cpath_index index of the matched edge in the complete path
+   */
+  virtual void point(int index, const MatchedCandidate &mc,
+                     int cpath_index) {}
+  /**
+   * Write an edge of the complete path
+   * @param index index of the edge in the complete path
+   * @param edge the edge traversed
+   */
+  virtual void path_edge(int index, const NETWORK::Edge &edge) {}
+  /**
+   * Tell if the geometry of the matched path is computed
+   */
+  virtual bool need_geometry() const { return false; }
+  /**
+   * Write the geometry of the matched path
+   * @param mgeom the geometry of the matched path
+   */
+  virtual void geometry(const CORE::LineString &mgeom) {}
+  /**
+   * End the result of a trajectory
+   */
+  virtual void end() {}
+};
+
+/**
+ * Write the optimal path of a trajectory into a sink
+ * @param network road network
+ * @param traj trajectory matched
+ * @param tg_opath optimal candidate of each point, empty if not matched
+ * @param cpath complete path
+ * @param indices index of the edge matched to each point in cpath
+ * @param sink the sink written
+ */
+void write_to_sink(const NETWORK::Network &network,
+                   const CORE::Trajectory &traj,
+                   const TGOpath &tg_opath, const C_Path &cpath,
+                   const std::vector<int> &indices, ResultSink *sink);
+
+/**
+ * Write a match result into a sink
+ * @param network road network
+ * @param result match result with its candidates
+ * @param num_points number of points of the trajectory
+ * @param sink the sink written
+ */
+void write_to_sink(const NETWORK::Network &network,
+                   const MatchResult &result, int num_points,
+                   ResultSink *sink);
+
+} // MM
+} // FMM
+
+#endif // FMM_RESULT_SINK_HPP
@@ -0,0 +1,463 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the map matching server
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/server/match_server.hpp"
+#include "io/text_parser.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <boost/property_tree/json_parser.hpp>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+MatchModel::MatchModel(const MatchServerConfig &config, int version_arg) :
+    version(version_arg),
+    network(config.network_config),
+    graph(network) {
+  if (!config.ubodt_file.empty()) {
+    // The file may be missing while it is replaced, which the UBODT
+    // readers do not check
+    if (!UTIL::file_exists(config.ubodt_file)) {
+      std::string message = "UBODT file not exists " + config.ubodt_file;
+      SPDLOG_CRITICAL(message);
+      throw std::runtime_error(message);
+    }
+    ubodt = UBODT::read_ubodt_file(config.ubodt_file);
+    fmm.reset(new FastMapMatch(network, graph, ubodt));
+  }
+  stmatch.reset(new STMATCH(network, graph));
+};
+
+MatchServer::MatchServer(const MatchServerConfig &config) :
+    config_(config),
+    model_(std::make_shared<const MatchModel>(config, 1)) {
+  int num_workers = config_.num_workers;
+  if (num_workers <= 0) {
+    num_workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(&MatchServer::run_worker, this);
+  }
+  SPDLOG_INFO("Server started with {} workers", num_workers);
+};
+
+MatchServer::~MatchServer() {
+  {
+    std::lock_guard<std::mutex> lock(task_mutex_);
+    workers_stopped_ = true;
+  }
+  task_cv_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+  if (reload_thread_.joinable()) reload_thread_.join();
+};
+
+void MatchServer::stop() {
+  running_.store(false);
+};
+
+void MatchServer::reload() {
+  reload_requested_.store(true);
+};
+
+std::shared_ptr<const MatchModel> MatchServer::get_model() const {
+  return std::atomic_load(&model_);
+};
+
+void MatchServer::load_model() {
+  auto begin_time = UTIL::get_current_time();
+  int version = get_model()->version + 1;
+  SPDLOG_INFO("Load model version {}", version);
+  try {
+    std::shared_ptr<const MatchModel> model =
+      std::make_shared<const MatchModel>(config_, version);
+    // Requests already started keep the previous model, which is
+    // released when the last of them is answered
+    std::atomic_store(&model_, model);
+    auto end_time = UTIL::get_current_time();
+    SPDLOG_INFO("Model version {} loaded in {}s", version,
+                UTIL::get_duration(begin_time, end_time));
+  } catch (const std::exception &e) {
+    SPDLOG_ERROR("Load model version {} fail, keep version {} {}",
+                 version, version - 1, e.what());
+  }
+  reloading_.store(false);
+};
+
+void MatchServer::run() {
+  const std::string &socket_file = config_.socket_file;
+  struct sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_file.size() >= sizeof(address.sun_path)) {
+    std::string message = "Socket path too long " + socket_file;
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  std::strcpy(address.sun_path, socket_file.c_str());
+  // A socket left by a server which did not exit cleanly is replaced,
+  // but other files are never removed.
+  struct stat file_stat;
+  if (lstat(socket_file.c_str(), &file_stat) == 0) {
+    if (!S_ISSOCK(file_stat.st_mode)) {
+      std::string message = "File exists and is not a socket " + socket_file;
+      SPDLOG_CRITICAL(message);
+      throw std::runtime_error(message);
+    }
+    unlink(socket_file.c_str());
+  }
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0 ||
+      bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+      listen(listen_fd, SOMAXCONN) != 0) {
+    std::string message = "Listen on socket fail " + socket_file + " " +
+                          std::strerror(errno);
+    if (listen_fd >= 0) close(listen_fd);
+    SPDLOG_CRITICAL(message);
+    throw std::runtime_error(message);
+  }
+  SPDLOG_INFO("Listen on socket {}", socket_file);
+  while (running_.load()) {
+    if (reload_requested_.load() && !reloading_.load()) {
+      reload_requested_.store(false);
+      reloading_.store(true);
+      if (reload_thread_.joinable()) reload_thread_.join();
+      reload_thread_ = std::thread(&MatchServer::load_model, this);
+    }
+    struct pollfd pfd{listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, POLL_TIMEOUT) <= 0) continue;
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) continue;
+    {
+      std::lock_guard<std::mutex> lock(connection_mutex_);
+      if (num_connections_ >= config_.max_connections) {
+        SPDLOG_WARN("Connection refused, {} clients connected",
+                    num_connections_);
+        std::string response =
+          error_response("too many connections") + "\n";
+        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+        close(fd);
+        continue;
+      }
+      ++num_connections_;
+    }
+    std::thread(&MatchServer::serve_connection, this, fd).detach();
+  }
+  close(listen_fd);
+  unlink(socket_file.c_str());
+  if (reload_thread_.joinable()) reload_thread_.join();
+  SPDLOG_INFO("Wait for {} clients to disconnect", num_connections_);
+  std::unique_lock<std::mutex> lock(connection_mutex_);
+  connection_cv_.wait(lock, [&] { return num_connections_ == 0; });
+  SPDLOG_INFO("Server stopped");
+};
+
+void MatchServer::serve_connection(int fd) {
+  SPDLOG_DEBUG("Client connected {}", fd);
+  std::size_t max_size = std::size_t(config_.max_request_size) << 20;
+  std::string buffer;
+  // Characters of the buffer already searched for a line break
+  std::size_t searched = 0;
+  char chunk[65536];
+  bool connected = true;
+  while (connected && running_.load()) {
+    struct pollfd pfd{fd, POLLIN, 0};
+    int ret = poll(&pfd, 1, POLL_TIMEOUT);
+    if (ret == 0 || (ret < 0 && errno == EINTR)) continue;
+    ssize_t n = ret < 0 ? -1 : recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) break;
+    buffer.append(chunk, n);
+    std::size_t start = 0;
+    std::size_t end;
+    while (connected &&
+           (end = buffer.find('\n', searched)) != std::string::npos) {
+      std::string response =
+        handle_request(buffer.substr(start, end - start)) + "\n";
+      const char *p = response.data();
+      std::size_t left = response.size();
+      while (left > 0) {
+        ssize_t sent = send(fd, p, left, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) {
+          connected = false;
+          break;
+        }
+        p += sent;
+        left -= sent;
+      }
+      start = end + 1;
+      searched = start;
+    }
+    buffer.erase(0, start);
+    searched = buffer.size();
+    if (connected && buffer.size() > max_size) {
+      SPDLOG_WARN("Request larger than {} MB", config_.max_request_size);
+      std::string response = error_response("request too large") + "\n";
+      send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+      connected = false;
+    }
+  }
+  close(fd);
+  SPDLOG_DEBUG("Client disconnected {}", fd);
+  std::lock_guard<std::mutex> lock(connection_mutex_);
+  --num_connections_;
+  connection_cv_.notify_all();
+};
+
+void MatchServer::run_worker() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(task_mutex_);
+      task_cv_.wait(lock, [&] { return workers_stopped_ || !tasks_.empty(); });
+      if (tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+};
+
+void MatchServer::run_tasks(std::size_t num_tasks,
+                            const std::function<void(std::size_t)> &task) {
+  std::mutex done_mutex;
+  std::condition_variable done_cv;
+  std::size_t num_done = 0;
+  {
+    std::lock_guard<std::mutex> lock(task_mutex_);
+    for (std::size_t i = 0; i < num_tasks; ++i) {
+      tasks_.emplace_back([&, i] {
+        task(i);
+        std::lock_guard<std::mutex> done_lock(done_mutex);
+        if (++num_done == num_tasks) done_cv.notify_one();
+      });
+    }
+  }
+  task_cv_.notify_all();
+  std::unique_lock<std::mutex> lock(done_mutex);
+  done_cv.wait(lock, [&] { return num_done == num_tasks; });
+};
+
+std::string MatchServer::handle_request(const std::string &request) {
+  boost::property_tree::ptree tree;
+  std::vector<Trajectory> trajectories;
+  bool use_fmm;
+  FastMapMatchConfig fmm_config;
+  STMATCHConfig stmatch_config;
+  // serve_connection only checks the size of the text not framed yet,
+  // so a request received in a single chunk may be larger
+  if (request.size() > (std::size_t(config_.max_request_size) << 20)) {
+    return error_response("request too large");
+  }
+  // All the trajectories of a request are matched with the same model
+  std::shared_ptr<const MatchModel> model = get_model();
+  try {
+    std::istringstream iss(request);
+    boost::property_tree::read_json(iss, tree);
+    auto command = tree.get_optional<std::string>("command");
+    if (command) {
+      if (*command != "reload") {
+        return error_response("unknown command " + *command);
+      }
+      reload();
+      return "{\"status\":\"ok\",\"version\":" +
+             std::to_string(model->version) + "}";
+    }
+    std::string algorithm = tree.get("algorithm", std::string("fmm"));
+    if (algorithm != "fmm" && algorithm != "stmatch") {
+      return error_response("unknown algorithm " + algorithm);
+    }
+    use_fmm = (algorithm == "fmm");
+    if (use_fmm && model->fmm == nullptr) {
+      return error_response("fmm not available without UBODT");
+    }
+    // The parameters are read with the names of the XML configuration
+    boost::property_tree::ptree parameters;
+    auto config_data = tree.get_child_optional("config");
+    if (config_data) parameters.put_child("config.parameters", *config_data);
+    if (use_fmm) {
+      fmm_config = FastMapMatchConfig::load_from_xml(parameters);
+      if (!fmm_config.validate()) return error_response("invalid config");
+    } else {
+      stmatch_config = STMATCHConfig::load_from_xml(parameters);
+      if (!stmatch_config.validate()) return error_response("invalid config");
+    }
+    for (const auto &item : tree.get_child("trajectories")) {
+      const boost::property_tree::ptree &data = item.second;
+      Trajectory traj;
+      traj.id = data.get("id", static_cast<int>(trajectories.size()));
+      auto wkt = data.get_optional<std::string>("wkt");
+      if (wkt) {
+        IO::TextSpan span{wkt->data(), wkt->data() + wkt->size()};
+        if (!IO::parse_linestring(span, &traj.geom)) {
+          return error_response(
+            "invalid wkt of trajectory " + std::to_string(traj.id));
+        }
+      } else {
+        std::vector<double> xs, ys;
+        for (const auto &v : data.get_child("x")) {
+          xs.push_back(v.second.get_value<double>());
+        }
+        for (const auto &v : data.get_child("y")) {
+          ys.push_back(v.second.get_value<double>());
+        }
+        if (xs.size() != ys.size()) {
+          return error_response(
+            "x and y sizes differ in trajectory " + std::to_string(traj.id));
+        }
+        for (std::size_t i = 0; i < xs.size(); ++i) {
+          traj.geom.add_point(xs[i], ys[i]);
+        }
+      }
+      auto timestamps = data.get_child_optional("timestamps");
+      if (timestamps) {
+        for (const auto &v : *timestamps) {
+          traj.timestamps.push_back(v.second.get_value<double>());
+        }
+        if (traj.timestamps.size() != traj.geom.get_num_points()) {
+          return error_response(
+            "timestamps size differs from points in trajectory " +
+            std::to_string(traj.id));
+        }
+      }
+      trajectories.push_back(std::move(traj));
+    }
+  } catch (const std::exception &e) {
+    return error_response(std::string("invalid request: ") + e.what());
+  }
+  std::vector<std::string> results(trajectories.size());
+  run_tasks(trajectories.size(), [&](std::size_t i) {
+    results[i] = match_trajectory(*model, trajectories[i], use_fmm,
+                                  fmm_config, stmatch_config);
+  });
+  std::string response = "{\"status\":\"ok\",\"results\":[";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    if (i > 0) response.push_back(',');
+    response += results[i];
+  }
+  response += "]}";
+  return response;
+};
+
+std::string MatchServer::match_trajectory(
+    const MatchModel &model, const Trajectory &traj, bool use_fmm,
+    const FastMapMatchConfig &fmm_config,
+    const STMATCHConfig &stmatch_config) {
+  int window_size = use_fmm ? fmm_config.window_size :
+                    stmatch_config.window_size;
+  std::unique_lock<std::mutex> lock(long_trajectory_mutex_,
+                                    std::defer_lock);
+  if (window_size > 0 && traj.geom.get_num_points() > window_size) {
+    lock.lock();
+  }
+  UTIL::FormatBuffer buf;
+  try {
+    MatchResult result =
+      use_fmm ? model.fmm->match_traj(traj, fmm_config) :
+      model.stmatch->match_traj(traj, stmatch_config);
+    write_result(model, result, buf);
+  } catch (const std::exception &e) {
+    SPDLOG_WARN("Match trajectory {} fail {}", traj.id, e.what());
+    buf.clear();
+    UTIL::append_string(buf, "{\"id\":");
+    UTIL::append_int(buf, traj.id);
+    UTIL::append_string(buf, ",\"opath\":[],\"cpath\":[],\"indices\":[],"
+                        "\"mgeom\":\"LINESTRING()\","
+                        "\"pgeom\":\"LINESTRING()\",\"candidates\":[]}");
+  }
+  return fmt::to_string(buf);
+};
+
+void MatchServer::write_result(const MatchModel &model,
+                               const MatchResult &result,
+                               UTIL::FormatBuffer &buf) {
+  // Probabilities may be infinite or not a number, which JSON does not
+  // support, so they are written as null
+  auto append_number = [&buf](double value) {
+    if (std::isfinite(value)) {
+      UTIL::append_double(buf, value, 12);
+    } else {
+      UTIL::append_string(buf, "null");
+    }
+  };
+  UTIL::append_string(buf, "{\"id\":");
+  UTIL::append_int(buf, result.id);
+  UTIL::append_string(buf, ",\"opath\":[");
+  UTIL::append_int_vector(buf, model.network.get_edge_ids(result.opath));
+  UTIL::append_string(buf, "],\"cpath\":[");
+  UTIL::append_int_vector(buf, model.network.get_edge_ids(result.cpath));
+  UTIL::append_string(buf, "],\"indices\":[");
+  UTIL::append_int_vector(buf, result.indices);
+  UTIL::append_string(buf, "],\"mgeom\":\"");
+  UTIL::append_wkt(buf, result.mgeom);
+  UTIL::append_string(buf, "\",\"pgeom\":\"");
+  LineString pgeom;
+  for (const MatchedCandidate &mc : result.opt_candidate_path) {
+    pgeom.add_point(mc.c.point);
+  }
+  UTIL::append_wkt(buf, pgeom);
+  UTIL::append_string(buf, "\",\"candidates\":[");
+  for (std::size_t i = 0; i < result.opt_candidate_path.size(); ++i) {
+    const MatchedCandidate &mc = result.opt_candidate_path[i];
+    if (i > 0) UTIL::append_char(buf, ',');
+    UTIL::append_string(buf, "{\"index\":");
+    UTIL::append_int(buf, i);
+    UTIL::append_string(buf, ",\"edge_id\":");
+    UTIL::append_int(buf, mc.c.edge->id);
+    UTIL::append_string(buf, ",\"source\":");
+    UTIL::append_int(buf, model.graph.get_node_id(mc.c.edge->source));
+    UTIL::append_string(buf, ",\"target\":");
+    UTIL::append_int(buf, model.graph.get_node_id(mc.c.edge->target));
+    UTIL::append_string(buf, ",\"error\":");
+    append_number(mc.c.dist);
+    UTIL::append_string(buf, ",\"offset\":");
+    append_number(mc.c.offset);
+    UTIL::append_string(buf, ",\"length\":");
+    append_number(mc.c.edge->length);
+    UTIL::append_string(buf, ",\"ep\":");
+    append_number(mc.ep);
+    UTIL::append_string(buf, ",\"tp\":");
+    append_number(mc.tp);
+    UTIL::append_string(buf, ",\"spdist\":");
+    append_number(mc.sp_dist);
+    UTIL::append_char(buf, '}');
+  }
+  UTIL::append_string(buf, "]}");
+};
+
+std::string MatchServer::error_response(const std::string &message) {
+  std::string response = "{\"status\":\"error\",\"message\":\"";
+  for (char c : message) {
+    if (c == '"' || c == '\\') {
+      response.push_back('\\');
+      response.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      response.push_back(' ');
+    } else {
+      response.push_back(c);
+    }
+  }
+  response += "\"}";
+  return response;
+};
@@ -0,0 +1,207 @@
+/**
+ * Fast map matching.
+ *
+ * A long running map matching server which loads the network, graph and
+ * UBODT once and serves matching requests over a unix domain socket.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_MATCH_SERVER_HPP_
+#define FMM_MATCH_SERVER_HPP_
+
+#include "mm/server/match_server_config.hpp"
+#include "mm/fmm/fmm_algorithm.hpp"
+#include "mm/stmatch/stmatch_algorithm.hpp"
+#include "util/formatter.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace FMM{
+namespace MM{
+/**
+ * The network, graph and UBODT served together with the models using
+ * them. A model is not modified after it is loaded, and it is shared by
+ * the requests being matched with it, so a new model can be loaded while
+ * the previous one is still in use.
+ */
+struct MatchModel {
+  /**
+   * Load the network, graph and UBODT
+   * @param config configuration of the server
+   * @param version_arg version of the model
+   */
+  MatchModel(const MatchServerConfig &config, int version_arg);
+  int version; /**< version of the model, incremented by each reload */
+  NETWORK::Network network; /**< road network */
+  NETWORK::NetworkGraph graph; /**< graph of the network */
+  std::shared_ptr<UBODT> ubodt; /**< UBODT, null if not configured */
+  std::unique_ptr<FastMapMatch> fmm; /**< fmm model, null without UBODT */
+  std::unique_ptr<STMATCH> stmatch; /**< stmatch model */
+};
+
+/**
+ * Map matching server.
+ *
+ * Clients connect to a unix domain socket and send requests, each one
+ * being a JSON object written on a single line. A response is written
+ * on a single line for each request, in the order of the requests.
+ *
+ * A request contains a batch of trajectories given either as a WKT
+ * linestring or as arrays of coordinates, with optional timestamps, and
+ * the parameters of the algorithm with the names used in the XML
+ * configuration, the parameters missing take their default value:
+ *
+ *     {"algorithm":"fmm","config":{"k":4,"r":0.4,"gps_error":0.5},
+ *      "trajectories":[{"id":1,"wkt":"LINESTRING(0 0,1 1)"},
+ *                      {"id":2,"x":[0,1],"y":[0,1],"timestamps":[0,5]}]}
+ *
+ * The response contains a result for each trajectory in the order of
+ * the request, with the members of PYTHON::PyMatchResult:
+ *
+ *     {"status":"ok","results":[{"id":1,"opath":[..],"cpath":[..],
+ *      "indices":[..],"mgeom":"LINESTRING(..)","pgeom":"LINESTRING(..)",
+ *      "candidates":[{"index":0,"edge_id":..,"source":..,"target":..,
+ *      "error":..,"offset":..,"length":..,"ep":..,"tp":..,"spdist":..}]}]}
+ *
+ * or {"status":"error","message":".."} if the request is invalid.
+ *
+ * The request {"command":"reload"} loads the network and UBODT files
+ * again in the background, as does the reload function. Requests
+ * received during the loading are matched with the previous model, and
+ * once the new model is loaded, it replaces the previous one, which is
+ * released when the last request using it is answered.
+ *
+ * The trajectories of all requests are matched by a shared pool of
+ * worker threads, so the trajectories of a batch are matched in
+ * parallel and the matching work of the server is bounded by the number
+ * of workers whatever the number of clients.
+ */
+class MatchServer {
+ public:
+  /**
+   * Load the network, graph and UBODT and start the worker threads
+   * @param config configuration of the server
+   */
+  explicit MatchServer(const MatchServerConfig &config);
+  /**
+   * Stop the worker threads
+   */
+  ~MatchServer();
+  MatchServer(const MatchServer &) = delete;
+  MatchServer &operator=(const MatchServer &) = delete;
+  /**
+   * Listen on the socket and serve clients until stop is called. The
+   * socket file is removed before returning.
+   * @throw std::runtime_error if the socket cannot be created
+   */
+  void run();
+  /**
+   * Ask the server to stop. It can be called from a signal handler.
+   * Requests being matched are answered before run returns.
+   */
+  void stop();
+  /**
+   * Ask the server to load the network, graph and UBODT again. The new
+   * model is loaded in the background by run. It can be called from a
+   * signal handler.
+   */
+  void reload();
+  /**
+   * Load a new model and replace the current one, the current one is
+   * kept if the loading fails. It is called in a thread by run after
+   * reload. The requests already started keep the model they use.
+   */
+  void load_model();
+  /**
+   * Get the model used by new requests
+   */
+  std::shared_ptr<const MatchModel> get_model() const;
+  /**
+   * Handle a request
+   * @param request a request in JSON, of at most max_request_size MB
+   * @return the response in JSON, without line break
+   */
+  std::string handle_request(const std::string &request);
+ private:
+  static const int POLL_TIMEOUT = 200; /**< Time in ms between two checks
+                                            of the stop flag */
+  /**
+   * Read requests from a client and write the responses until the
+   * client disconnects or the server stops, then close the connection.
+   * @param fd file descriptor of the connection
+   */
+  void serve_connection(int fd);
+  /**
+   * Run tasks of the queue until the pool is stopped
+   */
+  void run_worker();
+  /**
+   * Run a batch of tasks in the worker pool and wait for them
+   * @param num_tasks number of tasks
+   * @param task function called with the index of each task
+   */
+  void run_tasks(std::size_t num_tasks,
+                 const std::function<void(std::size_t)> &task);
+  /**
+   * Match a trajectory with the algorithm of a request
+   * @param model model used to match the trajectory
+   * @param traj trajectory to match
+   * @param use_fmm if true, fmm is used, otherwise stmatch
+   * @param fmm_config configuration of fmm
+   * @param stmatch_config configuration of stmatch
+   * @return the result serialized in JSON
+   */
+  std::string match_trajectory(const MatchModel &model,
+                               const CORE::Trajectory &traj, bool use_fmm,
+                               const FastMapMatchConfig &fmm_config,
+                               const STMATCHConfig &stmatch_config);
+  /**
+   * Write a match result in JSON
+   * @param model model used to match the trajectory
+   * @param result the result of a trajectory
+   * @param buf the buffer written
+   */
+  static void write_result(const MatchModel &model,
+                           const MatchResult &result,
+                           UTIL::FormatBuffer &buf);
+  /**
+   * Create an error response
+   * @param message the error message
+   */
+  static std::string error_response(const std::string &message);
+  const MatchServerConfig &config_;
+  std::shared_ptr<const MatchModel> model_; /**< model used by new
+                                                 requests, accessed with
+                                                 atomic_load/store */
+  std::atomic<bool> running_{true}; /**< false once stop is called */
+  std::atomic<bool> reload_requested_{false}; /**< true if reload is
+                                                   called */
+  std::atomic<bool> reloading_{false}; /**< true while a model is loaded */
+  std::thread reload_thread_; /**< thread loading a new model */
+  std::vector<std::thread> workers_; /**< threads of the worker pool */
+  std::deque<std::function<void()>> tasks_; /**< tasks of the pool */
+  bool workers_stopped_ = false;
+  std::mutex task_mutex_;
+  std::condition_variable task_cv_;
+  int num_connections_ = 0; /**< number of clients connected */
+  std::mutex connection_mutex_;
+  std::condition_variable connection_cv_;
+  std::mutex long_trajectory_mutex_; /**< long trajectories split into
+                                          windows are already matched in
+                                          parallel, so they are matched
+                                          one at a time */
+}; // MatchServer
+}
+}
+
+#endif //FMM_MATCH_SERVER_HPP_
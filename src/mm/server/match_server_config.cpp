@@ -0,0 +1,140 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/server/match_server_config.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+using namespace FMM;
+using namespace FMM::CONFIG;
+using namespace FMM::MM;
+
+MatchServerConfig::MatchServerConfig(int argc, char **argv){
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  if (argc==2) {
+    std::string configfile(argv[1]);
+    if (UTIL::check_file_extension(configfile,"xml,XML"))
+      load_xml(configfile);
+    else {
+      load_arg(argc,argv);
+    }
+  } else {
+    load_arg(argc,argv);
+  }
+  spdlog::set_level((spdlog::level::level_enum) log_level);
+  if (!help_specified)
+    print();
+};
+
+void MatchServerConfig::load_xml(const std::string &file){
+  SPDLOG_INFO("Start with reading server configuration {}",file);
+  boost::property_tree::ptree tree;
+  boost::property_tree::read_xml(file, tree);
+  network_config = NetworkConfig::load_from_xml(tree);
+  ubodt_file = tree.get("config.input.ubodt.file", std::string(""));
+  socket_file = tree.get<std::string>("config.server.socket");
+  num_workers = tree.get("config.server.workers", 0);
+  max_connections = tree.get("config.server.max_connections", 64);
+  max_request_size = tree.get("config.server.max_request_size", 64);
+  log_level = tree.get("config.other.log_level",2);
+  SPDLOG_INFO("Finish with reading server xml configuration");
+};
+
+void MatchServerConfig::load_arg(int argc, char **argv){
+  SPDLOG_INFO("Start reading server configuration from arguments");
+  cxxopts::Options options("fmm_server_config",
+                           "Configuration parser of fmm_server");
+  NetworkConfig::register_arg(options);
+  options.add_options()
+    ("ubodt","Ubodt file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("socket","Unix domain socket path",
+    cxxopts::value<std::string>()->default_value(""))
+    ("workers","Number of matching threads",
+    cxxopts::value<int>()->default_value("0"))
+    ("max_connections","Maximum number of clients",
+    cxxopts::value<int>()->default_value("64"))
+    ("max_request_size","Maximum request size in MB",
+    cxxopts::value<int>()->default_value("64"))
+    ("l,log_level","Log level",cxxopts::value<int>()->default_value("2"))
+    ("h,help","Help information");
+  if (argc==1) {
+    help_specified = true;
+    return;
+  }
+  auto result = options.parse(argc, argv);
+  network_config = NetworkConfig::load_from_arg(result);
+  ubodt_file = result["ubodt"].as<std::string>();
+  socket_file = result["socket"].as<std::string>();
+  num_workers = result["workers"].as<int>();
+  max_connections = result["max_connections"].as<int>();
+  max_request_size = result["max_request_size"].as<int>();
+  log_level = result["log_level"].as<int>();
+  if (result.count("help")>0) {
+    help_specified = true;
+  }
+  SPDLOG_INFO("Finish with reading server arg configuration");
+};
+
+void MatchServerConfig::print_help(){
+  std::ostringstream oss;
+  oss<<"fmm_server argument lists:\n";
+  NetworkConfig::register_help(oss);
+  oss<<"--socket (required) <string>: Unix domain socket path\n";
+  oss<<"--ubodt (optional) <string>: Ubodt file name, "
+     <<"without it only stmatch is served\n";
+  oss<<"--workers (optional) <int>: number of matching threads, "
+     <<"0 for the number of cores (0)\n";
+  oss<<"--max_connections (optional) <int>: maximum number of "
+     <<"clients connected at the same time (64)\n";
+  oss<<"--max_request_size (optional) <int>: maximum size of "
+     <<"a request in MB (64)\n";
+  oss<<"-l/--log_level (optional) <int>: log level (2)\n";
+  oss<<"-h/--help:print help information\n";
+  oss<<"SIGHUP or the request {\"command\":\"reload\"} reloads the "
+     <<"network and UBODT files\n";
+  oss<<"For the request format, check example folder\n";
+  std::cout<<oss.str();
+};
+
+void MatchServerConfig::print() const {
+  SPDLOG_INFO("----   Print configuration    ----");
+  network_config.print();
+  SPDLOG_INFO("UBODT file {}",(ubodt_file.empty() ? "none" : ubodt_file));
+  SPDLOG_INFO("Socket {}",socket_file);
+  SPDLOG_INFO("Workers {}",num_workers);
+  SPDLOG_INFO("Max connections {}",max_connections);
+  SPDLOG_INFO("Max request size {} MB",max_request_size);
+  SPDLOG_INFO("Log level {}",UTIL::LOG_LEVESLS[log_level]);
+  SPDLOG_INFO("---- Print configuration done ----");
+};
+
+bool MatchServerConfig::validate() const
+{
+  SPDLOG_DEBUG("Validating configuration");
+  if (log_level<0 || log_level>UTIL::LOG_LEVESLS.size()) {
+    SPDLOG_CRITICAL("Invalid log_level {}, which should be 0 - 6",log_level);
+    SPDLOG_CRITICAL("0-trace,1-debug,2-info,3-warn,4-err,5-critical,6-off");
+    return false;
+  }
+  if (!network_config.validate()) {
+    return false;
+  }
+  if (!ubodt_file.empty() && !UTIL::file_exists(ubodt_file)) {
+    SPDLOG_CRITICAL("UBODT file not exists {}", ubodt_file);
+    return false;
+  }
+  if (socket_file.empty()) {
+    SPDLOG_CRITICAL("Socket path not specified");
+    return false;
+  }
+  if (num_workers < 0 || max_connections <= 0 || max_request_size <= 0) {
+    SPDLOG_CRITICAL("Invalid workers {} max_connections {} "
+                    "max_request_size {}",
+                    num_workers, max_connections, max_request_size);
+    return false;
+  }
+  SPDLOG_DEBUG("Validating done");
+  return true;
+};
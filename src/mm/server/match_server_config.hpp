@@ -0,0 +1,74 @@
+/**
+ * Fast map matching.
+ *
+ * fmm_server command line program configuration
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_MATCH_SERVER_CONFIG_HPP_
+#define FMM_MATCH_SERVER_CONFIG_HPP_
+
+#include "config/network_config.hpp"
+
+#include <string>
+
+namespace FMM{
+namespace MM{
+/**
+ * Configuration class of fmm_server command line program
+ */
+class MatchServerConfig
+{
+ public:
+  /**
+   * Constructor of the configuration from command line arguments.
+   * The argument data are fetched from the main function directly.
+   *
+   * @param argc number of arguments
+   * @param argv raw argument data
+   */
+  MatchServerConfig(int argc, char **argv);
+  /**
+   * Load configuration from an XML file
+   * @param file xml file name
+   */
+  void load_xml(const std::string &file);
+  /**
+   * Load configuration from arguments. The argument data
+   * are fetched from the main function directly.
+   * @param argc number of arguments
+   * @param argv raw argument data
+   */
+  void load_arg(int argc, char **argv);
+  /**
+   * Validate the configuration
+   * @return true if valid
+   */
+  bool validate() const;
+  /**
+   * Print configuration data
+   */
+  void print() const;
+  /**
+   * Print help information
+   */
+  static void print_help();
+  CONFIG::NetworkConfig network_config; /**< Network data configuraiton */
+  std::string ubodt_file; /**< UBODT file name, if empty only stmatch
+                               requests are served */
+  std::string socket_file; /**< Path of the unix domain socket */
+  int num_workers = 0; /**< Number of threads matching trajectories,
+                            0 means the number of cores */
+  int max_connections = 64; /**< Maximum number of clients connected
+                                 at the same time */
+  int max_request_size = 64; /**< Maximum size of a request in MB */
+  bool help_specified = false;  /**< Help is specified or not */
+  int log_level = 2;  /**< log level, 0-trace,1-debug,2-info,
+                          3-warn,4-err,5-critical,6-off */
+}; // MatchServerConfig
+}
+}
+
+#endif //FMM_MATCH_SERVER_CONFIG_HPP_
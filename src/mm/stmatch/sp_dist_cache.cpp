@@ -0,0 +1,64 @@
+#include "mm/stmatch/sp_dist_cache.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+SPDistCache::SPDistCache(std::size_t capacity, int num_shards)
+    : cache_(capacity, num_shards) {
+}
+
+bool SPDistCache::look_up(NodeIndex source, NodeIndex target, double bound,
+                          double *distance) {
+  Entry entry;
+  // A bound smaller than the bound searched does not answer the look up
+  if (!cache_.find(make_key(source, target), &entry,
+                   [bound](const Entry &cached) {
+                     return cached.exact || cached.value >= bound;
+                   })) {
+    return false;
+  }
+  *distance = entry.exact && entry.value <= bound ?
+    entry.value : std::numeric_limits<double>::infinity();
+  return true;
+}
+
+void SPDistCache::insert_distance(NodeIndex source, NodeIndex target,
+                                  double distance) {
+  insert(make_key(source, target), distance, true);
+}
+
+void SPDistCache::insert_bound(NodeIndex source, NodeIndex target,
+                               double bound) {
+  insert(make_key(source, target), bound, false);
+}
+
+void SPDistCache::insert(uint64_t key, double value, bool exact) {
+  cache_.insert(key, Entry{value, exact},
+                [](Entry &cached, const Entry &entry) {
+                  if (cached.exact) return;
+                  // A distance replaces a bound, and a bound only grows
+                  cached.value = entry.exact ? entry.value :
+                    std::max(cached.value, entry.value);
+                  cached.exact = entry.exact;
+                });
+}
+
+std::size_t SPDistCache::size() const {
+  return cache_.size();
+}
+
+std::size_t SPDistCache::get_capacity() const {
+  return cache_.get_capacity();
+}
+
+const SPDistCacheStats &SPDistCache::get_stats() const {
+  return cache_.get_stats();
+}
+
+uint64_t SPDistCache::make_key(NodeIndex source, NodeIndex target) {
+  return (static_cast<uint64_t>(source) << 32) | target;
+}
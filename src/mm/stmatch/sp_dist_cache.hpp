@@ -0,0 +1,107 @@
+/**
+ * Fast map matching.
+ *
+ * Cache of shortest path distances between network nodes, shared by the
+ * trajectories matched by stmatch.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SP_DIST_CACHE_HPP
+#define FMM_SP_DIST_CACHE_HPP
+
+#include "network/type.hpp"
+#include "util/sharded_clock_cache.hpp"
+
+#include <cstdint>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Counters of a shortest path distance cache
+ */
+typedef UTIL::ClockCacheStats SPDistCacheStats;
+
+/**
+ * A bounded cache of the shortest path distances between pairs of nodes
+ * of a network, safe to use from multiple threads.
+ *
+ * As the searches of stmatch are bounded, an entry stores either the
+ * exact distance of a pair, or a lower bound of the distance when the
+ * target was not reached by a bounded search.
+ *
+ * The entries are kept in a ShardedClockCache indexed by the pair.
+ */
+class SPDistCache {
+ public:
+  /**
+   * Create a cache
+   * @param capacity maximum number of entries, rounded up to a multiple
+   * of the number of shards
+   * @param num_shards number of shards, rounded up to a power of 2 and
+   * reduced for a small capacity
+   */
+  explicit SPDistCache(std::size_t capacity, int num_shards = 64);
+  /**
+   * Look up the distance of a pair of nodes
+   * @param source source node
+   * @param target target node
+   * @param bound the distance is only needed if it is at most bound
+   * @param distance the distance if it is known and at most bound,
+   * infinity if it is known to be larger than bound
+   * @return true if the cache answers the look up
+   */
+  bool look_up(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+               double bound, double *distance);
+  /**
+   * Store the exact distance of a pair of nodes
+   * @param source source node
+   * @param target target node
+   * @param distance shortest path distance
+   */
+  void insert_distance(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                       double distance);
+  /**
+   * Store a lower bound of the distance of a pair of nodes, which is
+   * known to be larger than the bound
+   * @param source source node
+   * @param target target node
+   * @param bound lower bound of the shortest path distance
+   */
+  void insert_bound(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                    double bound);
+  /**
+   * Get the number of entries
+   */
+  std::size_t size() const;
+  /**
+   * Get the maximum number of entries
+   */
+  std::size_t get_capacity() const;
+  /**
+   * Get the counters of the cache
+   */
+  const SPDistCacheStats &get_stats() const;
+ private:
+  /**
+   * Distance of a pair of nodes
+   */
+  struct Entry {
+    double value; /**< distance or lower bound of the distance */
+    bool exact; /**< true if value is the distance */
+  };
+  /**
+   * Store a value of a pair of nodes
+   */
+  void insert(uint64_t key, double value, bool exact);
+  static uint64_t make_key(NETWORK::NodeIndex source,
+                           NETWORK::NodeIndex target);
+  UTIL::ShardedClockCache<uint64_t, Entry> cache_;
+}; // SPDistCache
+
+} // MM
+} // FMM
+
+#endif // FMM_SP_DIST_CACHE_HPP
@@ -4,8 +4,15 @@
 #include "util/util.hpp"
 #include "io/gps_reader.hpp"
 #include "io/mm_writer.hpp"
+#include "mm/traj_filter.hpp"
+#include "mm/match_pipeline.hpp"
+#include "mm/batch_match.hpp"
 
+#include <atomic>
+
+#include <cmath>
 #include <limits>
+#include <omp.h>
 
 using namespace FMM;
 using namespace FMM::CORE;
@@ -18,7 +25,12 @@ STMATCHConfig::STMATCHConfig(
   double vmax_arg, double factor_arg, double reverse_tolerance_arg):
   k(k_arg), radius(r_arg), gps_error(gps_error_arg),
   vmax(vmax_arg), factor(factor_arg),
-  reverse_tolerance(reverse_tolerance_arg) {
+  reverse_tolerance(reverse_tolerance_arg),
+  window_size(0),
+  min_point_distance(0), min_point_interval(0),
+  beam_width(0), beam_margin(0), beam_check(false),
+  adaptive_search(false), heading_tolerance(0),
+  candidate_cache_size(0), cache_size(0) {
 };
 
 void STMATCHConfig::print() const {
@@ -26,6 +38,15 @@ void STMATCHConfig::print() const {
   SPDLOG_INFO("k {} radius {} gps_error {} vmax {} factor {}",
               k, radius, gps_error, vmax, factor);
   SPDLOG_INFO("reverse_tolerance {}",reverse_tolerance);
+  SPDLOG_INFO("window_size {}",window_size);
+  SPDLOG_INFO("min_point_distance {} min_point_interval {}",
+    min_point_distance, min_point_interval);
+  SPDLOG_INFO("beam_width {} beam_margin {} beam_check {}",
+    beam_width, beam_margin, beam_check);
+  SPDLOG_INFO("adaptive_search {} heading_tolerance {}",
+    adaptive_search, heading_tolerance);
+  SPDLOG_INFO("candidate_cache_size {}", candidate_cache_size);
+  SPDLOG_INFO("cache_size {}", cache_size);
 };
 
 STMATCHConfig STMATCHConfig::load_from_xml(
@@ -37,7 +58,23 @@ STMATCHConfig STMATCHConfig::load_from_xml(
   double factor = xml_data.get("config.parameters.factor", 1.5);
   double reverse_tolerance =
     xml_data.get("config.parameters.reverse_tolerance", 0.0);
-  return STMATCHConfig{k, radius, gps_error, vmax, factor,reverse_tolerance};
+  STMATCHConfig config{k, radius, gps_error, vmax, factor, reverse_tolerance};
+  config.window_size = xml_data.get("config.parameters.window_size", 0);
+  config.min_point_distance =
+    xml_data.get("config.parameters.min_point_distance", 0.0);
+  config.min_point_interval =
+    xml_data.get("config.parameters.min_point_interval", 0.0);
+  config.beam_width = xml_data.get("config.parameters.beam_width", 0);
+  config.beam_margin = xml_data.get("config.parameters.beam_margin", 0.0);
+  config.beam_check = xml_data.get("config.parameters.beam_check", false);
+  config.adaptive_search =
+    xml_data.get("config.parameters.adaptive_search", false);
+  config.heading_tolerance =
+    xml_data.get("config.parameters.heading_tolerance", 0.0);
+  config.candidate_cache_size =
+    xml_data.get("config.parameters.candidate_cache_size", 0);
+  config.cache_size = xml_data.get("config.parameters.cache_size", 0);
+  return config;
 };
 
 STMATCHConfig STMATCHConfig::load_from_arg(
@@ -48,7 +85,18 @@ STMATCHConfig STMATCHConfig::load_from_arg(
   double vmax = arg_data["vmax"].as<double>();
   double factor = arg_data["factor"].as<double>();
   double reverse_tolerance = arg_data["reverse_tolerance"].as<double>();
-  return STMATCHConfig{k, radius, gps_error, vmax, factor, reverse_tolerance};
+  STMATCHConfig config{k, radius, gps_error, vmax, factor, reverse_tolerance};
+  config.window_size = arg_data["window_size"].as<int>();
+  config.min_point_distance = arg_data["min_point_distance"].as<double>();
+  config.min_point_interval = arg_data["min_point_interval"].as<double>();
+  config.beam_width = arg_data["beam_width"].as<int>();
+  config.beam_margin = arg_data["beam_margin"].as<double>();
+  config.beam_check = arg_data.count("beam_check") > 0;
+  config.adaptive_search = arg_data.count("adaptive_search") > 0;
+  config.heading_tolerance = arg_data["heading_tolerance"].as<double>();
+  config.candidate_cache_size = arg_data["candidate_cache_size"].as<int>();
+  config.cache_size = arg_data["cache_size"].as<int>();
+  return config;
 };
 
 void STMATCHConfig::register_arg(cxxopts::Options &options){
@@ -64,7 +112,25 @@ void STMATCHConfig::register_arg(cxxopts::Options &options){
     ("factor","Scale factor",
     cxxopts::value<double>()->default_value("1.5"))
     ("reverse_tolerance","Ratio of reverse movement allowed",
-      cxxopts::value<double>()->default_value("0.0"));
+      cxxopts::value<double>()->default_value("0.0"))
+    ("window_size","Points in a window of a long trajectory",
+      cxxopts::value<int>()->default_value("0"))
+    ("min_point_distance","Minimum distance between matched points",
+      cxxopts::value<double>()->default_value("0.0"))
+    ("min_point_interval","Minimum time interval between matched points",
+      cxxopts::value<double>()->default_value("0.0"))
+    ("beam_width","Candidates kept in each layer",
+      cxxopts::value<int>()->default_value("0"))
+    ("beam_margin","Log probability margin of candidates kept",
+      cxxopts::value<double>()->default_value("0.0"))
+    ("beam_check","Count paths changed by pruning")
+    ("adaptive_search","Search candidates by nearest neighbour query")
+    ("heading_tolerance","Heading difference in degrees allowed",
+      cxxopts::value<double>()->default_value("0.0"))
+    ("candidate_cache_size","Grid cells in the candidate search cache",
+      cxxopts::value<int>()->default_value("0"))
+    ("cache_size","Node pairs in the shortest path distance cache",
+      cxxopts::value<int>()->default_value("0"));
 }
 
 void STMATCHConfig::register_help(std::ostringstream &oss){
@@ -78,6 +144,36 @@ void STMATCHConfig::register_help(std::ostringstream &oss){
     " Maximum speed (unit: network_data_unit/s) (30)\n";
   oss<<"--reverse_tolerance (optional) <double>: proportion "
       "of reverse movement allowed on an edge\n";
+  oss<<"--window_size (optional) <int>: trajectories with more points "
+      "are split into windows of this size matched in parallel, "
+      "0 to disable (0)\n";
+  oss<<"--min_point_distance (optional) <double>: points closer than "
+      "this distance to the previous kept point are collapsed "
+      "before matching (0)\n";
+  oss<<"--min_point_interval (optional) <double>: points within this "
+      "time interval of the previous kept point are collapsed "
+      "before matching (0)\n";
+  oss<<"--beam_width (optional) <int>: candidates with the highest "
+      "probability kept in each layer, the shortest paths of "
+      "trajectories split into windows are not pruned, 0 to disable (0)\n";
+  oss<<"--beam_margin (optional) <double>: candidates whose log "
+      "probability is lower than the best by more than the margin are "
+      "pruned, 0 to disable (0)\n";
+  oss<<"--beam_check: if specified, trajectories are matched again "
+      "without pruning to count the paths changed by pruning\n";
+  oss<<"--adaptive_search: if specified, candidates are searched by "
+      "an incremental nearest neighbour query stopped after k "
+      "candidates are found within radius\n";
+  oss<<"--heading_tolerance (optional) <double>: candidates whose edge "
+      "direction differs from the heading estimated from the neighbouring "
+      "points by more than this angle in degrees are ranked after the "
+      "others, 0 to disable (0)\n";
+  oss<<"--candidate_cache_size (optional) <int>: number of grid cells "
+      "whose nearby edges are cached for the candidate search, "
+      "0 to disable (0)\n";
+  oss<<"--cache_size (optional) <int>: number of node pairs whose "
+      "shortest path distance is cached and reused by all the "
+      "trajectories, 0 to disable (0)\n";
 };
 
 bool STMATCHConfig::validate() const {
@@ -88,6 +184,38 @@ bool STMATCHConfig::validate() const {
                     k, radius, gps_error, vmax, factor, reverse_tolerance);
     return false;
   }
+  if (window_size < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter window_size {}", window_size);
+    return false;
+  }
+  if (min_point_distance < 0 || min_point_interval < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter min_point_distance {} "
+      "min_point_interval {}", min_point_distance, min_point_interval);
+    return false;
+  }
+  if (beam_width < 0 || beam_margin < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter beam_width {} beam_margin {}",
+                    beam_width, beam_margin);
+    return false;
+  }
+  if (window_size > 0 && (beam_width > 0 || beam_margin > 0)) {
+    SPDLOG_WARN("Beam pruning does not skip the shortest path search "
+                "of trajectories split into windows");
+  }
+  if (heading_tolerance < 0 || heading_tolerance > 180) {
+    SPDLOG_CRITICAL("Invalid mm parameter heading_tolerance {}",
+                    heading_tolerance);
+    return false;
+  }
+  if (candidate_cache_size < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter candidate_cache_size {}",
+                    candidate_cache_size);
+    return false;
+  }
+  if (cache_size < 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter cache_size {}", cache_size);
+    return false;
+  }
   return true;
 }
 
@@ -99,8 +227,8 @@ PyMatchResult STMATCH::match_wkt(
   MatchResult result = match_traj(traj, config);
   PyMatchResult output;
   output.id = result.id;
-  output.opath = result.opath;
-  output.cpath = result.cpath;
+  output.opath = network_.get_edge_ids(result.opath);
+  output.cpath = network_.get_edge_ids(result.cpath);
   output.mgeom = result.mgeom;
   output.indices = result.indices;
   for (int i = 0; i < result.opt_candidate_path.size(); ++i) {
@@ -122,50 +250,163 @@ PyMatchResult STMATCH::match_wkt(
   return output;
 };
 
+void STMATCH::match_points(const double *xs, const double *ys,
+                           const double *ts, std::size_t n,
+                           const STMATCHConfig &config, ResultSink &sink) {
+  Trajectory traj;
+  for (std::size_t i = 0; i < n; ++i) traj.geom.add_point(xs[i], ys[i]);
+  if (ts != nullptr) traj.timestamps.assign(ts, ts + n);
+  if (config.min_point_distance > 0 || config.min_point_interval > 0) {
+    // The result of a filtered trajectory is expanded by match_traj
+    MatchResult result = match_traj(
+      traj, config, sink.need_geometry() ? MATCH_ALL : MATCH_CANDIDATES);
+    write_to_sink(network_, result, n, &sink);
+    return;
+  }
+  Traj_Candidates tc = search_candidates(traj, config);
+  if (tc.empty()) {
+    write_to_sink(network_, traj, TGOpath{}, C_Path{}, {}, &sink);
+    return;
+  }
+  TransitionGraph tg(tc, config.gps_error);
+  TGOpath tg_opath = infer_opath(&tg, tc, traj, config);
+  std::vector<int> indices;
+  C_Path cpath = build_cpath(tg_opath, &indices, config.reverse_tolerance);
+  write_to_sink(network_, traj, tg_opath, cpath, indices, &sink);
+}
+
+PyBatchResult STMATCH::match_batch(
+  const std::vector<double> &xs, const std::vector<double> &ys,
+  const std::vector<double> &timestamps,
+  const std::vector<long long> &offsets,
+  const STMATCHConfig &config, int num_threads) {
+  return MM::match_batch(
+    network_, xs, ys, timestamps, offsets, num_threads,
+    [&](const Trajectory &traj) { return match_traj(traj, config); });
+}
+
 // Procedure of HMM based map matching algorithm.
-MatchResult STMATCH::match_traj(const Trajectory &traj,
-                                const STMATCHConfig &config) {
-  SPDLOG_DEBUG("Count of points in trajectory {}", traj.geom.get_num_points());
+Traj_Candidates STMATCH::search_candidates(
+  const Trajectory &traj, const STMATCHConfig &config) {
   SPDLOG_DEBUG("Search candidates");
-  Traj_Candidates tc = network_.search_tr_cs_knn(
-    traj.geom, config.k, config.radius);
+  CandidateCache *cache = get_candidate_cache(config);
+  // Long trajectories are split into windows processed in parallel
+  return is_split(traj, config) ?
+    network_.search_tr_cs_knn_omp(traj.geom, config.k, config.radius,
+                                  config.adaptive_search,
+                                  config.heading_tolerance,
+                                  config.gps_error, cache) :
+    network_.search_tr_cs_knn(traj.geom, config.k, config.radius,
+                              config.adaptive_search,
+                              config.heading_tolerance,
+                              config.gps_error, cache);
+}
+
+TGOpath STMATCH::infer_opath(TransitionGraph *tg, const Traj_Candidates &tc,
+                             const Trajectory &traj,
+                             const STMATCHConfig &config) {
   SPDLOG_DEBUG("Trajectory candidate {}", tc);
-  if (tc.empty()) return MatchResult{};
-  SPDLOG_DEBUG("Generate dummy graph");
-  DummyGraph dg(tc, config.reverse_tolerance);
-  SPDLOG_DEBUG("Generate composite_graph");
-  CompositeGraph cg(graph_, dg);
-  SPDLOG_DEBUG("Generate composite_graph");
-  TransitionGraph tg(tc, config.gps_error);
-  SPDLOG_DEBUG("Update cost in transition graph");
-  // The network will be used internally to update transition graph
-  update_tg(&tg, cg, traj, config);
+  bool split = is_split(traj, config);
+  auto update = [&](TransitionGraph *graph, const STMATCHConfig &config) {
+    if (split) {
+      SPDLOG_DEBUG("Update cost in transition graph by windows");
+      update_tg_windowed(graph, tc, traj, config);
+    } else {
+      SPDLOG_DEBUG("Generate dummy graph");
+      DummyGraph dg(tc, config.reverse_tolerance);
+      SPDLOG_DEBUG("Generate composite_graph");
+      CompositeGraph cg(graph_, dg);
+      SPDLOG_DEBUG("Update cost in transition graph");
+      // The network will be used internally to update transition graph
+      update_tg(graph, cg, traj, config);
+    }
+  };
+  update(tg, config);
   SPDLOG_DEBUG("Optimal path inference");
-  TGOpath tg_opath = tg.backtrack();
+  TGOpath tg_opath = tg->backtrack();
   SPDLOG_DEBUG("Optimal path size {}", tg_opath.size());
-  MatchedCandidatePath matched_candidate_path(tg_opath.size());
-  std::transform(tg_opath.begin(), tg_opath.end(),
-                 matched_candidate_path.begin(),
-                 [](const TGNode *a) {
-    return MatchedCandidate{
-      *(a->c), a->ep, a->tp, a->sp_dist
-    };
-  });
-  O_Path opath(tg_opath.size());
-  std::transform(tg_opath.begin(), tg_opath.end(),
-                 opath.begin(),
-                 [](const TGNode *a) {
-    return a->c->edge->id;
-  });
+  if (config.beam_check && (config.beam_width > 0 || config.beam_margin > 0)) {
+    STMATCHConfig full_config = config;
+    full_config.beam_width = 0;
+    full_config.beam_margin = 0;
+    TransitionGraph full_tg(tc, config.gps_error);
+    update(&full_tg, full_config);
+    TGOpath full_opath = full_tg.backtrack();
+    ++beam_stats_.checked_trajectories;
+    if (tg_opath.size() != full_opath.size() ||
+        !std::equal(tg_opath.begin(), tg_opath.end(), full_opath.begin(),
+                    [](const TGNode *a, const TGNode *b) {
+      return a->c->index == b->c->index;
+    })) {
+      SPDLOG_DEBUG("Traj {} optimal path changed by pruning", traj.id);
+      ++beam_stats_.changed_paths;
+    }
+  }
+  return tg_opath;
+}
+
+bool STMATCH::is_split(const Trajectory &traj, const STMATCHConfig &config) {
+  return config.window_size > 0 &&
+    traj.geom.get_num_points() > config.window_size;
+}
+
+MatchResult STMATCH::match_traj(const Trajectory &traj,
+                                const STMATCHConfig &config,
+                                int fields) {
+  SPDLOG_DEBUG("Count of points in trajectory {}", traj.geom.get_num_points());
+  if (config.min_point_distance > 0 || config.min_point_interval > 0) {
+    std::vector<int> kept_indices;
+    Trajectory filtered = filter_trajectory(
+      traj, config.min_point_distance, config.min_point_interval,
+      &kept_indices);
+    if (kept_indices.size() < traj.geom.get_num_points()) {
+      STMATCHConfig filtered_config = config;
+      filtered_config.min_point_distance = 0;
+      filtered_config.min_point_interval = 0;
+      // Candidates of the filtered points are required by the expansion
+      MatchResult result = match_traj(filtered, filtered_config,
+                                      fields | MATCH_CANDIDATES);
+      return expand_match_result(network_, traj, result, kept_indices,
+                                 config.gps_error, fields);
+    }
+  }
+  Traj_Candidates tc = search_candidates(traj, config);
+  if (tc.empty()) return MatchResult{};
+  TransitionGraph tg(tc, config.gps_error);
+  TGOpath tg_opath = infer_opath(&tg, tc, traj, config);
+  // Only the members requested by fields are computed
+  MatchedCandidatePath matched_candidate_path;
+  if (fields & MATCH_CANDIDATES) {
+    matched_candidate_path.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   matched_candidate_path.begin(),
+                   [](const TGNode *a) {
+      return MatchedCandidate{
+        *(a->c), a->ep, a->tp, a->sp_dist
+      };
+    });
+  }
+  O_Path opath;
+  if (fields & MATCH_OPATH) {
+    opath.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   opath.begin(),
+                   [](const TGNode *a) {
+      return a->c->edge->index;
+    });
+  }
   std::vector<int> indices;
   C_Path cpath = build_cpath(tg_opath, &indices, config.reverse_tolerance);
   SPDLOG_DEBUG("Opath is {}", opath);
   SPDLOG_DEBUG("Indices is {}", indices);
   SPDLOG_DEBUG("Complete path is {}", cpath);
-  LineString mgeom = network_.complete_path_to_geometry(
-    traj.geom, cpath);
+  LineString mgeom;
+  if (fields & MATCH_MGEOM) {
+    mgeom = network_.complete_path_to_geometry(traj.geom, cpath);
+  }
   return MatchResult{
-    traj.id, matched_candidate_path, opath, cpath, indices, mgeom};
+    traj.id, std::move(matched_candidate_path), std::move(opath),
+    std::move(cpath), std::move(indices), std::move(mgeom)};
 }
 
 std::string STMATCH::match_gps_file(
@@ -181,7 +422,8 @@ std::string STMATCH::match_gps_file(
     oss<<"gps_config invalid\n";
     validate = false;
   }
-  if (!result_config.validate()) {
+  if (!result_config.validate() ||
+      !result_config.validate_shards(gps_config.get_files())) {
     oss<<"result_config invalid\n";
     validate = false;
   }
@@ -194,56 +436,75 @@ std::string STMATCH::match_gps_file(
     return oss.str();
   }
   // Start map matching
-  int progress = 0;
-  int points_matched = 0;
-  int total_points = 0;
+  std::atomic<int> progress{0};
+  std::atomic<int> points_matched{0};
+  std::atomic<int> total_points{0};
   int step_size = 1000;
   auto begin_time = UTIL::get_current_time();
-  FMM::IO::GPSReader reader(gps_config);
-  FMM::IO::CSVMatchResultWriter writer(result_config.file,
-                                       result_config.output_config);
-  if (use_omp) {
-    int buffer_trajectories_size = 100000;
-    while (reader.has_next_trajectory()) {
-      std::vector<Trajectory> trajectories =
-        reader.read_next_N_trajectories(buffer_trajectories_size);
-      int trajectories_fetched = trajectories.size();
-      #pragma omp parallel for
-      for (int i = 0; i < trajectories_fetched; ++i) {
-        Trajectory &trajectory = trajectories[i];
+  // Only the members of the result exported are computed
+  int match_fields = FMM::IO::CSVMatchResultWriter::get_match_fields(
+    result_config.output_config);
+  // For a sharded result, the files are matched one after another into
+  // their own result file, otherwise they are read as a single file.
+  std::vector<std::string> gps_files = {gps_config.file};
+  if (result_config.is_sharded()) gps_files = gps_config.get_files();
+  for (const std::string &gps_file : gps_files) {
+    FMM::CONFIG::GPSConfig file_gps_config = gps_config;
+    file_gps_config.file = gps_file;
+    std::string result_file = result_config.is_sharded() ?
+      result_config.get_shard_file(gps_file) : result_config.file;
+    FMM::IO::GPSReader reader(file_gps_config);
+    FMM::IO::CSVMatchResultWriter writer(result_file,
+                                         result_config.output_config,
+                                         network_,
+                                         result_config.reorder_window);
+    if (use_omp) {
+      // Windows of a long trajectory are already matched in parallel,
+      // so long trajectories are matched one at a time.
+      std::mutex long_trajectory_mutex;
+      run_match_pipeline(
+        reader,
+        [&](const Trajectory &trajectory) -> MM::MatchResult {
+          if (stmatch_config.window_size > 0 &&
+              trajectory.geom.get_num_points() > stmatch_config.window_size) {
+            std::lock_guard<std::mutex> lock(long_trajectory_mutex);
+            return match_traj(trajectory, stmatch_config, match_fields);
+          }
+          return match_traj(trajectory, stmatch_config, match_fields);
+        },
+        [&](std::size_t index, const std::vector<Trajectory> &trajectories,
+            const std::vector<MM::MatchResult> &results) {
+          writer.write_results(index,trajectories,results);
+          for (std::size_t i = 0; i < trajectories.size(); ++i) {
+            const Trajectory &trajectory = trajectories[i];
+            int points_in_tr = trajectory.geom.get_num_points();
+            if (!results[i].cpath.empty()) {
+              points_matched += points_in_tr;
+            }
+            total_points += points_in_tr;
+            int done = ++progress;
+            if (done % step_size == 0) {
+              SPDLOG_INFO("Progress {}", done);
+            }
+          }
+        });
+    } else {
+      while (reader.has_next_trajectory()) {
+        if (progress % step_size == 0) {
+          SPDLOG_INFO("Progress {}", progress.load());
+        }
+        Trajectory trajectory = reader.read_next_trajectory();
         int points_in_tr = trajectory.geom.get_num_points();
         MM::MatchResult result = match_traj(
-          trajectory, stmatch_config);
+          trajectory, stmatch_config, match_fields);
         writer.write_result(trajectory,result);
-        #pragma omp critical
         if (!result.cpath.empty()) {
           points_matched += points_in_tr;
         }
         total_points += points_in_tr;
         ++progress;
-        if (progress % step_size == 0) {
-          std::stringstream buf;
-          buf << "Progress " << progress << '\n';
-          std::cout << buf.rdbuf();
-        }
       }
     }
-  } else {
-    while (reader.has_next_trajectory()) {
-      if (progress % step_size == 0) {
-        SPDLOG_INFO("Progress {}", progress);
-      }
-      Trajectory trajectory = reader.read_next_trajectory();
-      int points_in_tr = trajectory.geom.get_num_points();
-      MM::MatchResult result = match_traj(
-        trajectory, stmatch_config);
-      writer.write_result(trajectory,result);
-      if (!result.cpath.empty()) {
-        points_matched += points_in_tr;
-      }
-      total_points += points_in_tr;
-      ++progress;
-    }
   }
   auto end_time = UTIL::get_current_time();
   double duration = UTIL::get_duration(begin_time,end_time);
@@ -251,9 +512,34 @@ std::string STMATCH::match_gps_file(
   oss<<"Time takes " << duration << " seconds\n";
   oss<<"Total points " << total_points << " matched "<< points_matched <<"\n";
   oss<<"Map match speed " << points_matched / duration << " points/s \n";
+  if (stmatch_config.beam_width > 0 || stmatch_config.beam_margin > 0) {
+    oss<<"Beam pruned nodes " << beam_stats_.pruned_nodes << " of "
+       << beam_stats_.total_nodes << "\n";
+    oss<<"Beam changed paths " << beam_stats_.changed_paths << " of "
+       << beam_stats_.checked_trajectories << " checked\n";
+  }
   return oss.str();
 };
 
+CandidateCache *STMATCH::get_candidate_cache(const STMATCHConfig &config) {
+  if (config.candidate_cache_size <= 0) return nullptr;
+  std::call_once(candidate_cache_flag_, [&]() {
+    SPDLOG_INFO("Create candidate cache of {} cells of size {}",
+                config.candidate_cache_size, config.radius);
+    candidate_cache_.reset(
+      new CandidateCache(config.candidate_cache_size, config.radius));
+  });
+  return candidate_cache_.get();
+}
+
+const CandidateCache *STMATCH::get_candidate_cache() const {
+  return candidate_cache_.get();
+}
+
+const BeamStats &STMATCH::get_beam_stats() const {
+  return beam_stats_;
+}
+
 void STMATCH::update_tg(TransitionGraph *tg,
                         const CompositeGraph &cg,
                         const Trajectory &traj,
@@ -262,6 +548,10 @@ void STMATCH::update_tg(TransitionGraph *tg,
   std::vector<TGLayer> &layers = tg->get_layers();
   std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(traj.geom);
   int N = layers.size();
+  bool prune = config.beam_width > 0 || config.beam_margin > 0;
+  long long total_nodes = 0;
+  long long pruned_nodes = 0;
+  SPDistCache *cache = get_sp_cache(config);
   for (int i = 0; i < N - 1; ++i) {
     // Routing from current_layer to next_layer
     double delta = 0;
@@ -271,29 +561,229 @@ void STMATCH::update_tg(TransitionGraph *tg,
       double duration = traj.timestamps[i + 1] - traj.timestamps[i];
       delta = config.factor * config.vmax * duration;
     }
-    update_layer(i, &(layers[i]), &(layers[i + 1]),
-                 cg, eu_dists[i], delta);
+    double beam_threshold = -std::numeric_limits<double>::infinity();
+    if (prune) {
+      beam_threshold = TransitionGraph::calc_beam_threshold(
+        layers[i], config.beam_width, config.beam_margin);
+      total_nodes += layers[i].size();
+      pruned_nodes += std::count_if(
+        layers[i].begin(), layers[i].end(), [&](const TGNode &a) {
+        return a.cumu_prob < beam_threshold;
+      });
+    }
+    std::vector<double> sp_dists;
+    calc_layer_sp_dist(i, layers[i], layers[i + 1], cg, delta,
+                       beam_threshold, config.reverse_tolerance, cache,
+                       &sp_dists);
+    update_layer(i, &(layers[i]), &(layers[i + 1]), eu_dists[i],
+                 beam_threshold, sp_dists);
+  }
+  if (prune) {
+    beam_stats_.total_nodes += total_nodes;
+    beam_stats_.pruned_nodes += pruned_nodes;
   }
   SPDLOG_DEBUG("Update transition graph done");
 }
 
+void STMATCH::update_tg_windowed(TransitionGraph *tg,
+                                 const Traj_Candidates &tc,
+                                 const Trajectory &traj,
+                                 const STMATCHConfig &config) {
+  SPDLOG_DEBUG("Update transition graph by windows");
+  std::vector<TGLayer> &layers = tg->get_layers();
+  std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(traj.geom);
+  int N = layers.size();
+  int window_size = config.window_size;
+  bool prune = config.beam_width > 0 || config.beam_margin > 0;
+  long long total_nodes = 0;
+  long long pruned_nodes = 0;
+  SPDistCache *cache = get_sp_cache(config);
+  std::vector<double> deltas(N - 1);
+  for (int i = 0; i < N - 1; ++i) {
+    if (traj.timestamps.size() != N) {
+      deltas[i] = eu_dists[i] * config.factor * 4;
+    } else {
+      double duration = traj.timestamps[i + 1] - traj.timestamps[i];
+      deltas[i] = config.factor * config.vmax * duration;
+    }
+  }
+  // The shortest path distances do not depend on the accumulated
+  // probabilities, therefore they are calculated for a block of windows
+  // in parallel and the Viterbi update runs sequentially on the block.
+  // As the accumulated probabilities are not known in the parallel part,
+  // beam pruning only applies to the sequential update.
+  int block_size = window_size * omp_get_max_threads();
+  std::vector<std::vector<double>> sp_dists(block_size);
+  for (int start = 0; start < N - 1; start += block_size) {
+    int end = std::min(start + block_size, N - 1);
+    int windows = (end - start + window_size - 1) / window_size;
+    #pragma omp parallel for schedule(dynamic)
+    for (int w = 0; w < windows; ++w) {
+      int wstart = start + w * window_size;
+      int wend = std::min(wstart + window_size, end);
+      // Layers wstart to wend (inclusive) are routed in this window. The
+      // candidates of the other layers only split edges in the dummy
+      // graph, which leaves the distances unchanged, so they are left out.
+      Traj_Candidates window_tc(tc.begin() + wstart, tc.begin() + wend + 1);
+      DummyGraph dg(window_tc, config.reverse_tolerance);
+      CompositeGraph cg(graph_, dg);
+      for (int i = wstart; i < wend; ++i) {
+        calc_layer_sp_dist(i, layers[i], layers[i + 1], cg, deltas[i],
+                           -std::numeric_limits<double>::infinity(),
+                           config.reverse_tolerance, cache,
+                           &sp_dists[i - start]);
+      }
+    }
+    for (int i = start; i < end; ++i) {
+      double beam_threshold = -std::numeric_limits<double>::infinity();
+      if (prune) {
+        beam_threshold = TransitionGraph::calc_beam_threshold(
+          layers[i], config.beam_width, config.beam_margin);
+        total_nodes += layers[i].size();
+        pruned_nodes += std::count_if(
+          layers[i].begin(), layers[i].end(), [&](const TGNode &a) {
+          return a.cumu_prob < beam_threshold;
+        });
+      }
+      update_layer(i, &(layers[i]), &(layers[i + 1]),
+                   eu_dists[i], beam_threshold, sp_dists[i - start]);
+    }
+  }
+  if (prune) {
+    beam_stats_.total_nodes += total_nodes;
+    beam_stats_.pruned_nodes += pruned_nodes;
+  }
+  SPDLOG_DEBUG("Update transition graph by windows done");
+}
+
+void STMATCH::calc_layer_sp_dist(int level, const TGLayer &la,
+                                 const TGLayer &lb,
+                                 const CompositeGraph &cg, double delta,
+                                 double beam_threshold,
+                                 double reverse_tolerance,
+                                 SPDistCache *cache,
+                                 std::vector<double> *sp_dists) {
+  std::vector<NodeIndex> targets(lb.size());
+  std::transform(lb.begin(), lb.end(), targets.begin(),
+                 [](const TGNode &a) {
+    return a.c->index;
+  });
+  sp_dists->clear();
+  sp_dists->reserve(la.size() * lb.size());
+  for (auto iter_a = la.begin(); iter_a != la.end(); ++iter_a) {
+    if (iter_a->cumu_prob < beam_threshold) {
+      // Pruned by beam search
+      sp_dists->insert(sp_dists->end(), lb.size(),
+                       std::numeric_limits<double>::max());
+      continue;
+    }
+    if (cache != nullptr && look_up_sp_dist(iter_a->c, lb, delta,
+                                            reverse_tolerance, cache,
+                                            sp_dists)) {
+      continue;
+    }
+    std::vector<double> distances = shortest_path_upperbound(
+      level, cg, iter_a->c->index, targets, delta);
+    if (cache != nullptr) {
+      store_sp_dist(iter_a->c, lb, delta, reverse_tolerance, distances,
+                    cache);
+    }
+    sp_dists->insert(sp_dists->end(), distances.begin(), distances.end());
+  }
+}
+
+bool STMATCH::look_up_sp_dist(const Candidate *ca, const TGLayer &lb,
+                              double delta, double reverse_tolerance,
+                              SPDistCache *cache,
+                              std::vector<double> *sp_dists) {
+  std::size_t size = sp_dists->size();
+  // Distance from ca to the target of its edge
+  double head = ca->edge->length - ca->offset;
+  for (const TGNode &node : lb) {
+    const Candidate *cb = node.c;
+    double dist;
+    if (!edge_sp_dist(ca, cb, reverse_tolerance, &dist)) {
+      double bound = delta - head - cb->offset;
+      double node_dist;
+      if (bound < 0) {
+        dist = std::numeric_limits<double>::max();
+      } else if (cache->look_up(ca->edge->target, cb->edge->source, bound,
+                                &node_dist)) {
+        dist = std::isinf(node_dist) ? std::numeric_limits<double>::max() :
+          head + node_dist + cb->offset;
+      } else {
+        sp_dists->resize(size);
+        return false;
+      }
+    }
+    // Candidates beyond delta are not reached by the search
+    if (dist > delta) dist = std::numeric_limits<double>::max();
+    sp_dists->push_back(dist);
+  }
+  return true;
+}
+
+void STMATCH::store_sp_dist(const Candidate *ca, const TGLayer &lb,
+                            double delta, double reverse_tolerance,
+                            const std::vector<double> &distances,
+                            SPDistCache *cache) {
+  double head = ca->edge->length - ca->offset;
+  for (int i = 0; i < lb.size(); ++i) {
+    const Candidate *cb = lb[i].c;
+    double dist;
+    // The path along the edge does not involve the end nodes
+    if (edge_sp_dist(ca, cb, reverse_tolerance, &dist)) continue;
+    if (distances[i] == std::numeric_limits<double>::max()) {
+      double bound = delta - head - cb->offset;
+      if (bound >= 0) {
+        cache->insert_bound(ca->edge->target, cb->edge->source, bound);
+      }
+    } else {
+      cache->insert_distance(ca->edge->target, cb->edge->source,
+                             std::max(0.0, distances[i] - head - cb->offset));
+    }
+  }
+}
+
+bool STMATCH::edge_sp_dist(const Candidate *ca, const Candidate *cb,
+                           double reverse_tolerance, double *dist) {
+  // Same as the edges added between candidates by the dummy graph
+  if (ca->edge != cb->edge) return false;
+  if (ca->offset <= cb->offset) {
+    *dist = cb->offset - ca->offset;
+    return true;
+  }
+  if (ca->offset - cb->offset < ca->edge->length * reverse_tolerance) {
+    *dist = 0;
+    return true;
+  }
+  return false;
+}
+
+SPDistCache *STMATCH::get_sp_cache(const STMATCHConfig &config) {
+  if (config.cache_size <= 0) return nullptr;
+  std::call_once(sp_cache_flag_, [&]() {
+    SPDLOG_INFO("Create shortest path distance cache of {} node pairs",
+                config.cache_size);
+    sp_cache_.reset(new SPDistCache(config.cache_size));
+  });
+  return sp_cache_.get();
+}
+
+const SPDistCache *STMATCH::get_sp_cache() const {
+  return sp_cache_.get();
+}
+
 void STMATCH::update_layer(int level, TGLayer *la_ptr, TGLayer *lb_ptr,
-                           const CompositeGraph &cg,
-                           double eu_dist,
-                           double delta) {
+                           double eu_dist, double beam_threshold,
+                           const std::vector<double> &sp_dists) {
   SPDLOG_DEBUG("Update layer {} starts", level);
-  TGLayer &lb = *lb_ptr;
-  for (auto iter_a = la_ptr->begin(); iter_a != la_ptr->end(); ++iter_a) {
-    NodeIndex source = iter_a->c->index;
-    // SPDLOG_TRACE("  Calculate distance from source {}", source);
-    // single source upper bound routing
-    std::vector<NodeIndex> targets(lb.size());
-    std::transform(lb.begin(), lb.end(), targets.begin(),
-                   [](TGNode &a) {
-      return a.c->index;
-    });
-    std::vector<double> distances = shortest_path_upperbound(
-      level, cg, source, targets, delta);
+  int nb = lb_ptr->size();
+  auto distances = sp_dists.begin();
+  for (auto iter_a = la_ptr->begin(); iter_a != la_ptr->end();
+       ++iter_a, distances += nb) {
+    // Pruned by beam search
+    if (iter_a->cumu_prob < beam_threshold) continue;
     for (auto iter_b = lb_ptr->begin(); iter_b != lb_ptr->end(); ++iter_b) {
       int i = std::distance(lb_ptr->begin(),iter_b);
       double tp = TransitionGraph::calc_tp(distances[i], eu_dist);
@@ -391,9 +881,8 @@ C_Path STMATCH::build_cpath(const TGOpath &opath, std::vector<int> *indices,
   C_Path cpath;
   if (!indices->empty()) indices->clear();
   if (opath.empty()) return cpath;
-  const std::vector<Edge> &edges = network_.get_edges();
   int N = opath.size();
-  cpath.push_back(opath[0]->c->edge->id);
+  cpath.push_back(opath[0]->c->edge->index);
   int current_idx = 0;
   // SPDLOG_TRACE("Insert index {}", current_idx);
   indices->push_back(current_idx);
@@ -412,11 +901,9 @@ C_Path STMATCH::build_cpath(const TGOpath &opath, std::vector<int> *indices,
         indices->clear();
         return {};
       }
-      for (int e:segs) {
-        cpath.push_back(edges[e].id);
-        ++current_idx;
-      }
-      cpath.push_back(b->edge->id);
+      cpath.insert(cpath.end(), segs.begin(), segs.end());
+      current_idx += segs.size();
+      cpath.push_back(b->edge->index);
       ++current_idx;
       indices->push_back(current_idx);
     } else {
@@ -14,10 +14,14 @@
 #include "mm/composite_graph.hpp"
 #include "mm/transition_graph.hpp"
 #include "mm/mm_type.hpp"
+#include "mm/result_sink.hpp"
+#include "mm/stmatch/sp_dist_cache.hpp"
 #include "python/pyfmm.hpp"
 #include "config/gps_config.hpp"
 #include "config/result_config.hpp"
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -51,6 +55,49 @@ struct STMATCHConfig {
   double factor; /**< factor multiplied to vmax*deltaT to
                       limit the search of shortest path */
   double reverse_tolerance;
+  int window_size; /**< Trajectories with more points than window_size
+                        are split into windows matched in parallel,
+                        0 means no split */
+  double min_point_distance; /**< points closer than this distance to
+                                  the last kept point are dropped before
+                                  matching, 0 means no filter */
+  double min_point_interval; /**< points with a time interval to the last
+                                  kept point smaller than this value are
+                                  dropped before matching,
+                                  0 means no filter */
+  int beam_width; /**< number of candidates with the highest
+                       accumulative probability kept in each layer,
+                       0 means no pruning. The shortest paths of
+                       trajectories split into windows are searched
+                       before the probabilities are known, so there
+                       pruning only saves the Viterbi update. */
+  double beam_margin; /**< candidates whose accumulative log probability
+                           is lower than the best by more than this margin
+                           are pruned, 0 means no pruning */
+  bool beam_check; /**< if true and pruning is enabled, trajectories are
+                        matched again without pruning to count
+                        the paths changed by pruning */
+  bool adaptive_search; /**< if true, the candidates of a point are
+                             searched by an incremental nearest neighbour
+                             query which stops after k candidates are
+                             found, otherwise all edges within radius
+                             are examined */
+  double heading_tolerance; /**< maximum difference in degrees between
+                                 the heading of a point and the direction
+                                 of a candidate edge, candidates exceeding
+                                 it only fill the remaining of the k slots,
+                                 0 means no check */
+  int candidate_cache_size; /**< number of grid cells whose nearby edges
+                                 are cached by the model and reused by
+                                 the candidate search of the following
+                                 points, 0 means no cache. The cells have
+                                 the size of the search radius. The
+                                 adaptive search does not use it. */
+  int cache_size; /**< number of node pairs whose shortest path distance
+                       is cached by the model and reused by the following
+                       trajectories, 0 means no cache. The cache is
+                       created by the first trajectory matched with a
+                       positive size, which sets its capacity. */
   /**
    * Check the validity of the configuration
    */
@@ -98,14 +145,48 @@ public:
    */
   PYTHON::PyMatchResult match_wkt(
     const std::string &wkt,const STMATCHConfig &config);
+  /**
+   * Match a trajectory given as coordinate arrays and write the result
+   * into a sink, without building a WKT or a MatchResult.
+   * @param xs x of the points
+   * @param ys y of the points
+   * @param ts timestamp of the points, can be nullptr
+   * @param n number of points
+   * @param config Map matching configuration
+   * @param sink receiver of the result
+   */
+  void match_points(const double *xs, const double *ys, const double *ts,
+                    std::size_t n, const STMATCHConfig &config,
+                    ResultSink &sink);
+  /**
+   * Match a batch of trajectories stored in flat arrays with several
+   * threads, see MM::match_batch for the layout of the arrays. In Python,
+   * the arrays can be NumPy arrays or any object supporting the buffer
+   * protocol, and the GIL is released while matching.
+   * @param xs x of all the points
+   * @param ys y of all the points
+   * @param timestamps timestamp of all the points, can be empty
+   * @param offsets offsets of the trajectories in the points
+   * @param config Map matching configuration
+   * @param num_threads number of threads, 0 means the number of cores
+   * @return Map matching results in flat arrays
+   */
+  PYTHON::PyBatchResult match_batch(
+    const std::vector<double> &xs, const std::vector<double> &ys,
+    const std::vector<double> &timestamps,
+    const std::vector<long long> &offsets,
+    const STMATCHConfig &config, int num_threads = 0);
   /**
    * Match a trajectory to the road network
    * @param  traj   input trajector data
    * @param  config configuration of stmatch algorithm
+   * @param  fields bit mask of %MatchResultField specifying the optional
+   * members of the result computed, the others are left empty
    * @return map matching result
    */
   MatchResult match_traj(const CORE::Trajectory &traj,
-                         const STMATCHConfig &config);
+                         const STMATCHConfig &config,
+                         int fields = MATCH_ALL);
   /**
    * Match GPS data stored in a file
    * @param  gps_config    [description]
@@ -120,6 +201,22 @@ public:
     const STMATCHConfig &config,
     bool use_omp = true
     );
+  /**
+   * Get the counters of beam pruning accumulated by the model
+   */
+  const BeamStats &get_beam_stats() const;
+  /**
+   * Get the candidate cache of the model
+   * @return the cache, nullptr if no trajectory is matched with a
+   * positive candidate_cache_size yet
+   */
+  const NETWORK::CandidateCache *get_candidate_cache() const;
+  /**
+   * Get the shortest path distance cache of the model
+   * @return the cache, nullptr if no trajectory is matched with a
+   * positive cache_size yet
+   */
+  const SPDistCache *get_sp_cache() const;
 protected:
   /**
    * Update probabilities in a transition graph
@@ -132,19 +229,103 @@ protected:
                  const CompositeGraph &cg,
                  const CORE::Trajectory &traj,
                  const STMATCHConfig &config);
+  /**
+   * Update probabilities in a transition graph of a long trajectory.
+   *
+   * The trajectory is split into windows of config.window_size layers.
+   * For each window, a dummy graph is built from the candidates of the
+   * window and the shortest path distances between its layers are
+   * calculated in parallel.
+   * The probabilities are then propagated sequentially over all layers.
+   *
+   * @param tg transition graph
+   * @param tc trajectory candidates
+   * @param traj raw trajectory
+   * @param config map match configuration
+   */
+  void update_tg_windowed(TransitionGraph *tg,
+                          const Traj_Candidates &tc,
+                          const CORE::Trajectory &traj,
+                          const STMATCHConfig &config);
   /**
    * Update probabilities between two layers a and b in the transition graph
    * @param level   the index of layer a
    * @param la_ptr  layer a
    * @param lb_ptr  layer b next to a
-   * @param cg      Composition graph
    * @param eu_dist Euclidean distance between two observed point
-   * @param delta   An upper bound to limit the search
+   * @param beam_threshold nodes in layer a with accumulative probability
+   * lower than the threshold are skipped
+   * @param sp_dists shortest path distances between the two layers
+   * calculated by calc_layer_sp_dist
    */
   void update_layer(int level, TGLayer *la_ptr, TGLayer *lb_ptr,
-                    const CompositeGraph &cg,
-                    double eu_dist,
-                    double delta);
+                    double eu_dist, double beam_threshold,
+                    const std::vector<double> &sp_dists);
+  /**
+   * Calculate the shortest path distances from all nodes in layer a
+   * to all nodes in layer b
+   * @param level   the index of layer a
+   * @param la      layer a
+   * @param lb      layer b next to a
+   * @param cg      Composition graph
+   * @param delta   An upper bound to limit the search
+   * @param beam_threshold no search is done from nodes in layer a with
+   * accumulative probability lower than the threshold
+   * @param reverse_tolerance reverse movement allowed on an edge
+   * @param cache if not nullptr, the distances from a node are taken from
+   * the cache when it knows all of them, and the distances searched are
+   * stored into it
+   * @param sp_dists the distances stored in row major order with
+   * la.size() rows and lb.size() columns
+   */
+  void calc_layer_sp_dist(int level, const TGLayer &la, const TGLayer &lb,
+                          const CompositeGraph &cg, double delta,
+                          double beam_threshold, double reverse_tolerance,
+                          SPDistCache *cache,
+                          std::vector<double> *sp_dists);
+  /**
+   * Get the distances from a candidate to the candidates of the next
+   * layer from the cache. The distance of a pair of candidates on
+   * different edges is the distance between the end nodes of their
+   * edges, taken from the cache, combined with the offsets of the
+   * candidates, as in the composite graph.
+   * @param ca candidate of layer a
+   * @param lb layer b next to a
+   * @param delta An upper bound to limit the search
+   * @param reverse_tolerance reverse movement allowed on an edge
+   * @param cache the distance cache
+   * @param sp_dists the distances are appended to it
+   * @return true if all the distances are found, otherwise sp_dists is
+   * not modified
+   */
+  bool look_up_sp_dist(const Candidate *ca, const TGLayer &lb, double delta,
+                       double reverse_tolerance, SPDistCache *cache,
+                       std::vector<double> *sp_dists);
+  /**
+   * Store the distances between end nodes of edges found by a search
+   * from a candidate into the cache
+   * @param ca candidate of layer a
+   * @param lb layer b next to a
+   * @param delta the upper bound of the search
+   * @param reverse_tolerance reverse movement allowed on an edge
+   * @param distances the distances to the candidates of lb
+   * @param cache the distance cache
+   */
+  void store_sp_dist(const Candidate *ca, const TGLayer &lb, double delta,
+                     double reverse_tolerance,
+                     const std::vector<double> &distances,
+                     SPDistCache *cache);
+  /**
+   * Get the distance between two candidates on the same edge if the
+   * second one is reached without leaving the edge
+   * @param ca candidate of layer a
+   * @param cb candidate of layer b
+   * @param reverse_tolerance reverse movement allowed on an edge
+   * @param dist the distance
+   * @return true if cb is reached along the edge of ca
+   */
+  static bool edge_sp_dist(const Candidate *ca, const Candidate *cb,
+                           double reverse_tolerance, double *dist);
 
   /**
    * Return distances from source to all targets and with an upper bound of
@@ -169,13 +350,56 @@ protected:
    * @param  tg_opath A sequence of optimal candidate nodes
    * @param  indices  the indices to be updated to store the index of matched
    * edge or candidate in the returned path.
-   * @return A vector of edge id representing the traversed path
+   * @return A vector of edge index representing the traversed path
    */
   C_Path build_cpath(const TGOpath &tg_opath, std::vector<int> *indices,
                      double reverse_tolerance=0);
 private:
+  /**
+   * Search the candidates of the points of a trajectory
+   * @param traj trajectory
+   * @param config map match configuration
+   * @return the candidates of each point
+   */
+  Traj_Candidates search_candidates(const CORE::Trajectory &traj,
+                                    const STMATCHConfig &config);
+  /**
+   * Get the candidate cache, which is created with the cache size and
+   * search radius of the configuration on the first call
+   * @return the cache, nullptr if config.candidate_cache_size is 0
+   */
+  NETWORK::CandidateCache *get_candidate_cache(const STMATCHConfig &config);
+  /**
+   * Update a transition graph and find its optimal path
+   * @param tg transition graph created from tc
+   * @param tc candidates of the trajectory
+   * @param traj trajectory
+   * @param config map match configuration
+   * @return the optimal candidate of each point
+   */
+  TGOpath infer_opath(TransitionGraph *tg, const Traj_Candidates &tc,
+                      const CORE::Trajectory &traj,
+                      const STMATCHConfig &config);
+  /**
+   * Tell if a trajectory is matched by windows in parallel
+   */
+  static bool is_split(const CORE::Trajectory &traj,
+                       const STMATCHConfig &config);
+  /**
+   * Get the shortest path distance cache, which is created with the
+   * cache size of the configuration on the first call
+   * @return the cache, nullptr if config.cache_size is 0
+   */
+  SPDistCache *get_sp_cache(const STMATCHConfig &config);
   const NETWORK::Network &network_;
   const NETWORK::NetworkGraph &graph_;
+  BeamStats beam_stats_;
+  std::once_flag sp_cache_flag_;
+  std::unique_ptr<SPDistCache> sp_cache_; /**< distances between nodes
+                                               shared by the trajectories */
+  std::once_flag candidate_cache_flag_;
+  std::unique_ptr<NETWORK::CandidateCache> candidate_cache_; /**< edges
+    near the cells of the points shared by the trajectories */
 };// STMATCH
 }
 } // FMM
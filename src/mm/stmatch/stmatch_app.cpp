@@ -3,6 +3,9 @@
 //
 
 #include "mm/stmatch/stmatch_app.hpp"
+#include "mm/match_pipeline.hpp"
+
+#include <atomic>
 
 using namespace FMM;
 using namespace FMM::CORE;
@@ -14,62 +17,85 @@ void STMATCHApp::run() {
   STMATCH mm_model(network_, ng_);
   const STMATCHConfig &stmatch_config =
       config_.stmatch_config;
-  IO::GPSReader reader(config_.gps_config);
-  IO::CSVMatchResultWriter writer(config_.result_config.file,
-                                  config_.result_config.output_config);
+  // Only the members of the result exported are computed
+  int match_fields = IO::CSVMatchResultWriter::get_match_fields(
+    config_.result_config.output_config);
   // Start map matching
-  int progress = 0;
-  int points_matched = 0;
-  int total_points = 0;
+  std::atomic<int> progress{0};
+  std::atomic<int> points_matched{0};
+  std::atomic<int> total_points{0};
   int step_size = 100;
   if (config_.step > 0) step_size = config_.step;
   SPDLOG_INFO("Progress report step {}", step_size);
   auto corrected_begin = UTIL::get_current_time();
   SPDLOG_INFO("Start to match trajectories");
-  if (config_.use_omp){
-    SPDLOG_INFO("Run map matching parallelly");
-    int buffer_trajectories_size = 100000;
-    while (reader.has_next_trajectory()) {
-      std::vector<Trajectory> trajectories =
-        reader.read_next_N_trajectories(buffer_trajectories_size);
-      int trajectories_fetched = trajectories.size();
-      #pragma omp parallel for
-      for (int i = 0; i < trajectories_fetched; ++i) {
-        Trajectory &trajectory = trajectories[i];
+  const CONFIG::GPSConfig &gps_config = config_.gps_config;
+  const CONFIG::ResultConfig &result_config = config_.result_config;
+  // The network is loaded once for all the GPS files, which are written
+  // into a result file each if the output is a folder.
+  std::vector<std::string> gps_files = {gps_config.file};
+  if (result_config.is_sharded()) gps_files = gps_config.get_files();
+  for (const std::string &gps_file : gps_files) {
+    CONFIG::GPSConfig file_gps_config = gps_config;
+    file_gps_config.file = gps_file;
+    std::string result_file = result_config.is_sharded() ?
+      result_config.get_shard_file(gps_file) : result_config.file;
+    IO::GPSReader reader(file_gps_config);
+    IO::CSVMatchResultWriter writer(result_file,
+                                    result_config.output_config,
+                                    network_,
+                                    result_config.reorder_window);
+    if (config_.use_omp){
+      SPDLOG_INFO("Run map matching parallelly");
+      // Windows of a long trajectory are already matched in parallel,
+      // so long trajectories are matched one at a time.
+      std::mutex long_trajectory_mutex;
+      run_match_pipeline(
+        reader,
+        [&](const Trajectory &trajectory) -> MM::MatchResult {
+          if (stmatch_config.window_size > 0 &&
+              trajectory.geom.get_num_points() > stmatch_config.window_size) {
+            std::lock_guard<std::mutex> lock(long_trajectory_mutex);
+            return mm_model.match_traj(trajectory, stmatch_config,
+                                       match_fields);
+          }
+          return mm_model.match_traj(trajectory, stmatch_config,
+                                     match_fields);
+        },
+        [&](std::size_t index, const std::vector<Trajectory> &trajectories,
+            const std::vector<MM::MatchResult> &results) {
+          writer.write_results(index,trajectories,results);
+          for (std::size_t i = 0; i < trajectories.size(); ++i) {
+            const Trajectory &trajectory = trajectories[i];
+            int points_in_tr = trajectory.geom.get_num_points();
+            if (!results[i].cpath.empty()) {
+              points_matched += points_in_tr;
+            }
+            total_points += points_in_tr;
+            int done = ++progress;
+            if (done % step_size == 0) {
+              SPDLOG_INFO("Progress {}", done);
+            }
+          }
+        });
+    } else {
+      SPDLOG_INFO("Run map matching in single thread");
+      while (reader.has_next_trajectory()) {
+        if (progress % step_size == 0) {
+          SPDLOG_INFO("Progress {}", progress.load());
+        }
+        Trajectory trajectory = reader.read_next_trajectory();
         int points_in_tr = trajectory.geom.get_num_points();
         MM::MatchResult result = mm_model.match_traj(
-            trajectory, stmatch_config);
+            trajectory, stmatch_config, match_fields);
         writer.write_result(trajectory,result);
-        #pragma omp critical
         if (!result.cpath.empty()) {
           points_matched += points_in_tr;
         }
         total_points += points_in_tr;
         ++progress;
-        if (progress % step_size == 0) {
-          std::stringstream buf;
-          buf << "Progress " << progress << '\n';
-          std::cout << buf.rdbuf();
-        }
       }
     }
-  } else {
-    SPDLOG_INFO("Run map matching in single thread");
-    while (reader.has_next_trajectory()) {
-      if (progress % step_size == 0) {
-        SPDLOG_INFO("Progress {}", progress);
-      }
-      Trajectory trajectory = reader.read_next_trajectory();
-      int points_in_tr = trajectory.geom.get_num_points();
-      MM::MatchResult result = mm_model.match_traj(
-          trajectory, stmatch_config);
-      writer.write_result(trajectory,result);
-      if (!result.cpath.empty()) {
-        points_matched += points_in_tr;
-      }
-      total_points += points_in_tr;
-      ++progress;
-    }
   }
   SPDLOG_INFO("MM process finished");
   auto end_time = UTIL::get_current_time();
@@ -78,10 +104,38 @@ void STMATCHApp::run() {
   SPDLOG_INFO("Time takes {}", time_spent);
   SPDLOG_INFO("Time takes excluding input {}", time_spent_exclude_input);
   SPDLOG_INFO("Finish map match total points {} matched {}",
-              total_points, points_matched);
-  SPDLOG_INFO("Matched percentage: {}", points_matched / (double) total_points);
+              total_points.load(), points_matched.load());
+  SPDLOG_INFO("Matched percentage: {}",
+              points_matched / (double) total_points);
   SPDLOG_INFO("Point match speed: {}", points_matched / time_spent);
   SPDLOG_INFO("Point match speed (excluding input): {}",
               points_matched / time_spent_exclude_input);
+  if (stmatch_config.beam_width > 0 || stmatch_config.beam_margin > 0) {
+    const BeamStats &beam_stats = mm_model.get_beam_stats();
+    SPDLOG_INFO("Beam pruned nodes {} of {}",
+                beam_stats.pruned_nodes, beam_stats.total_nodes);
+    SPDLOG_INFO("Beam changed paths {} of {} checked",
+                beam_stats.changed_paths, beam_stats.checked_trajectories);
+  }
+  const CandidateCache *candidate_cache = mm_model.get_candidate_cache();
+  if (candidate_cache != nullptr) {
+    const CandidateCacheStats &cell_stats = candidate_cache->get_stats();
+    long long hits = cell_stats.hits;
+    long long searches = hits + cell_stats.misses;
+    SPDLOG_INFO("Candidate cache hits {} of {} points ({:.2f}%) "
+                "cells {} evictions {}",
+                hits, searches, searches > 0 ? 100.0 * hits / searches : 0.0,
+                candidate_cache->size(), cell_stats.evictions.load());
+  }
+  const SPDistCache *sp_cache = mm_model.get_sp_cache();
+  if (sp_cache != nullptr) {
+    const SPDistCacheStats &cache_stats = sp_cache->get_stats();
+    long long hits = cache_stats.hits;
+    long long lookups = hits + cache_stats.misses;
+    SPDLOG_INFO("Distance cache hits {} of {} look ups ({:.2f}%) "
+                "entries {} evictions {}",
+                hits, lookups, lookups > 0 ? 100.0 * hits / lookups : 0.0,
+                sp_cache->size(), cache_stats.evictions.load());
+  }
   SPDLOG_INFO("Time takes {}", time_spent);
 };
@@ -107,7 +107,8 @@ bool STMATCHAppConfig::validate() const {
   if (!gps_config.validate()) {
     return false;
   }
-  if (!result_config.validate()) {
+  if (!result_config.validate() ||
+      !result_config.validate_shards(gps_config.get_files())) {
     return false;
   }
   if (!network_config.validate()) {
@@ -0,0 +1,96 @@
+#include "mm/traj_filter.hpp"
+#include "mm/transition_graph.hpp"
+#include "algorithm/geom_algorithm.hpp"
+#include "util/debug.hpp"
+
+#include <cmath>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+Trajectory FMM::MM::filter_trajectory(const Trajectory &traj,
+                                      double min_distance,
+                                      double min_interval,
+                                      std::vector<int> *kept_indices) {
+  kept_indices->clear();
+  int N = traj.geom.get_num_points();
+  bool has_timestamp = traj.timestamps.size() == N;
+  Trajectory filtered;
+  filtered.id = traj.id;
+  for (int i = 0; i < N; ++i) {
+    if (i > 0 && i < N - 1) {
+      int last = kept_indices->back();
+      double dx = traj.geom.get_x(i) - traj.geom.get_x(last);
+      double dy = traj.geom.get_y(i) - traj.geom.get_y(last);
+      if (std::sqrt(dx * dx + dy * dy) < min_distance) continue;
+      if (has_timestamp &&
+          traj.timestamps[i] - traj.timestamps[last] < min_interval) continue;
+    }
+    kept_indices->push_back(i);
+    filtered.geom.add_point(traj.geom.get_x(i), traj.geom.get_y(i));
+    if (has_timestamp) filtered.timestamps.push_back(traj.timestamps[i]);
+  }
+  SPDLOG_DEBUG("Trajectory {} filtered from {} to {} points",
+               traj.id, N, kept_indices->size());
+  return filtered;
+}
+
+MatchResult FMM::MM::expand_match_result(
+  const Network &network, const Trajectory &traj, const MatchResult &result,
+  const std::vector<int> &kept_indices, double gps_error, int fields) {
+  MatchResult expanded;
+  expanded.id = result.id;
+  expanded.cpath = result.cpath;
+  expanded.mgeom = result.mgeom;
+  if (result.opt_candidate_path.size() != kept_indices.size()) {
+    // Unmatched trajectory
+    return expanded;
+  }
+  const std::vector<Edge> &edges = network.get_edges();
+  int N = traj.geom.get_num_points();
+  int j = 0;
+  for (int i = 0; i < N; ++i) {
+    if (j + 1 < kept_indices.size() && kept_indices[j + 1] == i) ++j;
+    if (kept_indices[j] == i) {
+      if (fields & MATCH_OPATH) expanded.opath.push_back(result.opath[j]);
+      expanded.indices.push_back(result.indices[j]);
+      if (fields & MATCH_CANDIDATES) {
+        expanded.opt_candidate_path.push_back(result.opt_candidate_path[j]);
+      }
+      continue;
+    }
+    // The last point is always kept, so a dropped point lies between the
+    // kept points j and j + 1
+    double x = traj.geom.get_x(i), y = traj.geom.get_y(i);
+    int best = result.indices[j];
+    double best_dist = 0, best_offset = 0, best_x = 0, best_y = 0;
+    for (int k = result.indices[j]; k <= result.indices[j + 1]; ++k) {
+      double dist, offset, proj_x, proj_y;
+      ALGORITHM::linear_referencing(x, y, edges[result.cpath[k]].geom,
+                                    &dist, &offset, &proj_x, &proj_y);
+      if (k == result.indices[j] || dist < best_dist) {
+        best = k;
+        best_dist = dist;
+        best_offset = offset;
+        best_x = proj_x;
+        best_y = proj_y;
+      }
+    }
+    EdgeIndex edge_index = result.cpath[best];
+    if (fields & MATCH_OPATH) expanded.opath.push_back(edge_index);
+    expanded.indices.push_back(best);
+    if (!(fields & MATCH_CANDIDATES)) continue;
+    MatchedCandidate mc = result.opt_candidate_path[j];
+    mc.c.edge = const_cast<Edge *>(&edges[edge_index]);
+    mc.c.dist = best_dist;
+    mc.c.offset = best_offset;
+    mc.c.point = Point(best_x, best_y);
+    mc.ep = TransitionGraph::calc_ep(best_dist, gps_error);
+    mc.tp = 1.0;
+    mc.sp_dist = 0;
+    expanded.opt_candidate_path.push_back(mc);
+  }
+  return expanded;
+}
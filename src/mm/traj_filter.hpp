@@ -0,0 +1,73 @@
+/**
+ * Fast map matching.
+ *
+ * Preprocessing of a trajectory before map matching, where stationary
+ * points are collapsed and a minimum spacing is enforced, and the
+ * expansion of the match result back to the original points.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_TRAJ_FILTER_HPP
+#define FMM_TRAJ_FILTER_HPP
+
+#include "core/gps.hpp"
+#include "mm/mm_type.hpp"
+#include "network/network.hpp"
+
+#include <vector>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Filter a trajectory before map matching.
+ *
+ * A point is dropped if it is within min_distance of the last kept point,
+ * which collapses a stationary cluster into its first point, or if less
+ * than min_interval seconds passed since the last kept point. The first
+ * and the last point are always kept. The interval is only checked when
+ * the trajectory has timestamps.
+ *
+ * @param traj input trajectory
+ * @param min_distance minimum distance between two kept points, in map unit
+ * @param min_interval minimum time interval between two kept points
+ * @param kept_indices the index in traj of each kept point, the vector
+ * will be updated
+ * @return the filtered trajectory
+ */
+CORE::Trajectory filter_trajectory(const CORE::Trajectory &traj,
+                                   double min_distance,
+                                   double min_interval,
+                                   std::vector<int> *kept_indices);
+
+/**
+ * Expand the match result of a filtered trajectory to the original points.
+ *
+ * A dropped point is matched to the nearest edge of the complete path
+ * between the edges matched to the kept points before and after it, as
+ * the vehicle may have moved on to a later edge, and it is projected to
+ * that edge to update the error, offset and emission probability. Its
+ * transition probability is 1 and its shortest path distance is 0.
+ *
+ * @param network the network whose edges are indexed by the path
+ * @param traj the original trajectory
+ * @param result the match result of the filtered trajectory
+ * @param kept_indices the indices returned by filter_trajectory
+ * @param gps_error GPS error used to calculate the emission probability
+ * @param fields bit mask of %MatchResultField specifying the optional
+ * members expanded, the result must contain the candidates
+ * @return the match result of the original trajectory
+ */
+MatchResult expand_match_result(const NETWORK::Network &network,
+                                const CORE::Trajectory &traj,
+                                const MatchResult &result,
+                                const std::vector<int> &kept_indices,
+                                double gps_error,
+                                int fields = MATCH_ALL);
+
+} // MM
+} // FMM
+
+#endif //FMM_TRAJ_FILTER_HPP
@@ -11,6 +11,9 @@
 #include "network/type.hpp"
 #include "util/debug.hpp"
 
+#include <algorithm>
+#include <functional>
+
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
@@ -40,6 +43,30 @@ double TransitionGraph::calc_ep(double dist,double error){
   return exp(-0.5 * a * a);
 }
 
+double TransitionGraph::calc_beam_threshold(
+  const TGLayer &layer, int beam_width, double beam_margin){
+  double threshold = -std::numeric_limits<double>::infinity();
+  if (layer.empty()) return threshold;
+  if (beam_margin > 0) {
+    auto opt_c = std::max_element(layer.begin(), layer.end(),
+                                  [](const TGNode &a, const TGNode &b) {
+      return a.cumu_prob < b.cumu_prob;
+    });
+    threshold = opt_c->cumu_prob - beam_margin;
+  }
+  if (beam_width > 0 && beam_width < layer.size()) {
+    std::vector<double> probs(layer.size());
+    std::transform(layer.begin(), layer.end(), probs.begin(),
+                   [](const TGNode &a) {
+      return a.cumu_prob;
+    });
+    std::nth_element(probs.begin(), probs.begin() + beam_width - 1,
+                     probs.end(), std::greater<double>());
+    threshold = std::max(threshold, probs[beam_width - 1]);
+  }
+  return threshold;
+}
+
 // Reset the properties of a candidate set
 void TransitionGraph::reset_layer(TGLayer *layer){
   for (auto iter=layer->begin(); iter!=layer->end(); ++iter) {
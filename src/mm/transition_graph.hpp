@@ -17,6 +17,7 @@
 #include "mm/mm_type.hpp"
 
 #include <float.h>
+#include <atomic>
 
 namespace FMM
 {
@@ -36,6 +37,19 @@ struct TGNode {
                        candidate to current node */
 };
 
+/**
+ * Counters of beam pruning in the transition graph, which can be updated
+ * by multiple threads.
+ */
+struct BeamStats {
+  std::atomic<long long> total_nodes{0}; /**< source nodes examined */
+  std::atomic<long long> pruned_nodes{0}; /**< source nodes pruned */
+  std::atomic<long long> checked_trajectories{0}; /**< trajectories also
+                                matched without pruning for comparison */
+  std::atomic<long long> changed_paths{0}; /**< trajectories whose optimal
+                                path is changed by pruning */
+};
+
 /**
  * A layer of nodes in the transition graph.
  */
@@ -82,6 +96,20 @@ public:
    */
   static double calc_ep(double dist,double error);
 
+  /**
+   * Calculate the beam threshold of a layer, nodes whose accumulative
+   * probability is below the threshold are pruned as sources of the
+   * transition to the next layer.
+   * @param  layer       A layer in the transition graph
+   * @param  beam_width  Number of nodes with the highest accumulative
+   * probability kept, 0 means no limit
+   * @param  beam_margin Nodes whose log probability is lower than the best
+   * one by more than the margin are pruned, 0 means no limit
+   * @return the threshold, -infinity if no node is pruned
+   */
+  static double calc_beam_threshold(const TGLayer &layer, int beam_width,
+                                    double beam_margin);
+
   /**
    * Reset all the proability data stored in a layer of the transition graph
    * @param layer A layer in the transition graph
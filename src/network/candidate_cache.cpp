@@ -0,0 +1,71 @@
+#include "network/candidate_cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+CandidateCache::CandidateCache(std::size_t capacity, double cell_size,
+                               int num_shards)
+    : cache_(capacity, num_shards), cell_size_(cell_size) {
+}
+
+CandidateCache::CellItems CandidateCache::find(double px, double py,
+                                               double radius) {
+  CellItems items;
+  cache_.find(make_key(px, py, radius), &items);
+  return items;
+}
+
+CandidateCache::CellItems CandidateCache::insert(double px, double py,
+                                                 double radius,
+                                                 std::vector<Item> items) {
+  // The cell inserted by another thread in the meantime is returned
+  return cache_.insert(
+    make_key(px, py, radius),
+    std::make_shared<const std::vector<Item>>(std::move(items)));
+}
+
+CandidateCache::Box CandidateCache::get_cell_box(double px, double py,
+                                                 double radius) const {
+  CellKey key = make_key(px, py, radius);
+  // The margin covers the rounding of the cell bounds
+  double margin = radius + cell_size_ * 1e-6;
+  return Box(Point(key.x * cell_size_ - margin, key.y * cell_size_ - margin),
+             Point((key.x + 1) * cell_size_ + margin,
+                   (key.y + 1) * cell_size_ + margin));
+}
+
+double CandidateCache::get_cell_size() const {
+  return cell_size_;
+}
+
+std::size_t CandidateCache::size() const {
+  return cache_.size();
+}
+
+std::size_t CandidateCache::get_capacity() const {
+  return cache_.get_capacity();
+}
+
+const CandidateCacheStats &CandidateCache::get_stats() const {
+  return cache_.get_stats();
+}
+
+std::size_t CandidateCache::CellKeyHash::operator()(
+  const CellKey &key) const {
+  uint64_t h = static_cast<uint64_t>(key.x) * 0x9E3779B97F4A7C15ULL;
+  h ^= static_cast<uint64_t>(key.y) + 0x7F4A7C159E3779B9ULL + (h << 6) +
+    (h >> 2);
+  h ^= std::hash<double>()(key.radius) + (h << 6) + (h >> 2);
+  return h;
+}
+
+CandidateCache::CellKey CandidateCache::make_key(double px, double py,
+                                                 double radius) const {
+  return CellKey{static_cast<int64_t>(std::floor(px / cell_size_)),
+                 static_cast<int64_t>(std::floor(py / cell_size_)),
+                 radius};
+}
@@ -0,0 +1,140 @@
+/**
+ * Fast map matching.
+ *
+ * Cache of the edges near the cells of a grid, shared by the candidate
+ * searches of the trajectories.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_CANDIDATE_CACHE_HPP
+#define FMM_CANDIDATE_CACHE_HPP
+
+#include "network/type.hpp"
+#include "core/geometry.hpp"
+#include "util/sharded_clock_cache.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/geometry/geometries/box.hpp>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Counters of a candidate cache, a hit is a point whose cell is cached
+ */
+typedef UTIL::ClockCacheStats CandidateCacheStats;
+
+/**
+ * A bounded cache of the edges within a search radius of the cells of a
+ * square grid, safe to use from multiple threads.
+ *
+ * The candidate search of a point queries the rtree with a box of the
+ * search radius around the point. With the cache, the rtree is queried
+ * once per cell with the box of the cell enlarged by the radius, and
+ * the edges of the cell are then filtered by the box of each point of
+ * the cell. As the rtree returns the edges of any box in the same
+ * relative order, the edges found are the same, in the same order, as
+ * the query of the point.
+ *
+ * The cells are kept in a ShardedClockCache indexed by the cell.
+ */
+class CandidateCache {
+ public:
+  /**
+   * Box of an edge
+   */
+  typedef boost::geometry::model::box<CORE::Point> Box;
+  /**
+   * Edge with its box, as stored in the rtree of the network
+   */
+  typedef std::pair<Box, Edge *> Item;
+  /**
+   * Edges of a cell, which stay valid while they are used even if the
+   * cell is evicted
+   */
+  typedef std::shared_ptr<const std::vector<Item>> CellItems;
+  /**
+   * Create a cache
+   * @param capacity maximum number of cells, rounded up to a multiple of
+   * the number of shards
+   * @param cell_size size of the cells, in map unit
+   * @param num_shards number of shards, rounded up to a power of 2 and
+   * reduced for a small capacity
+   */
+  CandidateCache(std::size_t capacity, double cell_size, int num_shards = 64);
+  /**
+   * Find the edges of the cell of a point
+   * @param px x of the point
+   * @param py y of the point
+   * @param radius search radius
+   * @return the edges, nullptr if the cell is not cached
+   */
+  CellItems find(double px, double py, double radius);
+  /**
+   * Store the edges of the cell of a point
+   * @param px x of the point
+   * @param py y of the point
+   * @param radius search radius
+   * @param items edges whose box intersects the box of the cell, in the
+   * order returned by the rtree
+   * @return the edges stored
+   */
+  CellItems insert(double px, double py, double radius,
+                   std::vector<Item> items);
+  /**
+   * Get the box queried for the cell of a point, which contains the
+   * search box of all the points of the cell
+   * @param px x of the point
+   * @param py y of the point
+   * @param radius search radius
+   */
+  Box get_cell_box(double px, double py, double radius) const;
+  /**
+   * Get the size of the cells
+   */
+  double get_cell_size() const;
+  /**
+   * Get the number of cells cached
+   */
+  std::size_t size() const;
+  /**
+   * Get the maximum number of cells
+   */
+  std::size_t get_capacity() const;
+  /**
+   * Get the counters of the cache
+   */
+  const CandidateCacheStats &get_stats() const;
+ private:
+  /**
+   * Cell of the grid searched with a radius
+   */
+  struct CellKey {
+    int64_t x; /**< column of the cell */
+    int64_t y; /**< row of the cell */
+    double radius; /**< search radius */
+    bool operator==(const CellKey &rhs) const {
+      return x == rhs.x && y == rhs.y && radius == rhs.radius;
+    }
+  };
+  /**
+   * Hash of a cell
+   */
+  struct CellKeyHash {
+    std::size_t operator()(const CellKey &key) const;
+  };
+  CellKey make_key(double px, double py, double radius) const;
+  UTIL::ShardedClockCache<CellKey, CellItems, CellKeyHash> cache_;
+  double cell_size_;
+}; // CandidateCache
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_CANDIDATE_CACHE_HPP
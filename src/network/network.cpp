@@ -5,6 +5,7 @@
 
 #include <ogrsf_frmts.h> // C++ API for GDAL
 #include <math.h> // Calulating probability
+#include <cmath>
 #include <algorithm> // Partial sort copy
 #include <stdexcept>
 
@@ -27,6 +28,16 @@ bool Network::candidate_compare(const Candidate &a, const Candidate &b) {
   }
 }
 
+bool Network::candidate_heading_agrees(const Candidate &c, double heading,
+                                       double heading_tolerance) {
+  if (heading_tolerance <= 0 || std::isnan(heading)) return true;
+  double edge_heading =
+    ALGORITHM::calc_heading_at_offset(c.edge->geom, c.offset);
+  if (std::isnan(edge_heading)) return true;
+  return ALGORITHM::heading_difference(heading, edge_heading)
+         <= heading_tolerance;
+}
+
 Network::Network(const std::string &filename,
                  const std::string &id_name,
                  const std::string &source_name,
@@ -204,6 +215,15 @@ EdgeIndex Network::get_edge_index(EdgeID id) const {
   return edge_map.at(id);
 }
 
+std::vector<EdgeID> Network::get_edge_ids(
+  const std::vector<EdgeIndex> &path) const {
+  std::vector<EdgeID> ids(path.size());
+  for (int i = 0; i < path.size(); ++i) {
+    ids[i] = edges[path[i]].id;
+  }
+  return ids;
+}
+
 NodeID Network::get_node_id(NodeIndex index) const {
   return index < num_vertices ? node_id_vec[index] : -1;
 }
@@ -238,58 +258,30 @@ Traj_Candidates Network::search_tr_cs_knn(Trajectory &trajectory, std::size_t k,
 }
 
 Traj_Candidates Network::search_tr_cs_knn(const LineString &geom, std::size_t k,
-                                          double radius) const {
+                                          double radius, bool adaptive,
+                                          double heading_tolerance,
+                                          double heading_min_distance,
+                                          CandidateCache *cache) const {
   int NumberPoints = geom.get_num_points();
   Traj_Candidates tr_cs(NumberPoints);
+  std::vector<double> headings = heading_tolerance > 0 ?
+    ALGORITHM::calc_headings(geom, heading_min_distance) :
+    std::vector<double>(NumberPoints, NAN);
+  double tolerance = heading_tolerance * M_PI / 180.0;
   unsigned int current_candidate_index = num_vertices;
   for (int i = 0; i < NumberPoints; ++i) {
     // SPDLOG_DEBUG("Search candidates for point index {}",i);
-    // Construct a bounding boost_box
-    double px = geom.get_x(i);
-    double py = geom.get_y(i);
-    Point_Candidates pcs;
-    boost_box b(Point(geom.get_x(i) - radius, geom.get_y(i) - radius),
-                Point(geom.get_x(i) + radius, geom.get_y(i) + radius));
-    std::vector<Item> temp;
-    // Rtree can only detect intersect with a the bounding box of
-    // the geometry stored.
-    rtree.query(boost::geometry::index::intersects(b),
-                std::back_inserter(temp));
-    int Nitems = temp.size();
-    for (unsigned int j = 0; j < Nitems; ++j) {
-      // Check for detailed intersection
-      // The two edges are all in OGR_linestring
-      Edge *edge = temp[j].second;
-      double offset;
-      double dist;
-      double closest_x, closest_y;
-      ALGORITHM::linear_referencing(px, py, edge->geom,
-                                    &dist, &offset, &closest_x, &closest_y);
-      if (dist <= radius) {
-        // index, offset, dist, edge, pseudo id, point
-        Candidate c = {0,
-                       offset,
-                       dist,
-                       edge,
-                       Point(closest_x, closest_y)};
-        pcs.push_back(c);
-      }
-    }
-    SPDLOG_DEBUG("Candidate count point {}: {} (filter to k)",i,pcs.size());
-    if (pcs.empty()) {
-      SPDLOG_DEBUG("Candidate not found for point {}: {} {}",i,px,py);
+    tr_cs[i] = adaptive ?
+      search_point_cs_nearest(geom.get_x(i), geom.get_y(i), k, radius,
+                              headings[i], tolerance) :
+      search_point_cs_knn(geom.get_x(i), geom.get_y(i), k, radius,
+                          headings[i], tolerance, cache);
+    SPDLOG_DEBUG("Candidate count point {}: {}",i,tr_cs[i].size());
+    if (tr_cs[i].empty()) {
+      SPDLOG_DEBUG("Candidate not found for point {}: {} {}",
+                   i, geom.get_x(i), geom.get_y(i));
       return Traj_Candidates();
     }
-    // KNN part
-    if (pcs.size() <= k) {
-      tr_cs[i] = pcs;
-    } else {
-      tr_cs[i] = Point_Candidates(k);
-      std::partial_sort_copy(
-        pcs.begin(), pcs.end(),
-        tr_cs[i].begin(), tr_cs[i].end(),
-        candidate_compare);
-    }
     for (int m = 0; m < tr_cs[i].size(); ++m) {
       tr_cs[i][m].index = current_candidate_index + m;
     }
@@ -299,6 +291,170 @@ Traj_Candidates Network::search_tr_cs_knn(const LineString &geom, std::size_t k,
   return tr_cs;
 }
 
+Traj_Candidates Network::search_tr_cs_knn_omp(const LineString &geom,
+                                              std::size_t k,
+                                              double radius,
+                                              bool adaptive,
+                                              double heading_tolerance,
+                                              double heading_min_distance,
+                                              CandidateCache *cache)
+const {
+  int NumberPoints = geom.get_num_points();
+  Traj_Candidates tr_cs(NumberPoints);
+  std::vector<double> headings = heading_tolerance > 0 ?
+    ALGORITHM::calc_headings(geom, heading_min_distance) :
+    std::vector<double>(NumberPoints, NAN);
+  double tolerance = heading_tolerance * M_PI / 180.0;
+  // Points are searched independently, the candidate index is assigned
+  // afterwards so that the result is the same as search_tr_cs_knn.
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < NumberPoints; ++i) {
+    tr_cs[i] = adaptive ?
+      search_point_cs_nearest(geom.get_x(i), geom.get_y(i), k, radius,
+                              headings[i], tolerance) :
+      search_point_cs_knn(geom.get_x(i), geom.get_y(i), k, radius,
+                          headings[i], tolerance, cache);
+  }
+  unsigned int current_candidate_index = num_vertices;
+  for (int i = 0; i < NumberPoints; ++i) {
+    if (tr_cs[i].empty()) {
+      SPDLOG_DEBUG("Candidate not found for point {}: {} {}",
+                   i, geom.get_x(i), geom.get_y(i));
+      return Traj_Candidates();
+    }
+    for (int m = 0; m < tr_cs[i].size(); ++m) {
+      tr_cs[i][m].index = current_candidate_index + m;
+    }
+    current_candidate_index += tr_cs[i].size();
+  }
+  return tr_cs;
+}
+
+Point_Candidates Network::search_point_cs_knn(double px, double py,
+                                              std::size_t k,
+                                              double radius,
+                                              double heading,
+                                              double heading_tolerance,
+                                              CandidateCache *cache) const {
+  Point_Candidates pcs;
+  // Construct a bounding boost_box
+  boost_box b(Point(px - radius, py - radius),
+              Point(px + radius, py + radius));
+  std::vector<Item> temp;
+  if (cache != nullptr) {
+    // The edges of the cell are filtered with the same predicate as the
+    // rtree query, which gives the same edges in the same order
+    CandidateCache::CellItems items = cache->find(px, py, radius);
+    if (items == nullptr) {
+      std::vector<Item> cell_items;
+      rtree.query(boost::geometry::index::intersects(
+                    cache->get_cell_box(px, py, radius)),
+                  std::back_inserter(cell_items));
+      items = cache->insert(px, py, radius, std::move(cell_items));
+    }
+    for (const Item &item : *items) {
+      if (boost::geometry::intersects(item.first, b)) temp.push_back(item);
+    }
+  } else {
+    // Rtree can only detect intersect with a the bounding box of
+    // the geometry stored.
+    rtree.query(boost::geometry::index::intersects(b),
+                std::back_inserter(temp));
+  }
+  int Nitems = temp.size();
+  for (unsigned int j = 0; j < Nitems; ++j) {
+    // Check for detailed intersection
+    // The two edges are all in OGR_linestring
+    Edge *edge = temp[j].second;
+    double offset;
+    double dist;
+    double closest_x, closest_y;
+    ALGORITHM::linear_referencing(px, py, edge->geom,
+                                  &dist, &offset, &closest_x, &closest_y);
+    if (dist <= radius) {
+      // index, offset, dist, edge, pseudo id, point
+      Candidate c = {0,
+                     offset,
+                     dist,
+                     edge,
+                     Point(closest_x, closest_y)};
+      pcs.push_back(c);
+    }
+  }
+  // Candidates disagreeing with the heading are moved to the end and
+  // only fill the slots left by the others.
+  auto agree_end = pcs.end();
+  if (heading_tolerance > 0 && !std::isnan(heading)) {
+    agree_end = std::stable_partition(
+      pcs.begin(), pcs.end(), [&](const Candidate &c) {
+        return candidate_heading_agrees(c, heading, heading_tolerance);
+      });
+  }
+  std::size_t n_agree = agree_end - pcs.begin();
+  // KNN part
+  if (pcs.size() <= k) {
+    return pcs;
+  }
+  Point_Candidates knn(k);
+  if (n_agree >= k) {
+    std::partial_sort_copy(
+      pcs.begin(), agree_end,
+      knn.begin(), knn.end(),
+      candidate_compare);
+  } else {
+    std::partial_sort(agree_end, agree_end + (k - n_agree), pcs.end(),
+                      candidate_compare);
+    std::copy(pcs.begin(), pcs.begin() + k, knn.begin());
+  }
+  return knn;
+}
+
+Point_Candidates Network::search_point_cs_nearest(
+  double px, double py, std::size_t k, double radius,
+  double heading, double heading_tolerance) const {
+  Point_Candidates pcs;
+  if (k == 0) return pcs;
+  Point p(px, py);
+  // The candidates are kept in a max heap ordered by candidate_compare,
+  // so that the front is the k-th nearest candidate found. Candidates
+  // disagreeing with the heading are kept in a separate heap and only
+  // fill the slots left at the end.
+  Point_Candidates disagree;
+  for (auto iter = rtree.qbegin(
+         boost::geometry::index::nearest(p, (unsigned) rtree.size()));
+       iter != rtree.qend(); ++iter) {
+    // The distance to the bounding box is a lower bound of the distance
+    // to the edge, and the query returns the boxes in increasing distance.
+    double box_dist = boost::geometry::distance(p, iter->first);
+    if (box_dist > radius) break;
+    if (pcs.size() == k && box_dist > pcs.front().dist) break;
+    Edge *edge = iter->second;
+    double offset;
+    double dist;
+    double closest_x, closest_y;
+    ALGORITHM::linear_referencing(px, py, edge->geom,
+                                  &dist, &offset, &closest_x, &closest_y);
+    if (dist > radius) continue;
+    Candidate c = {0, offset, dist, edge, Point(closest_x, closest_y)};
+    Point_Candidates &heap =
+      candidate_heading_agrees(c, heading, heading_tolerance) ?
+      pcs : disagree;
+    if (heap.size() == k) {
+      if (!candidate_compare(c, heap.front())) continue;
+      std::pop_heap(heap.begin(), heap.end(), candidate_compare);
+      heap.pop_back();
+    }
+    heap.push_back(c);
+    std::push_heap(heap.begin(), heap.end(), candidate_compare);
+  }
+  std::sort_heap(pcs.begin(), pcs.end(), candidate_compare);
+  std::sort_heap(disagree.begin(), disagree.end(), candidate_compare);
+  for (std::size_t j = 0; j < disagree.size() && pcs.size() < k; ++j) {
+    pcs.push_back(disagree[j]);
+  }
+  return pcs;
+}
+
 const LineString &Network::get_edge_geom(EdgeID edge_id) const {
   return edges[get_edge_index(edge_id)].geom;
 }
@@ -314,7 +470,7 @@ LineString Network::complete_path_to_geometry(
     double dist;
     double firstoffset;
     double lastoffset;
-    const LineString &firstseg = get_edge_geom(complete_path[0]);
+    const LineString &firstseg = edges[complete_path[0]].geom;
     ALGORITHM::linear_referencing(traj.get_x(0), traj.get_y(0), firstseg,
                                   &dist, &firstoffset);
     ALGORITHM::linear_referencing(traj.get_x(Npts - 1), traj.get_y(Npts - 1),
@@ -323,8 +479,8 @@ LineString Network::complete_path_to_geometry(
                                                           lastoffset);
     append_segs_to_line(&line, firstlineseg, 0);
   } else {
-    const LineString &firstseg = get_edge_geom(complete_path[0]);
-    const LineString &lastseg = get_edge_geom(complete_path[NCsegs - 1]);
+    const LineString &firstseg = edges[complete_path[0]].geom;
+    const LineString &lastseg = edges[complete_path[NCsegs - 1]].geom;
     double dist;
     double firstoffset;
     double lastoffset;
@@ -337,7 +493,7 @@ LineString Network::complete_path_to_geometry(
     append_segs_to_line(&line, firstlineseg, 0);
     if (NCsegs > 2) {
       for (int i = 1; i < NCsegs - 1; ++i) {
-        const LineString &middleseg = get_edge_geom(complete_path[i]);
+        const LineString &middleseg = edges[complete_path[i]].geom;
         append_segs_to_line(&line, middleseg, 1);
       }
     }
@@ -11,6 +11,7 @@
 #define FMM_NETWORK_HPP
 
 #include "network/type.hpp"
+#include "network/candidate_cache.hpp"
 #include "config/network_config.hpp"
 #include "core/gps.hpp"
 #include "mm/mm_type.hpp"
@@ -95,6 +96,13 @@ public:
    * @return edge index
    */
   EdgeIndex get_edge_index(EdgeID id) const;
+  /**
+   * Get edge IDs from a path of edge indices, such as the opath or
+   * cpath of a match result
+   * @param path edge indices
+   * @return edge IDs
+   */
+  std::vector<EdgeID> get_edge_ids(const std::vector<EdgeIndex> &path) const;
   /**
    * Get node ID from index
    * @param index index of node
@@ -135,12 +143,97 @@ public:
    * @param geom
    * @param k number of candidates
    * @param radius search radius
+   * @param adaptive if true, candidates of a point are searched with
+   * search_point_cs_nearest, otherwise with search_point_cs_knn
+   * @param heading_tolerance maximum difference in degrees between the
+   * heading of a point and the direction of a candidate edge, candidates
+   * exceeding it are ranked after the others. 0 disables the check.
+   * @param heading_min_distance minimum displacement between the
+   * neighbouring points for the heading of a point to be estimated
+   * @param cache if not nullptr and adaptive is false, the edges near the
+   * points are taken from the cache, see search_point_cs_knn
    * @return a 2D vector of Candidates containing
    * the candidates selected for each point in a linestring
    */
   FMM::MM::Traj_Candidates search_tr_cs_knn(const FMM::CORE::LineString &geom,
                                             std::size_t k,
-                                            double radius) const;
+                                            double radius,
+                                            bool adaptive = false,
+                                            double heading_tolerance = 0,
+                                            double heading_min_distance = 0,
+                                            CandidateCache *cache = nullptr)
+  const;
+  /**
+   * Search for KNN candidates of a linestring with points searched in
+   * parallel by OpenMP. The result is identical to search_tr_cs_knn.
+   *
+   * @param geom
+   * @param k number of candidates
+   * @param radius search radius
+   * @param adaptive if true, candidates of a point are searched with
+   * search_point_cs_nearest, otherwise with search_point_cs_knn
+   * @param heading_tolerance maximum difference in degrees between the
+   * heading of a point and the direction of a candidate edge, candidates
+   * exceeding it are ranked after the others. 0 disables the check.
+   * @param heading_min_distance minimum displacement between the
+   * neighbouring points for the heading of a point to be estimated
+   * @param cache if not nullptr and adaptive is false, the edges near the
+   * points are taken from the cache, see search_point_cs_knn
+   * @return a 2D vector of Candidates containing
+   * the candidates selected for each point in a linestring
+   */
+  FMM::MM::Traj_Candidates search_tr_cs_knn_omp(
+    const FMM::CORE::LineString &geom, std::size_t k, double radius,
+    bool adaptive = false, double heading_tolerance = 0,
+    double heading_min_distance = 0, CandidateCache *cache = nullptr) const;
+  /**
+   * Search for k nearest neighboring (KNN) candidates of a single point
+   * within a search radius. The index of the returned candidates is
+   * not assigned.
+   *
+   * @param px x coordinate of the point
+   * @param py y coordinate of the point
+   * @param k number of candidates
+   * @param radius search radius
+   * @param heading heading of the point in radians, NaN if unknown
+   * @param heading_tolerance tolerance in radians, candidates whose edge
+   * direction differs from heading by more than it only take the slots
+   * left by the others. 0 disables the check.
+   * @param cache if not nullptr, the edges near the point are taken from
+   * the edges cached for its cell instead of querying the rtree, the
+   * candidates found are the same
+   * @return candidates of the point sorted by distance when more than k
+   * candidates are found
+   */
+  FMM::MM::Point_Candidates search_point_cs_knn(double px, double py,
+                                                std::size_t k,
+                                                double radius,
+                                                double heading = 0,
+                                                double heading_tolerance = 0,
+                                                CandidateCache *cache =
+                                                  nullptr)
+  const;
+  /**
+   * Search for k nearest neighboring (KNN) candidates of a single point
+   * within a search radius by an incremental nearest neighbour query on
+   * the rtree. The search grows from the point and stops once k
+   * candidates are found closer than the bounding box of the next edge,
+   * or the radius is reached, so the number of edges examined does not
+   * depend on the edge density within the radius.
+   * The candidates found are the same as search_point_cs_knn.
+   *
+   * @param px x coordinate of the point
+   * @param py y coordinate of the point
+   * @param k number of candidates
+   * @param radius maximum search radius
+   * @param heading heading of the point in radians, NaN if unknown
+   * @param heading_tolerance tolerance in radians, as in
+   * search_point_cs_knn
+   * @return candidates of the point sorted by distance
+   */
+  FMM::MM::Point_Candidates search_point_cs_nearest(
+    double px, double py, std::size_t k, double radius,
+    double heading = 0, double heading_tolerance = 0) const;
   /**
    * Get edge geometry
    * @param edge_id edge id
@@ -151,7 +244,7 @@ public:
    * Extract the geometry of a complete path, whose two end segment will be
    * clipped according to the input trajectory
    * @param traj input trajectory
-   * @param complete_path complete path
+   * @param complete_path complete path stored with edge index
    */
   FMM::CORE::LineString complete_path_to_geometry(
     const FMM::CORE::LineString &traj,
@@ -187,6 +280,17 @@ public:
    * @return true if a.dist<b.dist
    */
   static bool candidate_compare(const MM::Candidate &a, const MM::Candidate &b);
+  /**
+   * Check if the direction of a candidate edge at its offset agrees
+   * with a heading
+   * @param c candidate
+   * @param heading heading in radians, NaN if unknown
+   * @param heading_tolerance tolerance in radians, 0 disables the check
+   * @return false if the difference exceeds the tolerance, true otherwise
+   */
+  static bool candidate_heading_agrees(const MM::Candidate &c,
+                                       double heading,
+                                       double heading_tolerance);
   void add_edge(EdgeID edge_id, NodeID source, NodeID target,
     const FMM::CORE::LineString &geom);
 private:
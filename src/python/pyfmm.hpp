@@ -38,13 +38,54 @@ struct PyCandidate{
  */
 struct PyMatchResult {
   int id; /**< id of a trajectory */
-  MM::O_Path opath; /**< Edge ID matched for each point of the trajectory  */
-  MM::C_Path cpath; /**< Edge ID traversed by the matched path */
+  std::vector<NETWORK::EdgeID> opath; /**< Edge ID matched for each point
+                                           of the trajectory  */
+  std::vector<NETWORK::EdgeID> cpath; /**< Edge ID traversed by the
+                                           matched path */
   std::vector<PyCandidate> candidates; /**< Candidate matched to each point */
   std::vector<int> indices; /**< index of matched edge in the cpath */
   CORE::LineString mgeom; /**< Geometry of the matched path */
   CORE::LineString pgeom; /**< Point position matched for each GPS point */
 };
+
+/**
+ * Match results of a batch of trajectories stored in flat arrays, which
+ * can be copied at once into NumPy arrays.
+ *
+ * The arrays with a value per point are indexed like the input points,
+ * the values of trajectory i are in the range [offsets[i],offsets[i+1])
+ * of the input offsets. The edges of the complete path of trajectory i
+ * are in the range [cpath_offsets[i],cpath_offsets[i+1]) of cpath and
+ * the points of its matched geometry in the range
+ * [mgeom_offsets[i],mgeom_offsets[i+1]) of mgeom_x and mgeom_y.
+ *
+ * A trajectory not matched has an empty cpath, its values per point are
+ * 0 for the edge ids and indices and NaN for the others.
+ */
+struct PyBatchResult {
+  std::vector<NETWORK::EdgeID> opath; /**< Edge ID matched to each point */
+  std::vector<int> indices; /**< index of the edge matched to each point
+                                 in the cpath of its trajectory */
+  std::vector<double> error; /**< distance from each point to its
+                                  matched position */
+  std::vector<double> offset; /**< distance from the start of the matched
+                                   edge to the matched position */
+  std::vector<double> ep; /**< emission probability of each point */
+  std::vector<double> tp; /**< transition probability from the previous
+                               point */
+  std::vector<double> spdist; /**< shortest path distance from the
+                                   previous point */
+  std::vector<double> px; /**< x of the matched position of each point */
+  std::vector<double> py; /**< y of the matched position of each point */
+  std::vector<long long> cpath_offsets; /**< offsets of the trajectories
+                                             in cpath */
+  std::vector<NETWORK::EdgeID> cpath; /**< Edge ID traversed by the
+                                           matched paths */
+  std::vector<long long> mgeom_offsets; /**< offsets of the trajectories
+                                             in mgeom_x and mgeom_y */
+  std::vector<double> mgeom_x; /**< x of the matched geometries */
+  std::vector<double> mgeom_y; /**< y of the matched geometries */
+};
 }; // PYTHON
 }; // FMM
 
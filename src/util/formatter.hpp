@@ -0,0 +1,156 @@
+/**
+ * Fast map matching.
+ *
+ * Formatting functions writing numbers, vectors and geometries into a
+ * character buffer with fmt, which are used to export the match result
+ * without going through std::ostream.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_FORMATTER_HPP
+#define FMM_FORMATTER_HPP
+
+#include "core/geometry.hpp"
+#include "util/debug.hpp"
+
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Character buffer used by the formatting functions
+ */
+typedef fmt::memory_buffer FormatBuffer;
+
+/**
+ * Append a string to a buffer
+ * @param buf buffer to write
+ * @param str string appended
+ */
+inline void append_string(FormatBuffer &buf, const std::string &str) {
+  buf.append(str.data(), str.data() + str.size());
+}
+
+/**
+ * Append a string to a buffer
+ * @param buf buffer to write
+ * @param str null terminated string appended
+ */
+inline void append_string(FormatBuffer &buf, const char *str) {
+  buf.append(str, str + std::char_traits<char>::length(str));
+}
+
+/**
+ * Append a character to a buffer
+ * @param buf buffer to write
+ * @param c character appended
+ */
+inline void append_char(FormatBuffer &buf, char c) {
+  buf.push_back(c);
+}
+
+/**
+ * Append an integer value to a buffer
+ * @tparam T integer type
+ * @param buf buffer to write
+ * @param value the value appended
+ */
+template<typename T>
+inline void append_int(FormatBuffer &buf, T value) {
+  fmt::format_int f(value);
+  buf.append(f.data(), f.data() + f.size());
+}
+
+/**
+ * Append a floating point value to a buffer in the general format
+ * (%g), which is the format of std::ostream with a precision
+ * @param buf buffer to write
+ * @param value the value appended
+ * @param precision number of significant digits
+ */
+inline void append_double(FormatBuffer &buf, double value,
+                          int precision = 6) {
+  fmt::format_to(buf, "{:.{}g}", value, precision);
+}
+
+/**
+ * Append the integer values of a vector separated by delim
+ * @param buf buffer to write
+ * @param vec input vector
+ * @param delim the separator
+ */
+template<typename T>
+inline void append_int_vector(FormatBuffer &buf, const std::vector<T> &vec,
+                              char delim = ',') {
+  for (std::size_t i = 0; i < vec.size(); ++i) {
+    if (i > 0) buf.push_back(delim);
+    append_int(buf, vec[i]);
+  }
+}
+
+/**
+ * Append the floating point values of a vector separated by delim
+ * @param buf buffer to write
+ * @param vec input vector
+ * @param precision number of significant digits
+ * @param delim the separator
+ */
+inline void append_double_vector(FormatBuffer &buf,
+                                 const std::vector<double> &vec,
+                                 int precision = 6, char delim = ',') {
+  for (std::size_t i = 0; i < vec.size(); ++i) {
+    if (i > 0) buf.push_back(delim);
+    append_double(buf, vec[i], precision);
+  }
+}
+
+/**
+ * Append the WKT of a linestring, in the same format as
+ * boost::geometry::wkt, e.g. LINESTRING(30 10,10 30,40 40)
+ * @param buf buffer to write
+ * @param line input linestring
+ * @param precision number of significant digits of a coordinate
+ */
+inline void append_wkt(FormatBuffer &buf, const FMM::CORE::LineString &line,
+                       int precision = 12) {
+  append_string(buf, "LINESTRING(");
+  int N = line.get_num_points();
+  for (int i = 0; i < N; ++i) {
+    if (i > 0) buf.push_back(',');
+    append_double(buf, line.get_x(i), precision);
+    buf.push_back(' ');
+    append_double(buf, line.get_y(i), precision);
+  }
+  buf.push_back(')');
+}
+
+/**
+ * Append the GeoJSON of a linestring, an empty linestring writes nothing
+ * @param buf buffer to write
+ * @param line input linestring
+ * @param precision number of significant digits of a coordinate
+ */
+inline void append_json(FormatBuffer &buf, const FMM::CORE::LineString &line,
+                        int precision = 6) {
+  int N = line.get_num_points();
+  if (N == 0) return;
+  append_string(buf, "{\"type\":\"LineString\",\"coordinates\": [");
+  for (int i = 0; i < N; ++i) {
+    if (i > 0) buf.push_back(',');
+    buf.push_back('[');
+    append_double(buf, line.get_x(i), precision);
+    buf.push_back(',');
+    append_double(buf, line.get_y(i), precision);
+    buf.push_back(']');
+  }
+  append_string(buf, "]}");
+}
+
+} // UTIL
+} // FMM
+
+#endif // FMM_FORMATTER_HPP
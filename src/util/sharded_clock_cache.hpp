@@ -0,0 +1,215 @@
+/**
+ * Fast map matching.
+ *
+ * Bounded key value cache shared by multiple threads, used to cache the
+ * candidates, the shortest path distances and the shortest paths.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SHARDED_CLOCK_CACHE_HPP
+#define FMM_SHARDED_CLOCK_CACHE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Counters of a cache, which can be updated by multiple threads.
+ */
+struct ClockCacheStats {
+  std::atomic<long long> hits{0}; /**< look ups answered by the cache */
+  std::atomic<long long> misses{0}; /**< look ups not answered */
+  std::atomic<long long> evictions{0}; /**< entries replaced */
+};
+
+/**
+ * A bounded cache of values indexed by keys, safe to use from multiple
+ * threads.
+ *
+ * The entries are split into shards selected by the hash of the key,
+ * each shard protected by its own mutex, so that threads rarely wait
+ * for each other. When a shard is full, an entry is evicted with the
+ * CLOCK algorithm: an entry read since the hand last passed it is
+ * skipped once, so frequently used keys stay in the cache.
+ *
+ * @tparam Key key of an entry
+ * @tparam Value value of an entry, copied out of the cache when it is
+ * found, so a large value is better held by a shared pointer
+ * @tparam Hash hash of a key
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedClockCache {
+ public:
+  /**
+   * Create a cache
+   * @param capacity maximum number of entries, rounded up to a multiple
+   * of the number of shards
+   * @param num_shards number of shards, rounded up to a power of 2 and
+   * reduced for a small capacity
+   */
+  explicit ShardedClockCache(std::size_t capacity, int num_shards = 64)
+      : shard_bits_(0) {
+    // A small cache has fewer shards, each one holding at least an entry
+    while ((1 << shard_bits_) < num_shards &&
+           (std::size_t(2) << shard_bits_) <= capacity) {
+      ++shard_bits_;
+    }
+    int shard_count = 1 << shard_bits_;
+    shard_capacity_ = std::max<std::size_t>(
+      1, (capacity + shard_count - 1) / shard_count);
+    shards_.reset(new Shard[shard_count]);
+  }
+  /**
+   * Find the value of a key
+   * @param key key searched
+   * @param value the value if it is found
+   * @param accept called with the value found, the look up is only
+   * answered if it returns true
+   * @return true if the look up is answered
+   */
+  template <typename Accept>
+  bool find(const Key &key, Value *value, Accept accept) {
+    Shard &shard = get_shard(key);
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto iter = shard.index.find(key);
+      if (iter != shard.index.end()) {
+        Entry &entry = shard.entries[iter->second];
+        if (accept(entry.value)) {
+          entry.referenced = true;
+          *value = entry.value;
+          ++stats_.hits;
+          return true;
+        }
+      }
+    }
+    ++stats_.misses;
+    return false;
+  }
+  /**
+   * Find the value of a key
+   * @param key key searched
+   * @param value the value if it is found
+   * @return true if the key is found
+   */
+  bool find(const Key &key, Value *value) {
+    return find(key, value, [](const Value &) { return true; });
+  }
+  /**
+   * Store the value of a key
+   * @param key key stored
+   * @param value value stored
+   * @param merge called with the value cached and the new value if the
+   * key is already cached, to update the value cached
+   * @return the value cached for the key
+   */
+  template <typename Merge>
+  Value insert(const Key &key, Value value, Merge merge) {
+    Shard &shard = get_shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto iter = shard.index.find(key);
+    if (iter != shard.index.end()) {
+      Value &cached = shard.entries[iter->second].value;
+      merge(cached, value);
+      return cached;
+    }
+    if (shard.entries.size() < shard_capacity_) {
+      shard.index.insert({key, shard.entries.size()});
+      shard.entries.push_back(Entry{key, value, false});
+      return value;
+    }
+    // CLOCK eviction, an entry referenced since the last pass of the hand
+    // gets a second chance
+    while (shard.entries[shard.hand].referenced) {
+      shard.entries[shard.hand].referenced = false;
+      shard.hand = (shard.hand + 1) % shard.entries.size();
+    }
+    Entry &victim = shard.entries[shard.hand];
+    shard.index.erase(victim.key);
+    victim = Entry{key, value, false};
+    shard.index.insert({key, shard.hand});
+    shard.hand = (shard.hand + 1) % shard.entries.size();
+    ++stats_.evictions;
+    return value;
+  }
+  /**
+   * Store the value of a key, the value already cached is kept if the
+   * key was inserted by another thread in the meantime
+   * @param key key stored
+   * @param value value stored
+   * @return the value cached for the key
+   */
+  Value insert(const Key &key, Value value) {
+    return insert(key, std::move(value), [](Value &, const Value &) {});
+  }
+  /**
+   * Get the number of entries
+   */
+  std::size_t size() const {
+    std::size_t total = 0;
+    for (int i = 0; i < (1 << shard_bits_); ++i) {
+      std::lock_guard<std::mutex> lock(shards_[i].mutex);
+      total += shards_[i].entries.size();
+    }
+    return total;
+  }
+  /**
+   * Get the maximum number of entries
+   */
+  std::size_t get_capacity() const {
+    return shard_capacity_ << shard_bits_;
+  }
+  /**
+   * Get the counters of the cache
+   */
+  const ClockCacheStats &get_stats() const {
+    return stats_;
+  }
+ private:
+  /**
+   * An entry of the cache
+   */
+  struct Entry {
+    Key key;
+    Value value;
+    bool referenced; /**< true if read since the hand passed */
+  };
+  /**
+   * A shard of the cache
+   */
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, std::size_t, Hash> index; /**< position of the
+                                                           entry of a key */
+    std::vector<Entry> entries;
+    std::size_t hand = 0; /**< position of the CLOCK hand */
+  };
+  /**
+   * Get the shard of a key
+   */
+  Shard &get_shard(const Key &key) const {
+    if (shard_bits_ == 0) return shards_[0];
+    // Fibonacci hashing spreads the consecutive keys over the shards
+    uint64_t h = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ULL;
+    return shards_[h >> (64 - shard_bits_)];
+  }
+  std::unique_ptr<Shard[]> shards_;
+  int shard_bits_;
+  std::size_t shard_capacity_;
+  ClockCacheStats stats_;
+}; // ShardedClockCache
+
+} // UTIL
+} // FMM
+
+#endif // FMM_SHARDED_CLOCK_CACHE_HPP
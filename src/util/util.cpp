@@ -1,11 +1,16 @@
 #include "util/util.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <sys/stat.h>
+#include <dirent.h>
+#include <glob.h>
 #include <chrono>
 #include <vector>
 #include <ctime>
+#include <climits>
+#include <cstdlib>
 #include "mm/mm_type.hpp"
 
 #if defined BOOST_OS_WINDOWS && !defined S_ISDIR
@@ -105,6 +110,47 @@ bool file_exists(const std::string &filename) {
   return file_exists(filename.c_str());
 }
 
+std::string get_file_stem(const std::string &fn) {
+  std::size_t start = fn.find_last_of('/');
+  start = (start == std::string::npos) ? 0 : start + 1;
+  std::size_t end = fn.find_last_of('.');
+  if (end == std::string::npos || end < start) end = fn.size();
+  return fn.substr(start, end - start);
+}
+
+std::vector<std::string> list_folder_files(const std::string &folder_name) {
+  std::vector<std::string> files;
+  DIR *dir = opendir(folder_name.c_str());
+  if (dir == nullptr) return files;
+  while (struct dirent *entry = readdir(dir)) {
+    std::string path = folder_name + "/" + entry->d_name;
+    struct stat sb;
+    if (stat(path.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+      files.push_back(path);
+    }
+  }
+  closedir(dir);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+std::vector<std::string> glob_files(const std::string &pattern) {
+  std::vector<std::string> files;
+  glob_t result;
+  if (glob(pattern.c_str(), 0, nullptr, &result) == 0) {
+    files.assign(result.gl_pathv, result.gl_pathv + result.gl_pathc);
+  }
+  globfree(&result);
+  // glob sorts the paths already
+  return files;
+}
+
+std::string get_real_path(const std::string &fn) {
+  char path[PATH_MAX];
+  if (realpath(fn.c_str(), path) == nullptr) return fn;
+  return path;
+}
+
 std::vector<std::string> split_string(const std::string &str) {
   char delim = ',';
   std::vector<std::string> result;
@@ -132,6 +132,32 @@ bool folder_exist(const std::string &folder_name);
  * @return Folder path to a file
  */
 std::string get_file_directory(const std::string &fn);
+/**
+ * Get the file name from file path, without the folder and extension
+ * @param  fn File path
+ * @return the file name, e.g., trips for data/trips.csv
+ */
+std::string get_file_stem(const std::string &fn);
+/**
+ * List the regular files in a folder, not recursively
+ * @param  folder_name folder name
+ * @return the paths of the files sorted by name
+ */
+std::vector<std::string> list_folder_files(const std::string &folder_name);
+/**
+ * Find the files matching a pattern with wildcards * ? and [],
+ * e.g., data/2020-01-*.csv
+ * @param  pattern the pattern of the file paths
+ * @return the paths of the files sorted by name
+ */
+std::vector<std::string> glob_files(const std::string &pattern);
+/**
+ * Get the absolute path of a file with the symbolic links, . and ..
+ * resolved, so that two paths of the same file can be compared
+ * @param  fn File path
+ * @return the resolved path, fn itself if the file does not exist
+ */
+std::string get_real_path(const std::string &fn);
 
 /**
  * Convert string to bool
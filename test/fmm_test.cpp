@@ -8,12 +8,41 @@
 #include "core/gps.hpp"
 #include "io/gps_reader.hpp"
 
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 using namespace FMM;
 using namespace FMM::IO;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 using namespace FMM::MM;
 
+/**
+ * Sink storing the edges of a result
+ */
+class EdgeSink : public ResultSink {
+ public:
+  void begin(int num_points, int cpath_size) override {
+    opath.assign(num_points, -1);
+    cpath.clear();
+  }
+  void point(int index, const MatchedCandidate &mc,
+             int cpath_index) override {
+    opath[index] = mc.c.edge->id;
+  }
+  void path_edge(int index, const Edge &edge) override {
+    cpath.push_back(edge.id);
+  }
+  std::vector<EdgeID> opath;
+  std::vector<EdgeID> cpath;
+};
+
 TEST_CASE( "fmm is tested", "[fmm]" ) {
   spdlog::set_level((spdlog::level::level_enum) 0);
   spdlog::set_pattern("[%l][%s:%-3#] %v");
@@ -30,7 +59,365 @@ TEST_CASE( "fmm is tested", "[fmm]" ) {
     MatchResult result = model.match_traj(trajectory,config);
     LineString expected_mgeom = wkt2linestring(
       "LINESTRING(2 0.250988700565,2 1,2 2,3 2,4 2,4 2.45776836158)");
-    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    REQUIRE_THAT(network.get_edge_ids(result.cpath),
+                 Catch::Equals<EdgeID>({2,5,13,14,23}));
     REQUIRE(expected_mgeom==result.mgeom);
   }
+  SECTION( "window_test" ) {
+    const Trajectory &trajectory = trajectories[0];
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult expected = model.match_traj(trajectory,config);
+    config.window_size = 2;
+    MatchResult result = model.match_traj(trajectory,config);
+    REQUIRE(result.cpath==expected.cpath);
+    REQUIRE(result.indices==expected.indices);
+    REQUIRE(expected.mgeom==result.mgeom);
+  }
+  SECTION( "beam_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    std::vector<MatchResult> expected;
+    for (const Trajectory &trajectory : trajectories) {
+      expected.push_back(model.match_traj(trajectory,config));
+    }
+    REQUIRE(model.get_beam_stats().checked_trajectories==0);
+    // A beam as wide as k with a large margin keeps the optimal path
+    config.beam_width = 4;
+    config.beam_margin = 1000;
+    config.beam_check = true;
+    for (int i = 0; i < trajectories.size(); ++i) {
+      MatchResult result = model.match_traj(trajectories[i],config);
+      REQUIRE(result.cpath==expected[i].cpath);
+      REQUIRE(result.opath==expected[i].opath);
+      REQUIRE(result.indices==expected[i].indices);
+    }
+    const BeamStats &stats = model.get_beam_stats();
+    REQUIRE(stats.checked_trajectories==trajectories.size());
+    REQUIRE(stats.changed_paths==0);
+    REQUIRE(stats.total_nodes>0);
+    // Only the unreachable sources can be pruned by such a beam
+    long long pruned_nodes = stats.pruned_nodes;
+    // A beam of a single candidate prunes the other sources
+    config.beam_width = 1;
+    config.beam_margin = 0;
+    for (const Trajectory &trajectory : trajectories) {
+      model.match_traj(trajectory,config);
+    }
+    REQUIRE(stats.checked_trajectories==2 * trajectories.size());
+    REQUIRE(stats.changed_paths<=trajectories.size());
+    REQUIRE(stats.pruned_nodes>pruned_nodes);
+    // The windows prune the same layers
+    config.beam_check = false;
+    for (const Trajectory &trajectory : trajectories) {
+      MatchResult result = model.match_traj(trajectory,config);
+      config.window_size = 2;
+      MatchResult window_result = model.match_traj(trajectory,config);
+      config.window_size = 0;
+      REQUIRE(window_result.cpath==result.cpath);
+      REQUIRE(window_result.indices==result.indices);
+    }
+    config.beam_check = true;
+    // Without pruning, no trajectory is checked
+    config.beam_width = 0;
+    model.match_traj(trajectories[0],config);
+    REQUIRE(stats.checked_trajectories==2 * trajectories.size());
+  }
+  SECTION( "filter_test" ) {
+    const Trajectory &trajectory = trajectories[0];
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    config.min_point_distance = 0.5;
+    MatchResult result = model.match_traj(trajectory,config);
+    REQUIRE(result.opath.size()==trajectory.geom.get_num_points());
+    REQUIRE(result.indices.size()==trajectory.geom.get_num_points());
+    REQUIRE_THAT(network.get_edge_ids(result.cpath),
+                 Catch::Equals<EdgeID>({2,5,13,14,23}));
+  }
+  SECTION( "filter_expand_test" ) {
+    // The second and third points are dropped by the interval while the
+    // vehicle moves on to the edges 5 and 13
+    Trajectory trajectory(1, wkt2linestring(
+      "LINESTRING(1.9 0.3,1.9 1.5,2.5 2.1,3.5 2.1,4.1 2.5)"),
+      {0,1,2,10,20});
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult expected = model.match_traj(trajectory,config);
+    REQUIRE_THAT(network.get_edge_ids(expected.opath),
+                 Catch::Equals<EdgeID>({2,5,13,14,23}));
+    config.min_point_interval = 5;
+    MatchResult result = model.match_traj(trajectory,config);
+    REQUIRE(result.cpath==expected.cpath);
+    REQUIRE(result.opath==expected.opath);
+    REQUIRE(result.indices==expected.indices);
+    REQUIRE(result.opt_candidate_path.size()==5);
+    for (int i = 0; i < 5; ++i) {
+      const MatchedCandidate &mc = result.opt_candidate_path[i];
+      const MatchedCandidate &expected_mc = expected.opt_candidate_path[i];
+      REQUIRE(mc.c.edge==expected_mc.c.edge);
+      REQUIRE(mc.c.offset==Approx(expected_mc.c.offset));
+      REQUIRE(mc.c.dist==Approx(expected_mc.c.dist));
+      REQUIRE(mc.ep==Approx(expected_mc.ep));
+    }
+    // A dropped point is projected to the edge it is matched to
+    REQUIRE(boost::geometry::get<0>(result.opt_candidate_path[2].c.point)==
+            Approx(2.5));
+    REQUIRE(boost::geometry::get<1>(result.opt_candidate_path[2].c.point)==
+            Approx(2));
+    // Without the candidates, the edges are still found
+    result = model.match_traj(trajectory,config,MATCH_OPATH);
+    REQUIRE(result.opath==expected.opath);
+    REQUIRE(result.opt_candidate_path.empty());
+  }
+  SECTION( "match_fields_test" ) {
+    const Trajectory &trajectory = trajectories[0];
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult expected = model.match_traj(trajectory,config);
+    MatchResult result = model.match_traj(trajectory,config,0);
+    REQUIRE(result.cpath==expected.cpath);
+    REQUIRE(result.indices==expected.indices);
+    REQUIRE(result.opath.empty());
+    REQUIRE(result.opt_candidate_path.empty());
+    REQUIRE(result.mgeom.get_num_points()==0);
+    config.min_point_distance = 0.5;
+    result = model.match_traj(trajectory,config,MATCH_OPATH);
+    REQUIRE(result.opath.size()==trajectory.geom.get_num_points());
+    REQUIRE(result.opt_candidate_path.empty());
+    REQUIRE(result.cpath==expected.cpath);
+  }
+  SECTION( "ubodt_filter_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(ubodt->get_filter_size()>0);
+    REQUIRE(ubodt->get_filter_false_positive_rate()<0.01);
+    // The filter never rejects a row of the table
+    std::ifstream ifs("../data/ubodt.txt");
+    std::string line;
+    std::getline(ifs,line);
+    long long rows = 0;
+    NodeIndex source, target;
+    while (std::getline(ifs,line)) {
+      REQUIRE(sscanf(line.c_str(),"%u;%u",&source,&target)==2);
+      REQUIRE(ubodt->look_up(source,target)!=nullptr);
+      ++rows;
+    }
+    REQUIRE(rows==ubodt->get_num_rows());
+  }
+  SECTION( "ubodt_look_up_many_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    // All the pairs of nodes and pairs of unknown nodes, most of which
+    // are rejected by the filter, in a number of pairs which is not a
+    // multiple of the group size
+    std::vector<NodeIndex> sources, targets;
+    for (NodeIndex source = 0; source < multiplier; ++source) {
+      for (NodeIndex target = 0; target < multiplier; ++target) {
+        sources.push_back(source);
+        targets.push_back(target);
+        sources.push_back(source + 1000);
+        targets.push_back(target);
+      }
+    }
+    sources.push_back(1);
+    targets.push_back(1);
+    REQUIRE(sources.size()%UBODT::LOOK_UP_GROUP!=0);
+    for (std::size_t n : {std::size_t(0), std::size_t(1),
+                          std::size_t(UBODT::LOOK_UP_GROUP + 1),
+                          sources.size()}) {
+      std::vector<double> costs(n, -1);
+      ubodt->look_up_many(sources.data(),targets.data(),n,costs.data());
+      int found = 0;
+      for (std::size_t i = 0; i < n; ++i) {
+        Record *r = ubodt->look_up(sources[i],targets[i]);
+        if (r == nullptr) {
+          REQUIRE(costs[i]==std::numeric_limits<double>::infinity());
+        } else {
+          REQUIRE(costs[i]==r->cost);
+          ++found;
+        }
+      }
+      if (n == sources.size()) {
+        REQUIRE(found>0);
+        REQUIRE(found<n);
+      }
+    }
+  }
+  SECTION( "ubodt_path_cache_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    // A single path forces an eviction at every new path
+    for (int capacity : {1000, 1}) {
+      SPPathCache cache(capacity);
+      for (int round = 0; round < 2; ++round) {
+        for (NodeIndex source = 0; source < multiplier; ++source) {
+          for (NodeIndex target = 0; target < multiplier; ++target) {
+            REQUIRE(ubodt->look_sp_path(source,target,&cache)==
+                    ubodt->look_sp_path(source,target));
+          }
+        }
+      }
+      REQUIRE(cache.size()<=cache.get_capacity());
+      if (capacity > 1) REQUIRE(cache.get_stats().hits>0);
+    }
+  }
+  SECTION( "ubodt_shared_test" ) {
+    const Trajectory &trajectory = trajectories[0];
+    UBODT::remove_shared("/fmm_test_ubodt");
+    auto ubodt = UBODT::read_ubodt_shared(
+      "../data/ubodt.txt","/fmm_test_ubodt",multiplier);
+    REQUIRE(ubodt->is_shared());
+    // A second table attaches to the segment created by the first one
+    auto attached = UBODT::read_ubodt_shared(
+      "../data/ubodt.txt","/fmm_test_ubodt",multiplier);
+    REQUIRE(attached->get_num_rows()==ubodt->get_num_rows());
+    REQUIRE(attached->get_filter_size()==ubodt->get_filter_size());
+    FastMapMatch model(network,graph,attached);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult result = model.match_traj(trajectory,config);
+    REQUIRE_THAT(network.get_edge_ids(result.cpath),
+                 Catch::Equals<EdgeID>({2,5,13,14,23}));
+  }
+  SECTION( "ubodt_shared_race_test" ) {
+    auto expected = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    for (int round = 0; round < 5; ++round) {
+      UBODT::remove_shared("/fmm_test_race");
+      // The two attachers and the creator are released at the same time
+      int start[2];
+      REQUIRE(pipe(start)==0);
+      std::vector<pid_t> children;
+      for (int i = 0; i < 2; ++i) {
+        pid_t pid = fork();
+        REQUIRE(pid>=0);
+        if (pid == 0) {
+          close(start[1]);
+          char c;
+          bool ok = read(start[0],&c,1)==0;
+          try {
+            auto ubodt = UBODT::read_ubodt_shared(
+              "../data/ubodt.txt","/fmm_test_race",multiplier);
+            for (NodeIndex s = 0; s < multiplier; ++s) {
+              for (NodeIndex t = 0; t < multiplier; ++t) {
+                Record *r = ubodt->look_up(s,t);
+                Record *e = expected->look_up(s,t);
+                ok = ok && (r==nullptr)==(e==nullptr) &&
+                  (r==nullptr || r->cost==e->cost);
+              }
+            }
+          } catch (...) {
+            ok = false;
+          }
+          _exit(ok ? 0 : 1);
+        }
+        children.push_back(pid);
+      }
+      close(start[0]);
+      close(start[1]);
+      auto ubodt = UBODT::read_ubodt_shared(
+        "../data/ubodt.txt","/fmm_test_race",multiplier);
+      REQUIRE(ubodt->get_num_rows()==expected->get_num_rows());
+      for (pid_t pid : children) {
+        int status = -1;
+        REQUIRE(waitpid(pid,&status,0)==pid);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status)==0);
+      }
+      // The attachers exiting do not remove the segment still used
+      int fd = shm_open("/fmm_test_race",O_RDONLY,0);
+      REQUIRE(fd>=0);
+      close(fd);
+    }
+  }
+  SECTION( "match_batch_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    // The second trajectory is too far from the network to be matched
+    // and the last one has no point
+    std::vector<Trajectory> batch_trajectories{
+      trajectories[0],
+      Trajectory(1,wkt2linestring("LINESTRING(100 100,101 101)")),
+      trajectories[1], Trajectory()};
+    std::vector<double> xs, ys;
+    std::vector<long long> offsets{0};
+    for (const Trajectory &trajectory : batch_trajectories) {
+      for (int i = 0; i < trajectory.geom.get_num_points(); ++i) {
+        xs.push_back(trajectory.geom.get_x(i));
+        ys.push_back(trajectory.geom.get_y(i));
+      }
+      offsets.push_back(xs.size());
+    }
+    PYTHON::PyBatchResult batch = model.match_batch(xs,ys,{},offsets,
+                                                    config,2);
+    REQUIRE(batch.cpath_offsets.size()==5);
+    REQUIRE(batch.mgeom_offsets.size()==5);
+    REQUIRE(batch.opath.size()==xs.size());
+    REQUIRE(batch.ep.size()==xs.size());
+    for (int t = 0; t < 4; ++t) {
+      MatchResult expected = model.match_traj(batch_trajectories[t],config);
+      std::vector<EdgeID> cpath(
+        batch.cpath.begin() + batch.cpath_offsets[t],
+        batch.cpath.begin() + batch.cpath_offsets[t + 1]);
+      REQUIRE(cpath==network.get_edge_ids(expected.cpath));
+      LineString mgeom;
+      for (long long j = batch.mgeom_offsets[t];
+           j < batch.mgeom_offsets[t + 1]; ++j) {
+        mgeom.add_point(batch.mgeom_x[j],batch.mgeom_y[j]);
+      }
+      REQUIRE(mgeom==expected.mgeom);
+      for (long long j = offsets[t]; j < offsets[t + 1]; ++j) {
+        if (expected.cpath.empty()) {
+          // The points not matched are filled with 0 and NaN
+          REQUIRE(batch.opath[j]==0);
+          REQUIRE(batch.indices[j]==0);
+          REQUIRE(std::isnan(batch.error[j]));
+          REQUIRE(std::isnan(batch.ep[j]));
+          REQUIRE(std::isnan(batch.px[j]));
+        } else {
+          const MatchedCandidate &mc =
+            expected.opt_candidate_path[j - offsets[t]];
+          REQUIRE(batch.opath[j]==mc.c.edge->id);
+          REQUIRE(batch.indices[j]==expected.indices[j - offsets[t]]);
+          REQUIRE(batch.error[j]==mc.c.dist);
+          REQUIRE(batch.ep[j]==mc.ep);
+          REQUIRE(batch.tp[j]==mc.tp);
+        }
+      }
+    }
+    REQUIRE(batch.cpath_offsets[2]==batch.cpath_offsets[1]);
+    REQUIRE(batch.cpath_offsets[4]==batch.cpath_offsets[3]);
+    // Sizes and offsets not matching the points
+    std::vector<double> short_ys(ys.begin(),ys.end() - 1);
+    std::vector<double> short_timestamps(xs.size() - 1,0);
+    std::vector<std::vector<long long>> invalid_offsets{
+      {}, {1,(long long) xs.size()}, {0,(long long) xs.size() - 1},
+      {0,(long long) xs.size() + 1}, {0,4,2,(long long) xs.size()}};
+    REQUIRE_THROWS_AS(model.match_batch(xs,short_ys,{},offsets,config),
+                      std::runtime_error);
+    REQUIRE_THROWS_AS(model.match_batch(xs,ys,short_timestamps,offsets,
+                                        config),
+                      std::runtime_error);
+    for (const std::vector<long long> &invalid : invalid_offsets) {
+      REQUIRE_THROWS_AS(model.match_batch(xs,ys,{},invalid,config),
+                        std::runtime_error);
+    }
+  }
+  SECTION( "match_points_test" ) {
+    const Trajectory &trajectory = trajectories[0];
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult expected = model.match_traj(trajectory,config);
+    std::vector<double> xs, ys;
+    for (int i = 0; i < trajectory.geom.get_num_points(); ++i) {
+      xs.push_back(trajectory.geom.get_x(i));
+      ys.push_back(trajectory.geom.get_y(i));
+    }
+    EdgeSink sink;
+    model.match_points(xs.data(),ys.data(),nullptr,xs.size(),config,sink);
+    REQUIRE_THAT(sink.cpath, Catch::Equals<EdgeID>({2,5,13,14,23}));
+    REQUIRE(sink.opath==network.get_edge_ids(expected.opath));
+  }
 }
@@ -0,0 +1,842 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "util/debug.hpp"
+#include "io/text_parser.hpp"
+#include "io/gps_reader.hpp"
+#include "io/gps_sorter.hpp"
+#include "io/async_file_writer.hpp"
+#include "mm/match_pipeline.hpp"
+#include "config/gps_config.hpp"
+#include "config/result_config.hpp"
+#include "util/util.hpp"
+#include "util/formatter.hpp"
+#include "mm/h3mm/h3_type.hpp"
+#include "mm/h3mm/h3_util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+using namespace FMM;
+using namespace FMM::IO;
+using namespace FMM::CORE;
+
+/**
+ * Parse a number with parse_double
+ * @param text the text to parse
+ * @param value the value parsed
+ * @return the number of characters parsed, -1 if no number is found
+ */
+int parse_text(const std::string &text, double *value) {
+  const char *cursor = text.data();
+  if (!parse_double(&cursor, text.data() + text.size(), value)) return -1;
+  return cursor - text.data();
+}
+
+/**
+ * Parse a linestring with parse_linestring
+ */
+bool parse_text(const std::string &text, LineString *line) {
+  return parse_linestring(
+    TextSpan{text.data(), text.data() + text.size()}, line);
+}
+
+/**
+ * Write a file in binary mode, so that the line breaks are kept
+ */
+void write_file(const std::string &filename, const std::string &content) {
+  std::ofstream ofs(filename, std::ios::binary);
+  ofs << content;
+}
+
+/**
+ * Read a file in binary mode
+ */
+std::string read_file(const std::string &filename) {
+  std::ifstream ifs(filename, std::ios::binary);
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  return ss.str();
+}
+
+/**
+ * Write the WKT of hexagons with std::ostream, as hexs2wkt did
+ */
+std::string hexs2wkt_ostream(const std::vector<MM::HexIndex> &hexs,
+                             int precision) {
+  std::ostringstream oss;
+  oss << "MULTIPOLYGON(";
+  for (int i = 0 ; i<hexs.size();++i){
+    GeoBoundary boundary;
+    oss << "((";
+    h3ToGeoBoundary(hexs[i], &boundary);
+    for (int v = 0; v < boundary.numVerts; v++) {
+      oss << std::setprecision(precision) << radsToDegs(boundary.verts[v].lon)
+          << " " << radsToDegs(boundary.verts[v].lat) << ",";
+    }
+    oss << std::setprecision(precision) << radsToDegs(boundary.verts[0].lon)
+        << " " << radsToDegs(boundary.verts[0].lat);
+    oss << "))" << (i<hexs.size()-1?",":"");
+  }
+  oss << ")";
+  return oss.str();
+}
+
+TEST_CASE( "Formatter is tested", "[io]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  // The numbers are written as std::ostream writes them
+  std::vector<double> values = {
+    0, -0.0, 1, -2.5, 0.1 + 0.2, 1.0 / 3, 123456789.123456789, 1e-5,
+    -1.5e-7, 2.5e15, 1e20, 0.250988700565, 4.45776836158,
+    std::numeric_limits<double>::min(), std::numeric_limits<double>::max(),
+    std::numeric_limits<double>::infinity()};
+
+  SECTION( "append_double_test" ) {
+    for (int precision : {1, 6, 12, 17}) {
+      for (double value : values) {
+        UTIL::FormatBuffer buf;
+        UTIL::append_double(buf, value, precision);
+        std::ostringstream oss;
+        oss << std::setprecision(precision) << value;
+        REQUIRE(fmt::to_string(buf)==oss.str());
+      }
+    }
+  }
+
+  SECTION( "append_wkt_test" ) {
+    LineString line;
+    for (std::size_t i = 0; i + 2 < values.size(); i += 2) {
+      line.add_point(values[i], values[i + 1]);
+    }
+    std::vector<LineString> geoms = {line, LineString(), wkt2linestring(
+      "LINESTRING(2 0.250988700565,2 1,4 2.45776836158)")};
+    for (const LineString &geom : geoms) {
+      UTIL::FormatBuffer buf;
+      UTIL::append_wkt(buf, geom);
+      std::ostringstream oss;
+      oss << geom;
+      REQUIRE(fmt::to_string(buf)==oss.str());
+    }
+  }
+
+  SECTION( "hexs2wkt_test" ) {
+    std::vector<MM::HexIndex> hexs;
+    for (int level : {0, 8, 15}) {
+      hexs.push_back(MM::xy2hex(114.05, 22.54, level));
+    }
+    hexs.push_back(MM::xy2hex(-0.12, 51.5, 8));
+    for (int precision : {6, 12}) {
+      REQUIRE(MM::hexs2wkt({}, precision)==hexs2wkt_ostream({}, precision));
+      REQUIRE(MM::hexs2wkt({hexs[1]}, precision)==
+              hexs2wkt_ostream({hexs[1]}, precision));
+      REQUIRE(MM::hexs2wkt(hexs, precision)==
+              hexs2wkt_ostream(hexs, precision));
+    }
+  }
+}
+
+TEST_CASE( "Text parser is tested", "[io]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  double value = 0;
+
+  SECTION( "parse_double_test" ) {
+    const char *texts[] = {
+      "0", "12", "-3.25", "+4.5", "0.1", ".5", "5.", "1e5", "1E-5",
+      "-2.5e+3", "6.02214076e23", "1e22", "1e23", "1e-300", "4.9e-324",
+      "1.7976931348623157e308", "9007199254740993",
+      // Mantissas longer than 19 digits are parsed by strtod
+      "123456789012345678901234567890",
+      "0.30000000000000000444089209850062616",
+      "3.14159265358979323846264338327950288",
+      "0.000000000000000000000000000001234"};
+    for (const char *text : texts) {
+      INFO(text);
+      REQUIRE(parse_text(text,&value)==std::strlen(text));
+      // The value is correctly rounded as with strtod
+      REQUIRE(value==std::strtod(text,nullptr));
+    }
+  }
+
+  SECTION( "parse_double_spaces_test" ) {
+    REQUIRE(parse_text("  \t-1.5;2",&value)==7);
+    REQUIRE(value==-1.5);
+    // An exponent without digits is not a part of the number
+    REQUIRE(parse_text("2e;",&value)==1);
+    REQUIRE(value==2);
+    REQUIRE(parse_text("2e+",&value)==1);
+    REQUIRE(parse_text("",&value)==-1);
+    REQUIRE(parse_text("  ",&value)==-1);
+    REQUIRE(parse_text("-",&value)==-1);
+    REQUIRE(parse_text(".",&value)==-1);
+    REQUIRE(parse_text("abc",&value)==-1);
+  }
+
+  SECTION( "parse_int_test" ) {
+    long long v = 0;
+    std::string text = " -42 ";
+    REQUIRE(parse_int(TextSpan{text.data(),text.data()+text.size()},&v));
+    REQUIRE(v==-42);
+    text = "4.2";
+    REQUIRE(!parse_int(TextSpan{text.data(),text.data()+text.size()},&v));
+  }
+
+  SECTION( "parse_double_list_test" ) {
+    std::vector<double> values;
+    std::string text = "1, 2.5 ,-3e1";
+    REQUIRE(parse_double_list(
+      TextSpan{text.data(),text.data()+text.size()},',',&values));
+    REQUIRE_THAT(values, Catch::Equals<double>({1,2.5,-30}));
+    text = "1,x";
+    REQUIRE(!parse_double_list(
+      TextSpan{text.data(),text.data()+text.size()},',',&values));
+  }
+
+  SECTION( "parse_linestring_test" ) {
+    LineString line;
+    REQUIRE(parse_text(" linestring ( 1 2 , 3.5 -4e1,5 6 ) ",&line));
+    REQUIRE(line==wkt2linestring("LINESTRING(1 2,3.5 -40,5 6)"));
+    line.clear();
+    REQUIRE(parse_text("LINESTRING()",&line));
+    REQUIRE(line.get_num_points()==0);
+    const char *malformed[] = {
+      "", "POINT(1 2)", "LINESTRIN(1 2)", "LINESTRING 1 2,3 4",
+      "LINESTRING(1 2,3 4", "LINESTRING(1 2,3)", "LINESTRING(1 2;3 4)",
+      "LINESTRING(1 2,3 4) x", "LINESTRING(1 2,)", "LINESTRING(1 2 3,4 5)",
+      "LINESTRING(a b)"};
+    for (const char *text : malformed) {
+      INFO(text);
+      line.clear();
+      REQUIRE(!parse_text(text,&line));
+    }
+  }
+
+  SECTION( "next_line_test" ) {
+    std::string text = "a;b\r\n\r\nc\nd";
+    const char *cursor = text.data();
+    const char *end = text.data() + text.size();
+    TextSpan line;
+    std::vector<std::string> lines;
+    while (next_line(&cursor,end,&line)) lines.push_back(line.str());
+    REQUIRE_THAT(lines, Catch::Equals<std::string>({"a;b","","c","d"}));
+  }
+}
+
+TEST_CASE( "CSV readers are tested", "[io]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  LineString expected_geom = wkt2linestring("LINESTRING(1 2,3 4.5,6 -7)");
+
+  SECTION( "csv_trajectory_test" ) {
+    // CRLF line breaks and no line break after the last line
+    for (const std::string &eol : {std::string("\n"), std::string("\r\n")}) {
+      write_file("io_test_traj.csv",
+        "id;geom;timestamp" + eol +
+        "1;LINESTRING(1 2,3 4.5,6 -7);0,1.5,3" + eol +
+        "2;LINESTRING(1 2,3 4.5,6 -7);4,5,6");
+      CSVTrajectoryReader reader("io_test_traj.csv","id","geom");
+      REQUIRE(reader.has_timestamp());
+      std::vector<Trajectory> trajectories = reader.read_all_trajectories();
+      REQUIRE(trajectories.size()==2);
+      REQUIRE(trajectories[0].id==1);
+      REQUIRE(trajectories[0].geom==expected_geom);
+      REQUIRE_THAT(trajectories[0].timestamps,
+                   Catch::Equals<double>({0,1.5,3}));
+      REQUIRE(trajectories[1].id==2);
+      REQUIRE_THAT(trajectories[1].timestamps,
+                   Catch::Equals<double>({4,5,6}));
+      reader.reset_cursor();
+      std::vector<Trajectory> batch = reader.read_next_N_trajectories(10);
+      REQUIRE(batch.size()==2);
+      REQUIRE(batch[1].geom==expected_geom);
+    }
+    std::remove("io_test_traj.csv");
+  }
+
+  SECTION( "csv_point_test" ) {
+    for (const std::string &eol : {std::string("\n"), std::string("\r\n")}) {
+      write_file("io_test_point.csv",
+        "id;x;y;timestamp" + eol +
+        "1;1;2;0" + eol + "1;3;4.5;1.5" + eol + "1;6;-7;3" + eol +
+        "2;1;2;4" + eol + "2;3;4.5;5" + eol + "2;6;-7;6");
+      CSVPointReader reader("io_test_point.csv","id","x","y","timestamp");
+      REQUIRE(reader.has_timestamp());
+      std::vector<Trajectory> trajectories = reader.read_all_trajectories();
+      REQUIRE(trajectories.size()==2);
+      REQUIRE(trajectories[0].id==1);
+      REQUIRE(trajectories[0].geom==expected_geom);
+      REQUIRE_THAT(trajectories[0].timestamps,
+                   Catch::Equals<double>({0,1.5,3}));
+      REQUIRE(trajectories[1].id==2);
+      REQUIRE(trajectories[1].geom==expected_geom);
+      REQUIRE_THAT(trajectories[1].timestamps,
+                   Catch::Equals<double>({4,5,6}));
+      // Chunks smaller than a trajectory never split it
+      std::vector<Trajectory> chunked;
+      std::size_t num_chunks = reader.get_num_chunks(8);
+      REQUIRE(num_chunks>1);
+      for (std::size_t i = 0; i < num_chunks; ++i) {
+        std::vector<Trajectory> chunk = reader.read_chunk(i,8);
+        chunked.insert(chunked.end(),chunk.begin(),chunk.end());
+      }
+      REQUIRE(chunked.size()==2);
+      REQUIRE(chunked[0].geom==expected_geom);
+      REQUIRE(chunked[1].geom==expected_geom);
+      REQUIRE_THAT(chunked[1].timestamps, Catch::Equals<double>({4,5,6}));
+    }
+    std::remove("io_test_point.csv");
+  }
+}
+
+TEST_CASE( "CSV point sorter is tested", "[io]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  SECTION( "external_sort_test" ) {
+    // Enough lines for more than MAX_MERGE_FILES runs of the minimum run
+    // size of 64 KB, so that the runs are merged twice
+    std::mt19937 generator(1);
+    std::uniform_int_distribution<int> id_dist(0, 999);
+    std::uniform_int_distribution<int> time_dist(0, 99);
+    std::string text = "id;x;y;timestamp;seq\n";
+    int num_lines = 0;
+    while (text.size() < 5000000) {
+      text += std::to_string(id_dist(generator)) + ";1.5;2.5;" +
+        std::to_string(time_dist(generator)) + ";" +
+        std::to_string(num_lines++) + "\n";
+    }
+    write_file("io_test_unsorted.csv", text);
+    REQUIRE(mkdir("io_test_sort_tmp", 0755)==0);
+    {
+      CSVPointSorter sorter("id","timestamp",1,"io_test_sort_tmp");
+      REQUIRE(sorter.sort("io_test_unsorted.csv","io_test_sorted.csv")==
+              num_lines);
+      // The runs are removed once merged
+      DIR *dir = opendir("io_test_sort_tmp");
+      REQUIRE(dir!=nullptr);
+      int entries = 0;
+      while (readdir(dir) != nullptr) ++entries;
+      closedir(dir);
+      REQUIRE(entries==2);
+    }
+    REQUIRE(rmdir("io_test_sort_tmp")==0);
+    std::ifstream ifs("io_test_sorted.csv");
+    std::string line;
+    std::getline(ifs,line);
+    REQUIRE(line=="id;x;y;timestamp;seq");
+    // Points with the same id and timestamp keep their input order
+    long long last_id = -1, last_time = -1, last_seq = -1;
+    int lines = 0;
+    int unordered = 0;
+    while (std::getline(ifs,line)) {
+      long long id, time, seq;
+      if (sscanf(line.c_str(),"%lld;1.5;2.5;%lld;%lld",
+                 &id,&time,&seq) != 3) {
+        break;
+      }
+      bool ordered = id > last_id || (id == last_id && time > last_time) ||
+        (id == last_id && time == last_time && seq > last_seq);
+      if (!ordered) ++unordered;
+      last_id = id;
+      last_time = time;
+      last_seq = seq;
+      ++lines;
+    }
+    REQUIRE(lines==num_lines);
+    REQUIRE(unordered==0);
+    std::remove("io_test_unsorted.csv");
+    std::remove("io_test_sorted.csv");
+  }
+}
+
+TEST_CASE( "Binary trajectory file is tested", "[io]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  std::vector<Trajectory> expected;
+  expected.push_back(Trajectory(
+    5, wkt2linestring("LINESTRING(1 2,3 4.5,6 -7)"), {0,1.5,3}));
+  expected.push_back(Trajectory(-2, LineString(), {}));
+  expected.push_back(Trajectory(
+    7, wkt2linestring("LINESTRING(0.1 0.2,0.3 0.4)"),
+    {10,11}));
+
+  SECTION( "round_trip_test" ) {
+    for (bool has_timestamp : {true, false}) {
+      {
+        BinaryTrajectoryWriter writer("io_test.fmmtraj",has_timestamp);
+        for (const Trajectory &trajectory : expected) writer.write(trajectory);
+        REQUIRE(writer.get_num_trajectories()==3);
+        REQUIRE(writer.get_num_points()==5);
+        writer.close();
+      }
+      BinaryTrajectoryReader reader("io_test.fmmtraj");
+      REQUIRE(reader.has_timestamp()==has_timestamp);
+      REQUIRE(reader.get_num_trajectories()==3);
+      auto check = [&](const Trajectory &trajectory, int i) {
+        REQUIRE(trajectory.id==expected[i].id);
+        REQUIRE(trajectory.geom==expected[i].geom);
+        if (has_timestamp) {
+          REQUIRE(trajectory.timestamps==expected[i].timestamps);
+        } else {
+          REQUIRE(trajectory.timestamps.empty());
+        }
+      };
+      int i = 0;
+      while (reader.has_next_trajectory()) {
+        check(reader.read_next_trajectory(),i++);
+      }
+      REQUIRE(i==3);
+      for (i = 2; i >= 0; --i) check(reader.get_trajectory(i),i);
+      // A chunk of a single point holds at most a trajectory
+      for (std::size_t chunk_size : {std::size_t(8), std::size_t(1 << 20)}) {
+        std::vector<Trajectory> chunked;
+        for (std::size_t c = 0; c < reader.get_num_chunks(chunk_size); ++c) {
+          std::vector<Trajectory> chunk = reader.read_chunk(c,chunk_size);
+          chunked.insert(chunked.end(),chunk.begin(),chunk.end());
+        }
+        REQUIRE(chunked.size()==3);
+        for (i = 0; i < 3; ++i) check(chunked[i],i);
+      }
+    }
+    std::remove("io_test.fmmtraj");
+  }
+
+  SECTION( "invalid_file_test" ) {
+    {
+      BinaryTrajectoryWriter writer("io_test.fmmtraj",true);
+      for (const Trajectory &trajectory : expected) writer.write(trajectory);
+      writer.close();
+    }
+    std::string content;
+    {
+      std::ifstream ifs("io_test.fmmtraj",std::ios::binary);
+      content.assign(std::istreambuf_iterator<char>(ifs),
+                     std::istreambuf_iterator<char>());
+    }
+    BinaryTrajectoryHeader header;
+    std::memcpy(&header,content.data(),sizeof(header));
+    std::vector<std::string> corrupt;
+    // Truncated in the header and in the columns
+    corrupt.push_back(content.substr(0,16));
+    corrupt.push_back(content.substr(0,content.size()-8));
+    std::string text = content;
+    text[0] = 'X';
+    corrupt.push_back(text);
+    BinaryTrajectoryHeader bad = header;
+    bad.version = BINARY_TRAJECTORY_VERSION + 1;
+    corrupt.push_back(std::string(reinterpret_cast<char *>(&bad),
+                                  sizeof(bad)) + content.substr(sizeof(bad)));
+    bad = header;
+    bad.flags = 4;
+    corrupt.push_back(std::string(reinterpret_cast<char *>(&bad),
+                                  sizeof(bad)) + content.substr(sizeof(bad)));
+    // Counts whose expected size overflows
+    bad = header;
+    bad.num_points = (uint64_t(1) << 62) + 1;
+    corrupt.push_back(std::string(reinterpret_cast<char *>(&bad),
+                                  sizeof(bad)) + content.substr(sizeof(bad)));
+    // Offsets decreasing or out of the points, at the same file size
+    text = content;
+    uint64_t offset = 4;
+    std::memcpy(&text[sizeof(header) + 3 * sizeof(int64_t) + 8],
+                &offset, sizeof(offset));
+    corrupt.push_back(text);
+    text = content;
+    offset = 1;
+    std::memcpy(&text[sizeof(header) + 3 * sizeof(int64_t)],
+                &offset, sizeof(offset));
+    corrupt.push_back(text);
+    for (const std::string &file : corrupt) {
+      write_file("io_test.fmmtraj",file);
+      REQUIRE_THROWS_AS(BinaryTrajectoryReader("io_test.fmmtraj"),
+                        std::runtime_error);
+    }
+    std::remove("io_test.fmmtraj");
+  }
+}
+
+TEST_CASE( "Multiple GPS files are tested", "[io]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  mkdir("io_test_files", 0755);
+  mkdir("io_test_output", 0755);
+  write_file("io_test_files/a.csv",
+    "id;geom\n1;LINESTRING(1 2,3 4.5,6 -7)\n2;LINESTRING(1 2,3 4)\n");
+  write_file("io_test_files/b.txt",
+    "id;geom\n3;LINESTRING(1 2,3 4.5,6 -7)\n");
+  // A file in an unknown format is not a GPS file of the folder
+  write_file("io_test_files/c.dat", "id;geom\n");
+
+  SECTION( "glob_files_test" ) {
+    REQUIRE_THAT(UTIL::glob_files("io_test_files/*.csv"),
+                 Catch::Equals<std::string>({"io_test_files/a.csv"}));
+    REQUIRE_THAT(UTIL::glob_files("io_test_files/[ab].*"),
+                 Catch::Equals<std::string>(
+                   {"io_test_files/a.csv","io_test_files/b.txt"}));
+    REQUIRE(UTIL::glob_files("io_test_files/*.gpkg").empty());
+  }
+
+  SECTION( "get_files_test" ) {
+    CONFIG::GPSConfig config("io_test_files");
+    REQUIRE_THAT(config.get_files(),
+                 Catch::Equals<std::string>(
+                   {"io_test_files/a.csv","io_test_files/b.txt"}));
+    // The items are kept in order and the empty ones are skipped
+    config.file = "io_test_files/b.txt,,io_test_files/*.csv,missing.csv";
+    REQUIRE_THAT(config.get_files(),
+                 Catch::Equals<std::string>(
+                   {"io_test_files/b.txt","io_test_files/a.csv",
+                    "missing.csv"}));
+    REQUIRE(!config.validate());
+    config.file = "io_test_files/*.csv";
+    REQUIRE(config.validate());
+  }
+
+  SECTION( "multi_file_reader_test" ) {
+    MultiFileTrajectoryReader reader(CONFIG::GPSConfig("io_test_files"));
+    REQUIRE(reader.get_num_chunks(8)==0);
+    REQUIRE(reader.read_next_trajectory().id==1);
+    // A batch continues in the next file
+    std::vector<Trajectory> trajectories = reader.read_next_N_trajectories(10);
+    REQUIRE(trajectories.size()==2);
+    REQUIRE(trajectories[0].id==2);
+    REQUIRE(trajectories[1].id==3);
+    REQUIRE(!reader.has_next_trajectory());
+    // The point files are read in chunks numbered across the files
+    write_file("io_test_files/a.csv",
+      "id;x;y\n1;1;2\n1;3;4.5\n1;6;-7\n2;1;2\n2;3;4\n");
+    write_file("io_test_files/b.txt", "id;x;y\n3;1;2\n3;3;4.5\n3;6;-7\n");
+    CONFIG::GPSConfig config("io_test_files");
+    config.gps_point = true;
+    MultiFileTrajectoryReader point_reader(config);
+    std::size_t num_chunks = point_reader.get_num_chunks(8);
+    REQUIRE(num_chunks>2);
+    std::vector<long long> ids;
+    for (std::size_t i = 0; i < num_chunks; ++i) {
+      for (const Trajectory &trajectory : point_reader.read_chunk(i,8)) {
+        ids.push_back(trajectory.id);
+        REQUIRE(trajectory.geom.get_x(0)==1);
+      }
+    }
+    REQUIRE_THAT(ids, Catch::Equals<long long>({1,2,3}));
+  }
+
+  SECTION( "validate_shards_test" ) {
+    CONFIG::ResultConfig config;
+    config.file = "io_test_output";
+    REQUIRE(config.is_sharded());
+    REQUIRE(config.get_shard_file("io_test_files/a.csv")==
+            "io_test_output/a.txt");
+    REQUIRE(config.validate_shards(
+      {"io_test_files/a.csv","io_test_files/b.txt"}));
+    // Two files with the same name in different folders
+    REQUIRE(!config.validate_shards(
+      {"io_test_files/a.csv","io_test_output/../a.csv"}));
+    // The result of a.csv would overwrite a.txt, given by another path
+    write_file("io_test_output/a.txt", "id;geom\n");
+    REQUIRE(!config.validate_shards({"io_test_files/a.csv",
+                                     "./io_test_output/a.txt"}));
+    std::remove("io_test_output/a.txt");
+    // The shards would be read as GPS files by the next run
+    config.file = "./io_test_files/";
+    REQUIRE(!config.validate_shards({"io_test_files/a.csv"}));
+    // A single result file is not checked
+    config.file = "io_test_output/result.txt";
+    REQUIRE(!config.is_sharded());
+    REQUIRE(config.validate_shards(
+      {"io_test_files/a.csv","io_test_output/a.csv"}));
+  }
+  for (const char *file : {"a.csv","b.txt","c.dat"}) {
+    std::remove((std::string("io_test_files/") + file).c_str());
+  }
+  REQUIRE(rmdir("io_test_files")==0);
+  REQUIRE(rmdir("io_test_output")==0);
+}
+
+TEST_CASE( "Async file writer is tested", "[io]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  const int num_threads = 4;
+  const int num_records = 200;
+
+  SECTION( "unordered_test" ) {
+    // A small buffer hands the records of a thread over several times
+    AsyncFileWriter writer("io_test_async.txt", 0, 64);
+    writer.write_header("header\n");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&writer, t, num_records]() {
+        for (int i = 0; i < num_records; ++i) {
+          writer.write(std::to_string(t) + ";" + std::to_string(i) + "\n");
+        }
+      });
+    }
+    for (std::thread &thread : threads) thread.join();
+    writer.close();
+    std::ifstream ifs("io_test_async.txt");
+    std::string line;
+    std::getline(ifs,line);
+    REQUIRE(line=="header");
+    // The records of a thread keep their order
+    std::vector<int> last(num_threads, -1);
+    int lines = 0;
+    while (std::getline(ifs,line)) {
+      int t, i;
+      REQUIRE(sscanf(line.c_str(),"%d;%d",&t,&i)==2);
+      REQUIRE(i==last[t] + 1);
+      last[t] = i;
+      ++lines;
+    }
+    REQUIRE(lines==num_threads * num_records);
+    std::remove("io_test_async.txt");
+  }
+
+  SECTION( "ordered_test" ) {
+    std::string expected = "header\n";
+    for (int i = 0; i < num_records; ++i) {
+      expected += std::to_string(i) + "\n";
+    }
+    AsyncFileWriter writer("io_test_async.txt", num_records, 64);
+    writer.write_header("header\n");
+    // Each thread writes its indices backwards
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&writer, t, num_threads, num_records]() {
+        for (int i = num_records - num_threads + t; i >= 0;
+             i -= num_threads) {
+          writer.write(i, std::to_string(i) + "\n");
+        }
+      });
+    }
+    for (std::thread &thread : threads) thread.join();
+    writer.close();
+    REQUIRE(read_file("io_test_async.txt")==expected);
+    std::remove("io_test_async.txt");
+  }
+
+  SECTION( "ordered_window_test" ) {
+    std::string expected;
+    for (int i = 0; i < num_records; ++i) {
+      expected += std::to_string(i) + "\n";
+    }
+    // The threads wait for each other within a window of 3 records
+    AsyncFileWriter writer("io_test_async.txt", 3, 16);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&writer, t, num_threads, num_records]() {
+        for (int i = t; i < num_records; i += num_threads) {
+          writer.write(i, std::to_string(i) + "\n");
+        }
+      });
+    }
+    for (std::thread &thread : threads) thread.join();
+    writer.close();
+    REQUIRE(read_file("io_test_async.txt")==expected);
+    std::remove("io_test_async.txt");
+  }
+
+  SECTION( "backpressure_test" ) {
+    AsyncFileWriter writer("io_test_async.txt", 2);
+    writer.write(1, "1\n");
+    std::atomic<bool> written{false};
+    std::thread thread([&writer, &written]() {
+      writer.write(2, "2\n");
+      written = true;
+    });
+    // Index 2 is out of the window until index 0 is written
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    REQUIRE(!written);
+    writer.write(0, "0\n");
+    thread.join();
+    REQUIRE(written);
+    writer.close();
+    REQUIRE(read_file("io_test_async.txt")=="0\n1\n2\n");
+    std::remove("io_test_async.txt");
+  }
+
+  SECTION( "close_gap_test" ) {
+    // The records after a missing index are written by close in order
+    AsyncFileWriter writer("io_test_async.txt", 4);
+    writer.write_header("header\n");
+    writer.write(0, "0\n");
+    writer.write(3, "3\n");
+    writer.write(2, "2\n");
+    writer.close();
+    REQUIRE(read_file("io_test_async.txt")=="header\n0\n2\n3\n");
+    // Closing again does nothing
+    writer.close();
+    std::remove("io_test_async.txt");
+  }
+
+  SECTION( "ordered_call_index_test" ) {
+    // Without an index, the records are numbered in the order of the calls
+    AsyncFileWriter writer("io_test_async.txt", 2);
+    writer.write("0\n");
+    writer.write("1\n");
+    writer.write(2, "2\n");
+    writer.close();
+    REQUIRE(read_file("io_test_async.txt")=="0\n1\n2\n");
+    std::remove("io_test_async.txt");
+  }
+}
+
+TEST_CASE( "Match pipeline is tested", "[io]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  // Trajectory i has 2 + i % 3 points
+  const int num_trajectories = 50;
+  std::string traj_text = "id;geom\n";
+  std::string point_text = "id;x;y\n";
+  for (int i = 1; i <= num_trajectories; ++i) {
+    std::string coords;
+    for (int j = 0; j < 2 + i % 3; ++j) {
+      coords += (j > 0 ? "," : "") + std::to_string(j) + " 1";
+      point_text += std::to_string(i) + ";" + std::to_string(j) + ";1\n";
+    }
+    traj_text += std::to_string(i) + ";LINESTRING(" + coords + ")\n";
+  }
+  write_file("io_test_pipeline.csv", traj_text);
+  write_file("io_test_pipeline_points.csv", point_text);
+  CONFIG::GPSConfig traj_config("io_test_pipeline.csv");
+  CONFIG::GPSConfig point_config("io_test_pipeline_points.csv");
+  point_config.gps_point = true;
+  auto match = [](const Trajectory &trajectory) {
+    return trajectory.geom.get_num_points();
+  };
+  // The trajectories and results written, by batch index. The workers
+  // count the invalid batches, as Catch assertions are not thread safe.
+  std::mutex mutex;
+  std::map<std::size_t, std::vector<std::pair<int, int>>> batches;
+  int invalid_batches = 0;
+  auto write = [&](std::size_t index,
+                   const std::vector<Trajectory> &trajectories,
+                   const std::vector<int> &results) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (trajectories.size() != results.size() || batches.count(index)) {
+      ++invalid_batches;
+      return;
+    }
+    std::vector<std::pair<int, int>> batch;
+    for (std::size_t i = 0; i < trajectories.size(); ++i) {
+      batch.emplace_back(trajectories[i].id, results[i]);
+    }
+    batches[index] = batch;
+  };
+
+  SECTION( "bounded_queue_test" ) {
+    MM::BoundedQueue<int> queue(5);
+    REQUIRE(queue.push(1,3));
+    std::atomic<bool> pushed{false};
+    std::thread producer([&queue, &pushed]() {
+      pushed = queue.push(2,3);
+    });
+    // The queue is full until the first item is popped
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    REQUIRE(!pushed);
+    int item = 0;
+    REQUIRE(queue.pop(&item));
+    REQUIRE(item==1);
+    producer.join();
+    REQUIRE(pushed);
+    REQUIRE(queue.pop(&item));
+    REQUIRE(item==2);
+    // An item heavier than the capacity is accepted by an empty queue
+    REQUIRE(queue.push(3,10));
+    // A producer blocked on a full queue is released by close
+    std::atomic<bool> returned{false};
+    std::thread blocked([&queue, &pushed, &returned]() {
+      pushed = queue.push(4,1);
+      returned = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    REQUIRE(!returned);
+    queue.close();
+    blocked.join();
+    REQUIRE(!pushed);
+    // The items left are drained after close
+    REQUIRE(!queue.push(5,1));
+    REQUIRE(queue.pop(&item));
+    REQUIRE(item==3);
+    REQUIRE(!queue.pop(&item));
+  }
+
+  SECTION( "pipeline_queue_test" ) {
+    GPSReader reader(traj_config);
+    REQUIRE(reader.get_num_chunks(64)==0);
+    // A small buffer makes the reader wait for the workers
+    MM::run_match_pipeline(reader, match, write, 3, 4);
+    REQUIRE(invalid_batches==0);
+    REQUIRE(batches.size()==num_trajectories);
+    for (auto &item : batches) {
+      REQUIRE(item.second.size()==1);
+      int id = item.first + 1;
+      REQUIRE(item.second[0]==std::make_pair(id, 2 + id % 3));
+    }
+  }
+
+  SECTION( "pipeline_chunk_test" ) {
+    GPSReader reader(point_config);
+    std::size_t num_chunks = reader.get_num_chunks(64);
+    REQUIRE(num_chunks>2);
+    MM::run_match_pipeline(reader, match, write, 3, 4, 64);
+    REQUIRE(invalid_batches==0);
+    REQUIRE(batches.size()==num_chunks);
+    std::vector<std::pair<int, int>> results;
+    std::size_t index = 0;
+    for (auto &item : batches) {
+      REQUIRE(item.first==index++);
+      results.insert(results.end(), item.second.begin(), item.second.end());
+    }
+    REQUIRE(results.size()==num_trajectories);
+    for (int i = 0; i < num_trajectories; ++i) {
+      REQUIRE(results[i]==std::make_pair(i + 1, 2 + (i + 1) % 3));
+    }
+  }
+
+  SECTION( "pipeline_error_test" ) {
+    // An exception of a worker is rethrown by the calling thread
+    auto failed_match = [](const Trajectory &trajectory) {
+      if (trajectory.id == 25) throw std::runtime_error("match failed");
+      return trajectory.geom.get_num_points();
+    };
+    for (const CONFIG::GPSConfig &config : {traj_config, point_config}) {
+      GPSReader reader(config);
+      REQUIRE_THROWS_AS(
+        MM::run_match_pipeline(reader, failed_match, write, 3, 4, 64),
+        std::runtime_error);
+      for (auto &item : batches) {
+        for (auto &result : item.second) REQUIRE(result.first!=25);
+      }
+      batches.clear();
+    }
+    // So is an exception of the write function
+    GPSReader reader(traj_config);
+    auto failed_write = [](std::size_t index,
+                           const std::vector<Trajectory> &trajectories,
+                           const std::vector<int> &results) {
+      throw std::runtime_error("write failed");
+    };
+    REQUIRE_THROWS_AS(
+      MM::run_match_pipeline(reader, match, failed_write, 3, 4),
+      std::runtime_error);
+  }
+  std::remove("io_test_pipeline.csv");
+  std::remove("io_test_pipeline_points.csv");
+}
@@ -48,4 +48,64 @@ TEST_CASE( "Network is tested", "[network]" ) {
     trcs = network.search_tr_cs_knn(line,3,0.05);
     REQUIRE(trcs.size()==0);
   }
+
+  SECTION( "search_tr_cs_knn_adaptive" ) {
+    LineString line = wkt2linestring("LineString(2.1 1.9,2.1 2.8)");
+    Traj_Candidates trcs = network.search_tr_cs_knn(line,2,0.15,true);
+    REQUIRE(trcs.size()==2);
+    REQUIRE(trcs[0].size()==2);
+    REQUIRE(trcs[1].size()==2);
+    Traj_Candidates expected = network.search_tr_cs_knn(line,2,0.15);
+    for (int j=0;j<trcs[0].size();++j){
+      REQUIRE(trcs[0][j].edge->id==expected[0][j].edge->id);
+      REQUIRE(trcs[0][j].dist==expected[0][j].dist);
+    }
+    trcs = network.search_tr_cs_knn(line,3,0.05,true);
+    REQUIRE(trcs.size()==0);
+  }
+
+  SECTION( "search_tr_cs_knn_heading" ) {
+    // Moving south along the two way road of edge 5 and 6
+    LineString line = wkt2linestring(
+      "LineString(2.05 1.8,2.05 1.5,2.05 1.2)");
+    Traj_Candidates trcs = network.search_tr_cs_knn(line,1,0.1);
+    REQUIRE(trcs.size()==3);
+    REQUIRE(trcs[1][0].edge->id==5);
+    trcs = network.search_tr_cs_knn(line,1,0.1,false,45,0.1);
+    REQUIRE(trcs.size()==3);
+    for (int i=0;i<trcs.size();++i){
+      REQUIRE(trcs[i].size()==1);
+      REQUIRE(trcs[i][0].edge->id==6);
+    }
+    trcs = network.search_tr_cs_knn(line,1,0.1,true,45,0.1);
+    REQUIRE(trcs.size()==3);
+    REQUIRE(trcs[1][0].edge->id==6);
+    // Disagreeing candidates still fill the remaining slots
+    trcs = network.search_tr_cs_knn(line,2,0.1,true,45,0.1);
+    REQUIRE(trcs[1].size()==2);
+    REQUIRE(trcs[1][1].edge->id==5);
+  }
+
+  SECTION( "search_tr_cs_knn_cache" ) {
+    LineString line = wkt2linestring(
+      "LineString(2.1 1.9,2.1 2.8,2.05 1.8,2.05 1.5,2.05 1.2,2.1 1.9)");
+    Traj_Candidates expected = network.search_tr_cs_knn(line,3,0.15);
+    // A single cell forces an eviction at every new cell
+    for (int capacity : {100, 1}) {
+      CandidateCache cache(capacity,0.15);
+      for (int round=0;round<2;++round){
+        Traj_Candidates trcs = network.search_tr_cs_knn(
+          line,3,0.15,false,0,0,&cache);
+        REQUIRE(trcs.size()==expected.size());
+        for (int i=0;i<trcs.size();++i){
+          REQUIRE(trcs[i].size()==expected[i].size());
+          for (int j=0;j<trcs[i].size();++j){
+            REQUIRE(trcs[i][j].edge->id==expected[i][j].edge->id);
+            REQUIRE(trcs[i][j].dist==expected[i][j].dist);
+          }
+        }
+      }
+      REQUIRE(cache.get_stats().hits>0);
+    }
+  }
 }
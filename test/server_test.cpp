@@ -0,0 +1,186 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "util/debug.hpp"
+#include "mm/server/match_server.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+using namespace FMM;
+using namespace FMM::MM;
+
+/**
+ * Create a server configuration from command line arguments
+ */
+MatchServerConfig create_config(std::vector<std::string> args) {
+  args.insert(args.begin(), "fmm_server");
+  std::vector<char *> argv;
+  for (std::string &arg : args) argv.push_back(&arg[0]);
+  return MatchServerConfig(argv.size(), argv.data());
+}
+
+/**
+ * Parse a response of the server
+ */
+boost::property_tree::ptree parse_response(const std::string &response) {
+  boost::property_tree::ptree tree;
+  std::istringstream iss(response);
+  boost::property_tree::read_json(iss, tree);
+  return tree;
+}
+
+/**
+ * Get the error message of a response, empty if the status is ok
+ */
+std::string get_error(const std::string &response) {
+  boost::property_tree::ptree tree = parse_response(response);
+  if (tree.get<std::string>("status") == "ok") return "";
+  return tree.get<std::string>("message");
+}
+
+TEST_CASE( "Match server requests are tested", "[server]" ) {
+  MatchServerConfig config = create_config(
+    {"--network","../data/network.gpkg","--ubodt","../data/ubodt.txt",
+     "--socket","server_test.sock","--workers","2",
+     "--max_request_size","1"});
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  MatchServer server(config);
+  const std::string trajectory =
+    "{\"id\":1,\"wkt\":\"LINESTRING(1.65889830508474 0.25098870056497,"
+    "1.65494350282486 0.701836158192091,2.4933615819209 1.76567796610169,"
+    "3.54929378531073 1.88827683615819,4.13064971751412 2.45776836158192)\"}";
+  const std::string config_data =
+    "\"config\":{\"k\":4,\"r\":0.4,\"gps_error\":0.5}";
+
+  SECTION( "match_test" ) {
+    for (const std::string algorithm : {"fmm", "stmatch"}) {
+      std::string response = server.handle_request(
+        "{\"algorithm\":\"" + algorithm + "\"," + config_data +
+        ",\"trajectories\":[" + trajectory + "," + trajectory + "]}");
+      REQUIRE(get_error(response)=="");
+      boost::property_tree::ptree tree = parse_response(response);
+      REQUIRE(tree.get_child("results").size()==2);
+      for (const auto &result : tree.get_child("results")) {
+        std::vector<int> cpath;
+        for (const auto &v : result.second.get_child("cpath")) {
+          cpath.push_back(v.second.get_value<int>());
+        }
+        REQUIRE_THAT(cpath, Catch::Equals<int>({2,5,13,14,23}));
+      }
+    }
+    // Points given as coordinate arrays with timestamps
+    std::string response = server.handle_request(
+      "{" + config_data + ",\"trajectories\":[{\"x\":[2.1,2.1],"
+      "\"y\":[0.5,1.5],\"timestamps\":[0,1]}]}");
+    REQUIRE(get_error(response)=="");
+  }
+
+  SECTION( "invalid_request_test" ) {
+    const char *invalid_json[] = {
+      "", "{", "{\"trajectories\":[", "[1,2", "not json"};
+    for (const char *request : invalid_json) {
+      INFO(request);
+      REQUIRE(get_error(server.handle_request(request)).find(
+        "invalid request")==0);
+    }
+    // The trajectories are required
+    REQUIRE(get_error(server.handle_request("{}")).find(
+      "invalid request")==0);
+    REQUIRE(get_error(server.handle_request(
+      "{\"trajectories\":[{\"id\":3,\"x\":[1,2],\"y\":[1]}]}"))==
+      "x and y sizes differ in trajectory 3");
+    REQUIRE(get_error(server.handle_request(
+      "{\"trajectories\":[{\"id\":4,\"x\":[1,2],\"y\":[1,2],"
+      "\"timestamps\":[0]}]}"))==
+      "timestamps size differs from points in trajectory 4");
+    REQUIRE(get_error(server.handle_request(
+      "{\"trajectories\":[{\"id\":5,\"wkt\":\"LINESTRING(1 2,3)\"}]}"))==
+      "invalid wkt of trajectory 5");
+    REQUIRE(get_error(server.handle_request(
+      "{\"algorithm\":\"hmm\",\"trajectories\":[]}"))==
+      "unknown algorithm hmm");
+    REQUIRE(get_error(server.handle_request(
+      "{\"config\":{\"k\":-1},\"trajectories\":[]}"))=="invalid config");
+    REQUIRE(get_error(server.handle_request("{\"command\":\"exit\"}"))==
+      "unknown command exit");
+  }
+
+  SECTION( "request_size_test" ) {
+    // A request of exactly max_request_size MB is accepted
+    std::string request = "{\"trajectories\":[]}";
+    request.resize(std::size_t(1) << 20, ' ');
+    REQUIRE(get_error(server.handle_request(request))=="");
+    request.push_back(' ');
+    REQUIRE(get_error(server.handle_request(request))=="request too large");
+  }
+}
+
+TEST_CASE( "Match server reload is tested", "[server]" ) {
+  // The UBODT is copied so that it can be removed
+  {
+    std::ifstream ifs("../data/ubodt.txt", std::ios::binary);
+    std::ofstream ofs("server_test_ubodt.txt", std::ios::binary);
+    ofs << ifs.rdbuf();
+  }
+  MatchServerConfig config = create_config(
+    {"--network","../data/network.gpkg","--ubodt","server_test_ubodt.txt",
+     "--socket","server_test.sock","--workers","2"});
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  MatchServer server(config);
+  const std::string request =
+    "{\"config\":{\"k\":4,\"r\":0.4,\"gps_error\":0.5},"
+    "\"trajectories\":[{\"wkt\":\"LINESTRING(1.65889830508474 "
+    "0.25098870056497,4.13064971751412 2.45776836158192)\"}]}";
+  REQUIRE(get_error(server.handle_request(request))=="");
+  REQUIRE(server.get_model()->version==1);
+
+  SECTION( "reload_test" ) {
+    // The reload command answers with the version in use
+    boost::property_tree::ptree tree = parse_response(
+      server.handle_request("{\"command\":\"reload\"}"));
+    REQUIRE(tree.get<int>("version")==1);
+    std::shared_ptr<const MatchModel> model = server.get_model();
+    // Requests are matched while the new model is loaded
+    std::vector<std::string> errors;
+    std::thread requests([&] {
+      for (int i = 0; i < 20; ++i) {
+        errors.push_back(get_error(server.handle_request(request)));
+      }
+    });
+    server.load_model();
+    requests.join();
+    for (const std::string &error : errors) REQUIRE(error=="");
+    REQUIRE(server.get_model()->version==2);
+    REQUIRE(server.get_model()!=model);
+    // A request holding the previous model can still match with it
+    REQUIRE(model->version==1);
+    CORE::Trajectory trajectory(1, CORE::wkt2linestring(
+      "LINESTRING(1.65889830508474 0.25098870056497,"
+      "4.13064971751412 2.45776836158192)"));
+    MatchResult result = model->fmm->match_traj(
+      trajectory, FastMapMatchConfig{4,0.4,0.5});
+    REQUIRE(!result.cpath.empty());
+  }
+
+  SECTION( "reload_fail_test" ) {
+    server.load_model();
+    REQUIRE(server.get_model()->version==2);
+    // A missing UBODT keeps the current model
+    std::remove("server_test_ubodt.txt");
+    server.load_model();
+    REQUIRE(server.get_model()->version==2);
+    REQUIRE(server.get_model()->fmm!=nullptr);
+    REQUIRE(get_error(server.handle_request(request))=="");
+  }
+  std::remove("server_test_ubodt.txt");
+}
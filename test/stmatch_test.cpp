@@ -0,0 +1,131 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "util/debug.hpp"
+#include "network/network.hpp"
+#include "mm/stmatch/stmatch_algorithm.hpp"
+#include "mm/stmatch/sp_dist_cache.hpp"
+#include "core/gps.hpp"
+#include "io/gps_reader.hpp"
+
+#include <limits>
+
+using namespace FMM;
+using namespace FMM::IO;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+TEST_CASE( "SPDistCache is tested", "[stmatch]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  const double inf = std::numeric_limits<double>::infinity();
+  double distance = 0;
+  SECTION( "bound_test" ) {
+    SPDistCache cache(100);
+    REQUIRE(!cache.look_up(1,2,3,&distance));
+    cache.insert_bound(1,2,5);
+    // The distance is larger than 5, so it is larger than any bound up
+    // to 5
+    REQUIRE(cache.look_up(1,2,3,&distance));
+    REQUIRE(distance==inf);
+    REQUIRE(cache.look_up(1,2,5,&distance));
+    REQUIRE(distance==inf);
+    REQUIRE(!cache.look_up(1,2,6,&distance));
+    // A bound only grows
+    cache.insert_bound(1,2,4);
+    REQUIRE(cache.look_up(1,2,5,&distance));
+    cache.insert_bound(1,2,7);
+    REQUIRE(cache.look_up(1,2,6,&distance));
+    REQUIRE(distance==inf);
+    REQUIRE(cache.size()==1);
+    REQUIRE(cache.get_stats().hits==4);
+    REQUIRE(cache.get_stats().misses==2);
+  }
+  SECTION( "distance_test" ) {
+    SPDistCache cache(100);
+    cache.insert_bound(1,2,5);
+    // A distance replaces a bound
+    cache.insert_distance(1,2,8);
+    REQUIRE(cache.look_up(1,2,10,&distance));
+    REQUIRE(distance==8);
+    REQUIRE(cache.look_up(1,2,7,&distance));
+    REQUIRE(distance==inf);
+    // A distance is kept
+    cache.insert_bound(1,2,20);
+    cache.insert_distance(1,2,3);
+    REQUIRE(cache.look_up(1,2,100,&distance));
+    REQUIRE(distance==8);
+    // The pair is ordered
+    REQUIRE(!cache.look_up(2,1,10,&distance));
+  }
+  SECTION( "eviction_test" ) {
+    SPDistCache cache(4,1);
+    REQUIRE(cache.get_capacity()==4);
+    for (NodeIndex i = 0; i < 4; ++i) cache.insert_distance(i,i+1,i);
+    REQUIRE(cache.look_up(0,1,10,&distance));
+    // The pair read is skipped by the hand, the next one is evicted
+    cache.insert_distance(4,5,4);
+    REQUIRE(cache.size()==4);
+    REQUIRE(cache.get_stats().evictions==1);
+    REQUIRE(cache.look_up(0,1,10,&distance));
+    REQUIRE(distance==0);
+    REQUIRE(!cache.look_up(1,2,10,&distance));
+    REQUIRE(cache.look_up(4,5,10,&distance));
+    REQUIRE(distance==4);
+  }
+}
+
+TEST_CASE( "stmatch is tested", "[stmatch]" ) {
+  spdlog::set_level((spdlog::level::level_enum) 0);
+  spdlog::set_pattern("[%l][%s:%-3#] %v");
+  Network network("../data/network.gpkg");
+  NetworkGraph graph(network);
+  CSVTrajectoryReader reader("../data/trips.csv","id","geom");
+  std::vector<Trajectory> trajectories = reader.read_all_trajectories();
+  SECTION( "window_test" ) {
+    STMATCH model(network,graph);
+    STMATCHConfig config{4,0.4,0.5};
+    for (const Trajectory &trajectory : trajectories) {
+      config.window_size = 0;
+      MatchResult expected = model.match_traj(trajectory,config);
+      // Windows of 2 and 3 layers, the last one being shorter
+      for (int window_size : {2, 3}) {
+        REQUIRE(trajectory.geom.get_num_points()>window_size);
+        config.window_size = window_size;
+        MatchResult result = model.match_traj(trajectory,config);
+        REQUIRE(result.cpath==expected.cpath);
+        REQUIRE(result.opath==expected.opath);
+        REQUIRE(result.indices==expected.indices);
+        REQUIRE(result.mgeom==expected.mgeom);
+      }
+    }
+  }
+  SECTION( "cache_size_test" ) {
+    STMATCHConfig config{4,0.4,0.5};
+    STMATCH expected_model(network,graph);
+    std::vector<MatchResult> expected;
+    for (const Trajectory &trajectory : trajectories) {
+      expected.push_back(expected_model.match_traj(trajectory,config));
+    }
+    REQUIRE(expected_model.get_sp_cache()==nullptr);
+    // A single pair forces an eviction at every new pair
+    for (int cache_size : {10000, 1}) {
+      config.cache_size = cache_size;
+      STMATCH model(network,graph);
+      for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < trajectories.size(); ++i) {
+          MatchResult result = model.match_traj(trajectories[i],config);
+          REQUIRE(result.cpath==expected[i].cpath);
+          REQUIRE(result.opath==expected[i].opath);
+          REQUIRE(result.indices==expected[i].indices);
+          REQUIRE(result.mgeom==expected[i].mgeom);
+        }
+      }
+      const SPDistCache *cache = model.get_sp_cache();
+      REQUIRE(cache!=nullptr);
+      REQUIRE(cache->size()<=cache->get_capacity());
+      if (cache_size > 1) REQUIRE(cache->get_stats().hits>0);
+    }
+  }
+}
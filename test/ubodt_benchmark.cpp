@@ -0,0 +1,77 @@
+/**
+ * Fast map matching.
+ *
+ * Benchmark of the look ups of a UBODT one pair at a time with look_up
+ * and in batches with look_up_many.
+ *
+ * Usage: ubodt_benchmark ubodt_file num_nodes [queries] [span]
+ *
+ * The queries are pairs of random nodes whose indices differ by at most
+ * span, so that a part of them is found in the table.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/fmm/ubodt.hpp"
+#include "util/util.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cout << "Usage: " << argv[0]
+              << " ubodt_file num_nodes [queries] [span]\n";
+    return 0;
+  }
+  spdlog::set_level(spdlog::level::warn);
+  int num_nodes = std::atoi(argv[2]);
+  std::size_t queries = argc > 3 ? std::atol(argv[3]) : 10000000;
+  int span = argc > 4 ? std::atoi(argv[4]) : 1000;
+  auto ubodt = UBODT::read_ubodt_file(argv[1], num_nodes);
+  std::mt19937 generator(1);
+  std::uniform_int_distribution<int> node_dist(0, num_nodes - 1);
+  std::uniform_int_distribution<int> span_dist(-span, span);
+  std::vector<NodeIndex> sources(queries), targets(queries);
+  for (std::size_t i = 0; i < queries; ++i) {
+    int source = node_dist(generator);
+    sources[i] = source;
+    targets[i] = std::min(num_nodes - 1,
+                          std::max(0, source + span_dist(generator)));
+  }
+  std::vector<double> costs(queries);
+  auto begin_time = UTIL::get_current_time();
+  for (std::size_t i = 0; i < queries; ++i) {
+    Record *r = ubodt->look_up(sources[i], targets[i]);
+    costs[i] = r == nullptr ? std::numeric_limits<double>::infinity() :
+               r->cost;
+  }
+  double single_time = UTIL::get_duration(begin_time,
+                                          UTIL::get_current_time());
+  std::vector<double> batch_costs(queries);
+  begin_time = UTIL::get_current_time();
+  ubodt->look_up_many(sources.data(), targets.data(), queries,
+                      batch_costs.data());
+  double batch_time = UTIL::get_duration(begin_time,
+                                         UTIL::get_current_time());
+  std::size_t found = std::count_if(costs.begin(), costs.end(),
+    [](double cost) { return cost != std::numeric_limits<double>::infinity();
+  });
+  std::cout << "Queries " << queries << " found " << found << "\n";
+  std::cout << "look_up      " << queries / single_time << " look ups/s\n";
+  std::cout << "look_up_many " << queries / batch_time << " look ups/s\n";
+  if (costs != batch_costs) {
+    std::cout << "Results of look_up and look_up_many differ\n";
+    return 1;
+  }
+  return 0;
+}